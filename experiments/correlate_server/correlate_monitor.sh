@@ -8,6 +8,8 @@ set -u
 
 CORX_DIR="/tmp/uploads"
 CORR_DIR="/tmp/corr"
+# e.g. CORRELATE_SERVER="../../build/corx_correlate_server --group_size=4"
+CORRELATE_SERVER="${CORRELATE_SERVER:-./correlate_server.py}"
 
 if [ ! -d "${CORX_DIR}" ]; then
     echo "${CORX_DIR} does not exist or isn't a directory"
@@ -21,5 +23,5 @@ fi
 
 echo "Waiting..."
 inotifywait --quiet --monitor --event=CLOSE_WRITE --event=MOVED_TO --format="%f" "${CORX_DIR}/" |
-    ./correlate_server.py
+    ${CORRELATE_SERVER}
     # while read line; do echo "Received \"$line\""; done
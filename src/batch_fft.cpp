@@ -0,0 +1,63 @@
+#include "batch_fft.h"
+
+#include <cassert>
+#include <cstring>
+#include <new>
+
+namespace corx {
+
+BatchFFT::BatchFFT(size_t len,
+                   size_t max_count,
+                   std::complex<float> *output)
+    : len_(len), output_(output), owns_output_(output == nullptr) {
+
+    assert(max_count > 0);
+    size_t size = len * max_count * sizeof(std::complex<float>);
+    if (owns_output_) {
+        output_ = static_cast<std::complex<float>*>(fftwf_malloc(size));
+    }
+    // plan on scratch buffers, since measuring overwrites the arrays
+    fftwf_complex *scratch = static_cast<fftwf_complex*>(fftwf_malloc(size));
+    if (output_ == nullptr || scratch == nullptr) {
+        if (owns_output_) {
+            fftwf_free(output_);
+        }
+        fftwf_free(scratch);
+        throw std::bad_alloc();
+    }
+
+    int n = len;
+    fftwf_complex *out = reinterpret_cast<fftwf_complex*>(output_);
+    for (size_t count = 1; count <= max_count; ++count) {
+        plans_.push_back(fftwf_plan_many_dft(
+                1, &n, count,
+                scratch, nullptr, 1, n,
+                out, nullptr, 1, n,
+                FFTW_FORWARD,
+                FFTW_MEASURE | FFTW_UNALIGNED | FFTW_PRESERVE_INPUT));
+    }
+    fftwf_free(scratch);
+    memset(static_cast<void*>(output_), 0, size);
+}
+
+BatchFFT::~BatchFFT() {
+    for (fftwf_plan plan : plans_) {
+        fftwf_destroy_plan(plan);
+    }
+    if (owns_output_) {
+        fftwf_free(output_);
+    }
+}
+
+void BatchFFT::execute(const std::complex<float> *input,
+                       size_t count,
+                       size_t first) {
+    assert(count > 0 && first + count <= plans_.size());
+    // the input is preserved (FFTW_PRESERVE_INPUT)
+    fftwf_complex *in = reinterpret_cast<fftwf_complex*>(
+            const_cast<std::complex<float>*>(input));
+    fftwf_complex *out = reinterpret_cast<fftwf_complex*>(output(first));
+    fftwf_execute_dft(plans_[count - 1], in, out);
+}
+
+} // namespace corx
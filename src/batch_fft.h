@@ -0,0 +1,54 @@
+#ifndef CORX_BATCH_FFT_H
+#define CORX_BATCH_FFT_H
+
+#include <complex>
+#include <vector>
+
+#include <stddef.h>
+
+#include <fftw3.h>
+
+namespace corx {
+
+// Batched forward FFTs of up to max_count contiguous segments of len samples.
+//
+// One FFTW plan is created per batch size (FFTW advanced interface), so that
+// a run of adjacent segments is transformed with a single call, directly from
+// the input signal and without copying it. Plans are created with
+// FFTW_UNALIGNED, i.e. segments may start at any sample.
+class BatchFFT {
+public:
+    // The spectra are written to output (len * max_count samples, e.g. from
+    // a HotArena) if given, otherwise to a buffer of the BatchFFT.
+    BatchFFT(size_t len,
+             size_t max_count,
+             std::complex<float> *output = nullptr);
+    ~BatchFFT();
+
+    BatchFFT(const BatchFFT&) = delete;
+    BatchFFT& operator=(const BatchFFT&) = delete;
+
+    size_t len() const { return len_; }
+    size_t max_count() const { return plans_.size(); }
+
+    // Transform count segments starting at input, which is not modified.
+    // The spectrum of segment i is written to output(first + i).
+    void execute(const std::complex<float> *input,
+                 size_t count,
+                 size_t first = 0);
+
+    std::complex<float>* output(size_t idx) {
+        return output_ + idx * len_;
+    }
+    size_t output_size() const { return len_ * plans_.size(); }
+
+private:
+    size_t len_;
+    std::vector<fftwf_plan> plans_;   // plans_[count - 1]
+    std::complex<float> *output_;
+    bool owns_output_;
+};
+
+} // namespace corx
+
+#endif /* CORX_BATCH_FFT_H */
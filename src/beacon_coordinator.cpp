@@ -0,0 +1,59 @@
+#include "beacon_coordinator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace corx {
+
+BeaconCoordinator::BeaconCoordinator(double interval, double window)
+    : interval_(interval),
+      window_(window),
+      max_age_(2.5 * interval),
+      last_time_(0),
+      valid_(false),
+      searches_(0),
+      skips_(0) {
+
+    if (interval <= 0 || window <= 0 || 2 * window >= interval) {
+        throw std::invalid_argument("window should be positive and less "
+                                    "than half the beacon interval");
+    }
+}
+
+void BeaconCoordinator::report(double time) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // (several receivers report the same pulse: keep the first report, so
+    //  the prediction does not drift with the timestamp jitter)
+    if (!valid_ || std::fabs(time - last_time_) > window_) {
+        last_time_ = time;
+        valid_ = true;
+    }
+}
+
+bool BeaconCoordinator::shouldSearch(double begin, double end) {
+    double last_time;
+    bool valid;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        last_time = last_time_;
+        valid = valid_;
+    }
+
+    bool search = true;
+    if (valid && begin - last_time < max_age_) {
+        // nearest expected pulse after the start of the block
+        double k = std::ceil((begin - window_ - last_time) / interval_);
+        double expected = last_time + std::max(k, 0.0) * interval_;
+        search = (expected - window_ <= end);
+    }
+
+    if (search) {
+        searches_++;
+    } else {
+        skips_++;
+    }
+    return search;
+}
+
+} // namespace corx
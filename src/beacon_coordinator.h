@@ -0,0 +1,55 @@
+#ifndef CORX_BEACON_COORDINATOR_H
+#define CORX_BEACON_COORDINATOR_H
+
+#include <atomic>
+#include <mutex>
+
+#include <stdint.h>
+
+namespace corx {
+
+// Shares beacon detections between the receivers of a single host.
+//
+// All receivers of a host see the same beacon pulses. Once one of them has
+// detected a pulse, the next pulses are expected at multiples of the beacon
+// interval after it (in host time, i.e. the timestamps of the blocks).
+// The other receivers then only run the full beacon detection on blocks that
+// overlap with a window around the expected time, instead of on every block
+// that passes the carrier trigger.
+//
+// If no receiver has detected a pulse for a while (or none at all), every
+// block is searched again.
+class BeaconCoordinator {
+public:
+    // interval: nominal time between beacon pulses in seconds
+    // window: maximum difference between the expected and the actual time of
+    //         a pulse in seconds (timestamp jitter between receivers)
+    BeaconCoordinator(double interval, double window);
+
+    // Report a beacon pulse detected at the given host time.
+    void report(double time);
+
+    // Returns true if a pulse may start between the given host times, i.e.
+    // if the full beacon detection should be performed on the block.
+    bool shouldSearch(double begin, double end);
+
+    uint64_t searches() const { return searches_; }
+    uint64_t skips() const { return skips_; }
+
+private:
+    const double interval_;
+    const double window_;
+    // Detections older than this are no longer used for predictions
+    const double max_age_;
+
+    std::mutex mutex_;
+    double last_time_;
+    bool valid_;
+
+    std::atomic<uint64_t> searches_;
+    std::atomic<uint64_t> skips_;
+};
+
+} // namespace corx
+
+#endif /* CORX_BEACON_COORDINATOR_H */
@@ -0,0 +1,140 @@
+#include "beacon_prefilter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace corx {
+
+namespace {
+
+inline std::complex<float>* to_complex(fcomplex *array) {
+    return reinterpret_cast<std::complex<float>*>(array);
+}
+
+} // namespace
+
+
+BeaconPrefilter::BeaconPrefilter(const std::vector<float> &template_samples,
+                                 size_t block_size,
+                                 size_t history_size,
+                                 size_t decimation,
+                                 float threshold)
+    : decimation_(std::max(decimation, (size_t)1)),
+      threshold_(threshold),
+      have_prev_(false),
+      prev_block_idx_(0),
+      last_score_(0),
+      checks_(0),
+      passes_(0) {
+
+    block_len_ = block_size / decimation_;
+    template_len_ = template_samples.size() / decimation_;
+    if (template_len_ == 0 || template_len_ > block_len_) {
+        throw std::invalid_argument("Beacon template does not fit in a "
+                                    "decimated block");
+    }
+    bool aligned = (block_size % decimation_ == 0 &&
+                    history_size % decimation_ == 0);
+    reuse_len_ = aligned ? history_size / decimation_ : 0;
+
+    size_t fft_len = 1;
+    while (fft_len < block_len_) {
+        fft_len *= 2;
+    }
+    fft_.reset(new FFT(fft_len, true));
+    ifft_.reset(new FFT(fft_len, false));
+    template_fft_.reset(new AlignedArray<std::complex<float>>(fft_len));
+    decimated_.resize(block_len_);
+
+    // FFT of the decimated template (conjugated for correlation)
+    std::complex<float> *input = to_complex(fft_->input());
+    std::fill(input, input + fft_len, std::complex<float>(0));
+    template_energy_ = 0;
+    for (size_t i = 0; i < template_len_; ++i) {
+        float sum = 0;
+        for (size_t j = 0; j < decimation_; ++j) {
+            sum += template_samples[i * decimation_ + j];
+        }
+        input[i] = sum;
+        template_energy_ += sum * sum;
+    }
+    fft_->execute();
+    const std::complex<float> *output = to_complex(fft_->output());
+    for (size_t i = 0; i < fft_len; ++i) {
+        template_fft_->data()[i] = std::conj(output[i]);
+    }
+}
+
+void BeaconPrefilter::decimate(std::complex<float> *dest,
+                               const std::complex<float> *src,
+                               size_t len) const {
+    for (size_t i = 0; i < len; ++i) {
+        std::complex<float> sum = 0;
+        for (size_t j = 0; j < decimation_; ++j) {
+            sum += src[i * decimation_ + j];
+        }
+        dest[i] = sum;
+    }
+}
+
+bool BeaconPrefilter::check(const std::complex<float> *signal,
+                            unsigned block_idx) {
+    checks_++;
+
+    // decimate new samples
+    if (reuse_len_ > 0 && have_prev_ && block_idx == prev_block_idx_ + 1) {
+        std::copy(decimated_.end() - reuse_len_, decimated_.end(),
+                  decimated_.begin());
+        decimate(decimated_.data() + reuse_len_,
+                 signal + reuse_len_ * decimation_,
+                 block_len_ - reuse_len_);
+    } else {
+        decimate(decimated_.data(), signal, block_len_);
+    }
+    have_prev_ = true;
+    prev_block_idx_ = block_idx;
+
+    // correlate with the template
+    const size_t fft_len = template_fft_->size();
+    std::complex<float> *input = to_complex(fft_->input());
+    std::copy(decimated_.begin(), decimated_.end(), input);
+    std::fill(input + block_len_, input + fft_len, std::complex<float>(0));
+    fft_->execute();
+
+    const std::complex<float> *spectrum = to_complex(fft_->output());
+    const std::complex<float> *template_fft = template_fft_->data();
+    std::complex<float> *product = to_complex(ifft_->input());
+    for (size_t i = 0; i < fft_len; ++i) {
+        product[i] = spectrum[i] * template_fft[i];
+    }
+    ifft_->execute();
+    const std::complex<float> *corr = to_complex(ifft_->output());
+
+    // normalize by the energy of the signal under the template
+    double energy = 0;
+    for (size_t i = 0; i < template_len_; ++i) {
+        energy += std::norm(decimated_[i]);
+    }
+    // the inverse FFT is not normalized
+    const double scale = template_energy_ * (double)fft_len * fft_len;
+    double score = 0;
+    for (size_t n = 0; n + template_len_ <= block_len_; ++n) {
+        if (n > 0) {
+            energy += (std::norm(decimated_[n + template_len_ - 1])
+                       - std::norm(decimated_[n - 1]));
+        }
+        if (energy > 0) {
+            score = std::max(score, std::norm(corr[n]) / (scale * energy));
+        }
+    }
+
+    last_score_ = score;
+    bool pass = (last_score_ >= threshold_);
+    if (pass) {
+        passes_++;
+    }
+    return pass;
+}
+
+} // namespace corx
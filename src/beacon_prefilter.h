@@ -0,0 +1,70 @@
+#ifndef CORX_BEACON_PREFILTER_H
+#define CORX_BEACON_PREFILTER_H
+
+#include <complex>
+#include <memory>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <fastdet/fastcard_wrappers.h>
+
+namespace corx {
+
+// Coarse beacon search that gates the full beacon detection.
+//
+// The synced signal and the beacon template are decimated by summing groups
+// of `decimation` samples, and correlated with a small FFT. The score of a
+// block is the maximum normalized correlation coefficient (squared), i.e.
+// |<x, t>|^2 / (|x|^2 |t|^2) over all positions where the template fits in
+// the block, which is between 0 and 1 and independent of the signal level.
+//
+// Blocks overlap by history_size samples. If the decimation factor divides
+// the history size, the decimated samples of the overlap are reused from the
+// previous block, so only the new samples of each consecutive block are
+// decimated.
+class BeaconPrefilter {
+public:
+    BeaconPrefilter(const std::vector<float> &template_samples,
+                    size_t block_size,
+                    size_t history_size,
+                    size_t decimation,
+                    float threshold);
+
+    // Returns true if the block may contain a beacon, i.e. if its score is at
+    // least the threshold.
+    bool check(const std::complex<float> *signal, unsigned block_idx);
+
+    float lastScore() const { return last_score_; }
+
+    uint64_t checks() const { return checks_; }
+    uint64_t passes() const { return passes_; }
+
+private:
+    void decimate(std::complex<float> *dest,
+                  const std::complex<float> *src,
+                  size_t len) const;
+
+    const size_t decimation_;
+    const float threshold_;
+    size_t block_len_;      // decimated block size
+    size_t reuse_len_;      // decimated history size (0: no reuse)
+    size_t template_len_;   // decimated template size
+    float template_energy_;
+
+    std::unique_ptr<FFT> fft_;
+    std::unique_ptr<FFT> ifft_;
+    std::unique_ptr<AlignedArray<std::complex<float>>> template_fft_;
+    std::vector<std::complex<float>> decimated_;
+
+    bool have_prev_;
+    unsigned prev_block_idx_;
+    float last_score_;
+    uint64_t checks_;
+    uint64_t passes_;
+};
+
+} // namespace corx
+
+#endif /* CORX_BEACON_PREFILTER_H */
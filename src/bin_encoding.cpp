@@ -0,0 +1,217 @@
+#include "bin_encoding.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace corx {
+
+namespace {
+
+uint16_t float_to_half_scalar(float f) {
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    uint16_t sign = (x >> 16) & 0x8000;
+    x &= 0x7fffffff;
+
+    if (x >= 0x7f800000) {
+        // inf or nan
+        return sign | 0x7c00 | (x > 0x7f800000 ? 0x200 : 0);
+    }
+    if (x >= 0x477ff000) {
+        // overflow: rounds to inf
+        return sign | 0x7c00;
+    }
+    if (x < 0x38800000) {
+        // subnormal (or zero): value = mantissa * 2^-24
+        float a;
+        memcpy(&a, &x, sizeof(a));
+        return sign | (uint16_t)nearbyintf(a * 16777216.f);
+    }
+    // normal: rebias exponent and round mantissa to nearest even
+    x += ((uint32_t)(15 - 127) << 23) + 0xfff + ((x >> 13) & 1);
+    return sign | (uint16_t)(x >> 13);
+}
+
+float half_to_float_scalar(uint16_t h) {
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    uint32_t x;
+
+    if (exponent == 0) {
+        float a = mantissa / 16777216.f;
+        memcpy(&x, &a, sizeof(x));
+        x |= sign;
+    } else if (exponent == 0x1f) {
+        x = sign | 0x7f800000 | (mantissa << 13);
+    } else {
+        x = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+// Quantize to signed integers: dest = round(src / scale)
+template <typename T>
+float quantize(T *dest, const float *src, size_t len, float max_int) {
+    float max_abs = 0;
+    for (size_t i = 0; i < len; ++i) {
+        max_abs = std::max(max_abs, std::fabs(src[i]));
+    }
+
+    float scale = (max_abs > 0) ? max_abs / max_int : 1.f;
+    float inv_scale = 1.f / scale;
+    for (size_t i = 0; i < len; ++i) {
+        float x = src[i] * inv_scale;
+        dest[i] = (T)(x + (x >= 0 ? 0.5f : -0.5f));
+    }
+    return scale;
+}
+
+template <typename T>
+void dequantize(float *dest, const T *src, size_t len, float scale) {
+    for (size_t i = 0; i < len; ++i) {
+        dest[i] = src[i] * scale;
+    }
+}
+
+} // namespace
+
+
+bool parse_bin_encoding(const std::string &str, uint8_t &encoding) {
+    if (str == "float32") {
+        encoding = CORX_ENCODING_FLOAT32;
+    } else if (str == "float16") {
+        encoding = CORX_ENCODING_FLOAT16;
+    } else if (str == "int16") {
+        encoding = CORX_ENCODING_INT16;
+    } else if (str == "int8") {
+        encoding = CORX_ENCODING_INT8;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* bin_encoding_to_string(uint8_t encoding) {
+    switch (encoding) {
+        case CORX_ENCODING_FLOAT32:
+            return "float32";
+        case CORX_ENCODING_FLOAT16:
+            return "float16";
+        case CORX_ENCODING_INT16:
+            return "int16";
+        case CORX_ENCODING_INT8:
+            return "int8";
+    }
+    return "UNKNOWN";
+}
+
+size_t bin_encoding_size(uint8_t encoding) {
+    switch (encoding) {
+        case CORX_ENCODING_FLOAT32:
+            return 2 * sizeof(float);
+        case CORX_ENCODING_FLOAT16:
+            return 2 * sizeof(uint16_t);
+        case CORX_ENCODING_INT16:
+            return 2 * sizeof(int16_t);
+        case CORX_ENCODING_INT8:
+            return 2 * sizeof(int8_t);
+    }
+    return 0;
+}
+
+bool bin_encoding_has_scale(uint8_t encoding) {
+    return (encoding == CORX_ENCODING_INT16 ||
+            encoding == CORX_ENCODING_INT8);
+}
+
+float encode_bins(uint8_t encoding,
+                  void *dest,
+                  const std::complex<float> *src,
+                  size_t len) {
+    const float *in = reinterpret_cast<const float*>(src);
+    switch (encoding) {
+        case CORX_ENCODING_FLOAT16:
+            float_to_half(static_cast<uint16_t*>(dest), in, 2 * len);
+            return 1;
+        case CORX_ENCODING_INT16:
+            return quantize(static_cast<int16_t*>(dest), in, 2 * len,
+                            32767.f);
+        case CORX_ENCODING_INT8:
+            return quantize(static_cast<int8_t*>(dest), in, 2 * len, 127.f);
+        default:
+            memcpy(dest, in, 2 * len * sizeof(float));
+            return 1;
+    }
+}
+
+void decode_bins(uint8_t encoding,
+                 std::complex<float> *dest,
+                 const void *src,
+                 size_t len,
+                 float scale) {
+    float *out = reinterpret_cast<float*>(dest);
+    switch (encoding) {
+        case CORX_ENCODING_FLOAT16:
+            half_to_float(out, static_cast<const uint16_t*>(src), 2 * len);
+            break;
+        case CORX_ENCODING_INT16:
+            dequantize(out, static_cast<const int16_t*>(src), 2 * len, scale);
+            break;
+        case CORX_ENCODING_INT8:
+            dequantize(out, static_cast<const int8_t*>(src), 2 * len, scale);
+            break;
+        default:
+            memcpy(out, src, 2 * len * sizeof(float));
+            break;
+    }
+}
+
+void float_to_half(uint16_t *dest, const float *src, size_t len) {
+    size_t i = 0;
+#if defined(__F16C__)
+    for (; i + 8 <= len; i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i),
+                                    _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), h);
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 4 <= len; i += 4) {
+        float16x4_t h = vcvt_f16_f32(vld1q_f32(src + i));
+        vst1_u16(dest + i, vreinterpret_u16_f16(h));
+    }
+#endif
+    for (; i < len; ++i) {
+        dest[i] = float_to_half_scalar(src[i]);
+    }
+}
+
+void half_to_float(float *dest, const uint16_t *src, size_t len) {
+    size_t i = 0;
+#if defined(__F16C__)
+    for (; i + 8 <= len; i += 8) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm256_storeu_ps(dest + i, _mm256_cvtph_ps(h));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 4 <= len; i += 4) {
+        float16x4_t h = vreinterpret_f16_u16(vld1_u16(src + i));
+        vst1q_f32(dest + i, vcvt_f32_f16(h));
+    }
+#endif
+    for (; i < len; ++i) {
+        dest[i] = half_to_float_scalar(src[i]);
+    }
+}
+
+} // namespace corx
@@ -0,0 +1,48 @@
+#ifndef CORX_BIN_ENCODING_H
+#define CORX_BIN_ENCODING_H
+
+#include <complex>
+#include <string>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "corx_file_format.h"
+
+namespace corx {
+
+// Conversion of FFT bins to and from the compact encodings of .corx
+// version 2 (see CORX_ENCODING_* in corx_file_format.h).
+
+// Parse an encoding name ("float32", "float16", "int16" or "int8")
+bool parse_bin_encoding(const std::string &str, uint8_t &encoding);
+const char* bin_encoding_to_string(uint8_t encoding);
+
+// Size in bytes of a single complex bin
+size_t bin_encoding_size(uint8_t encoding);
+
+// Whether blocks store a scale factor for this encoding
+bool bin_encoding_has_scale(uint8_t encoding);
+
+// Encode len complex bins into dest, which should be able to hold
+// len * bin_encoding_size(encoding) bytes.
+// Returns the scale factor of the block (1 for float encodings).
+float encode_bins(uint8_t encoding,
+                  void *dest,
+                  const std::complex<float> *src,
+                  size_t len);
+
+// Decode len complex bins that have been encoded with encode_bins.
+void decode_bins(uint8_t encoding,
+                 std::complex<float> *dest,
+                 const void *src,
+                 size_t len,
+                 float scale);
+
+// IEEE 754 half-precision conversion (round to nearest even)
+void float_to_half(uint16_t *dest, const float *src, size_t len);
+void half_to_float(float *dest, const uint16_t *src, size_t len);
+
+} // namespace corx
+
+#endif /* CORX_BIN_ENCODING_H */
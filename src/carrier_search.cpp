@@ -0,0 +1,183 @@
+#include "carrier_search.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include <fastdet/corr_detector.h>
+
+#include "dsp.h"
+
+namespace corx {
+
+CarrierSearch::CarrierSearch(size_t block_size,
+                             int window_min,
+                             int window_max,
+                             float threshold_const,
+                             float threshold_snr)
+    : block_size_(block_size),
+      threshold_const_(threshold_const),
+      threshold_snr_(threshold_snr),
+      searches_(0),
+      detections_(0) {
+
+    int size = block_size;
+    int min = window_min < 0 ? window_min + size : window_min;
+    int max = window_max < 0 ? window_max + size : window_max;
+    if (min < 0 || max >= size || min > max) {
+        throw std::invalid_argument("carrier window does not fit in a "
+                                    "block");
+    }
+    window_min_ = min;
+    window_max_ = max;
+
+    fft_.reset(new FFT(block_size, true));
+    power_.resize(block_size);
+}
+
+void CarrierSearch::detect(const std::complex<float> *samples,
+                           CarrierInfo &carrier) {
+    searches_++;
+    memcpy(static_cast<void*>(fft_->input()), samples,
+           block_size_ * sizeof(std::complex<float>));
+    fft_->execute();
+
+    // power spectrum of the window and its neighbours (for interpolation)
+    const float *out = reinterpret_cast<const float*>(fft_->output());
+    size_t begin = window_min_ > 0 ? window_min_ - 1 : 0;
+    size_t end = std::min(window_max_ + 2, block_size_);
+    const float scale = 1.f / block_size_;
+    for (size_t k = begin; k < end; ++k) {
+        power_[k] = (out[2*k] * out[2*k] + out[2*k+1] * out[2*k+1]) * scale;
+    }
+
+    size_t argmax = window_min_;
+    double sum = 0;
+    for (size_t k = window_min_; k <= window_max_; ++k) {
+        sum += power_[k];
+        if (power_[k] > power_[argmax]) {
+            argmax = k;
+        }
+    }
+    size_t num_bins = window_max_ - window_min_ + 1;
+    float max = power_[argmax];
+    float noise = (num_bins > 1 ? (sum - max) / (num_bins - 1) : 0);
+
+    carrier.detected = (max > threshold_const_ &&
+                        max > threshold_snr_ * noise);
+    if (carrier.detected) {
+        detections_++;
+        // (no interpolation at the edges of the spectrum)
+        float offset = 0;
+        if (argmax > 0 && argmax + 1 < block_size_) {
+            offset = CorrDetector::interpolate_parabolic(&power_[argmax]);
+        }
+        carrier.pos = argmax + offset;
+        carrier.max = max;
+        carrier.noise = noise;
+    }
+}
+
+
+NarrowCarrierSearch::NarrowCarrierSearch(size_t block_size,
+                                         size_t half_width,
+                                         float threshold_const,
+                                         float threshold_snr)
+    : block_size_(block_size),
+      half_width_(half_width),
+      threshold_const_(threshold_const),
+      threshold_snr_(threshold_snr),
+      searches_(0),
+      detections_(0) {
+
+    // (at least 4 zoom bins per bin of the window, so that the gain of the
+    //  decimation is close to 1 and aliases are suppressed by > 18 dB)
+    size_t min_size = std::max<size_t>(4 * (2 * half_width_ + 3), 16);
+    zoom_size_ = 1;
+    while (zoom_size_ < min_size) {
+        zoom_size_ *= 2;
+    }
+    // (the noise level excludes the strongest bin and its neighbours)
+    if (half_width_ < 2) {
+        throw std::invalid_argument("narrow carrier window should be at "
+                                    "least 2 bins on either side");
+    }
+    if (zoom_size_ > block_size_ || block_size_ % zoom_size_ != 0) {
+        throw std::invalid_argument("narrow carrier window does not fit in "
+                                    "a block");
+    }
+    decimation_ = block_size_ / zoom_size_;
+
+    shifted_.resize(block_size_);
+    fft_.reset(new FFT(zoom_size_, true));
+    power_.resize(2 * half_width_ + 3);
+}
+
+void NarrowCarrierSearch::detect(const std::complex<float> *samples,
+                                 float pos,
+                                 CarrierInfo &carrier) {
+    searches_++;
+    long center = std::lround(pos);
+    freq_shift(shifted_.data(), samples, block_size_, -(float)center, 0);
+
+    std::complex<float> *in = reinterpret_cast<std::complex<float>*>(
+            fft_->input());
+    for (size_t m = 0; m < zoom_size_; ++m) {
+        const std::complex<float> *group = &shifted_[m * decimation_];
+        std::complex<float> sum = 0;
+        for (size_t d = 0; d < decimation_; ++d) {
+            sum += group[d];
+        }
+        in[m] = sum;
+    }
+    fft_->execute();
+
+    // power_[i]: zoom bin i - half_width_ - 1, i.e. bin center + i - w - 1
+    const std::complex<float> *out = reinterpret_cast<std::complex<float>*>(
+            fft_->output());
+    const float scale = 1.f / block_size_;
+    const long w = half_width_;
+    for (long i = 0; i < (long)power_.size(); ++i) {
+        long q = i - w - 1;
+        power_[i] = std::norm(out[q < 0 ? q + (long)zoom_size_ : q]) * scale;
+    }
+
+    const size_t last = power_.size() - 2;
+    size_t argmax = 1;
+    double sum = 0;
+    for (size_t i = 1; i <= last; ++i) {
+        sum += power_[i];
+        if (power_[i] > power_[argmax]) {
+            argmax = i;
+        }
+    }
+    // (the leakage of the carrier into its neighbours is a large part of
+    //  the power of a narrow window, so they are not counted as noise)
+    size_t num_noise = last;
+    for (size_t i = argmax - 1; i <= argmax + 1; ++i) {
+        if (i >= 1 && i <= last) {
+            sum -= power_[i];
+            num_noise--;
+        }
+    }
+    float max = power_[argmax];
+    float noise = sum / num_noise;
+
+    carrier.detected = (max > threshold_const_ &&
+                        max > threshold_snr_ * noise);
+    if (carrier.detected) {
+        detections_++;
+        float offset = CorrDetector::interpolate_parabolic(&power_[argmax]);
+        long bin = center + (long)argmax - w - 1;
+        bin %= (long)block_size_;
+        if (bin < 0) {
+            bin += block_size_;
+        }
+        carrier.pos = bin + offset;
+        carrier.max = max;
+        carrier.noise = noise;
+    }
+}
+
+} // namespace corx
@@ -0,0 +1,104 @@
+#ifndef CORX_CARRIER_SEARCH_H
+#define CORX_CARRIER_SEARCH_H
+
+#include <complex>
+#include <memory>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <fastdet/fastcard_wrappers.h>
+
+#include "pipeline.h"
+
+namespace corx {
+
+// Carrier detection for input that is not read through fastcard (see
+// RtlsdrAsyncReader): the strongest bin of the power spectrum of a block
+// within the carrier window.
+//
+// The carrier is detected if its power exceeds both the constant threshold
+// and snr times the noise level, which is the mean power of the other bins
+// of the window (cf. --carrier_threshold). The power spectrum is |X|^2 / N
+// of the block of N samples scaled to [-1, 1].
+class CarrierSearch {
+public:
+    // window_min, window_max: first and last bin of the carrier window
+    //                         (negative values count from the end)
+    CarrierSearch(size_t block_size,
+                  int window_min,
+                  int window_max,
+                  float threshold_const,
+                  float threshold_snr);
+
+    // Search for the carrier in a block of block_size samples
+    void detect(const std::complex<float> *samples, CarrierInfo &carrier);
+
+    uint64_t searches() const { return searches_; }
+    uint64_t detections() const { return detections_; }
+
+private:
+    const size_t block_size_;
+    size_t window_min_;
+    size_t window_max_;
+    const float threshold_const_;
+    const float threshold_snr_;
+
+    std::unique_ptr<FFT> fft_;
+    std::vector<float> power_;
+
+    uint64_t searches_;
+    uint64_t detections_;
+};
+
+// Re-acquisition of a carrier that has just been lost: the power spectrum of
+// a narrow window around its predicted position, computed with a zoom FFT.
+// The block is shifted down by the predicted bin (rounded) and decimated by
+// summing groups of samples, so that a small FFT yields the bins of the
+// window at the resolution of a full FFT of the block (up to a gain of less
+// than 0.5 dB at the edges of the window) for a fraction of its cost.
+//
+// Same detection rule and power scale as CarrierSearch, with the window
+// instead of the carrier window, except that the neighbours of the
+// strongest bin are not part of the noise level.
+class NarrowCarrierSearch {
+public:
+    // half_width: number of bins on either side of the predicted position
+    // (at least 2). Throws std::invalid_argument if it is smaller or the
+    // window does not fit in a block.
+    NarrowCarrierSearch(size_t block_size,
+                        size_t half_width,
+                        float threshold_const,
+                        float threshold_snr);
+
+    // Search for the carrier in a block of block_size samples around pos
+    // (in bins, signed or unsigned)
+    void detect(const std::complex<float> *samples,
+                float pos,
+                CarrierInfo &carrier);
+
+    uint64_t searches() const { return searches_; }
+    uint64_t detections() const { return detections_; }
+
+private:
+    const size_t block_size_;
+    const size_t half_width_;
+    const float threshold_const_;
+    const float threshold_snr_;
+    // Size of the zoom FFT and decimation factor (block_size / zoom_size)
+    size_t zoom_size_;
+    size_t decimation_;
+
+    std::vector<std::complex<float>> shifted_;
+    std::unique_ptr<FFT> fft_;
+    // Power of the bins of the window and one more on either side
+    std::vector<float> power_;
+
+    uint64_t searches_;
+    uint64_t detections_;
+};
+
+} // namespace corx
+
+#endif /* CORX_CARRIER_SEARCH_H */
@@ -0,0 +1,24 @@
+find_package(PkgConfig)
+pkg_check_modules (PC_FFTW3F fftw3f)
+
+find_path(
+    FFTW3F_INCLUDE_DIRS
+    NAMES fftw3.h
+    HINTS ${PC_FFTW3F_INCLUDE_DIRS}
+    PATHS /usr/include
+          /usr/local/include
+)
+
+find_library(
+    FFTW3F_LIBRARIES
+    NAMES fftw3f
+    HINTS ${PC_FFTW3F_LIBRARY_DIRS}
+    PATHS /usr/lib
+          /usr/local/lib
+)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(FFTW3F DEFAULT_MSG
+                                  FFTW3F_LIBRARIES FFTW3F_INCLUDE_DIRS)
+
+mark_as_advanced(FFTW3F_LIBRARIES FFTW3F_INCLUDE_DIRS)
@@ -0,0 +1,26 @@
+find_package(PkgConfig)
+pkg_check_modules (PC_OPENCL OpenCL)
+
+find_path(
+    OPENCL_INCLUDE_DIRS
+    NAMES CL/cl.h OpenCL/cl.h
+    HINTS ${PC_OPENCL_INCLUDE_DIRS}
+    PATHS /usr/include
+          /usr/local/include
+          /usr/local/cuda/include
+)
+
+find_library(
+    OPENCL_LIBRARIES
+    NAMES OpenCL
+    HINTS ${PC_OPENCL_LIBRARY_DIRS}
+    PATHS /usr/lib
+          /usr/local/lib
+          /usr/local/cuda/lib64
+)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(OPENCL DEFAULT_MSG
+                                  OPENCL_LIBRARIES OPENCL_INCLUDE_DIRS)
+
+mark_as_advanced(OPENCL_LIBRARIES OPENCL_INCLUDE_DIRS)
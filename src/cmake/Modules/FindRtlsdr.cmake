@@ -0,0 +1,24 @@
+find_package(PkgConfig)
+pkg_check_modules (PC_RTLSDR librtlsdr)
+
+find_path(
+    RTLSDR_INCLUDE_DIRS
+    NAMES rtl-sdr.h
+    HINTS ${PC_RTLSDR_INCLUDE_DIRS}
+    PATHS /usr/include
+          /usr/local/include
+)
+
+find_library(
+    RTLSDR_LIBRARIES
+    NAMES rtlsdr
+    HINTS ${PC_RTLSDR_LIBRARY_DIRS}
+    PATHS /usr/lib
+          /usr/local/lib
+)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(RTLSDR DEFAULT_MSG
+                                  RTLSDR_LIBRARIES RTLSDR_INCLUDE_DIRS)
+
+mark_as_advanced(RTLSDR_LIBRARIES RTLSDR_INCLUDE_DIRS)
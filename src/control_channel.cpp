@@ -0,0 +1,265 @@
+#include "control_channel.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace corx {
+
+namespace {
+
+// Largest frame accepted from the controller
+const uint32_t MAX_FRAME = 1 << 16;
+// Time the controller gets to accept more data before the pending frames
+// are dropped on destruction
+const int FLUSH_TIMEOUT_MS = 100;
+
+void put_u8(std::string &out, uint8_t value) {
+    out.push_back(static_cast<char>(value));
+}
+
+void put_u16(std::string &out, uint16_t value) {
+    put_u8(out, value & 0xff);
+    put_u8(out, value >> 8);
+}
+
+void put_u32(std::string &out, uint32_t value) {
+    put_u16(out, value & 0xffff);
+    put_u16(out, value >> 16);
+}
+
+void put_u64(std::string &out, uint64_t value) {
+    put_u32(out, value & 0xffffffff);
+    put_u32(out, value >> 32);
+}
+
+void put_f64(std::string &out, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put_u64(out, bits);
+}
+
+void put_f32(std::string &out, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put_u32(out, bits);
+}
+
+uint32_t get_u32(const std::string &in, size_t pos) {
+    const unsigned char *p =
+            reinterpret_cast<const unsigned char*>(in.data()) + pos;
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+           (uint32_t)p[3] << 24;
+}
+
+uint16_t get_u16(const std::string &in, size_t pos) {
+    const unsigned char *p =
+            reinterpret_cast<const unsigned char*>(in.data()) + pos;
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+} // namespace
+
+
+ControlChannel::ControlChannel(int fd)
+    : fd_(fd), dropped_(0), failed_(false), quit_(false) {
+    thread_ = std::thread(&ControlChannel::run, this);
+}
+
+ControlChannel::~ControlChannel() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        quit_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+    close(fd_);
+}
+
+bool ControlChannel::receive(std::deque<std::string> &commands) {
+    char buf[4096];
+    ssize_t len = recv(fd_, buf, sizeof(buf), MSG_DONTWAIT);
+    if (len == 0) {
+        return false;
+    } else if (len < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return true;
+        }
+        fprintf(stderr, "Warning: control channel read error: %s\n",
+                strerror(errno));
+        return false;
+    }
+    inbuf_.append(buf, len);
+
+    size_t pos = 0;
+    while (inbuf_.size() - pos >= 4) {
+        uint32_t length = get_u32(inbuf_, pos);
+        if (length < 4 || length > MAX_FRAME) {
+            fprintf(stderr, "Warning: invalid control frame (length %u)\n",
+                    length);
+            return false;
+        }
+        if (inbuf_.size() - pos - 4 < length) {
+            break;
+        }
+        uint16_t type = get_u16(inbuf_, pos + 4);
+        if (type == static_cast<uint16_t>(ControlFrame::COMMAND)) {
+            commands.push_back(inbuf_.substr(pos + 8, length - 4));
+        } else {
+            fprintf(stderr, "Warning: ignoring control frame of type %u\n",
+                    type);
+        }
+        pos += 4 + length;
+    }
+    inbuf_.erase(0, pos);
+    return true;
+}
+
+void ControlChannel::send(ControlFrame type,
+                          int rx,
+                          const std::string &payload) {
+    std::string frame;
+    frame.reserve(8 + payload.size());
+    put_u32(frame, 4 + payload.size());
+    put_u16(frame, static_cast<uint16_t>(type));
+    put_u16(frame, static_cast<uint16_t>(rx));
+    frame += payload;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (failed_) {
+            return;
+        }
+        if (outbuf_.size() + frame.size() > MAX_PENDING) {
+            if (dropped_++ == 0) {
+                fprintf(stderr, "Warning: control channel is full, "
+                                "dropping frames\n");
+            }
+            return;
+        }
+        outbuf_ += frame;
+    }
+    cv_.notify_one();
+}
+
+void ControlChannel::sendTransition(ControlFrame type,
+                                    int rx,
+                                    uint8_t old_value,
+                                    uint8_t new_value,
+                                    uint32_t block) {
+    std::string payload;
+    put_u8(payload, old_value);
+    put_u8(payload, new_value);
+    put_u32(payload, block);
+    send(type, rx, payload);
+}
+
+void ControlChannel::sendBeacon(int rx,
+                                int32_t beacon,
+                                uint32_t block,
+                                double soa,
+                                float peak_power) {
+    std::string payload;
+    put_u32(payload, static_cast<uint32_t>(beacon));
+    put_u32(payload, block);
+    put_f64(payload, soa);
+    put_f32(payload, peak_power);
+    send(ControlFrame::BEACON, rx, payload);
+}
+
+void ControlChannel::sendCycle(int rx,
+                               int32_t beacon,
+                               uint32_t block,
+                               bool preamp_on) {
+    std::string payload;
+    put_u32(payload, static_cast<uint32_t>(beacon));
+    put_u32(payload, block);
+    put_u8(payload, preamp_on ? 1 : 0);
+    send(ControlFrame::CYCLE, rx, payload);
+}
+
+void ControlChannel::sendStatus(const std::vector<ControlStatus> &status) {
+    std::string payload;
+    for (const ControlStatus &entry : status) {
+        put_u16(payload, static_cast<uint16_t>(entry.rx));
+        put_u8(payload, entry.state);
+        put_u8(payload, entry.mode);
+        put_u8(payload, entry.track_state);
+        put_u8(payload, entry.failed ? 1 : 0);
+        put_u32(payload, entry.block);
+        put_u32(payload, static_cast<uint32_t>(entry.beacon));
+    }
+    send(ControlFrame::STATUS, -1, payload);
+}
+
+uint64_t ControlChannel::dropped() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return dropped_;
+}
+
+void ControlChannel::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this] { return quit_ || !outbuf_.empty(); });
+        if (outbuf_.empty()) {
+            break;
+        }
+
+        // (send without holding the mutex)
+        std::string data;
+        data.swap(outbuf_);
+        lock.unlock();
+        const char *src = data.data();
+        size_t len = data.size();
+        bool ok = true;
+        while (len > 0) {
+            // (never block in send, so that the destructor cannot hang on a
+            //  controller that has stopped reading)
+            ssize_t r = ::send(fd_, src, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (r < 0 && errno == EINTR) {
+                continue;
+            }
+            if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                struct pollfd pfd;
+                pfd.fd = fd_;
+                pfd.events = POLLOUT;
+                if (poll(&pfd, 1, FLUSH_TIMEOUT_MS) != 0) {
+                    continue;
+                }
+                lock.lock();
+                bool quit = quit_;
+                lock.unlock();
+                if (quit) {
+                    fprintf(stderr, "Warning: control channel is not read, "
+                                    "dropping %zu bytes\n", len);
+                    ok = false;
+                    break;
+                }
+                continue;
+            }
+            if (r <= 0) {
+                fprintf(stderr, "Warning: control channel write error: "
+                                "%s\n", strerror(errno));
+                ok = false;
+                break;
+            }
+            src += r;
+            len -= r;
+        }
+        lock.lock();
+
+        if (!ok) {
+            // (stop sending, but keep receiving commands)
+            failed_ = true;
+            outbuf_.clear();
+            break;
+        }
+    }
+}
+
+} // namespace corx
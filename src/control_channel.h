@@ -0,0 +1,123 @@
+#ifndef CORX_CONTROL_CHANNEL_H
+#define CORX_CONTROL_CHANNEL_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary control and telemetry channel of corx_rx (--control_fd).
+//
+// The channel is a connected stream socket, e.g. one end of a socketpair
+// inherited from multicorx.py --binary. Both directions carry frames of
+//
+//     uint32_t length, uint16_t type, int16_t rx, uint8_t payload[]
+//
+// where length counts the bytes after the length field (i.e. 4 plus the
+// size of the payload) and rx is the device index of the receiver (-1 for
+// frames of the whole process). All integers are little endian. Commands
+// are sent to corx_rx as COMMAND frames; events are pushed by the receivers
+// as soon as they happen, so that the controller neither scrapes stdout nor
+// polls for states.
+
+namespace corx {
+
+// Frame types and their payloads (-> corx_rx, <- controller)
+enum class ControlFrame : uint16_t {
+    // -> command line, as on stdin (without the newline)
+    COMMAND = 1,
+    // <- uint8_t old, uint8_t new (ReceiverState), uint32_t block
+    STATE = 2,
+    // <- uint8_t old, uint8_t new (TrackState), uint32_t block
+    TRACK_STATE = 3,
+    // <- uint8_t old, uint8_t new (ReceiverMode), uint32_t block
+    MODE = 4,
+    // <- int32_t beacon, uint32_t block, double soa (in samples),
+    //    float peak_power
+    BEACON = 5,
+    // <- int32_t beacon, uint32_t block, uint8_t preamp_on
+    //    (the cycle of a beacon has been written)
+    CYCLE = 6,
+    // <- reply to "status", one entry per receiver (rx -1):
+    //    int16_t rx, uint8_t state, uint8_t mode, uint8_t track_state,
+    //    uint8_t failed, uint32_t block, int32_t beacon
+    STATUS = 7,
+    // <- reply to "stats": text of the STATS lines of a receiver
+    STATS = 8,
+};
+
+// Status entry of a STATUS frame
+struct ControlStatus {
+    int rx;
+    uint8_t state;
+    uint8_t mode;
+    uint8_t track_state;
+    bool failed;
+    uint32_t block;
+    int32_t beacon;
+};
+
+// Frames are sent by a thread of the channel, so that the receiver threads
+// never block on the socket. If the controller falls behind by more than
+// MAX_PENDING bytes, frames are dropped (with a warning). The destructor
+// flushes the pending frames, unless the controller stops reading. Receiving
+// is done on the control thread by receive(), e.g. after poll() on fd().
+class ControlChannel {
+public:
+    static const size_t MAX_PENDING = 1 << 20;
+
+    // Takes ownership of fd
+    explicit ControlChannel(int fd);
+    ~ControlChannel();
+
+    ControlChannel(const ControlChannel&) = delete;
+    ControlChannel& operator=(const ControlChannel&) = delete;
+
+    int fd() const { return fd_; }
+
+    // Read the available data and append the command lines of complete
+    // COMMAND frames to commands. Returns false on EOF or error.
+    bool receive(std::deque<std::string> &commands);
+
+    // -- May be called from any thread
+    void send(ControlFrame type, int rx, const std::string &payload);
+
+    void sendTransition(ControlFrame type,
+                        int rx,
+                        uint8_t old_value,
+                        uint8_t new_value,
+                        uint32_t block);
+    void sendBeacon(int rx,
+                    int32_t beacon,
+                    uint32_t block,
+                    double soa,
+                    float peak_power);
+    void sendCycle(int rx, int32_t beacon, uint32_t block, bool preamp_on);
+    void sendStatus(const std::vector<ControlStatus> &status);
+
+    uint64_t dropped() const;
+
+private:
+    void run();
+
+    int fd_;
+    // Partial frame received so far
+    std::string inbuf_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::string outbuf_;
+    uint64_t dropped_;
+    bool failed_;
+    bool quit_;
+    std::thread thread_;
+};
+
+} // namespace corx
+
+#endif /* CORX_CONTROL_CHANNEL_H */
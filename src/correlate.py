@@ -9,18 +9,32 @@ import sys
 import numpy as np
 import matplotlib.pyplot as plt
 
-from corx_reader import corx_reader
+from corx_reader import corx_reader, AutoRecord, CrossRecord
 
 
-def correlate(corx1, corx2, period):
-    file_header1, reader1 = corx_reader(corx1)
-    file_header2, reader2 = corx_reader(corx2)
+def accept_segment(metrics, min_snr, max_phase_std):
+    """Whether a block passes the segment filter (always without metrics)."""
+    if metrics is None:
+        return True
+    if metrics.snr < min_snr:
+        return False
+    return max_phase_std <= 0 or metrics.phase_std <= max_phase_std
+
+
+def correlate(corx1, corx2, period, min_snr=-100, max_phase_std=0):
+    file_header1, reader1 = corx_reader(corx1, with_metrics=True)
+    file_header2, reader2 = corx_reader(corx2, with_metrics=True)
 
     assert(file_header1.slice_start == file_header2.slice_start)
     assert(file_header1.slice_size == file_header2.slice_size)
     print('Slice start:', file_header1.slice_start)
     print('Slice size:', file_header1.slice_size)
 
+    if file_header1.version == 3 or file_header2.version == 3:
+        assert(file_header1.version == file_header2.version)
+        return correlate_integrated(file_header1, reader1,
+                                    file_header2, reader2)
+
     fft_len = file_header1.slice_size
     xcorr_sum = np.zeros(fft_len, dtype='complex64')
     autocorr1_sum = np.zeros(fft_len, dtype='complex64')
@@ -37,6 +51,7 @@ def correlate(corx1, corx2, period):
 
     errors1 = []
     errors2 = []
+    rejected = 0
 
     while True:
         # advance all readers if synced
@@ -64,17 +79,23 @@ def correlate(corx1, corx2, period):
 
         if not header1.preamp_on or not header2.preamp_on:
             if not header1.preamp_on:
-                for _, fft1 in cycles1:
+                for _, fft1, _ in cycles1:
                     autocorr1_off_sum += fft1 * fft1.conjugate()
                     autocorr1_off_cnt += 1
             if not header2.preamp_on:
-                for _, fft2 in cycles2:
+                for _, fft2, _ in cycles2:
                     autocorr2_off_sum += fft2 * fft2.conjugate()
                     autocorr2_off_cnt += 1
             timediff = 0  # force both readers to be moved forward
 
         elif abs(timediff) < timediff_thresh:
-            for (error1, fft1), (error2, fft2) in itertools.izip(cycles1, cycles2):
+            for (error1, fft1, metrics1), (error2, fft2, metrics2) in \
+                    itertools.izip(cycles1, cycles2):
+                # reject bad segments before correlating them
+                if not (accept_segment(metrics1, min_snr, max_phase_std) and
+                        accept_segment(metrics2, min_snr, max_phase_std)):
+                    rejected += 1
+                    continue
                 xcorr_sum += fft1 * fft2.conjugate()
                 autocorr1_sum += fft1 * fft1.conjugate()
                 autocorr2_sum += fft2 * fft2.conjugate()
@@ -83,6 +104,9 @@ def correlate(corx1, corx2, period):
                 errors1.append(error1)
                 errors2.append(error2)
 
+    if rejected > 0:
+        print("Rejected {} blocks by their segment metrics".format(rejected))
+
     if cnt == 0:
         print("No beacon matches :(")
         return None
@@ -109,6 +133,82 @@ def correlate(corx1, corx2, period):
             errors1, errors2)
 
 
+def correlate_integrated(file_header1, records1, file_header2, records2):
+    """Same as correlate(), but for integrated (version 3) files of two
+    receivers of the same host. The cross-spectrum of each pair of cycles is
+    stored in the file of the receiver that completed its cycle last."""
+    fft_len = file_header1.slice_size
+    xcorr_sum = np.zeros(fft_len, dtype='complex64')
+    autocorr1_sum = np.zeros(fft_len, dtype='complex64')
+    autocorr2_sum = np.zeros(fft_len, dtype='complex64')
+    cnt = 0
+
+    autocorr_off_sums = [np.zeros(fft_len, dtype='complex64'),
+                         np.zeros(fft_len, dtype='complex64')]
+    autocorr_off_cnts = [0, 0]
+
+    # auto records by cycle timestamp, cross records with the other file
+    autos = [{}, {}]
+    crosses = []
+    peers = (file_header2.device_index, file_header1.device_index)
+    for i, records in enumerate((records1, records2)):
+        for record in records:
+            if isinstance(record, AutoRecord):
+                header = record.header
+                if header.preamp_on:
+                    key = (header.timestamp_sec, header.timestamp_msec)
+                    autos[i][key] = record
+                else:
+                    autocorr_off_sums[i] += record.power
+                    autocorr_off_cnts[i] += record.integration.num_blocks
+            elif record.header.peer_device_index == peers[i]:
+                crosses.append((i, record))
+
+    errors1 = []
+    errors2 = []
+
+    for i, record in crosses:
+        header = record.header
+        own = (header.timestamp_sec, header.timestamp_msec)
+        peer = (header.peer_timestamp_sec, header.peer_timestamp_msec)
+        key1, key2 = (own, peer) if i == 0 else (peer, own)
+        if key1 not in autos[0] or key2 not in autos[1]:
+            print('Skip cross-spectrum without auto-power spectra')
+            continue
+        auto1 = autos[0][key1]
+        auto2 = autos[1][key2]
+        if (auto1.integration.num_blocks != header.num_blocks or
+                auto2.integration.num_blocks != header.num_blocks):
+            # (the auto-power sums also contain the unmatched segments)
+            print('Warning: cycles have different numbers of segments')
+
+        xcorr_sum += record.xcorr if i == 0 else record.xcorr.conjugate()
+        autocorr1_sum += auto1.power
+        autocorr2_sum += auto2.power
+        cnt += header.num_blocks
+
+        errors1.append(auto1.integration.phase_error_mean * 360)
+        errors2.append(auto2.integration.phase_error_mean * 360)
+
+    if cnt == 0:
+        print("No beacon matches :(")
+        return None
+
+    autocorr_offs = []
+    for i in range(2):
+        if autocorr_off_cnts[i] > 0:
+            autocorr_offs.append(autocorr_off_sums[i] / autocorr_off_cnts[i])
+        else:
+            autocorr_offs.append(None)
+            print("Warning: No data with preamp off in .corx file %d."
+                  % (i + 1))
+
+    return (xcorr_sum / cnt, autocorr1_sum / cnt, autocorr2_sum / cnt, cnt,
+            autocorr_offs[0], autocorr_off_cnts[0],
+            autocorr_offs[1], autocorr_off_cnts[1],
+            errors1, errors2)
+
+
 def plot_coeffs(xcorr_coeffs):
     plt.figure()
     plt.plot(np.fft.fftshift(xcorr_coeffs.real), label='Real')
@@ -144,6 +244,14 @@ def _main():
                         help="Plot autocorr and xcorr coefficients")
     parser.add_argument('--period', type=float, default=1.0,
                         help='Expected time delay between subsequent beacon pulses.')
+    parser.add_argument('--min-segment-snr', type=float, default=-100,
+                        help='Skip blocks whose carrier bin is less than '
+                        'this many dB above the mean power of the slice '
+                        '(files with segment metrics only).')
+    parser.add_argument('--max-segment-phase-std', type=float, default=0,
+                        help='Skip blocks whose rolling phase error standard '
+                        'deviation exceeds this fraction of a turn (files '
+                        'with segment metrics only; 0: no limit).')
     args = parser.parse_args()
 
     if args.plot and args.plot is not True:
@@ -160,7 +268,8 @@ def _main():
         print("too few arguments: no .corx files specified.", file=sys.stderr)
         sys.exit(2)
 
-    ret = correlate(args.corx1, args.corx2, args.period)
+    ret = correlate(args.corx1, args.corx2, args.period,
+                    args.min_segment_snr, args.max_segment_phase_std)
     if ret is not None:
         xcorr, autocorr1, autocorr2, cnt, \
                 autocorr1_off, autocorr1_off_cnt, \
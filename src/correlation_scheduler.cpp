@@ -0,0 +1,550 @@
+#include "correlation_scheduler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <exception>
+#include <stdexcept>
+
+namespace corx {
+
+namespace {
+
+double now_sec() {
+    return std::chrono::duration<double>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::string join_path(const std::string &dir, const std::string &name) {
+    if (dir.empty() || dir.back() == '/') {
+        return dir + name;
+    }
+    return dir + "/" + name;
+}
+
+std::vector<std::string> split(const std::string &str, char sep) {
+    std::vector<std::string> fields;
+    size_t offset = 0;
+    while (true) {
+        size_t pos = str.find(sep, offset);
+        if (pos == std::string::npos) {
+            fields.push_back(str.substr(offset));
+            return fields;
+        }
+        fields.push_back(str.substr(offset, pos - offset));
+        offset = pos + 1;
+    }
+}
+
+// Write to a temporary file first so that readers never see partial files
+bool save_atomic(const Baseline &baseline, const std::string &path) {
+    std::string tmp_path = path + ".tmp";
+    if (!Correlator::saveNpz(baseline, tmp_path)) {
+        return false;
+    }
+    if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "Error: could not rename %s: %s\n",
+                tmp_path.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+template <typename T>
+void add_to(std::vector<T> &sum, const std::vector<T> &x) {
+    for (size_t i = 0; i < sum.size(); ++i) {
+        sum[i] += x[i];
+    }
+}
+
+} // namespace
+
+
+bool parse_corx_filename(const std::string &filename,
+                         int64_t &group_key,
+                         std::string &noise_type,
+                         std::string &rxid) {
+    size_t start = filename.find_last_of('/');
+    std::string name = filename.substr(
+            start == std::string::npos ? 0 : start + 1);
+    size_t end = name.find_last_of('.');
+    std::vector<std::string> fields = split(name.substr(0, end), '_');
+    if (fields.size() < 4) {
+        return false;
+    }
+
+    std::string date = fields[0] + "_" + fields[1];
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char *rest = strptime(date.c_str(), "%Y%m%d_%H%M%S", &tm);
+    if (rest == nullptr || *rest != '\0') {
+        return false;
+    }
+    tm.tm_isdst = -1;
+    group_key = mktime(&tm);
+    noise_type = fields[2];
+    rxid = fields[3];
+    return true;
+}
+
+
+struct CorrelationScheduler::File {
+    std::string name;
+    std::string noise_type;
+    std::string rxid;
+    // Order of arrival within the group
+    size_t arrival;
+    CorxFileReader reader;
+    // Beacon numbers of the cycles (relative to the epoch of the group)
+    BeaconIndex beacons;
+    int64_t beacon_offset;
+    bool loaded;
+    bool failed;
+};
+
+struct CorrelationScheduler::Group {
+    int64_t key;
+    double start_time;
+    std::vector<std::shared_ptr<File>> files;
+    size_t pending_loads;
+    size_t baselines_started;
+    size_t baselines_done;
+    // Epoch of the first decoded file (reference of the beacon numbers)
+    bool has_epoch;
+    double epoch;
+    bool stale;
+    bool done;
+};
+
+struct CorrelationScheduler::Job {
+    std::shared_ptr<Group> group;
+    std::shared_ptr<File> file1;
+    std::shared_ptr<File> file2;
+    std::string output_path;
+    size_t len;
+    CycleAlignment alignment;
+    // Partial results, one per chunk of matching cycles (and one for the
+    // preamp-off cycles, if any)
+    size_t match_chunks;
+    std::vector<Baseline> partials;
+    std::atomic<size_t> remaining;
+};
+
+
+CorrelationScheduler::CorrelationScheduler(const SchedulerOptions &options,
+                                           WorkStealingPool &pool)
+    : options_(options), pool_(pool), files_loaded_(0),
+      baselines_written_(0), groups_done_(0), errors_(0) {
+    if (options_.num_shards == 0 ||
+            options_.shard_index >= options_.num_shards) {
+        throw std::invalid_argument("invalid shard");
+    }
+    if (options_.cycles_per_task == 0) {
+        throw std::invalid_argument("invalid number of cycles per task");
+    }
+}
+
+CorrelationScheduler::~CorrelationScheduler() {
+    pool_.wait();
+}
+
+void CorrelationScheduler::setGroupCallback(const GroupCallback &callback) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    callback_ = callback;
+}
+
+unsigned CorrelationScheduler::shardOf(const std::string &rxid1,
+                                       const std::string &rxid2,
+                                       unsigned num_shards) {
+    // FNV-1a of the sorted pair (the same on every server, unlike
+    // std::hash)
+    const std::string &a = std::min(rxid1, rxid2);
+    const std::string &b = std::max(rxid1, rxid2);
+    uint32_t hash = 2166136261u;
+    std::string key = a + '\0' + b;
+    for (char c : key) {
+        hash = (hash ^ (uint8_t)c) * 16777619u;
+    }
+    return hash % num_shards;
+}
+
+bool CorrelationScheduler::addFile(const std::string &filename) {
+    int64_t key;
+    std::shared_ptr<File> file(new File());
+    if (!parse_corx_filename(filename, key, file->noise_type, file->rxid)) {
+        printf("Skipping %s: invalid filename\n", filename.c_str());
+        return false;
+    }
+    file->name = filename;
+    file->beacon_offset = 0;
+    file->loaded = false;
+    file->failed = false;
+
+    std::shared_ptr<Group> group;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::shared_ptr<Group> &entry = groups_[key];
+        bool is_new_group = !entry;
+        if (is_new_group) {
+            entry.reset(new Group());
+            entry->key = key;
+            entry->start_time = now_sec();
+            entry->pending_loads = 0;
+            entry->baselines_started = 0;
+            entry->baselines_done = 0;
+            entry->has_epoch = false;
+            entry->epoch = 0;
+            entry->stale = false;
+            entry->done = false;
+        }
+        group = entry;
+        for (const std::shared_ptr<File> &other : group->files) {
+            if (other->name == filename) {
+                printf("Skipping %s: already added\n", filename.c_str());
+                return true;
+            }
+        }
+
+        printf("Add %s to group %lld%s\n", file->rxid.c_str(),
+               (long long)key, is_new_group ? " (new group)" : "");
+        file->arrival = group->files.size();
+        group->files.push_back(file);
+        group->pending_loads++;
+    }
+
+    pool_.submit([this, group, file] { loadFile(group, file); });
+
+    std::vector<GroupInfo> done;
+    std::vector<int64_t> purged;
+    GroupCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        purgeStale(key, done, purged);
+        callback = callback_;
+    }
+    signalGroups(done, callback);
+    for (int64_t purged_key : purged) {
+        printf("Purge group %lld\n", (long long)purged_key);
+    }
+    return true;
+}
+
+void CorrelationScheduler::loadFile(const std::shared_ptr<Group> &group,
+                                    const std::shared_ptr<File> &file) {
+    bool failed = false;
+    try {
+        file->reader.load(join_path(options_.corx_dir, file->name));
+        if (options_.align == AlignMethod::BEACON) {
+            index_beacons(file->reader.cycles(), options_.period,
+                          file->beacons);
+        }
+        files_loaded_++;
+    } catch (const std::exception &e) {
+        fprintf(stderr, "Error: %s\n", e.what());
+        errors_++;
+        failed = true;
+    }
+
+    // (pairs are started by whichever of their files is decoded last)
+    std::vector<std::shared_ptr<File>> partners;
+    std::vector<GroupInfo> done;
+    GroupCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        file->loaded = !failed;
+        file->failed = failed;
+        if (!failed) {
+            if (!group->has_epoch) {
+                group->epoch = file->beacons.epoch;
+                group->has_epoch = true;
+            }
+            file->beacon_offset = beacon_offset(file->beacons, group->epoch,
+                                                options_.period);
+            for (const std::shared_ptr<File> &other : group->files) {
+                if (other != file && other->loaded &&
+                        shardOf(file->rxid, other->rxid,
+                                options_.num_shards) ==
+                            options_.shard_index) {
+                    partners.push_back(other);
+                }
+            }
+        }
+        group->baselines_started += partners.size();
+        group->pending_loads--;
+        checkGroup(*group, done);
+        callback = callback_;
+    }
+    signalGroups(done, callback);
+
+    for (const std::shared_ptr<File> &other : partners) {
+        // (the later file first, as in correlate_server.py)
+        if (other->arrival > file->arrival) {
+            startBaseline(group, other, file);
+        } else {
+            startBaseline(group, file, other);
+        }
+    }
+}
+
+void CorrelationScheduler::startBaseline(const std::shared_ptr<Group> &group,
+                                         const std::shared_ptr<File> &file1,
+                                         const std::shared_ptr<File> &file2) {
+    std::shared_ptr<Job> job(new Job());
+    job->group = group;
+    job->file1 = file1;
+    job->file2 = file2;
+    job->output_path = join_path(
+            options_.corr_dir,
+            "corr_" + std::to_string(group->key) + "_" + file1->noise_type +
+            "_" + file1->rxid + "-" + file2->rxid + ".npz");
+
+    const CorxFileReader &corx1 = file1->reader;
+    const CorxFileReader &corx2 = file2->reader;
+    job->len = corx1.slice_size();
+    if (corx1.header().slice_start_idx != corx2.header().slice_start_idx ||
+            corx1.slice_size() != corx2.slice_size()) {
+        fprintf(stderr, "Error: slice of %s differs from %s\n",
+                file1->name.c_str(), file2->name.c_str());
+        errors_++;
+        job->match_chunks = 0;
+        job->remaining = 0;
+        finishBaseline(job);
+        return;
+    }
+
+    if (options_.align == AlignMethod::TIMESTAMP) {
+        align_cycles(corx1.cycles(), corx2.cycles(), options_.period,
+                     job->alignment);
+    } else {
+        align_beacons(corx1.cycles(), file1->beacons, file1->beacon_offset,
+                      corx2.cycles(), file2->beacons, file2->beacon_offset,
+                      job->alignment);
+    }
+    size_t num_matches = job->alignment.matches.size();
+    job->match_chunks = ((num_matches + options_.cycles_per_task - 1)
+                         / options_.cycles_per_task);
+    bool has_off = (!job->alignment.off1.empty() ||
+                    !job->alignment.off2.empty());
+    size_t num_chunks = job->match_chunks + (has_off ? 1 : 0);
+    job->partials.resize(num_chunks);
+    job->remaining = num_chunks;
+    if (num_chunks == 0) {
+        finishBaseline(job);
+        return;
+    }
+    for (size_t chunk = 0; chunk < num_chunks; ++chunk) {
+        pool_.submit([this, job, chunk] { runChunk(job, chunk); });
+    }
+}
+
+void CorrelationScheduler::runChunk(const std::shared_ptr<Job> &job,
+                                    size_t chunk) {
+    const CorxFileReader &corx1 = job->file1->reader;
+    const CorxFileReader &corx2 = job->file2->reader;
+    const std::vector<CorxCycle> &cycles1 = corx1.cycles();
+    const std::vector<CorxCycle> &cycles2 = corx2.cycles();
+    const CycleAlignment &alignment = job->alignment;
+    Baseline &partial = job->partials[chunk];
+    partial.reset(job->len);
+
+    if (chunk < job->match_chunks) {
+        size_t begin = chunk * options_.cycles_per_task;
+        size_t end = std::min(begin + options_.cycles_per_task,
+                              alignment.matches.size());
+        for (size_t i = begin; i < end; ++i) {
+            const std::pair<size_t, size_t> &match = alignment.matches[i];
+            accumulate_cycles(cycles1[match.first], cycles2[match.second],
+                              job->len, true, partial, options_.filter);
+        }
+    } else {
+        for (size_t idx1 : alignment.off1) {
+            for (size_t k = 0; k < cycles1[idx1].num_blocks(); ++k) {
+                accumulate_power(partial.autocorr1_off_sum.data(),
+                                 corx1.block(cycles1[idx1], k), job->len);
+                partial.autocorr1_off_cnt++;
+            }
+        }
+        for (size_t idx2 : alignment.off2) {
+            for (size_t k = 0; k < cycles2[idx2].num_blocks(); ++k) {
+                accumulate_power(partial.autocorr2_off_sum.data(),
+                                 corx2.block(cycles2[idx2], k), job->len);
+                partial.autocorr2_off_cnt++;
+            }
+        }
+    }
+
+    if (--job->remaining == 0) {
+        finishBaseline(job);
+    }
+}
+
+void CorrelationScheduler::finishBaseline(const std::shared_ptr<Job> &job) {
+    Group &group = *job->group;
+    const File &file1 = *job->file1;
+    const File &file2 = *job->file2;
+
+    // -- Sum up the chunks in cycle order
+    Baseline baseline;
+    baseline.file1 = file1.arrival;
+    baseline.file2 = file2.arrival;
+    baseline.reset(job->len);
+    baseline.skipped = job->alignment.skipped;
+    for (const Baseline &partial : job->partials) {
+        add_to(baseline.xcorr_sum, partial.xcorr_sum);
+        add_to(baseline.autocorr1_sum, partial.autocorr1_sum);
+        add_to(baseline.autocorr2_sum, partial.autocorr2_sum);
+        add_to(baseline.autocorr1_off_sum, partial.autocorr1_off_sum);
+        add_to(baseline.autocorr2_off_sum, partial.autocorr2_off_sum);
+        baseline.cnt += partial.cnt;
+        baseline.rejected += partial.rejected;
+        baseline.autocorr1_off_cnt += partial.autocorr1_off_cnt;
+        baseline.autocorr2_off_cnt += partial.autocorr2_off_cnt;
+        baseline.errors1.insert(baseline.errors1.end(),
+                                partial.errors1.begin(),
+                                partial.errors1.end());
+        baseline.errors2.insert(baseline.errors2.end(),
+                                partial.errors2.begin(),
+                                partial.errors2.end());
+    }
+    job->partials.clear();
+
+    // -- Save
+    printf("Task done: (%lld, %s, %s): calculated xcorr from %lld blocks; "
+           "number of autocorr off blocks: %lld, %lld; "
+           "%lld cycles skipped; %lld blocks rejected\n",
+           (long long)group.key, file1.rxid.c_str(), file2.rxid.c_str(),
+           (long long)baseline.cnt,
+           (long long)baseline.autocorr1_off_cnt,
+           (long long)baseline.autocorr2_off_cnt,
+           (long long)baseline.skipped,
+           (long long)baseline.rejected);
+    if (baseline.cnt == 0) {
+        fprintf(stderr, "Warning: no beacon matches; %s not written\n",
+                job->output_path.c_str());
+    } else if (save_atomic(baseline, job->output_path)) {
+        baselines_written_++;
+    } else {
+        fprintf(stderr, "Error: could not write %s\n",
+                job->output_path.c_str());
+        errors_++;
+    }
+    fflush(stdout);
+
+    std::vector<GroupInfo> done;
+    GroupCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        group.baselines_done++;
+        checkGroup(group, done);
+        callback = callback_;
+    }
+    signalGroups(done, callback);
+}
+
+void CorrelationScheduler::checkGroup(Group &group,
+                                      std::vector<GroupInfo> &done) {
+    bool complete = group.stale ||
+                    (options_.group_size > 0 &&
+                     group.files.size() >= options_.group_size);
+    if (group.done || !complete || group.pending_loads > 0 ||
+            group.baselines_done < group.baselines_started) {
+        return;
+    }
+    group.done = true;
+    groups_done_++;
+
+    GroupInfo info;
+    info.key = group.key;
+    info.num_files = group.files.size();
+    info.num_baselines = group.baselines_started;
+    info.seconds = now_sec() - group.start_time;
+    done.push_back(info);
+}
+
+void CorrelationScheduler::signalGroups(const std::vector<GroupInfo> &done,
+                                        const GroupCallback &callback) {
+    for (const GroupInfo &info : done) {
+        printf("Group done: %lld (%zu files, %zu baselines, %.1f s)\n",
+               (long long)info.key, info.num_files, info.num_baselines,
+               info.seconds);
+        fflush(stdout);
+        if (callback) {
+            callback(info);
+        }
+    }
+}
+
+void CorrelationScheduler::purgeStale(int64_t latest,
+                                      std::vector<GroupInfo> &done,
+                                      std::vector<int64_t> &purged) {
+    for (auto it = groups_.begin(); it != groups_.end(); ) {
+        Group &group = *it->second;
+        if (group.key > latest - options_.stale_timeout) {
+            ++it;
+            continue;
+        }
+        group.stale = true;
+        checkGroup(group, done);
+        // (a late file may have been added to a group that is done)
+        if (!group.done || group.pending_loads > 0 ||
+                group.baselines_done < group.baselines_started) {
+            // (retried when the next file arrives)
+            ++it;
+            continue;
+        }
+
+        purged.push_back(group.key);
+        if (options_.delete_stale) {
+            for (const std::shared_ptr<File> &file : group.files) {
+                std::string path = join_path(options_.corx_dir, file->name);
+                if (remove(path.c_str()) != 0) {
+                    fprintf(stderr, "Warning: could not delete %s: %s\n",
+                            path.c_str(), strerror(errno));
+                }
+            }
+        }
+        // (the decoded files are released once no task uses them)
+        it = groups_.erase(it);
+    }
+}
+
+void CorrelationScheduler::finish() {
+    pool_.wait();
+
+    std::vector<GroupInfo> done;
+    GroupCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto &entry : groups_) {
+            entry.second->stale = true;
+            checkGroup(*entry.second, done);
+        }
+        callback = callback_;
+    }
+    signalGroups(done, callback);
+}
+
+void CorrelationScheduler::printStats(FILE *out) const {
+    size_t cached = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto &entry : groups_) {
+            cached += entry.second->files.size();
+        }
+    }
+    fprintf(out,
+            "Scheduler: %llu files decoded (%zu cached); %llu baselines "
+            "written; %llu groups done; %llu errors; %llu tasks on %u "
+            "threads (%llu stolen)\n",
+            (unsigned long long)files_loaded_.load(), cached,
+            (unsigned long long)baselines_written_.load(),
+            (unsigned long long)groups_done_.load(),
+            (unsigned long long)errors_.load(),
+            (unsigned long long)pool_.tasksRun(), pool_.numThreads(),
+            (unsigned long long)pool_.steals());
+}
+
+} // namespace corx
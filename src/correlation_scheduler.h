@@ -0,0 +1,151 @@
+#ifndef CORX_CORRELATION_SCHEDULER_H
+#define CORX_CORRELATION_SCHEDULER_H
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "correlator.h"
+#include "corx_file_reader.h"
+#include "segment_metrics.h"
+#include "work_stealing_pool.h"
+
+namespace corx {
+
+// Settings of CorrelationScheduler
+struct SchedulerOptions {
+    // Directory of the incoming .corx files and of the .npz files
+    std::string corx_dir;
+    std::string corr_dir;
+    // Expected time delay between subsequent beacon pulses
+    double period;
+    // Alignment of the cycles of a baseline
+    AlignMethod align;
+    SegmentFilter filter;
+    // Number of matching cycle pairs correlated by a task
+    size_t cycles_per_task;
+    // Number of files of a complete group (0: unknown, i.e. a group is
+    // complete once it is stale)
+    size_t group_size;
+    // Groups older than stale_timeout seconds (by group key) relative to the
+    // newest group are purged from the cache, and their files deleted if
+    // delete_stale is set
+    int64_t stale_timeout;
+    bool delete_stale;
+    // Only correlate the baselines of shard shard_index of num_shards
+    // (to split the baselines of every group among several servers)
+    unsigned shard_index;
+    unsigned num_shards;
+
+    SchedulerOptions()
+        : corx_dir("/tmp/uploads/"), corr_dir("/tmp/corr/"), period(1.0),
+          align(AlignMethod::BEACON), cycles_per_task(4), group_size(0),
+          stale_timeout(40), delete_stale(true), shard_index(0),
+          num_shards(1) {}
+};
+
+// Correlates groups of incoming .corx files, replacing the per-pair
+// subprocesses of correlate_server.py.
+//
+// Files are named and grouped as in correlate_server.py (a date_time prefix
+// as group key, then the noise type and the receiver id). Every file is
+// decoded by a task of the pool once and kept in memory until its group is
+// purged. Its cycles are numbered by beacon (index_beacons) relative to the
+// first decoded file of the group. As soon as both files of a baseline are
+// decoded, their cycles are aligned and the baseline is split into tasks of
+// cycles_per_task matching cycle pairs. The last task of a baseline sums up
+// the partial results (in cycle order, so that the result does not depend on
+// the scheduling) and writes corr_{group}_{noise}_{rx1}-{rx2}.npz to
+// corr_dir. A group is done as soon as it is complete and its last baseline
+// has been written.
+class CorrelationScheduler {
+public:
+    struct GroupInfo {
+        int64_t key;
+        size_t num_files;
+        size_t num_baselines;
+        // Seconds from the first file of the group until it was done
+        double seconds;
+    };
+    typedef std::function<void(const GroupInfo&)> GroupCallback;
+
+    // The scheduler submits its tasks to pool, which has to outlive it.
+    CorrelationScheduler(const SchedulerOptions &options,
+                         WorkStealingPool &pool);
+    ~CorrelationScheduler();
+
+    CorrelationScheduler(const CorrelationScheduler&) = delete;
+    CorrelationScheduler& operator=(const CorrelationScheduler&) = delete;
+
+    // Called (by a worker) when a group is done
+    void setGroupCallback(const GroupCallback &callback);
+
+    // Add a file of corx_dir (by name) and purge stale groups. Returns false
+    // if the name is invalid.
+    bool addFile(const std::string &filename);
+
+    // Wait until all tasks are done and mark all remaining groups done
+    void finish();
+
+    // Stable assignment of a baseline (by receiver ids) to a shard
+    static unsigned shardOf(const std::string &rxid1,
+                            const std::string &rxid2,
+                            unsigned num_shards);
+
+    void printStats(FILE *out) const;
+
+private:
+    struct File;
+    struct Group;
+    struct Job;
+
+    void loadFile(const std::shared_ptr<Group> &group,
+                  const std::shared_ptr<File> &file);
+    void startBaseline(const std::shared_ptr<Group> &group,
+                       const std::shared_ptr<File> &file1,
+                       const std::shared_ptr<File> &file2);
+    void runChunk(const std::shared_ptr<Job> &job, size_t chunk);
+    void finishBaseline(const std::shared_ptr<Job> &job);
+    // Mark a group done if it is complete and idle (with mutex_ held)
+    void checkGroup(Group &group, std::vector<GroupInfo> &done);
+    // Print the groups that are done and call the callback (without
+    // mutex_ held)
+    void signalGroups(const std::vector<GroupInfo> &done,
+                      const GroupCallback &callback);
+    // Purge the stale groups that are done, and return their keys in purged
+    // (with mutex_ held)
+    void purgeStale(int64_t latest,
+                    std::vector<GroupInfo> &done,
+                    std::vector<int64_t> &purged);
+
+    const SchedulerOptions options_;
+    WorkStealingPool &pool_;
+    GroupCallback callback_;
+
+    mutable std::mutex mutex_;
+    std::map<int64_t, std::shared_ptr<Group>> groups_;
+
+    std::atomic<uint64_t> files_loaded_;
+    std::atomic<uint64_t> baselines_written_;
+    std::atomic<uint64_t> groups_done_;
+    std::atomic<uint64_t> errors_;
+};
+
+// Group key, receiver id and noise type of a .corx file name
+// (date_time_noise_rxid[_...].corx, as in correlate_server.py)
+bool parse_corx_filename(const std::string &filename,
+                         int64_t &group_key,
+                         std::string &noise_type,
+                         std::string &rxid);
+
+} // namespace corx
+
+#endif /* CORX_CORRELATION_SCHEDULER_H */
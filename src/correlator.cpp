@@ -0,0 +1,500 @@
+#include "correlator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include <thread>
+
+#include "npz_writer.h"
+
+namespace corx {
+
+namespace {
+
+double timestamp(const CorxBeaconHeader &header) {
+    return header.timestamp_sec + header.timestamp_msec / 1000.;
+}
+
+float error_to_degrees(int8_t error_fp) {
+    return error_fp / 127.f / 2 * 360;
+}
+
+// (destroys the order of values)
+double median(std::vector<double> &values) {
+    std::nth_element(values.begin(), values.begin() + values.size() / 2,
+                     values.end());
+    return values[values.size() / 2];
+}
+
+// A soa step is used if it is within this fraction of a whole number of
+// periods (and agrees with the timestamps within a period)
+const double MAX_SOA_STEP_ERROR = 0.1;
+
+std::vector<std::complex<float>> to_complex(const std::vector<float> &x) {
+    return std::vector<std::complex<float>>(x.begin(), x.end());
+}
+
+} // namespace
+
+
+void Baseline::reset(size_t len) {
+    xcorr_sum.assign(len, 0);
+    autocorr1_sum.assign(len, 0);
+    autocorr2_sum.assign(len, 0);
+    autocorr1_off_sum.assign(len, 0);
+    autocorr2_off_sum.assign(len, 0);
+    cnt = 0;
+    autocorr1_off_cnt = 0;
+    autocorr2_off_cnt = 0;
+    errors1.clear();
+    errors2.clear();
+    skipped = 0;
+    rejected = 0;
+}
+
+
+void accumulate_xcorr(std::complex<float> *sum,
+                      const std::complex<float> *a,
+                      const std::complex<float> *b,
+                      size_t len) {
+    // operate on interleaved floats so that the loop can be vectorized
+    float *s = reinterpret_cast<float*>(sum);
+    const float *x = reinterpret_cast<const float*>(a);
+    const float *y = reinterpret_cast<const float*>(b);
+    for (size_t i = 0; i < len; ++i) {
+        float xr = x[2*i], xi = x[2*i+1];
+        float yr = y[2*i], yi = y[2*i+1];
+        s[2*i] += xr * yr + xi * yi;
+        s[2*i+1] += xi * yr - xr * yi;
+    }
+}
+
+void accumulate_power(float *sum, const std::complex<float> *a, size_t len) {
+    const float *x = reinterpret_cast<const float*>(a);
+    for (size_t i = 0; i < len; ++i) {
+        sum[i] += x[2*i] * x[2*i] + x[2*i+1] * x[2*i+1];
+    }
+}
+
+
+void accumulate_cycles(const CorxCycle &cycle1,
+                       const CorxCycle &cycle2,
+                       size_t len,
+                       bool record_errors,
+                       Baseline &baseline,
+                       const SegmentFilter &filter) {
+    size_t num_blocks = std::min(cycle1.num_blocks(), cycle2.num_blocks());
+    bool has_metrics1 = !cycle1.metrics.empty();
+    bool has_metrics2 = !cycle2.metrics.empty();
+    for (size_t k = 0; k < num_blocks; ++k) {
+        // (before any multiply-accumulate work)
+        if ((has_metrics1 && !filter.accept(cycle1.metrics[k])) ||
+                (has_metrics2 && !filter.accept(cycle2.metrics[k]))) {
+            baseline.rejected++;
+            continue;
+        }
+
+        const std::complex<float> *fft1 = cycle1.data.data() + k * len;
+        const std::complex<float> *fft2 = cycle2.data.data() + k * len;
+        accumulate_xcorr(baseline.xcorr_sum.data(), fft1, fft2, len);
+        accumulate_power(baseline.autocorr1_sum.data(), fft1, len);
+        accumulate_power(baseline.autocorr2_sum.data(), fft2, len);
+        baseline.cnt++;
+
+        if (record_errors) {
+            baseline.errors1.push_back(
+                    error_to_degrees(cycle1.phase_errors[k]));
+            baseline.errors2.push_back(
+                    error_to_degrees(cycle2.phase_errors[k]));
+        }
+    }
+}
+
+
+void align_cycles(const std::vector<CorxCycle> &cycles1,
+                  const std::vector<CorxCycle> &cycles2,
+                  double period,
+                  CycleAlignment &alignment) {
+    alignment.matches.clear();
+    alignment.off1.clear();
+    alignment.off2.clear();
+    alignment.skipped = 0;
+
+    double timediff = 0;
+    const double timediff_thresh = period / 4.;
+    size_t idx1 = 0, idx2 = 0;
+    bool first = true;
+
+    while (true) {
+        // advance all readers if synced
+        // only advance the reader that are lagging behind if not synced
+        if (!first) {
+            if (std::abs(timediff) < timediff_thresh || timediff < 0) {
+                ++idx1;
+            }
+            if (std::abs(timediff) < timediff_thresh || timediff > 0) {
+                ++idx2;
+            }
+        }
+        first = false;
+        if (idx1 >= cycles1.size() || idx2 >= cycles2.size()) {
+            break;
+        }
+
+        const CorxCycle &cycle1 = cycles1[idx1];
+        const CorxCycle &cycle2 = cycles2[idx2];
+        timediff = timestamp(cycle1.header) - timestamp(cycle2.header);
+
+        if (std::abs(timediff) >= timediff_thresh) {
+            alignment.skipped++;
+        }
+
+        if (!cycle1.header.preamp_on || !cycle2.header.preamp_on) {
+            if (!cycle1.header.preamp_on) {
+                alignment.off1.push_back(idx1);
+            }
+            if (!cycle2.header.preamp_on) {
+                alignment.off2.push_back(idx2);
+            }
+            timediff = 0;  // force both readers to be moved forward
+
+        } else if (std::abs(timediff) < timediff_thresh) {
+            alignment.matches.push_back(std::make_pair(idx1, idx2));
+        }
+    }
+}
+
+
+void index_beacons(const std::vector<CorxCycle> &cycles,
+                   double period,
+                   BeaconIndex &index) {
+    const size_t n = cycles.size();
+    index.beacons.assign(n, 0);
+    index.epoch = 0;
+    index.resyncs = 0;
+    if (n == 0) {
+        return;
+    }
+
+    // -- Samples per period, from the soa steps of all cycles
+    std::vector<double> soa_steps(n, 0);
+    std::vector<double> rates;
+    for (size_t k = 1; k < n; ++k) {
+        const CorxBeaconHeader &prev = cycles[k - 1].header;
+        const CorxBeaconHeader &cur = cycles[k].header;
+        // (the sample clock of the receiver is off by clock_error)
+        soa_steps[k] = (cur.soa - prev.soa) / (1 - cur.clock_error);
+        double periods = std::round((timestamp(cur) - timestamp(prev))
+                                    / period);
+        if (soa_steps[k] > 0 && periods >= 1) {
+            rates.push_back(soa_steps[k] / periods);
+        }
+    }
+    double samples_per_period = rates.empty() ? 0 : median(rates);
+
+    // -- Beacon numbers
+    for (size_t k = 1; k < n; ++k) {
+        double timediff = (timestamp(cycles[k].header)
+                           - timestamp(cycles[k - 1].header));
+        int64_t step = std::llround(timediff / period);
+        if (samples_per_period > 0 && soa_steps[k] > 0) {
+            double periods = soa_steps[k] / samples_per_period;
+            int64_t soa_step = std::llround(periods);
+            if (std::abs(periods - soa_step) < MAX_SOA_STEP_ERROR &&
+                    std::abs(soa_step * period - timediff) < period) {
+                step = soa_step;
+            } else {
+                index.resyncs++;
+            }
+        } else if (samples_per_period > 0) {
+            index.resyncs++;
+        }
+        index.beacons[k] = index.beacons[k - 1] + std::max<int64_t>(step, 0);
+    }
+
+    std::vector<double> epochs(n);
+    for (size_t k = 0; k < n; ++k) {
+        epochs[k] = (timestamp(cycles[k].header)
+                     - index.beacons[k] * period);
+    }
+    index.epoch = median(epochs);
+}
+
+int64_t beacon_offset(const BeaconIndex &index,
+                      double reference_epoch,
+                      double period) {
+    return std::llround((index.epoch - reference_epoch) / period);
+}
+
+void align_beacons(const std::vector<CorxCycle> &cycles1,
+                   const BeaconIndex &index1,
+                   int64_t offset1,
+                   const std::vector<CorxCycle> &cycles2,
+                   const BeaconIndex &index2,
+                   int64_t offset2,
+                   CycleAlignment &alignment) {
+    alignment.matches.clear();
+    alignment.off1.clear();
+    alignment.off2.clear();
+    alignment.skipped = 0;
+
+    const size_t n1 = cycles1.size(), n2 = cycles2.size();
+    if (n1 == 0 || n2 == 0) {
+        return;
+    }
+    auto beacon1 = [&](size_t k) { return index1.beacons[k] + offset1; };
+    auto beacon2 = [&](size_t k) { return index2.beacons[k] + offset2; };
+
+    // (only the beacons that both files cover)
+    const int64_t first = std::max(beacon1(0), beacon2(0));
+    const int64_t last = std::min(beacon1(n1 - 1), beacon2(n2 - 1));
+    size_t idx1 = 0, idx2 = 0;
+    while (idx1 < n1 && beacon1(idx1) < first) {
+        ++idx1;
+    }
+    while (idx2 < n2 && beacon2(idx2) < first) {
+        ++idx2;
+    }
+
+    const size_t none = (size_t)-1;
+    while (idx1 < n1 && idx2 < n2) {
+        const int64_t beacon = std::min(beacon1(idx1), beacon2(idx2));
+        if (beacon > last) {
+            break;
+        }
+
+        // (further cycles of the same beacon are not paired)
+        size_t c1 = none, c2 = none;
+        for (; idx1 < n1 && beacon1(idx1) == beacon; ++idx1) {
+            if (c1 == none) {
+                c1 = idx1;
+            } else if (cycles1[idx1].header.preamp_on) {
+                alignment.skipped++;
+            } else {
+                alignment.off1.push_back(idx1);
+            }
+        }
+        for (; idx2 < n2 && beacon2(idx2) == beacon; ++idx2) {
+            if (c2 == none) {
+                c2 = idx2;
+            } else if (cycles2[idx2].header.preamp_on) {
+                alignment.skipped++;
+            } else {
+                alignment.off2.push_back(idx2);
+            }
+        }
+
+        bool on1 = c1 != none && cycles1[c1].header.preamp_on;
+        bool on2 = c2 != none && cycles2[c2].header.preamp_on;
+        if (c1 != none && !on1) {
+            alignment.off1.push_back(c1);
+        }
+        if (c2 != none && !on2) {
+            alignment.off2.push_back(c2);
+        }
+        if (on1 && on2) {
+            alignment.matches.push_back(std::make_pair(c1, c2));
+        } else if ((on1 && c2 == none) || (on2 && c1 == none)) {
+            alignment.skipped++;
+        }
+    }
+    // (off cycles of duplicate beacons are appended out of order)
+    std::sort(alignment.off1.begin(), alignment.off1.end());
+    std::sort(alignment.off2.begin(), alignment.off2.end());
+}
+
+
+bool parse_align_str(const std::string &str, AlignMethod &align) {
+    if (str == "beacon") {
+        align = AlignMethod::BEACON;
+    } else if (str == "timestamp") {
+        align = AlignMethod::TIMESTAMP;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+
+CycleTable::CycleTable(double period, AlignMethod method)
+    : period_(period), method_(method) {}
+
+size_t CycleTable::addFile(const std::vector<CorxCycle> &cycles) {
+    // (timestamp alignment does not number the cycles)
+    BeaconIndex index = BeaconIndex();
+    int64_t offset = 0;
+    if (method_ == AlignMethod::BEACON) {
+        index_beacons(cycles, period_, index);
+    }
+    if (method_ == AlignMethod::BEACON && !indices_.empty()) {
+        offset = beacon_offset(index, indices_[0].epoch, period_);
+    }
+
+    files_.push_back(&cycles);
+    indices_.push_back(std::move(index));
+    offsets_.push_back(offset);
+    return files_.size() - 1;
+}
+
+void CycleTable::alignPair(size_t file1,
+                           size_t file2,
+                           CycleAlignment &alignment) const {
+    if (method_ == AlignMethod::TIMESTAMP) {
+        align_cycles(*files_[file1], *files_[file2], period_, alignment);
+    } else {
+        align_beacons(*files_[file1], indices_[file1], offsets_[file1],
+                      *files_[file2], indices_[file2], offsets_[file2],
+                      alignment);
+    }
+}
+
+
+Correlator::Correlator(const std::vector<const CorxFileReader*> &files,
+                       double period,
+                       const SegmentFilter &filter,
+                       AlignMethod align)
+    : files_(files), period_(period), filter_(filter),
+      table_(period, align) {
+
+    for (size_t i = 0; i < files_.size(); ++i) {
+        if (files_[i]->header().slice_start_idx !=
+                    files_[0]->header().slice_start_idx ||
+                files_[i]->slice_size() != files_[0]->slice_size()) {
+            throw std::runtime_error("Slice of " + files_[i]->path() +
+                                     " differs from " + files_[0]->path());
+        }
+    }
+
+    for (const CorxFileReader *file : files_) {
+        table_.addFile(file->cycles());
+    }
+
+    for (size_t i = 0; i < files_.size(); ++i) {
+        for (size_t j = i + 1; j < files_.size(); ++j) {
+            Baseline baseline;
+            baseline.file1 = i;
+            baseline.file2 = j;
+            baselines_.push_back(std::move(baseline));
+        }
+    }
+}
+
+void Correlator::run(unsigned num_threads) {
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        size_t idx;
+        while ((idx = next++) < baselines_.size()) {
+            Baseline &baseline = baselines_[idx];
+            CycleAlignment alignment;
+            table_.alignPair(baseline.file1, baseline.file2, alignment);
+            correlateAligned(*files_[baseline.file1],
+                             *files_[baseline.file2],
+                             alignment,
+                             baseline,
+                             filter_);
+        }
+    };
+
+    num_threads = std::max(1u, std::min<unsigned>(num_threads,
+                                                  baselines_.size()));
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < num_threads; ++i) {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+void Correlator::correlatePair(const CorxFileReader &corx1,
+                               const CorxFileReader &corx2,
+                               double period,
+                               Baseline &baseline,
+                               const SegmentFilter &filter,
+                               AlignMethod align) {
+    CycleTable table(period, align);
+    table.addFile(corx1.cycles());
+    table.addFile(corx2.cycles());
+    CycleAlignment alignment;
+    table.alignPair(0, 1, alignment);
+    correlateAligned(corx1, corx2, alignment, baseline, filter);
+}
+
+void Correlator::correlateAligned(const CorxFileReader &corx1,
+                                  const CorxFileReader &corx2,
+                                  const CycleAlignment &alignment,
+                                  Baseline &baseline,
+                                  const SegmentFilter &filter) {
+    const size_t len = corx1.slice_size();
+    const std::vector<CorxCycle> &cycles1 = corx1.cycles();
+    const std::vector<CorxCycle> &cycles2 = corx2.cycles();
+    baseline.reset(len);
+    baseline.skipped = alignment.skipped;
+
+    for (size_t idx1 : alignment.off1) {
+        const CorxCycle &cycle1 = cycles1[idx1];
+        for (size_t k = 0; k < cycle1.num_blocks(); ++k) {
+            accumulate_power(baseline.autocorr1_off_sum.data(),
+                             corx1.block(cycle1, k), len);
+            baseline.autocorr1_off_cnt++;
+        }
+    }
+    for (size_t idx2 : alignment.off2) {
+        const CorxCycle &cycle2 = cycles2[idx2];
+        for (size_t k = 0; k < cycle2.num_blocks(); ++k) {
+            accumulate_power(baseline.autocorr2_off_sum.data(),
+                             corx2.block(cycle2, k), len);
+            baseline.autocorr2_off_cnt++;
+        }
+    }
+    for (const std::pair<size_t, size_t> &match : alignment.matches) {
+        accumulate_cycles(cycles1[match.first], cycles2[match.second], len,
+                          true, baseline, filter);
+    }
+}
+
+bool Correlator::saveNpz(const Baseline &baseline, const std::string &path) {
+    const size_t len = baseline.xcorr_sum.size();
+    std::vector<std::complex<float>> coeffs(len);
+    std::vector<std::complex<float>> autocorr1(len), autocorr2(len);
+    if (baseline.cnt > 0) {
+        for (size_t i = 0; i < len; ++i) {
+            std::complex<float> xcorr = baseline.xcorr_sum[i]
+                                        / (float)baseline.cnt;
+            autocorr1[i] = baseline.autocorr1_sum[i] / baseline.cnt;
+            autocorr2[i] = baseline.autocorr2_sum[i] / baseline.cnt;
+            coeffs[i] = xcorr / std::sqrt(std::abs(autocorr1[i])
+                                          * std::abs(autocorr2[i]));
+        }
+    }
+
+    std::vector<std::complex<float>> autocorr1_off, autocorr2_off;
+    if (baseline.autocorr1_off_cnt > 0) {
+        autocorr1_off = to_complex(baseline.autocorr1_off_sum);
+        for (std::complex<float> &x : autocorr1_off) {
+            x /= (float)baseline.autocorr1_off_cnt;
+        }
+    }
+    if (baseline.autocorr2_off_cnt > 0) {
+        autocorr2_off = to_complex(baseline.autocorr2_off_sum);
+        for (std::complex<float> &x : autocorr2_off) {
+            x /= (float)baseline.autocorr2_off_cnt;
+        }
+    }
+
+    NpzWriter npz;
+    npz.add("coeffs", coeffs);
+    npz.add("autocorr1", autocorr1);
+    npz.add("autocorr2", autocorr2);
+    npz.add("autocorr1_off", autocorr1_off);
+    npz.add("autocorr1_off_cnt", baseline.autocorr1_off_cnt);
+    npz.add("autocorr2_off", autocorr2_off);
+    npz.add("autocorr2_off_cnt", baseline.autocorr2_off_cnt);
+    npz.add("cnt", baseline.cnt);
+    return npz.save(path);
+}
+
+} // namespace corx
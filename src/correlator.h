@@ -0,0 +1,206 @@
+#ifndef CORX_CORRELATOR_H
+#define CORX_CORRELATOR_H
+
+#include <complex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "corx_file_reader.h"
+#include "segment_metrics.h"
+
+namespace corx {
+
+// Accumulated cross- and autocorrelation of a pair of receivers
+struct Baseline {
+    size_t file1;
+    size_t file2;
+
+    std::vector<std::complex<float>> xcorr_sum;
+    std::vector<float> autocorr1_sum;
+    std::vector<float> autocorr2_sum;
+    int64_t cnt;
+
+    // Autocorrelation of data captured with the preamp off
+    std::vector<float> autocorr1_off_sum;
+    std::vector<float> autocorr2_off_sum;
+    int64_t autocorr1_off_cnt;
+    int64_t autocorr2_off_cnt;
+
+    // Phase errors (in degrees) of the correlated blocks
+    std::vector<float> errors1;
+    std::vector<float> errors2;
+
+    // Number of cycle pairs skipped due to a timestamp mismatch (aligned by
+    // beacon: preamp-on cycles without a cycle of the other file)
+    int64_t skipped;
+    // Number of block pairs not correlated due to their segment metrics
+    int64_t rejected;
+
+    void reset(size_t len);
+};
+
+// sum += a * conj(b)
+void accumulate_xcorr(std::complex<float> *sum,
+                      const std::complex<float> *a,
+                      const std::complex<float> *b,
+                      size_t len);
+
+// sum += |a|^2
+void accumulate_power(float *sum, const std::complex<float> *a, size_t len);
+
+// Accumulate the blocks of a pair of matching cycles (with the preamp on).
+// Phase errors are appended to errors1 and errors2 if record_errors is set.
+// Pairs of which either block is rejected by the filter (using the segment
+// metrics of the cycles, if any) are skipped.
+void accumulate_cycles(const CorxCycle &cycle1,
+                       const CorxCycle &cycle2,
+                       size_t len,
+                       bool record_errors,
+                       Baseline &baseline,
+                       const SegmentFilter &filter = SegmentFilter());
+
+// Cycles of a pair of files that are correlated, as indices into the cycles
+// of each file
+struct CycleAlignment {
+    // Pairs of preamp-on cycles with matching timestamps
+    std::vector<std::pair<size_t, size_t>> matches;
+    // Preamp-off cycles of each file
+    std::vector<size_t> off1;
+    std::vector<size_t> off2;
+    // Number of cycle pairs skipped due to a timestamp mismatch (see
+    // Baseline::skipped)
+    int64_t skipped;
+};
+
+// Align the cycles of two files by timestamp in the same way as correlate()
+// in correlate.py, i.e. cycles are paired if their timestamps differ by less
+// than period / 4, otherwise the reader that is lagging behind is advanced.
+void align_cycles(const std::vector<CorxCycle> &cycles1,
+                  const std::vector<CorxCycle> &cycles2,
+                  double period,
+                  CycleAlignment &alignment);
+
+// Beacon numbers of the cycles of a file
+struct BeaconIndex {
+    // Beacon number of every cycle, counted from the first cycle
+    std::vector<int64_t> beacons;
+    // Time of beacon 0 (median of the cycle timestamps minus their beacon
+    // number times the period)
+    double epoch;
+    // Number of cycles numbered by timestamp since their soa was not
+    // consistent with it (e.g. after dropped samples)
+    size_t resyncs;
+};
+
+// Number the cycles of a file by beacon. The step between subsequent cycles
+// is taken from their soa (corrected by the clock error), which is exact
+// unlike the timestamps, as long as it is a whole number of periods and
+// agrees with the timestamps within a period. O(number of cycles).
+void index_beacons(const std::vector<CorxCycle> &cycles,
+                   double period,
+                   BeaconIndex &index);
+
+// Beacon number of beacon 0 of a file relative to a reference epoch
+int64_t beacon_offset(const BeaconIndex &index,
+                      double reference_epoch,
+                      double period);
+
+// Align the cycles of two files by beacon number (index.beacons + offset).
+// Cycles of the beacons that both files cover are paired if both have the
+// preamp on. Unlike align_cycles, a missing cycle does not discard any
+// cycles of the other file.
+void align_beacons(const std::vector<CorxCycle> &cycles1,
+                   const BeaconIndex &index1,
+                   int64_t offset1,
+                   const std::vector<CorxCycle> &cycles2,
+                   const BeaconIndex &index2,
+                   int64_t offset2,
+                   CycleAlignment &alignment);
+
+enum class AlignMethod {
+    BEACON,     // align_beacons
+    TIMESTAMP   // align_cycles (as correlate.py)
+};
+
+// Parse an alignment method (beacon or timestamp)
+bool parse_align_str(const std::string &str, AlignMethod &align);
+
+// Alignment table of the cycles of a group of files: the beacon number of
+// every cycle relative to beacon 0 of the first file. Every file is indexed
+// once when it is added, so that aligning a pair is a merge of their beacon
+// numbers.
+class CycleTable {
+public:
+    explicit CycleTable(double period,
+                        AlignMethod method = AlignMethod::BEACON);
+
+    // Index the cycles of a file, which have to outlive the table. Returns
+    // the index of the file in the table.
+    size_t addFile(const std::vector<CorxCycle> &cycles);
+
+    size_t numFiles() const { return files_.size(); }
+    const BeaconIndex& index(size_t file) const { return indices_[file]; }
+    int64_t offset(size_t file) const { return offsets_[file]; }
+
+    void alignPair(size_t file1,
+                   size_t file2,
+                   CycleAlignment &alignment) const;
+
+private:
+    double period_;
+    AlignMethod method_;
+    std::vector<const std::vector<CorxCycle>*> files_;
+    std::vector<BeaconIndex> indices_;
+    std::vector<int64_t> offsets_;
+};
+
+// Calculates the cross-correlation of all pairs of .corx files of a group.
+//
+// Every file is parsed and indexed (see CycleTable) only once.
+class Correlator {
+public:
+    Correlator(const std::vector<const CorxFileReader*> &files,
+               double period,
+               const SegmentFilter &filter = SegmentFilter(),
+               AlignMethod align = AlignMethod::BEACON);
+
+    // Correlate all N(N-1)/2 baselines using the given number of threads
+    void run(unsigned num_threads);
+
+    const std::vector<Baseline>& baselines() const { return baselines_; }
+
+    // Correlate a single pair of files
+    static void correlatePair(const CorxFileReader &corx1,
+                              const CorxFileReader &corx2,
+                              double period,
+                              Baseline &baseline,
+                              const SegmentFilter &filter = SegmentFilter(),
+                              AlignMethod align = AlignMethod::BEACON);
+
+    // Correlate the aligned cycles of a pair of files
+    static void correlateAligned(const CorxFileReader &corx1,
+                                 const CorxFileReader &corx2,
+                                 const CycleAlignment &alignment,
+                                 Baseline &baseline,
+                                 const SegmentFilter &filter);
+
+    // Write a baseline to a .npz file with the same contents as the output of
+    // correlate.py. Autocorrelation arrays for preamp-off data are empty if
+    // no such data exists.
+    static bool saveNpz(const Baseline &baseline, const std::string &path);
+
+private:
+    std::vector<const CorxFileReader*> files_;
+    double period_;
+    SegmentFilter filter_;
+    CycleTable table_;
+    std::vector<Baseline> baselines_;
+};
+
+} // namespace corx
+
+#endif /* CORX_CORRELATOR_H */
@@ -0,0 +1,387 @@
+/**
+ * Corx benchmarks
+ *
+ * Microbenchmarks of the receiver's DSP kernels and of the .corx writer at
+ * production block and segment sizes. Every benchmark processes the data of
+ * a single block, so its real-time factor is the block's real-time budget
+ * (the duration of its new samples) divided by the time it takes.
+ *
+ * End-to-end throughput is measured by replaying a recording through
+ * corx_rx instead, e.g. corx_rx --input=recording.cfile --throughput_report
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include "batch_fft.h"
+#include "corx_file_format.h"
+#include "corx_file_writer.h"
+#include "dsp.h"
+#include "goertzel.h"
+
+using namespace corx;
+
+DEFINE_uint64(block_size, 16384, "Length of a block");
+DEFINE_uint64(history_size, 4920, "Number of history samples of a block");
+DEFINE_uint64(segment_size, 1024, "Size of a correlation segment");
+DEFINE_string(slice, "0-100", "Output slice of a segment (start-stop)");
+DEFINE_double(sample_rate, 2.4e6, "Sample rate (for the real-time factor)");
+DEFINE_double(min_time, 0.2,
+              "Minimum time in seconds of a single repetition");
+DEFINE_uint64(repetitions, 5, "Number of repetitions (the median is used)");
+DEFINE_string(filter, "", "Only run benchmarks whose name contains this");
+DEFINE_string(format, "text", "Output format: text or json");
+DEFINE_string(writer_output, "/dev/null",
+              "File to write to in the writer benchmarks");
+
+namespace {
+
+struct Result {
+    std::string name;
+    double ns_per_block;
+    double samples_per_sec;
+    double realtime_factor;
+};
+
+// Run fn repeatedly and return the median time per call in ns
+double measure(const std::function<void()> &fn) {
+    typedef std::chrono::steady_clock clock;
+    fn();  // warm up (e.g. page faults, FFTW)
+
+    std::vector<double> times;
+    for (size_t rep = 0; rep < std::max<uint64_t>(FLAGS_repetitions, 1);
+            ++rep) {
+        size_t iterations = 0;
+        clock::time_point start = clock::now();
+        double elapsed = 0;
+        do {
+            fn();
+            ++iterations;
+            elapsed = std::chrono::duration<double>(
+                    clock::now() - start).count();
+        } while (elapsed < FLAGS_min_time);
+        times.push_back(elapsed * 1e9 / iterations);
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+std::vector<std::complex<float>> random_signal(size_t len) {
+    std::mt19937 rng(1234);
+    std::normal_distribution<float> dist(0, 30);
+    std::vector<std::complex<float>> signal(len);
+    for (auto &x : signal) {
+        x = std::complex<float>(dist(rng), dist(rng));
+    }
+    return signal;
+}
+
+class Bench {
+public:
+    Bench() {
+        block_size_ = FLAGS_block_size;
+        segment_size_ = FLAGS_segment_size;
+        nonhistory_size_ = block_size_ - FLAGS_history_size;
+        num_segments_ = block_size_ / segment_size_;
+
+        int stop;
+        if (sscanf(FLAGS_slice.c_str(), "%zu-%d", &slice_start_,
+                   &stop) != 2 || stop < (int)slice_start_ ||
+                (size_t)stop >= segment_size_) {
+            fprintf(stderr, "Invalid value for --slice: %s\n",
+                    FLAGS_slice.c_str());
+            exit(1);
+        }
+        slice_len_ = stop - slice_start_ + 1;
+
+        signal_ = random_signal(block_size_);
+        raw_.resize(2 * block_size_);
+        for (size_t i = 0; i < raw_.size(); ++i) {
+            raw_[i] = (uint8_t)(i * 37);
+        }
+        sink_ = 0;
+        output_.resize(block_size_);
+        kernels_ = select_dsp_kernels(block_size_, segment_size_,
+                                      slice_start_,
+                                      slice_start_ + slice_len_);
+    }
+
+    void run() {
+        add("freq_shift/table", [this] {
+            freq_shift(output_.data(), signal_.data(), block_size_,
+                       -123.4f, 0.1f, NCOType::TABLE);
+        });
+        add("freq_shift/phasor", [this] {
+            freq_shift(output_.data(), signal_.data(), block_size_,
+                       -123.4f, 0.1f, NCOType::PHASOR);
+        });
+        add("freq_shift_dc/table", [this] {
+            sink_ += freq_shift_dc(output_.data(), signal_.data(),
+                                   block_size_, -123.4f, 0.1f,
+                                   NCOType::TABLE);
+        });
+        add("freq_shift_dc/phasor", [this] {
+            sink_ += freq_shift_dc(output_.data(), signal_.data(),
+                                   block_size_, -123.4f, 0.1f,
+                                   NCOType::PHASOR);
+        });
+
+        // kernels of the configuration (see select_dsp_kernels)
+        if (kernels_.block_size != 0) {
+            add("freq_shift/table_fixed", [this] {
+                kernels_.freq_shift(output_.data(), signal_.data(),
+                                    block_size_, -123.4f, 0.1f,
+                                    NCOType::TABLE, 0);
+            });
+            add("freq_shift_dc/table_fixed", [this] {
+                sink_ += kernels_.freq_shift_dc(output_.data(),
+                                                signal_.data(), block_size_,
+                                                -123.4f, 0.1f,
+                                                NCOType::TABLE, 0);
+            });
+        }
+
+        add("calculate_dc", [this] {
+            sink_ += calculate_dc(signal_.data(), block_size_);
+        });
+        // (new samples of a block, as converted by --rtlsdr_async)
+        add("convert_iq_u8", [this] {
+            convert_iq_u8(output_.data(), raw_.data(), nonhistory_size_);
+        });
+
+        // (all segments of a block)
+        add("fft_shift", [this] {
+            for (size_t i = 0; i < num_segments_; ++i) {
+                size_t offset = i * segment_size_;
+                fft_shift(output_.data() + offset, signal_.data() + offset,
+                          segment_size_, 0.3f, 0.1f, 7);
+            }
+        });
+        add("fft_shift_range/slice", [this] {
+            for (size_t i = 0; i < num_segments_; ++i) {
+                size_t offset = i * segment_size_;
+                fft_shift_range(output_.data() + offset,
+                                signal_.data() + offset, segment_size_,
+                                0.3f, 0.1f, 7,
+                                slice_start_, slice_start_ + slice_len_);
+            }
+        });
+
+        add("fft_shifter/slice", [this] {
+            for (size_t i = 0; i < num_segments_; ++i) {
+                size_t offset = i * segment_size_;
+                shiftSlice(output_.data() + offset, signal_.data() + offset);
+            }
+        });
+
+        // with the slice power of the segment metrics
+        add("fft_shifter/slice_power", [this] {
+            for (size_t i = 0; i < num_segments_; ++i) {
+                size_t offset = i * segment_size_;
+                shifter_.shift(output_.data() + offset,
+                               signal_.data() + offset, segment_size_,
+                               0.3f, 0.1f, 7,
+                               slice_start_, slice_start_ + slice_len_,
+                               &power_);
+            }
+        });
+
+        if (kernels_.segment_size != 0) {
+            add("fft_shifter/slice_fixed", [this] {
+                for (size_t i = 0; i < num_segments_; ++i) {
+                    size_t offset = i * segment_size_;
+                    kernels_.shift_slice(shifter_, output_.data() + offset,
+                                         signal_.data() + offset,
+                                         segment_size_, 0.3f, 0.1f, 7,
+                                         slice_start_,
+                                         slice_start_ + slice_len_,
+                                         nullptr);
+                }
+            });
+            add("fft_shifter/power_fixed", [this] {
+                for (size_t i = 0; i < num_segments_; ++i) {
+                    size_t offset = i * segment_size_;
+                    kernels_.shift_slice(shifter_, output_.data() + offset,
+                                         signal_.data() + offset,
+                                         segment_size_, 0.3f, 0.1f, 7,
+                                         slice_start_,
+                                         slice_start_ + slice_len_,
+                                         &power_);
+                }
+            });
+        }
+
+        // Segment FFTs and phase correction of a block, as in
+        // Receiver::captureCorrSegments (writer excluded)
+        if (selected("capture_segments/fft") ||
+                selected("capture_segments/goertzel")) {
+            BatchFFT batch_fft(segment_size_, num_segments_ + 1);
+            add("capture_segments/fft", [&] {
+                batch_fft.execute(signal_.data(), num_segments_);
+                for (size_t i = 0; i < num_segments_; ++i) {
+                    shiftSlice(output_.data() + i * segment_size_,
+                               batch_fft.output(i));
+                }
+            });
+            add("capture_segments/goertzel", [&] {
+                for (size_t i = 0; i < num_segments_; ++i) {
+                    std::complex<float> *bins = batch_fft.output(i);
+                    const std::complex<float> *segment =
+                            signal_.data() + i * segment_size_;
+                    goertzel_bins(bins, segment, segment_size_,
+                                  slice_start_, slice_start_ + slice_len_);
+                    if (slice_start_ > 0) {
+                        goertzel_bins(bins, segment, segment_size_, 0, 1);
+                    }
+                    shiftSlice(output_.data() + i * segment_size_, bins);
+                }
+            });
+        }
+
+        // Writing the segments of a block
+        const uint8_t encodings[] = {
+            CORX_ENCODING_FLOAT32, CORX_ENCODING_FLOAT16,
+            CORX_ENCODING_INT16, CORX_ENCODING_INT8
+        };
+        const char* encoding_names[] = {"float32", "float16", "int16", "int8"};
+        for (int async = 0; async <= 1; ++async) {
+            for (int e = 0; e < 4; ++e) {
+                std::string name = (std::string("writer/") +
+                                    (async ? "async/" : "sync/") +
+                                    encoding_names[e]);
+                if (!selected(name)) {
+                    continue;
+                }
+                CorxWriterOptions options;
+                options.async = async;
+                options.encoding = encodings[e];
+                CorxFileWriter writer(CFile(FLAGS_writer_output), options);
+                writer.write_file_header({(uint16_t)slice_start_,
+                                          (uint16_t)slice_len_});
+                add(name, [&] {
+                    for (size_t i = 0; i < num_segments_; ++i) {
+                        writer.write_cycle_block(
+                                1, signal_.data() + i * segment_size_,
+                                slice_len_);
+                    }
+                });
+            }
+        }
+
+        print();
+
+        // (use the results of the kernels, so they are not optimized away)
+        volatile float sink = std::abs(sink_);
+        (void)sink;
+    }
+
+private:
+    bool selected(const std::string &name) const {
+        return name.find(FLAGS_filter) != std::string::npos;
+    }
+
+    void add(const std::string &name, const std::function<void()> &fn) {
+        if (!selected(name)) {
+            return;
+        }
+        Result result;
+        result.name = name;
+        result.ns_per_block = measure(fn);
+        result.samples_per_sec = nonhistory_size_ * 1e9 / result.ns_per_block;
+        result.realtime_factor = result.samples_per_sec / FLAGS_sample_rate;
+        results_.push_back(result);
+        if (FLAGS_format != "json") {
+            fprintf(stderr, ".");
+        }
+    }
+
+    // Phase correction of the slice and bin 0 of a segment spectrum
+    // (as in Receiver::captureCorrSegments)
+    void shiftSlice(std::complex<float> *dest,
+                    const std::complex<float> *src) {
+        shifter_.shift(dest, src, segment_size_, 0.3f, 0.1f, 7,
+                       slice_start_, slice_start_ + slice_len_);
+        if (slice_start_ > 0) {
+            shifter_.shift(dest, src, segment_size_, 0.3f, 0.1f, 7, 0, 1);
+        }
+    }
+
+    void print() const {
+        if (FLAGS_format == "json") {
+            printf("{\"block_size\": %zu, \"history_size\": %zu, "
+                   "\"segment_size\": %zu, \"slice_start\": %zu, "
+                   "\"slice_len\": %zu, \"sample_rate\": %.1f, "
+                   "\"results\": [",
+                   block_size_, block_size_ - nonhistory_size_,
+                   segment_size_, slice_start_, slice_len_,
+                   FLAGS_sample_rate);
+            for (size_t i = 0; i < results_.size(); ++i) {
+                const Result &r = results_[i];
+                printf("%s\n  {\"name\": \"%s\", \"ns_per_block\": %.1f, "
+                       "\"samples_per_sec\": %.1f, "
+                       "\"realtime_factor\": %.2f}",
+                       i > 0 ? "," : "", r.name.c_str(), r.ns_per_block,
+                       r.samples_per_sec, r.realtime_factor);
+            }
+            printf("\n]}\n");
+        } else {
+            fprintf(stderr, "\n");
+            printf("%-28s %14s %16s %10s\n", "benchmark", "us/block",
+                   "samples/s", "realtime");
+            for (const Result &r : results_) {
+                printf("%-28s %14.2f %16.0f %9.1fx\n", r.name.c_str(),
+                       r.ns_per_block / 1e3, r.samples_per_sec,
+                       r.realtime_factor);
+            }
+        }
+    }
+
+    size_t block_size_;
+    size_t segment_size_;
+    size_t nonhistory_size_;
+    size_t num_segments_;
+    size_t slice_start_;
+    size_t slice_len_;
+
+    std::vector<std::complex<float>> signal_;
+    std::vector<uint8_t> raw_;
+    std::vector<std::complex<float>> output_;
+    std::complex<float> sink_;
+    float power_;
+    FFTShifter shifter_;
+    DspKernels kernels_;
+    std::vector<Result> results_;
+};
+
+} // namespace
+
+
+int main(int argc, char **argv) {
+    gflags::SetUsageMessage("Benchmark the DSP kernels of corx_rx");
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    if (FLAGS_format != "text" && FLAGS_format != "json") {
+        fprintf(stderr, "Invalid value for --format: %s\n",
+                FLAGS_format.c_str());
+        return 1;
+    }
+    if (FLAGS_segment_size == 0 || FLAGS_segment_size > FLAGS_block_size ||
+            FLAGS_history_size >= FLAGS_block_size) {
+        fprintf(stderr, "Invalid block, history or segment size\n");
+        return 1;
+    }
+
+    Bench bench;
+    bench.run();
+    return 0;
+}
@@ -0,0 +1,371 @@
+/**
+ * Corx correlator
+ *
+ * Calculates the correlation coefficients of all pairs of .corx files of a
+ * group. Native replacement of correlate.py: every file is read only once and
+ * all baselines are correlated in parallel.
+ *
+ * With --listen, .corx streams of the receivers (corx_rx --output=tcp://...)
+ * are correlated online and the results are updated periodically.
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gflags/gflags.h>
+
+#include "correlator.h"
+#include "corx_file_reader.h"
+#include "corx_stream.h"
+#include "online_correlator.h"
+#include "opencl_correlator.h"
+
+using namespace corx;
+
+DEFINE_string(output, "xcorr_{i}_{j}.npz",
+              "Output .npz file of each baseline. {i} and {j} are replaced "
+              "by the indices of the files, {name1} and {name2} by their "
+              "names without directory and extension (or the stream names "
+              "with --listen).");
+DEFINE_double(period, 1.0,
+              "Expected time delay between subsequent beacon pulses.");
+DEFINE_int32(threads, 0,
+             "Number of correlation threads (0: number of CPUs).");
+DEFINE_string(align, "beacon",
+              "Alignment of the cycles of a pair of files: beacon (by the "
+              "beacon numbers of the cycles, from their soa) or timestamp "
+              "(as correlate.py; files only).");
+DEFINE_string(listen, "",
+              "Port to listen on for .corx streams. Enables online "
+              "correlation instead of correlating files.");
+DEFINE_double(update_interval, 1.0,
+              "Interval in seconds between updates of the output files "
+              "(online correlation).");
+DEFINE_double(match_window, 10.0,
+              "Number of seconds a cycle is kept for matching with cycles of "
+              "other streams (online correlation).");
+DEFINE_double(min_segment_snr, -100,
+              "Skip blocks whose carrier bin is less than this many dB "
+              "above the mean power of the slice (only for files with "
+              "segment metrics, see corx_rx --segment_metrics).");
+DEFINE_double(max_segment_phase_std, 0,
+              "Skip blocks whose rolling phase error standard deviation "
+              "exceeds this fraction of a turn (only for files with "
+              "segment metrics; 0: no limit).");
+
+DEFINE_string(backend, "cpu",
+              "Backend of the correlation: cpu or opencl (all baselines in "
+              "a single kernel launch on an OpenCL device; files only).");
+DEFINE_int32(opencl_device, 0,
+             "Index of the OpenCL device among the devices of all platforms "
+             "(--backend=opencl).");
+
+static SegmentFilter segment_filter() {
+    SegmentFilter filter;
+    filter.min_snr = FLAGS_min_segment_snr;
+    filter.max_phase_std = FLAGS_max_segment_phase_std;
+    return filter;
+}
+
+static volatile sig_atomic_t do_exit = false;
+
+static void signal_handler(int signo) {
+    do_exit = true;
+}
+
+static std::string basename_noext(const std::string &path) {
+    size_t start = path.find_last_of('/');
+    start = (start == std::string::npos) ? 0 : start + 1;
+    size_t end = path.find_last_of('.');
+    if (end == std::string::npos || end < start) {
+        end = path.size();
+    }
+    return path.substr(start, end - start);
+}
+
+static void replace_all(std::string &str,
+                        const std::string &from,
+                        const std::string &to) {
+    size_t pos = 0;
+    while ((pos = str.find(from, pos)) != std::string::npos) {
+        str.replace(pos, from.size(), to);
+        pos += to.size();
+    }
+}
+
+static std::string output_path(const Baseline &baseline,
+                               const std::vector<std::string> &paths,
+                               bool strip = true) {
+    std::string path = FLAGS_output;
+    replace_all(path, "{i}", std::to_string(baseline.file1));
+    replace_all(path, "{j}", std::to_string(baseline.file2));
+    const std::string &name1 = paths[baseline.file1];
+    const std::string &name2 = paths[baseline.file2];
+    replace_all(path, "{name1}", strip ? basename_noext(name1) : name1);
+    replace_all(path, "{name2}", strip ? basename_noext(name2) : name2);
+    return path;
+}
+
+// Write to a temporary file first so that readers never see partial files
+static bool save_atomic(const Baseline &baseline, const std::string &path) {
+    std::string tmp_path = path + ".tmp";
+    if (!Correlator::saveNpz(baseline, tmp_path)) {
+        return false;
+    }
+    if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "Error: could not rename %s: %s\n",
+                tmp_path.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+struct Connection {
+    int fd;
+    std::thread thread;
+    std::atomic<bool> done;
+
+    Connection(int fd) : fd(fd), done(false) {}
+};
+
+static int listen_main() {
+    int listen_fd = stream_listen(FLAGS_listen);
+    if (listen_fd < 0) {
+        return 1;
+    }
+    printf("Listening for .corx streams on port %s\n", FLAGS_listen.c_str());
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+
+    OnlineCorrelator correlator(FLAGS_period, FLAGS_match_window,
+                                segment_filter());
+    std::vector<std::unique_ptr<Connection>> connections;
+    int ret = 0;
+
+    auto save_updated = [&]() {
+        std::vector<std::string> names = correlator.streamNames();
+        for (const Baseline &baseline : correlator.takeUpdated()) {
+            if (baseline.cnt == 0) {
+                continue;
+            }
+            std::string path = output_path(baseline, names, false);
+            if (!save_atomic(baseline, path)) {
+                fprintf(stderr, "Error: could not write %s\n", path.c_str());
+                ret = 1;
+            }
+        }
+    };
+
+    auto next_update = std::chrono::steady_clock::now();
+    const auto update_interval = std::chrono::microseconds(
+            (int64_t)(FLAGS_update_interval * 1e6));
+
+    while (!do_exit) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= next_update) {
+            save_updated();
+            next_update = now + update_interval;
+        }
+
+        // reap finished connections
+        for (auto it = connections.begin(); it != connections.end(); ) {
+            if ((*it)->done) {
+                (*it)->thread.join();
+                close((*it)->fd);
+                it = connections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        struct pollfd pfd = {listen_fd, POLLIN, 0};
+        int timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
+                next_update - now).count();
+        if (poll(&pfd, 1, std::max(timeout, 1)) <= 0) {
+            continue;
+        }
+
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+        connections.push_back(std::unique_ptr<Connection>(
+                new Connection(fd)));
+        Connection *connection = connections.back().get();
+        connection->thread = std::thread([&correlator, connection]() {
+            correlator.processStream(connection->fd);
+            connection->done = true;
+        });
+    }
+
+    // stop all streams and write the final results
+    for (auto &connection : connections) {
+        shutdown(connection->fd, SHUT_RDWR);
+        connection->thread.join();
+        close(connection->fd);
+    }
+    close(listen_fd);
+    save_updated();
+
+    return ret;
+}
+
+int main(int argc, char **argv) {
+    gflags::SetUsageMessage("corx_correlate [flags] file1.corx file2.corx "
+                            "[file3.corx ...]\n"
+                            "corx_correlate --listen=port [flags]");
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    if (FLAGS_update_interval <= 0) {
+        fprintf(stderr, "Invalid value for --update_interval\n");
+        exit(1);
+    }
+    if (FLAGS_match_window < FLAGS_period) {
+        fprintf(stderr, "Invalid value for --match_window\n");
+        exit(1);
+    }
+    if (FLAGS_max_segment_phase_std < 0) {
+        fprintf(stderr, "Invalid value for --max_segment_phase_std\n");
+        exit(1);
+    }
+    if (FLAGS_backend != "cpu" && FLAGS_backend != "opencl") {
+        fprintf(stderr, "Invalid value for --backend: %s\n",
+                FLAGS_backend.c_str());
+        exit(1);
+    }
+    if (FLAGS_opencl_device < 0) {
+        fprintf(stderr, "Invalid value for --opencl_device\n");
+        exit(1);
+    }
+    AlignMethod align;
+    if (!parse_align_str(FLAGS_align, align)) {
+        fprintf(stderr, "Invalid value for --align: %s\n",
+                FLAGS_align.c_str());
+        exit(1);
+    }
+    if (!FLAGS_listen.empty()) {
+        if (FLAGS_period <= 0) {
+            fprintf(stderr, "Invalid value for --period\n");
+            exit(1);
+        }
+        if (FLAGS_backend != "cpu") {
+            fprintf(stderr, "Warning: --backend is ignored with --listen\n");
+        }
+        if (FLAGS_align != "beacon") {
+            fprintf(stderr, "Warning: --align is ignored with --listen\n");
+        }
+        return listen_main();
+    }
+
+    if (argc < 3) {
+        fprintf(stderr, "At least two .corx files are required\n");
+        exit(2);
+    }
+    if (FLAGS_period <= 0) {
+        fprintf(stderr, "Invalid value for --period\n");
+        exit(1);
+    }
+    if (FLAGS_threads < 0) {
+        fprintf(stderr, "Invalid value for --threads\n");
+        exit(1);
+    }
+
+    std::vector<std::string> paths(argv + 1, argv + argc);
+    std::vector<std::unique_ptr<CorxFileReader>> readers;
+    std::vector<const CorxFileReader*> files;
+    std::unique_ptr<Correlator> correlator;
+    std::unique_ptr<OpenCLCorrelator> opencl;
+
+    try {
+        if (FLAGS_backend == "opencl") {
+            opencl.reset(new OpenCLCorrelator(FLAGS_period,
+                                              segment_filter(),
+                                              FLAGS_opencl_device,
+                                              align));
+            printf("OpenCL device: %s\n", opencl->deviceName().c_str());
+            opencl->reserveFiles(paths.size());
+        }
+        for (const std::string &path : paths) {
+            readers.push_back(std::unique_ptr<CorxFileReader>(
+                    new CorxFileReader()));
+            readers.back()->load(path);
+            files.push_back(readers.back().get());
+            printf("%s: %zu cycles\n", path.c_str(),
+                   readers.back()->cycles().size());
+            if (opencl) {
+                // (transferred while the next file is parsed)
+                opencl->addFile(files.back());
+            }
+        }
+        if (!opencl) {
+            correlator.reset(new Correlator(files, FLAGS_period,
+                                            segment_filter(), align));
+        }
+    } catch (const std::exception &e) {
+        fprintf(stderr, "Error: %s\n", e.what());
+        exit(1);
+    }
+
+    printf("Slice start: %u\n", (unsigned)files[0]->header().slice_start_idx);
+    printf("Slice size: %zu\n", files[0]->slice_size());
+
+    const std::vector<Baseline> *baselines;
+    if (opencl) {
+        try {
+            opencl->run();
+        } catch (const std::exception &e) {
+            fprintf(stderr, "Error: %s\n", e.what());
+            exit(1);
+        }
+        baselines = &opencl->baselines();
+    } else {
+        unsigned num_threads = FLAGS_threads;
+        if (num_threads == 0) {
+            num_threads = std::thread::hardware_concurrency();
+        }
+        correlator->run(num_threads);
+        baselines = &correlator->baselines();
+    }
+
+    int ret = 0;
+    for (const Baseline &baseline : *baselines) {
+        std::string path = output_path(baseline, paths);
+        printf("%s - %s: calculated xcorr from %lld blocks; "
+               "number of autocorr off blocks: %lld, %lld; "
+               "%lld cycles skipped; %lld blocks rejected\n",
+               paths[baseline.file1].c_str(),
+               paths[baseline.file2].c_str(),
+               (long long)baseline.cnt,
+               (long long)baseline.autocorr1_off_cnt,
+               (long long)baseline.autocorr2_off_cnt,
+               (long long)baseline.skipped,
+               (long long)baseline.rejected);
+
+        if (baseline.cnt == 0) {
+            fprintf(stderr, "Warning: no beacon matches; %s not written\n",
+                    path.c_str());
+            continue;
+        }
+        if (!Correlator::saveNpz(baseline, path)) {
+            fprintf(stderr, "Error: could not write %s\n", path.c_str());
+            ret = 1;
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,137 @@
+/**
+ * Corx correlate server
+ *
+ * Native replacement of experiments/correlate_server/correlate_server.py.
+ * Reads the names of new .corx files of --corx_dir from standard input (one
+ * per line, e.g. from correlate_monitor.sh) and correlates all baselines of
+ * every group of files on a work-stealing thread pool, decoding each file
+ * only once. See correlation_scheduler.h.
+ *
+ * The baselines of each group can be split among several servers that
+ * receive the same files with --shard=i/n.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <gflags/gflags.h>
+
+#include "correlation_scheduler.h"
+#include "work_stealing_pool.h"
+
+using namespace corx;
+
+DEFINE_string(corx_dir, "/tmp/uploads/",
+              "Directory of the incoming .corx files.");
+DEFINE_string(corr_dir, "/tmp/corr/",
+              "Output directory of the .npz files.");
+DEFINE_double(period, 1.0,
+              "Expected time delay between subsequent beacon pulses.");
+DEFINE_string(align, "beacon",
+              "Alignment of the cycles of a baseline: beacon (by the beacon "
+              "numbers of the cycles, from their soa) or timestamp (as "
+              "correlate.py).");
+DEFINE_int32(threads, 0,
+             "Number of correlation threads (0: number of CPUs).");
+DEFINE_int32(cycles_per_task, 4,
+             "Number of matching beacon cycles of a baseline correlated by "
+             "one task.");
+DEFINE_int32(group_size, 0,
+             "Number of files of a complete group, i.e. the number of "
+             "receivers. A group is done as soon as its last baseline has "
+             "been written (0: unknown; groups are done once they are "
+             "stale).");
+DEFINE_int32(stale_timeout, 40,
+             "Purge groups that are this many seconds older than the newest "
+             "group.");
+DEFINE_bool(delete_stale, true,
+            "Delete the .corx files of purged groups.");
+DEFINE_string(shard, "0/1",
+              "Only correlate the baselines of shard i of n (i/n), to split "
+              "the baselines among n servers that receive the same files.");
+DEFINE_double(min_segment_snr, -100,
+              "Skip blocks whose carrier bin is less than this many dB "
+              "above the mean power of the slice (only for files with "
+              "segment metrics, see corx_rx --segment_metrics).");
+DEFINE_double(max_segment_phase_std, 0,
+              "Skip blocks whose rolling phase error standard deviation "
+              "exceeds this fraction of a turn (only for files with "
+              "segment metrics; 0: no limit).");
+
+static bool parse_shard_str(const std::string &str,
+                            unsigned &index,
+                            unsigned &count) {
+    char end;
+    if (sscanf(str.c_str(), "%u/%u%c", &index, &count, &end) != 2) {
+        return false;
+    }
+    return count > 0 && index < count;
+}
+
+int main(int argc, char **argv) {
+    gflags::SetUsageMessage("corx_correlate_server [flags] < filenames");
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    SchedulerOptions options;
+    options.corx_dir = FLAGS_corx_dir;
+    options.corr_dir = FLAGS_corr_dir;
+    options.period = FLAGS_period;
+    options.filter.min_snr = FLAGS_min_segment_snr;
+    options.filter.max_phase_std = FLAGS_max_segment_phase_std;
+    options.cycles_per_task = FLAGS_cycles_per_task;
+    options.group_size = FLAGS_group_size;
+    options.stale_timeout = FLAGS_stale_timeout;
+    options.delete_stale = FLAGS_delete_stale;
+
+    if (FLAGS_period <= 0) {
+        fprintf(stderr, "Invalid value for --period\n");
+        exit(1);
+    }
+    if (FLAGS_threads < 0) {
+        fprintf(stderr, "Invalid value for --threads\n");
+        exit(1);
+    }
+    if (FLAGS_cycles_per_task <= 0) {
+        fprintf(stderr, "Invalid value for --cycles_per_task\n");
+        exit(1);
+    }
+    if (FLAGS_group_size < 0) {
+        fprintf(stderr, "Invalid value for --group_size\n");
+        exit(1);
+    }
+    if (FLAGS_max_segment_phase_std < 0) {
+        fprintf(stderr, "Invalid value for --max_segment_phase_std\n");
+        exit(1);
+    }
+    if (!parse_align_str(FLAGS_align, options.align)) {
+        fprintf(stderr, "Invalid value for --align: %s\n",
+                FLAGS_align.c_str());
+        exit(1);
+    }
+    if (!parse_shard_str(FLAGS_shard, options.shard_index,
+                         options.num_shards)) {
+        fprintf(stderr, "Invalid value for --shard: %s\n",
+                FLAGS_shard.c_str());
+        exit(1);
+    }
+
+    WorkStealingPool pool(FLAGS_threads);
+    CorrelationScheduler scheduler(options, pool);
+    printf("Correlating on %u threads (shard %u of %u)\n",
+           pool.numThreads(), options.shard_index, options.num_shards);
+    fflush(stdout);
+
+    // (decoding and correlation run on the pool while waiting for input)
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        if (!line.empty()) {
+            scheduler.addFile(line);
+        }
+    }
+
+    scheduler.finish();
+    scheduler.printStats(stdout);
+    return 0;
+}
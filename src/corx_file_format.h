@@ -4,6 +4,27 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+// File format versions
+//  0x01: bins stored as complex floats
+//  0x02: file header followed by a bin encoding byte (CORX_ENCODING_*);
+//        blocks with integer encodings store a float scale factor after the
+//        phase error byte; with CORX_ENCODING_METRICS, every block stores a
+//        CorxSegmentMetrics right before its bins
+//  0x03: integrated products only (see below); file header followed by the
+//        device index of the receiver (int16_t, -1 if unknown) and a
+//        sequence of records, each starting with a record type byte
+#define CORX_VERSION_1 0x01
+#define CORX_VERSION_2 0x02
+#define CORX_VERSION_3 0x03
+
+// Bin encodings (version 2)
+#define CORX_ENCODING_FLOAT32 0  // complex float (as in version 1)
+#define CORX_ENCODING_FLOAT16 1  // complex IEEE half-precision float
+#define CORX_ENCODING_INT16   2  // complex int16 * scale
+#define CORX_ENCODING_INT8    3  // complex int8 * scale
+// Flag of the encoding byte: every block stores its segment metrics
+#define CORX_ENCODING_METRICS 0x80
+
 struct CorxFileHeader {
     uint16_t slice_start_idx;
     uint16_t slice_size;  // a.k.a. corr block length
@@ -22,4 +43,47 @@ struct CorxBeaconHeader {
     bool preamp_on;
 } __attribute__((packed));
 
+
+// Quality metrics of a segment spectrum (version 2 with
+// CORX_ENCODING_METRICS). The phase error of the segment, i.e. the phase of
+// the carrier bin, is stored in the phase error byte of the block.
+struct CorxSegmentMetrics {
+    int16_t slice_power;  // mean |X|^2 of the slice bins (0.01 dB)
+    int8_t snr;           // |X|^2 of the carrier bin over slice_power (0.5 dB)
+    uint8_t phase_std;    // rolling std. dev. of the phase error of the
+                          // segments of the cycle (1/512 turn)
+} __attribute__((packed));
+
+
+// Record types (version 3)
+//  CORX_RECORD_AUTO: CorxBeaconHeader, CorxIntegrationHeader and the sum of
+//                    |X|^2 of all segments of the cycle (float per bin)
+//  CORX_RECORD_CROSS: CorxCrossHeader and the sum of X * conj(Y) over the
+//                     segments of two receivers of the same host (complex
+//                     float per bin), where X is the own and Y the peer's
+//                     segment spectrum
+#define CORX_RECORD_AUTO  0x01
+#define CORX_RECORD_CROSS 0x02
+
+// Phase error statistics of an integrated cycle
+// (phase errors in fractions of a full turn)
+struct CorxIntegrationHeader {
+    uint16_t num_blocks;
+    uint16_t num_phase_errors;  // blocks with a large phase error
+    float phase_error_mean;
+    float phase_error_rms;
+    float phase_error_max;  // largest absolute phase error
+} __attribute__((packed));
+
+// Cross-spectrum of two receivers of the same host. The timestamps are the
+// cycle start timestamps in the beacon headers of the matching auto records.
+struct CorxCrossHeader {
+    int16_t peer_device_index;
+    uint64_t timestamp_sec;
+    uint16_t timestamp_msec;
+    uint64_t peer_timestamp_sec;
+    uint16_t peer_timestamp_msec;
+    uint16_t num_blocks;
+} __attribute__((packed));
+
 #endif /* CORX_FILE_FORMAT_H */
@@ -0,0 +1,261 @@
+/**
+ * Corx File Reader
+ *
+ * Same assumptions as the writer (see corx_file_writer.cpp).
+ */
+
+#include "corx_file_reader.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include "bin_encoding.h"
+
+namespace corx {
+
+namespace {
+
+// Bounds-checked cursor over a memory buffer
+class Cursor {
+public:
+    Cursor(const char *data, size_t size) : data_(data), left_(size) {}
+
+    bool read(void *dest, size_t len) {
+        if (len > left_) {
+            return false;
+        }
+        memcpy(dest, data_, len);
+        skip(len);
+        return true;
+    }
+
+    void skip(size_t len) {
+        data_ += len;
+        left_ -= len;
+    }
+
+    bool eof() const { return left_ == 0; }
+
+private:
+    const char *data_;
+    size_t left_;
+};
+
+// Read and validate the signature and file header from a source that
+// provides read(dest, len)
+template <typename Source>
+void read_file_header(Source &source,
+                      const std::string &name,
+                      uint8_t &version,
+                      CorxFileHeader &header,
+                      uint8_t &encoding,
+                      bool &segment_metrics) {
+    char signature[4];
+    if (!source.read(signature, 4) || memcmp(signature, "CORX", 4) != 0) {
+        throw std::runtime_error("Invalid .corx signature: " + name);
+    }
+    if (!source.read(&version, 1) ||
+            (version != CORX_VERSION_1 && version != CORX_VERSION_2)) {
+        throw std::runtime_error("Unsupported .corx version: " + name);
+    }
+    if (!source.read(&header, sizeof(header))) {
+        throw std::runtime_error("Truncated .corx header: " + name);
+    }
+    encoding = CORX_ENCODING_FLOAT32;
+    segment_metrics = false;
+    if (version >= CORX_VERSION_2) {
+        if (!source.read(&encoding, 1)) {
+            throw std::runtime_error("Truncated .corx header: " + name);
+        }
+        segment_metrics = (encoding & CORX_ENCODING_METRICS) != 0;
+        encoding &= ~CORX_ENCODING_METRICS;
+        if (bin_encoding_size(encoding) == 0) {
+            throw std::runtime_error("Invalid .corx bin encoding: " + name);
+        }
+    }
+}
+
+} // namespace
+
+
+// Decodes cycles from a source that provides read(dest, len)
+class CycleDecoder {
+public:
+    CycleDecoder(size_t slice_size, uint8_t encoding, bool segment_metrics)
+        : slice_size_(slice_size),
+          encoding_(encoding),
+          has_scale_(bin_encoding_has_scale(encoding)),
+          has_metrics_(segment_metrics),
+          bins_(slice_size * bin_encoding_size(encoding)) {}
+
+    // Returns false if the cycle is truncated
+    template <typename Source>
+    bool read(Source &source, CorxCycle &cycle) {
+        if (!source.read(&cycle.header, sizeof(cycle.header))) {
+            return false;
+        }
+
+        while (true) {
+            int8_t phase_error;
+            if (!source.read(&phase_error, 1)) {
+                return false;
+            }
+            if (phase_error == -128) {
+                return true;  // end of cycle
+            }
+
+            float scale = 1;
+            if (has_scale_ && !source.read(&scale, sizeof(scale))) {
+                return false;
+            }
+            CorxSegmentMetrics metrics;
+            if (has_metrics_ && !source.read(&metrics, sizeof(metrics))) {
+                return false;
+            }
+            if (!source.read(bins_.data(), bins_.size())) {
+                return false;
+            }
+
+            size_t offset = cycle.data.size();
+            cycle.data.resize(offset + slice_size_);
+            decode_bins(encoding_, cycle.data.data() + offset, bins_.data(),
+                        slice_size_, scale);
+            cycle.phase_errors.push_back(phase_error);
+            if (has_metrics_) {
+                cycle.metrics.push_back(metrics);
+            }
+        }
+    }
+
+private:
+    size_t slice_size_;
+    uint8_t encoding_;
+    bool has_scale_;
+    bool has_metrics_;
+    std::vector<char> bins_;
+};
+
+
+void CorxFileReader::load(const std::string &path) {
+    std::unique_ptr<FILE, decltype(&fclose)> file(fopen(path.c_str(), "rb"),
+                                                  &fclose);
+    if (!file) {
+        throw std::runtime_error("Could not open " + path + ": "
+                                 + strerror(errno));
+    }
+
+    std::vector<char> buffer;
+    char chunk[1 << 16];
+    size_t len;
+    while ((len = fread(chunk, 1, sizeof(chunk), file.get())) > 0) {
+        buffer.insert(buffer.end(), chunk, chunk + len);
+    }
+    if (ferror(file.get())) {
+        throw std::runtime_error("Could not read " + path);
+    }
+
+    path_ = path;
+    parse(buffer.data(), buffer.size());
+}
+
+void CorxFileReader::parse(const char *data, size_t size) {
+    Cursor cursor(data, size);
+    read_file_header(cursor, path_, version_, header_, encoding_,
+                     segment_metrics_);
+
+    CycleDecoder decoder(header_.slice_size, encoding_, segment_metrics_);
+    cycles_.clear();
+    while (!cursor.eof()) {
+        CorxCycle cycle;
+        if (!decoder.read(cursor, cycle)) {
+            fprintf(stderr, "Warning: ignoring truncated cycle at the end "
+                            "of %s\n", path_.c_str());
+            break;
+        }
+        cycles_.push_back(std::move(cycle));
+    }
+}
+
+
+CorxStreamReader::CorxStreamReader(int fd, const std::string &name)
+    : fd_(fd), name_(name), version_(0), encoding_(CORX_ENCODING_FLOAT32),
+      segment_metrics_(false), buffer_(1 << 16), pos_(0), len_(0), eof_(false) {}
+
+CorxStreamReader::~CorxStreamReader() {}
+
+void CorxStreamReader::readHeader() {
+    read_file_header(*this, name_, version_, header_, encoding_,
+                     segment_metrics_);
+    decoder_.reset(new CycleDecoder(header_.slice_size, encoding_,
+                                    segment_metrics_));
+}
+
+bool CorxStreamReader::next(CorxCycle &cycle) {
+    assert(decoder_);
+    if (!fill(1)) {
+        return false;  // end of stream
+    }
+    if (!decoder_->read(*this, cycle)) {
+        fprintf(stderr, "Warning: ignoring truncated cycle at the end "
+                        "of %s\n", name_.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool CorxStreamReader::read(void *dest, size_t len) {
+    char *out = static_cast<char*>(dest);
+    while (len > 0) {
+        if (!fill(1)) {
+            return false;
+        }
+        size_t n = std::min(len, len_ - pos_);
+        memcpy(out, buffer_.data() + pos_, n);
+        pos_ += n;
+        out += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool CorxStreamReader::fill(size_t len) {
+    if (len_ - pos_ >= len) {
+        return true;
+    }
+    if (eof_) {
+        return false;
+    }
+    if (pos_ > 0) {
+        memmove(buffer_.data(), buffer_.data() + pos_, len_ - pos_);
+        len_ -= pos_;
+        pos_ = 0;
+    }
+    if (buffer_.size() < len) {
+        buffer_.resize(len);
+    }
+    while (len_ < len) {
+        ssize_t r = ::read(fd_, buffer_.data() + len_, buffer_.size() - len_);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            if (r < 0) {
+                fprintf(stderr, "Warning: read error on %s: %s\n",
+                        name_.c_str(), strerror(errno));
+            }
+            eof_ = true;
+            return false;
+        }
+        len_ += r;
+    }
+    return true;
+}
+
+} // namespace corx
@@ -0,0 +1,113 @@
+#ifndef CORX_FILE_READER_H
+#define CORX_FILE_READER_H
+
+#include <complex>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "corx_file_format.h"
+
+namespace corx {
+
+class CycleDecoder;
+
+// A cycle of correlation blocks following a beacon detection
+struct CorxCycle {
+    CorxBeaconHeader header;
+    // Quantized phase error of each block
+    std::vector<int8_t> phase_errors;
+    // Quality metrics of each block (empty if the file has none)
+    std::vector<CorxSegmentMetrics> metrics;
+    // Decoded FFT bins of all blocks (num_blocks() * slice size)
+    std::vector<std::complex<float>> data;
+
+    size_t num_blocks() const { return phase_errors.size(); }
+};
+
+// Reads and decodes a complete .corx file (version 1 or 2) into memory.
+// Throws std::runtime_error if the file cannot be read or is invalid.
+class CorxFileReader {
+public:
+    CorxFileReader()
+        : version_(0), encoding_(CORX_ENCODING_FLOAT32),
+          segment_metrics_(false) {}
+
+    // Read the file at the given path
+    void load(const std::string &path);
+
+    // Parse .corx data from a memory buffer
+    void parse(const char *data, size_t size);
+
+    const std::string& path() const { return path_; }
+    const CorxFileHeader& header() const { return header_; }
+    uint8_t version() const { return version_; }
+    uint8_t encoding() const { return encoding_; }
+    // Whether the blocks store quality metrics (CORX_ENCODING_METRICS)
+    bool has_segment_metrics() const { return segment_metrics_; }
+    size_t slice_size() const { return header_.slice_size; }
+
+    const std::vector<CorxCycle>& cycles() const { return cycles_; }
+
+    const std::complex<float>* block(const CorxCycle &cycle,
+                                     size_t idx) const {
+        return cycle.data.data() + idx * header_.slice_size;
+    }
+
+private:
+    std::string path_;
+    CorxFileHeader header_;
+    uint8_t version_;
+    uint8_t encoding_;
+    bool segment_metrics_;
+    std::vector<CorxCycle> cycles_;
+};
+
+// Reads a .corx stream cycle by cycle from a file descriptor, e.g. a socket
+// (see corx_stream.h). Throws std::runtime_error if the header is invalid.
+class CorxStreamReader {
+public:
+    // The name is only used in messages
+    CorxStreamReader(int fd, const std::string &name);
+    ~CorxStreamReader();
+
+    // Read the signature and file header. Blocks until they are received.
+    void readHeader();
+
+    // Read the next complete cycle. Returns false at the end of the stream.
+    bool next(CorxCycle &cycle);
+
+    const CorxFileHeader& header() const { return header_; }
+    uint8_t version() const { return version_; }
+    uint8_t encoding() const { return encoding_; }
+    // Whether the blocks store quality metrics (CORX_ENCODING_METRICS)
+    bool has_segment_metrics() const { return segment_metrics_; }
+    size_t slice_size() const { return header_.slice_size; }
+
+    // Read exactly len bytes. Returns false at the end of the stream.
+    bool read(void *dest, size_t len);
+
+private:
+    // Make sure len bytes are buffered
+    bool fill(size_t len);
+
+    int fd_;
+    std::string name_;
+    CorxFileHeader header_;
+    uint8_t version_;
+    uint8_t encoding_;
+    bool segment_metrics_;
+    std::unique_ptr<CycleDecoder> decoder_;
+
+    std::vector<char> buffer_;
+    size_t pos_;
+    size_t len_;
+    bool eof_;
+};
+
+} // namespace corx
+
+#endif /* CORX_FILE_READER_H */
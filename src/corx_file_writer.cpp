@@ -9,28 +9,145 @@
  * TODO: better portability (e.g. do not memcpy structs)
  */
 
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include "corx_file_writer.h"
+#include "bin_encoding.h"
 
 namespace corx {
 
+CorxFileWriter::CorxFileWriter(CFile&& out,
+                               const CorxWriterOptions &options)
+    : out_(std::move(out)),
+      fd_(out_.file() ? fileno(out_.file()) : -1),
+      socket_(false) {
+    init(options);
+}
+
+CorxFileWriter::CorxFileWriter(int socket_fd,
+                               const CorxWriterOptions &options)
+    : fd_(socket_fd),
+      socket_(true) {
+    CorxWriterOptions stream_options = options;
+    stream_options.async = true;
+    stream_options.direct_io = false;
+    init(stream_options);
+}
+
+void CorxFileWriter::init(const CorxWriterOptions &options) {
+    slice_size_ = 0;
+    version_ = (options.encoding == CORX_ENCODING_FLOAT32 ? CORX_VERSION_1
+                                                          : CORX_VERSION_2);
+    encoding_ = options.encoding;
+    segment_metrics_ = options.segment_metrics;
+    if (segment_metrics_) {
+        version_ = CORX_VERSION_2;
+    }
+    if (options.integrated) {
+        version_ = CORX_VERSION_3;
+        encoding_ = CORX_ENCODING_FLOAT32;
+        segment_metrics_ = false;
+    }
+    device_index_ = options.device_index;
+    placement_ = options.placement;
+    buffer_size_ = 0;
+    align_ = sysconf(_SC_PAGESIZE);
+    direct_io_ = false;
+    seekable_ = false;
+    current_ = nullptr;
+    next_offset_ = 0;
+    carry_len_ = 0;
+    direct_active_ = false;
+    writer_stalls_ = 0;
+    bytes_written_ = 0;
+    write_errors_ = 0;
+    disconnected_ = false;
+    bytes_submitted_ = 0;
+
+    if (!options.async || is_void()) {
+        return;
+    }
+
+    int fd = fd_;
+    off_t pos = socket_ ? (off_t)-1 : lseek(fd, 0, SEEK_CUR);
+    seekable_ = (pos != (off_t)-1);
+    next_offset_ = seekable_ ? pos : 0;
+
+    if (options.direct_io) {
+        if (!seekable_) {
+            fprintf(stderr, "Warning: O_DIRECT is not supported for "
+                            "non-seekable output\n");
+        } else if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_DIRECT) != 0) {
+            fprintf(stderr, "Warning: could not enable O_DIRECT: %s\n",
+                    strerror(errno));
+        } else {
+            direct_io_ = true;
+            direct_active_ = true;
+            carry_.reset(new char[align_]);
+        }
+    }
+
+    buffer_size_ = ((std::max(options.buffer_size, align_) + align_ - 1)
+                    / align_ * align_);
+    queue_.reset(new SpscRing<Chunk>(std::max(options.queue_depth,
+                                              (size_t)2)));
+    for (size_t i = 0; i < queue_->capacity(); ++i) {
+        Chunk &chunk = queue_->slot(i);
+        if (posix_memalign(reinterpret_cast<void**>(&chunk.data),
+                           align_, buffer_size_) != 0) {
+            throw std::bad_alloc();
+        }
+        chunk.len = 0;
+        chunk.offset = 0;
+        chunk.stop = false;
+    }
+    thread_ = std::thread(&CorxFileWriter::run_writer, this);
+}
+
+CorxFileWriter::~CorxFileWriter() {
+    if (queue_) {
+        publish_chunk(true);
+        thread_.join();
+        for (size_t i = 0; i < queue_->capacity(); ++i) {
+            free(queue_->slot(i).data);
+        }
+    }
+    if (socket_) {
+        close(fd_);
+    }
+}
+
 void CorxFileWriter::write_file_header(const CorxFileHeader &header) {
     if (is_void()) {
         return;
     }
 
     // output file signature
-    fprintf(out_.file(), "CORX");
+    write("CORX", 4);
 
     // output file format version
-    fputc(version, out_.file());
+    write(&version_, 1);
 
     // output file header
-    fwrite(reinterpret_cast<const char*>(&header),
-           sizeof(header),
-           1,
-           out_.file());
+    write(&header, sizeof(header));
+    if (version_ == CORX_VERSION_3) {
+        write(&device_index_, sizeof(device_index_));
+    } else if (version_ == CORX_VERSION_2) {
+        uint8_t encoding = (encoding_
+                            | (segment_metrics_ ? CORX_ENCODING_METRICS : 0));
+        write(&encoding, 1);
+        encoded_.reset(
+                new char[header.slice_size * bin_encoding_size(encoding_)]);
+    }
 
     slice_size_ = header.slice_size;
 }
@@ -41,22 +158,23 @@ void CorxFileWriter::write_cycle_start(const CorxBeaconHeader &header) {
         return;
     }
 
-    fwrite(reinterpret_cast<const char*>(&header),
-           sizeof(header),
-           1,
-           out_.file());
+    assert(version_ != CORX_VERSION_3);
+    write(&header, sizeof(header));
 }
 
 void CorxFileWriter::write_cycle_block(int8_t phase_error,
                        const std::complex<float> *data,
-                       uint16_t len) {
+                       uint16_t len,
+                       const CorxSegmentMetrics *metrics) {
     if (is_void()) {
         return;
     }
 
+    assert(version_ != CORX_VERSION_3);
     assert(len == slice_size_);
     assert(phase_error != -128);
-    write_cycle_block_internal(phase_error, data, len);
+    assert((metrics != nullptr) == segment_metrics_);
+    write_cycle_block_internal(phase_error, data, len, metrics);
 }
 
 void CorxFileWriter::write_cycle_stop() {
@@ -65,18 +183,249 @@ void CorxFileWriter::write_cycle_stop() {
     }
 
     // indicate end of cycle
-    write_cycle_block_internal(-128, NULL, 0);
+    assert(version_ != CORX_VERSION_3);
+    write_cycle_block_internal(-128, NULL, 0, NULL);
+}
+
+void CorxFileWriter::write_auto_record(
+        const CorxBeaconHeader &header,
+        const CorxIntegrationHeader &integration,
+        const float *power,
+        uint16_t len) {
+    if (is_void()) {
+        return;
+    }
+
+    assert(version_ == CORX_VERSION_3);
+    assert(len == slice_size_);
+    uint8_t type = CORX_RECORD_AUTO;
+    write(&type, 1);
+    write(&header, sizeof(header));
+    write(&integration, sizeof(integration));
+    write(power, sizeof(float) * len);
+}
+
+void CorxFileWriter::write_cross_record(const CorxCrossHeader &header,
+                                        const std::complex<float> *xcorr,
+                                        uint16_t len) {
+    if (is_void()) {
+        return;
+    }
+
+    assert(version_ == CORX_VERSION_3);
+    assert(len == slice_size_);
+    uint8_t type = CORX_RECORD_CROSS;
+    write(&type, 1);
+    write(&header, sizeof(header));
+    write(xcorr, sizeof(std::complex<float>) * len);
+}
+
+void CorxFileWriter::flush() {
+    if (is_void()) {
+        return;
+    }
+    if (!queue_) {
+        fflush(out_.file());
+    } else if (current_ != nullptr && current_->len > 0) {
+        publish_chunk(false);
+    }
+}
+
+void CorxFileWriter::print_stats(FILE* out) const {
+    if (!queue_) {
+        return;
+    }
+    fprintf(out,
+            "Async writer: %llu bytes written%s; "
+            "%llu DSP stalls (writer back-pressure); %llu write errors\n",
+            (unsigned long long)bytes_written_.load(),
+            direct_active_ ? " (O_DIRECT)" : "",
+            (unsigned long long)writer_stalls_.load(),
+            (unsigned long long)write_errors_.load());
 }
 
 void CorxFileWriter::write_cycle_block_internal(int8_t phase_error,
                                 const std::complex<float> *data,
-                                uint16_t len) {
-    fputc(phase_error, out_.file());
+                                uint16_t len,
+                                const CorxSegmentMetrics *metrics) {
+    write(&phase_error, 1);
+    if (len == 0) {
+        return;
+    }
+
+    if (encoding_ == CORX_ENCODING_FLOAT32) {
+        if (metrics != NULL) {
+            write(metrics, sizeof(*metrics));
+        }
+        write(data, sizeof(std::complex<float>) * len);
+    } else {
+        float scale = encode_bins(encoding_, encoded_.get(), data, len);
+        if (bin_encoding_has_scale(encoding_)) {
+            write(&scale, sizeof(scale));
+        }
+        if (metrics != NULL) {
+            write(metrics, sizeof(*metrics));
+        }
+        write(encoded_.get(), bin_encoding_size(encoding_) * len);
+    }
+}
+
+void CorxFileWriter::write(const void *data, size_t len) {
+    bytes_submitted_ += len;
+    if (!queue_) {
+        fwrite(data, 1, len, out_.file());
+        return;
+    }
+
+    const char *src = static_cast<const char*>(data);
+    while (len > 0) {
+        Chunk &chunk = current_chunk();
+        size_t n = std::min(len, buffer_size_ - chunk.len);
+        memcpy(chunk.data + chunk.len, src, n);
+        chunk.len += n;
+        src += n;
+        len -= n;
+        if (chunk.len == buffer_size_) {
+            publish_chunk(false);
+        }
+    }
+}
+
+CorxFileWriter::Chunk& CorxFileWriter::current_chunk() {
+    if (current_ == nullptr) {
+        current_ = queue_->acquire();
+        if (current_ == nullptr) {
+            writer_stalls_++;
+            unsigned attempt = 0;
+            while ((current_ = queue_->acquire()) == nullptr) {
+                spsc_backoff(attempt);
+            }
+        }
+        current_->len = 0;
+        current_->offset = next_offset_;
+        current_->stop = false;
+
+        if (carry_len_ > 0) {
+            memcpy(current_->data, carry_.get(), carry_len_);
+            current_->len = carry_len_;
+            carry_len_ = 0;
+        }
+    }
+    return *current_;
+}
+
+void CorxFileWriter::publish_chunk(bool stop) {
+    Chunk &chunk = current_chunk();
+    chunk.stop = stop;
+
+    size_t tail = direct_io_ ? chunk.len % align_ : 0;
+    if (tail > 0 && !stop) {
+        // O_DIRECT writes whole pages: the next chunk starts at the last
+        // page boundary and rewrites the unaligned tail of this chunk.
+        memcpy(carry_.get(), chunk.data + chunk.len - tail, tail);
+        carry_len_ = tail;
+    }
+    next_offset_ = chunk.offset + chunk.len - tail;
+
+    queue_->publish();
+    current_ = nullptr;
+}
+
+void CorxFileWriter::run_writer() {
+    // (always applied, since the thread inherits the placement of its
+    //  creator; only reported if it is not the default placement)
+    apply_thread_placement(placement_, "",
+                           placement_.isDefault() ? nullptr : stdout);
+    int fd = fd_;
+    off_t file_size = next_offset_;
+
+    while (true) {
+        unsigned attempt = 0;
+        Chunk *chunk;
+        while ((chunk = queue_->front()) == nullptr) {
+            spsc_backoff(attempt);
+        }
+
+        if (chunk->len > 0) {
+            if (write_chunk(*chunk)) {
+                bytes_written_ += chunk->len;
+            } else {
+                write_errors_++;
+            }
+            file_size = chunk->offset + chunk->len;
+        }
+        bool stop = chunk->stop;
+        queue_->pop();
+
+        if (stop) {
+            break;
+        }
+    }
+
+    if (direct_io_) {
+        // remove padding of the last page
+        if (ftruncate(fd, file_size) != 0) {
+            fprintf(stderr, "Warning: could not truncate output file: %s\n",
+                    strerror(errno));
+        }
+    }
+    if (seekable_) {
+        // keep the stdio stream position consistent for fclose
+        lseek(fd, file_size, SEEK_SET);
+    }
+}
 
-    fwrite(data,
-           sizeof(std::complex<float>),
-           len,
-           out_.file());
+bool CorxFileWriter::write_chunk(const Chunk &chunk) {
+    int fd = fd_;
+    size_t len = chunk.len;
+    if (disconnected_) {
+        return false;
+    }
+    if (direct_active_ && len % align_ != 0) {
+        // pad to a whole page (truncated when the file is closed)
+        size_t padded = (len + align_ - 1) / align_ * align_;
+        memset(chunk.data + len, 0, padded - len);
+        len = padded;
+    }
+
+    size_t done = 0;
+    while (done < len) {
+        ssize_t r;
+        if (seekable_) {
+            r = pwrite(fd, chunk.data + done, len - done,
+                       chunk.offset + done);
+        } else if (socket_) {
+            // do not raise SIGPIPE if the correlator goes away
+            r = send(fd, chunk.data + done, len - done, MSG_NOSIGNAL);
+        } else {
+            r = ::write(fd, chunk.data + done, len - done);
+        }
+
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r < 0 && errno == EINVAL && direct_active_) {
+            // file system does not support O_DIRECT (e.g. tmpfs)
+            // (the page-aligned chunk layout is kept, which is harmless)
+            fprintf(stderr, "Warning: O_DIRECT write failed; "
+                            "falling back to buffered I/O\n");
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+            direct_active_ = false;
+            continue;
+        }
+        if (r <= 0) {
+            fprintf(stderr, "Warning: write error: %s\n",
+                    r < 0 ? strerror(errno) : "no progress");
+            if (socket_) {
+                // drop the rest of the stream, but keep capturing
+                fprintf(stderr, "Warning: stream disconnected\n");
+                disconnected_ = true;
+            }
+            return false;
+        }
+        done += r;
+    }
+    return true;
 }
 
 } // namespace corx
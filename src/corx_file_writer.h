@@ -1,33 +1,155 @@
 #ifndef CORX_FILE_WRITER_H
 #define CORX_FILE_WRITER_H
 
+#include <atomic>
 #include <complex>
+#include <memory>
+#include <thread>
+#include <sys/types.h>
 #include <fastdet/fastcard_wrappers.h>
 #include "corx_file_format.h"
+#include "spsc_ring.h"
+#include "thread_placement.h"
 
 namespace corx {
 
+// Output settings of CorxFileWriter
+struct CorxWriterOptions {
+    // Collect output in large page-aligned buffers that are written to the
+    // file by a background thread, i.e. the caller never blocks on file I/O
+    // unless all buffers are in flight.
+    bool async;
+    // Number of buffers (async mode only; at least two for double buffering)
+    size_t queue_depth;
+    // Size of each buffer in bytes (rounded up to a multiple of the page size)
+    size_t buffer_size;
+    // Bypass the page cache using O_DIRECT (async mode only)
+    bool direct_io;
+    // Encoding of the FFT bins (CORX_ENCODING_*). Files are written in the
+    // version 1 format for float32 and in the version 2 format otherwise.
+    uint8_t encoding;
+    // Write integrated records in the version 3 format instead of the
+    // segment spectra (the encoding is not used; sums are stored as floats)
+    bool integrated;
+    // Device index stored in the version 3 file header
+    int16_t device_index;
+    // Store the quality metrics of every block (version 2 format with
+    // CORX_ENCODING_METRICS, also for float32)
+    bool segment_metrics;
+    // CPUs and scheduling policy of the background thread (async mode only)
+    ThreadPlacement placement;
+
+    CorxWriterOptions()
+        : async(false), queue_depth(4), buffer_size(1 << 20),
+          direct_io(false), encoding(CORX_ENCODING_FLOAT32),
+          integrated(false), device_index(-1), segment_metrics(false) {}
+};
+
 class CorxFileWriter {
   public:
-    CorxFileWriter(CFile&& out)
-        : out_(std::move(out)), slice_size_(0) {};
+    CorxFileWriter(CFile&& out,
+                   const CorxWriterOptions &options = CorxWriterOptions());
+    // Stream to a connected socket (see corx_stream.h). Takes ownership of
+    // the socket. Always uses the async mode so that the caller never
+    // blocks on the network.
+    CorxFileWriter(int socket_fd,
+                   const CorxWriterOptions &options = CorxWriterOptions());
+    ~CorxFileWriter();
 
     void write_file_header(const CorxFileHeader &header);
     void write_cycle_start(const CorxBeaconHeader &header);
+    // metrics must be given if and only if segment metrics are enabled
     void write_cycle_block(int8_t phase_error,
                            const std::complex<float> *data,
-                           uint16_t len);
+                           uint16_t len,
+                           const CorxSegmentMetrics *metrics = nullptr);
     void write_cycle_stop();
-    bool is_void() { return out_.file() == nullptr; }
+    // Integrated records (version 3 only)
+    void write_auto_record(const CorxBeaconHeader &header,
+                           const CorxIntegrationHeader &integration,
+                           const float *power,
+                           uint16_t len);
+    void write_cross_record(const CorxCrossHeader &header,
+                            const std::complex<float> *xcorr,
+                            uint16_t len);
+    bool is_void() { return out_.file() == nullptr && !socket_; }
+
+    // Hand buffered output to the background thread (async mode) or flush
+    // the stdio buffer (sync mode). Does not wait for the write to complete.
+    void flush();
+
+    // Print back-pressure stats of the writer stage.
+    void print_stats(FILE* out) const;
+
+    // Number of bytes handed to the writer (caller thread only)
+    uint64_t bytes_submitted() const { return bytes_submitted_; }
 
   private:
+    void init(const CorxWriterOptions &options);
     void write_cycle_block_internal(int8_t phase_error,
                                     const std::complex<float> *data,
-                                    uint16_t len);
+                                    uint16_t len,
+                                    const CorxSegmentMetrics *metrics);
+
+    // Append data to the output stream
+    void write(const void *data, size_t len);
+
+    // -- Background writer (async mode)
+    struct Chunk {
+        char *data;     // page-aligned buffer of buffer_size_ bytes
+        size_t len;     // number of valid bytes
+        off_t offset;   // file offset of the first byte
+        bool stop;      // writer thread should exit after this chunk
+    };
+
+    // Get the chunk currently being filled; waits for a free chunk if the
+    // writer thread is back-pressuring.
+    Chunk& current_chunk();
+    void publish_chunk(bool stop);
+    void run_writer();
+    bool write_chunk(const Chunk &chunk);
 
     CFile out_;
+    // Output file descriptor (async mode)
+    int fd_;
+    // Output is a socket owned by the writer
+    bool socket_;
     int slice_size_;
-    const static uint8_t version = 0x01;
+    uint8_t version_;
+    uint8_t encoding_;
+    bool segment_metrics_;
+    int16_t device_index_;
+    ThreadPlacement placement_;
+    // Encoded bins of a single block (version 2 only)
+    std::unique_ptr<char[]> encoded_;
+
+    size_t buffer_size_;
+    size_t align_;
+    bool direct_io_;
+    bool seekable_;
+    std::unique_ptr<SpscRing<Chunk>> queue_;
+    Chunk *current_;
+    std::thread thread_;
+
+    // File offset of the next chunk
+    off_t next_offset_;
+    // Unaligned tail of a partially written chunk that has to be rewritten
+    // at the start of the next chunk (O_DIRECT only)
+    std::unique_ptr<char[]> carry_;
+    size_t carry_len_;
+    // O_DIRECT is in effect (cleared by the writer thread if unsupported)
+    std::atomic<bool> direct_active_;
+
+    // Number of times the caller had to wait for the writer thread.
+    std::atomic<uint64_t> writer_stalls_;
+    // Number of bytes written to the file by the writer thread.
+    std::atomic<uint64_t> bytes_written_;
+    // Number of failed writes.
+    std::atomic<uint64_t> write_errors_;
+    // The peer closed the connection (socket only)
+    bool disconnected_;
+    // Number of bytes passed to write()
+    uint64_t bytes_submitted_;
 };
 
 } // namespace corx
@@ -0,0 +1,78 @@
+#include "corx_mmap.h"
+
+#include <exception>
+#include <string>
+
+#include "corx_mmap_reader.h"
+
+using corx::CorxMmapReader;
+
+struct corx_mmap {
+    CorxMmapReader reader;
+};
+
+static thread_local std::string last_error;
+
+corx_mmap_t* corx_mmap_open(const char *path, int use_sidecar) {
+    corx_mmap_t *corx = new corx_mmap_t();
+    try {
+        corx->reader.open(path, use_sidecar != 0);
+    } catch (const std::exception &e) {
+        last_error = e.what();
+        delete corx;
+        return nullptr;
+    }
+    return corx;
+}
+
+void corx_mmap_close(corx_mmap_t *corx) {
+    delete corx;
+}
+
+const char* corx_mmap_error(void) {
+    return last_error.c_str();
+}
+
+int corx_mmap_version(const corx_mmap_t *corx) {
+    return corx->reader.version();
+}
+
+int corx_mmap_encoding(const corx_mmap_t *corx) {
+    return corx->reader.encoding();
+}
+
+int corx_mmap_segment_metrics(const corx_mmap_t *corx) {
+    return corx->reader.has_segment_metrics() ? 1 : 0;
+}
+
+int corx_mmap_slice_start(const corx_mmap_t *corx) {
+    return corx->reader.header().slice_start_idx;
+}
+
+int corx_mmap_slice_size(const corx_mmap_t *corx) {
+    return corx->reader.header().slice_size;
+}
+
+const char* corx_mmap_data(const corx_mmap_t *corx) {
+    return corx->reader.data();
+}
+
+size_t corx_mmap_size(const corx_mmap_t *corx) {
+    return corx->reader.size();
+}
+
+size_t corx_mmap_num_cycles(const corx_mmap_t *corx) {
+    return corx->reader.num_cycles();
+}
+
+const void* corx_mmap_index(const corx_mmap_t *corx) {
+    return corx->reader.index().data();
+}
+
+size_t corx_mmap_block_stride(const corx_mmap_t *corx) {
+    return corx->reader.block_stride();
+}
+
+size_t corx_mmap_bins_offset(const corx_mmap_t *corx) {
+    return corx->reader.bins_offset();
+}
@@ -0,0 +1,50 @@
+/**
+ * C API of the memory-mapped .corx reader (libcorx_mmap), e.g. for the Python
+ * bindings in corx_mmap.py. See corx_mmap_reader.h.
+ */
+
+#ifndef CORX_MMAP_H
+#define CORX_MMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct corx_mmap corx_mmap_t;
+
+// Open and index a .corx file. Returns NULL on failure, see corx_mmap_error.
+corx_mmap_t* corx_mmap_open(const char *path, int use_sidecar);
+void corx_mmap_close(corx_mmap_t *corx);
+
+// Error message of the last failed corx_mmap_open of the calling thread
+const char* corx_mmap_error(void);
+
+int corx_mmap_version(const corx_mmap_t *corx);
+int corx_mmap_encoding(const corx_mmap_t *corx);
+// Non-zero if every block stores a CorxSegmentMetrics right before its bins
+int corx_mmap_segment_metrics(const corx_mmap_t *corx);
+int corx_mmap_slice_start(const corx_mmap_t *corx);
+int corx_mmap_slice_size(const corx_mmap_t *corx);
+
+// The mapped file
+const char* corx_mmap_data(const corx_mmap_t *corx);
+size_t corx_mmap_size(const corx_mmap_t *corx);
+
+// Cycle index: num_cycles packed entries of
+// {uint64_t beacon header offset, uint32_t number of blocks}
+size_t corx_mmap_num_cycles(const corx_mmap_t *corx);
+const void* corx_mmap_index(const corx_mmap_t *corx);
+
+// Block layout: the first block of a cycle follows its beacon header, and
+// the bins start at bins_offset within each block
+size_t corx_mmap_block_stride(const corx_mmap_t *corx);
+size_t corx_mmap_bins_offset(const corx_mmap_t *corx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CORX_MMAP_H */
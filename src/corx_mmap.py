@@ -0,0 +1,236 @@
+"""Zero-copy access to .corx files through libcorx_mmap (see corx_mmap.h).
+
+The file is memory-mapped and indexed once (the index is cached in a
+<file>.idx sidecar). Cycles can then be accessed at random and their blocks
+are returned as numpy views into the mapping. The mapping stays valid as long
+as any of the returned views is alive.
+
+The library is searched for in $CORX_MMAP_LIB, next to this module, in
+build/ and in the system library path.
+"""
+
+from __future__ import print_function
+from __future__ import division
+
+import ctypes
+import ctypes.util
+import os
+import struct
+
+import numpy as np
+
+from corx_reader import (BEACON_HEADER_FMT, BeaconHeader, FileHeader,
+                         ENCODING_FLOAT32, ENCODING_INT16, ENCODING_INT8,
+                         ENCODING_DTYPES)
+
+BEACON_HEADER_DTYPE = np.dtype([
+    ('soa', '<f8'),
+    ('timestamp_sec', '<u8'),
+    ('timestamp_msec', '<u2'),
+    ('beacon_amplitude', '<u4'),
+    ('beacon_noise', '<u4'),
+    ('clock_error', '<f4'),
+    ('carrier_pos', '<f4'),
+    ('carrier_amplitude', '<u4'),
+    ('preamp_on', '?'),
+])
+BEACON_HEADER_SIZE = struct.calcsize(BEACON_HEADER_FMT)
+assert(BEACON_HEADER_DTYPE.itemsize == BEACON_HEADER_SIZE)
+
+INDEX_DTYPE = np.dtype([('offset', '<u8'), ('num_blocks', '<u4')])
+
+# CorxSegmentMetrics (see corx_file_format.h)
+SEGMENT_METRICS_DTYPE = np.dtype([
+    ('slice_power', '<i2'),
+    ('snr', 'i1'),
+    ('phase_std', 'u1'),
+])
+
+_lib = None
+
+
+def _load_library():
+    global _lib
+    if _lib is not None:
+        return _lib
+
+    here = os.path.dirname(os.path.abspath(__file__))
+    candidates = [os.environ.get('CORX_MMAP_LIB'),
+                  os.path.join(here, 'libcorx_mmap.so'),
+                  os.path.join(here, 'build', 'libcorx_mmap.so'),
+                  ctypes.util.find_library('corx_mmap')]
+    for candidate in candidates:
+        if not candidate:
+            continue
+        try:
+            lib = ctypes.CDLL(candidate)
+            break
+        except OSError:
+            pass
+    else:
+        raise OSError('libcorx_mmap not found (set CORX_MMAP_LIB)')
+
+    handle = ctypes.c_void_p
+    lib.corx_mmap_open.argtypes = [ctypes.c_char_p, ctypes.c_int]
+    lib.corx_mmap_open.restype = handle
+    lib.corx_mmap_close.argtypes = [handle]
+    lib.corx_mmap_close.restype = None
+    lib.corx_mmap_error.argtypes = []
+    lib.corx_mmap_error.restype = ctypes.c_char_p
+    for name in ('version', 'encoding', 'segment_metrics', 'slice_start',
+                 'slice_size'):
+        func = getattr(lib, 'corx_mmap_' + name)
+        func.argtypes = [handle]
+        func.restype = ctypes.c_int
+    for name in ('size', 'num_cycles', 'block_stride', 'bins_offset'):
+        func = getattr(lib, 'corx_mmap_' + name)
+        func.argtypes = [handle]
+        func.restype = ctypes.c_size_t
+    for name in ('data', 'index'):
+        func = getattr(lib, 'corx_mmap_' + name)
+        func.argtypes = [handle]
+        func.restype = ctypes.c_void_p
+
+    _lib = lib
+    return lib
+
+
+class CorxMmap(object):
+    def __init__(self, path, use_sidecar=True):
+        lib = _load_library()
+        self._lib = lib
+        self._handle = lib.corx_mmap_open(path.encode(), int(use_sidecar))
+        if not self._handle:
+            raise IOError(lib.corx_mmap_error().decode())
+
+        self.file_header = FileHeader(lib.corx_mmap_slice_start(self._handle),
+                                      lib.corx_mmap_slice_size(self._handle),
+                                      lib.corx_mmap_version(self._handle),
+                                      lib.corx_mmap_encoding(self._handle),
+                                      bool(lib.corx_mmap_segment_metrics(
+                                          self._handle)))
+        self.block_stride = lib.corx_mmap_block_stride(self._handle)
+        self.bins_offset = lib.corx_mmap_bins_offset(self._handle)
+
+        self.buffer = self._view(lib.corx_mmap_data(self._handle),
+                                 lib.corx_mmap_size(self._handle),
+                                 np.uint8)
+        num_cycles = lib.corx_mmap_num_cycles(self._handle)
+        self.index = self._view(lib.corx_mmap_index(self._handle),
+                                num_cycles * INDEX_DTYPE.itemsize,
+                                INDEX_DTYPE)
+
+    def _view(self, address, size, dtype):
+        if size == 0:
+            return np.zeros(0, dtype=dtype)
+        buf = (ctypes.c_char * size).from_address(address)
+        buf._owner = self  # keep the mapping alive while views exist
+        return np.frombuffer(buf, dtype=dtype)
+
+    def __del__(self):
+        if getattr(self, '_handle', None):
+            self._lib.corx_mmap_close(self._handle)
+            self._handle = None
+
+    def __len__(self):
+        return len(self.index)
+
+    def beacon_header(self, cycle):
+        return BeaconHeader._make(struct.unpack_from(
+            BEACON_HEADER_FMT, self.buffer, int(self.index[cycle]['offset'])))
+
+    def beacon_headers(self):
+        """Beacon headers of all cycles as a structured array (a copy)."""
+        offsets = self.index['offset'].astype(np.intp)
+        rows = offsets[:, None] + np.arange(BEACON_HEADER_SIZE)
+        return self.buffer[rows].view(BEACON_HEADER_DTYPE).ravel()
+
+    def _strided(self, cycle, offset, dtype, shape):
+        entry = self.index[cycle]
+        start = int(entry['offset']) + BEACON_HEADER_SIZE + offset
+        dtype = np.dtype(dtype)
+        return np.ndarray(shape=(int(entry['num_blocks']),) + shape,
+                          dtype=dtype, buffer=self.buffer, offset=start,
+                          strides=(self.block_stride,) +
+                          ((dtype.itemsize,) if shape else ()))
+
+    def phase_errors(self, cycle):
+        """Quantized phase errors of the blocks of a cycle (a view)."""
+        return self._strided(cycle, 0, np.int8, ())
+
+    def phase_errors_deg(self, cycle):
+        return self.phase_errors(cycle) / 127. / 2 * 360
+
+    def scales(self, cycle):
+        """Scale factors of the blocks of a cycle (int encodings, a view)."""
+        encoding = self.file_header.encoding
+        if encoding not in (ENCODING_INT16, ENCODING_INT8):
+            return np.ones(int(self.index[cycle]['num_blocks']), 'float32')
+        return self._strided(cycle, 1, '<f4', ())
+
+    def segment_metrics(self, cycle):
+        """Raw segment metrics of the blocks of a cycle (a view of
+        SEGMENT_METRICS_DTYPE), or None if the file has none. SNR and slice
+        power are stored in 0.5 and 0.01 dB, the phase error standard
+        deviation in 1/512 turns."""
+        if not self.file_header.segment_metrics:
+            return None
+        return self._strided(cycle,
+                             self.bins_offset - SEGMENT_METRICS_DTYPE.itemsize,
+                             SEGMENT_METRICS_DTYPE, ())
+
+    def raw_bins(self, cycle):
+        """Encoded bins of the blocks of a cycle (a view).
+
+        complex64 of shape (blocks, slice_size) for float32 files, or
+        interleaved real and imaginary parts for the other encodings.
+        """
+        slice_size = self.file_header.slice_size
+        encoding = self.file_header.encoding
+        if encoding == ENCODING_FLOAT32:
+            return self._strided(cycle, self.bins_offset, '<c8',
+                                 (slice_size,))
+        return self._strided(cycle, self.bins_offset,
+                             ENCODING_DTYPES[encoding], (2 * slice_size,))
+
+    def blocks(self, cycle):
+        """Bins of the blocks of a cycle as complex64 (blocks, slice_size).
+
+        A view for float32 files, decoded otherwise.
+        """
+        raw = self.raw_bins(cycle)
+        if self.file_header.encoding == ENCODING_FLOAT32:
+            return raw
+        data = raw.astype('float32')
+        data *= self.scales(cycle)[:, None]
+        return data.view('complex64')
+
+    def cycles(self):
+        for cycle in range(len(self)):
+            yield self.beacon_header(cycle), self.blocks(cycle)
+
+
+def _main():
+    import argparse
+    parser = argparse.ArgumentParser()
+    parser.add_argument('input', help=".corx file")
+    parser.add_argument('--no-sidecar', action='store_true',
+                        help="Do not read or write the .idx sidecar")
+    args = parser.parse_args()
+    corx = CorxMmap(args.input, not args.no_sidecar)
+
+    print('Slice start:', corx.file_header.slice_start)
+    print('Slice size:', corx.file_header.slice_size)
+    print('Version:', corx.file_header.version)
+    print('Encoding:', corx.file_header.encoding)
+    print('Segment metrics:', corx.file_header.segment_metrics)
+    print('Cycles:', len(corx))
+
+    for cycle in range(len(corx)):
+        print(corx.beacon_header(cycle))
+        for i, error in enumerate(corx.phase_errors_deg(cycle)):
+            print("Error in corr block #%d: %.0f deg" % (i, error))
+
+
+if __name__ == '__main__':
+    _main()
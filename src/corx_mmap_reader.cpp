@@ -0,0 +1,266 @@
+/**
+ * Memory-mapped Corx File Reader
+ *
+ * Same assumptions as the writer (see corx_file_writer.cpp).
+ */
+
+#include "corx_mmap_reader.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bin_encoding.h"
+
+namespace corx {
+
+namespace {
+
+// Sidecar index file format:
+//   "CXIX", uint32_t version, uint64_t corx file size, int64_t corx mtime (ns),
+//   uint64_t number of cycles, CorxCycleIndex[number of cycles]
+const char SIDECAR_SIGNATURE[4] = {'C', 'X', 'I', 'X'};
+const uint32_t SIDECAR_VERSION = 1;
+
+struct SidecarHeader {
+    char signature[4];
+    uint32_t version;
+    uint64_t file_size;
+    int64_t mtime;
+    uint64_t num_cycles;
+} __attribute__((packed));
+
+int64_t mtime_ns(const struct stat &st) {
+    return (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+} // namespace
+
+
+void CorxBlockView::decode(std::complex<float> *dest) const {
+    decode_bins(encoding, dest, bins, len, scale);
+}
+
+
+CorxMmapReader::CorxMmapReader()
+    : data_(nullptr), size_(0), mtime_(0), version_(0),
+      encoding_(CORX_ENCODING_FLOAT32), segment_metrics_(false),
+      data_offset_(0), block_stride_(0),
+      bins_offset_(0), index_from_sidecar_(false) {}
+
+CorxMmapReader::~CorxMmapReader() {
+    close();
+}
+
+void CorxMmapReader::open(const std::string &path, bool use_sidecar) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open " + path + ": "
+                                 + strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Could not stat " + path + ": "
+                                 + strerror(errno));
+    }
+
+    path_ = path;
+    size_ = st.st_size;
+    mtime_ = mtime_ns(st);
+    if (size_ > 0) {
+        void *addr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            ::close(fd);
+            size_ = 0;
+            throw std::runtime_error("Could not map " + path + ": "
+                                     + strerror(errno));
+        }
+        data_ = static_cast<const char*>(addr);
+    }
+    ::close(fd);
+
+    try {
+        parseHeader();
+        std::string sidecar = path + ".idx";
+        if (!use_sidecar || !loadSidecar(sidecar)) {
+            buildIndex();
+            if (use_sidecar) {
+                saveSidecar(sidecar);
+            }
+        }
+    } catch (...) {
+        close();
+        throw;
+    }
+}
+
+void CorxMmapReader::close() {
+    if (data_ != nullptr) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+    index_.clear();
+    index_from_sidecar_ = false;
+}
+
+CorxBlockView CorxMmapReader::block(size_t cycle, size_t idx) const {
+    const char *block = (data_ + index_[cycle].offset
+                         + sizeof(CorxBeaconHeader) + idx * block_stride_);
+    CorxBlockView view;
+    view.phase_error = *reinterpret_cast<const int8_t*>(block);
+    view.scale = 1;
+    if (bin_encoding_has_scale(encoding_)) {
+        memcpy(&view.scale, block + 1, sizeof(view.scale));
+    }
+    view.metrics = nullptr;
+    if (segment_metrics_) {
+        view.metrics = reinterpret_cast<const CorxSegmentMetrics*>(
+                block + bins_offset_ - sizeof(CorxSegmentMetrics));
+    }
+    view.bins = block + bins_offset_;
+    view.len = header_.slice_size;
+    view.encoding = encoding_;
+    return view;
+}
+
+void CorxMmapReader::parseHeader() {
+    size_t offset = 4 + 1 + sizeof(header_);
+    if (size_ < offset || memcmp(data_, "CORX", 4) != 0) {
+        throw std::runtime_error("Invalid .corx signature: " + path_);
+    }
+    version_ = data_[4];
+    if (version_ != CORX_VERSION_1 && version_ != CORX_VERSION_2) {
+        throw std::runtime_error("Unsupported .corx version: " + path_);
+    }
+    memcpy(&header_, data_ + 5, sizeof(header_));
+
+    encoding_ = CORX_ENCODING_FLOAT32;
+    segment_metrics_ = false;
+    if (version_ >= CORX_VERSION_2) {
+        if (size_ < offset + 1) {
+            throw std::runtime_error("Truncated .corx header: " + path_);
+        }
+        encoding_ = data_[offset++];
+        segment_metrics_ = (encoding_ & CORX_ENCODING_METRICS) != 0;
+        encoding_ &= ~CORX_ENCODING_METRICS;
+        if (bin_encoding_size(encoding_) == 0) {
+            throw std::runtime_error("Invalid .corx bin encoding: " + path_);
+        }
+    }
+
+    data_offset_ = offset;
+    bins_offset_ = 1 + (bin_encoding_has_scale(encoding_) ? sizeof(float) : 0);
+    if (segment_metrics_) {
+        bins_offset_ += sizeof(CorxSegmentMetrics);
+    }
+    block_stride_ = (bins_offset_
+                     + header_.slice_size * bin_encoding_size(encoding_));
+}
+
+void CorxMmapReader::buildIndex() {
+    index_.clear();
+    size_t offset = data_offset_;
+
+    while (offset < size_) {
+        CorxCycleIndex entry;
+        entry.offset = offset;
+        entry.num_blocks = 0;
+
+        // skip over the blocks until the end of cycle marker
+        size_t pos = offset + sizeof(CorxBeaconHeader);
+        bool complete = false;
+        while (pos < size_) {
+            if ((int8_t)data_[pos] == -128) {
+                complete = true;
+                ++pos;
+                break;
+            }
+            if (pos + block_stride_ > size_) {
+                break;
+            }
+            pos += block_stride_;
+            entry.num_blocks++;
+        }
+
+        if (!complete) {
+            fprintf(stderr, "Warning: ignoring truncated cycle at the end "
+                            "of %s\n", path_.c_str());
+            break;
+        }
+        index_.push_back(entry);
+        offset = pos;
+    }
+}
+
+bool CorxMmapReader::loadSidecar(const std::string &path) {
+    std::unique_ptr<FILE, decltype(&fclose)> file(fopen(path.c_str(), "rb"),
+                                                  &fclose);
+    if (!file) {
+        return false;
+    }
+
+    SidecarHeader header;
+    if (fread(&header, sizeof(header), 1, file.get()) != 1 ||
+            memcmp(header.signature, SIDECAR_SIGNATURE, 4) != 0 ||
+            header.version != SIDECAR_VERSION ||
+            header.file_size != size_ ||
+            header.mtime != mtime_) {
+        return false;  // stale or invalid: rebuild
+    }
+
+    std::vector<CorxCycleIndex> index(header.num_cycles);
+    if (header.num_cycles > 0 &&
+            fread(index.data(), sizeof(CorxCycleIndex), index.size(),
+                  file.get()) != index.size()) {
+        return false;
+    }
+    for (const CorxCycleIndex &entry : index) {
+        if (entry.offset + sizeof(CorxBeaconHeader)
+                + (uint64_t)entry.num_blocks * block_stride_ >= size_) {
+            return false;
+        }
+    }
+
+    index_ = std::move(index);
+    index_from_sidecar_ = true;
+    return true;
+}
+
+void CorxMmapReader::saveSidecar(const std::string &path) const {
+    SidecarHeader header;
+    memcpy(header.signature, SIDECAR_SIGNATURE, 4);
+    header.version = SIDECAR_VERSION;
+    header.file_size = size_;
+    header.mtime = mtime_;
+    header.num_cycles = index_.size();
+
+    // write to a temporary file so that concurrent readers never see a
+    // partial index
+    std::string tmp_path = path + ".tmp";
+    FILE *file = fopen(tmp_path.c_str(), "wb");
+    if (file == nullptr) {
+        // e.g. read-only archive: simply rebuild the index next time
+        return;
+    }
+    bool ok = (fwrite(&header, sizeof(header), 1, file) == 1 &&
+               fwrite(index_.data(), sizeof(CorxCycleIndex), index_.size(),
+                      file) == index_.size());
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "Warning: could not write index %s\n", path.c_str());
+        unlink(tmp_path.c_str());
+    }
+}
+
+} // namespace corx
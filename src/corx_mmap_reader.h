@@ -0,0 +1,109 @@
+#ifndef CORX_MMAP_READER_H
+#define CORX_MMAP_READER_H
+
+#include <complex>
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "corx_file_format.h"
+
+namespace corx {
+
+// Location of a cycle in a .corx file
+struct CorxCycleIndex {
+    uint64_t offset;        // file offset of the CorxBeaconHeader
+    uint32_t num_blocks;
+} __attribute__((packed));
+
+// A block of a cycle as stored in the mapping (nothing is copied)
+struct CorxBlockView {
+    int8_t phase_error;
+    float scale;            // 1 for float encodings
+    // Quality metrics (nullptr if the file has none; not aligned)
+    const CorxSegmentMetrics *metrics;
+    const char *bins;       // encoded bins (not necessarily aligned)
+    size_t len;             // number of bins
+    uint8_t encoding;
+
+    // Decode the bins into len complex floats
+    void decode(std::complex<float> *dest) const;
+};
+
+// Random-access reader of .corx files (version 1 and 2) that maps the file
+// into memory.
+//
+// On open, an index of all complete cycles is built by skipping over the
+// blocks, which have a fixed size. The index can be stored in a sidecar file
+// (<path>.idx) that is reused as long as the size and modification time of
+// the .corx file are unchanged. Throws std::runtime_error on failure.
+class CorxMmapReader {
+public:
+    CorxMmapReader();
+    ~CorxMmapReader();
+
+    CorxMmapReader(const CorxMmapReader&) = delete;
+    CorxMmapReader& operator=(const CorxMmapReader&) = delete;
+
+    void open(const std::string &path, bool use_sidecar = true);
+    void close();
+
+    const CorxFileHeader& header() const { return header_; }
+    uint8_t version() const { return version_; }
+    uint8_t encoding() const { return encoding_; }
+    // Whether the blocks store quality metrics (CORX_ENCODING_METRICS)
+    bool has_segment_metrics() const { return segment_metrics_; }
+    size_t slice_size() const { return header_.slice_size; }
+
+    size_t num_cycles() const { return index_.size(); }
+    const CorxCycleIndex& index(size_t cycle) const { return index_[cycle]; }
+    const std::vector<CorxCycleIndex>& index() const { return index_; }
+    // Whether the index was loaded from the sidecar file
+    bool index_from_sidecar() const { return index_from_sidecar_; }
+
+    const CorxBeaconHeader& beacon_header(size_t cycle) const {
+        return *reinterpret_cast<const CorxBeaconHeader*>(
+                data_ + index_[cycle].offset);
+    }
+    size_t num_blocks(size_t cycle) const {
+        return index_[cycle].num_blocks;
+    }
+    CorxBlockView block(size_t cycle, size_t idx) const;
+
+    // Size of a single block in the file, i.e. the distance between the
+    // phase errors of subsequent blocks of a cycle
+    size_t block_stride() const { return block_stride_; }
+    // Offset of the bins within a block
+    size_t bins_offset() const { return bins_offset_; }
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    void parseHeader();
+    void buildIndex();
+    bool loadSidecar(const std::string &path);
+    void saveSidecar(const std::string &path) const;
+
+    std::string path_;
+    const char *data_;
+    size_t size_;
+    int64_t mtime_;
+
+    CorxFileHeader header_;
+    uint8_t version_;
+    uint8_t encoding_;
+    bool segment_metrics_;
+    size_t data_offset_;    // offset of the first cycle
+    size_t block_stride_;
+    size_t bins_offset_;
+
+    std::vector<CorxCycleIndex> index_;
+    bool index_from_sidecar_;
+};
+
+} // namespace corx
+
+#endif /* CORX_MMAP_READER_H */
@@ -9,12 +9,52 @@ import matplotlib.pyplot as plt
 
 FILE_HEADER_FMT = '<HH'
 BEACON_HEADER_FMT = '<dQHIIffI?'
-
-FileHeader = namedtuple('FileHeader', 'slice_start, slice_size')
+SCALE_FMT = '<f'
+DEVICE_INDEX_FMT = '<h'
+INTEGRATION_HEADER_FMT = '<HHfff'
+CROSS_HEADER_FMT = '<hQHQHH'
+SEGMENT_METRICS_FMT = '<hbB'
+
+# Record types (file format version 3)
+RECORD_AUTO = 1
+RECORD_CROSS = 2
+
+# Bin encodings (file format version 2)
+ENCODING_FLOAT32 = 0
+ENCODING_FLOAT16 = 1
+ENCODING_INT16 = 2
+ENCODING_INT8 = 3
+ENCODING_DTYPES = {
+    ENCODING_FLOAT32: '<f4',
+    ENCODING_FLOAT16: '<f2',
+    ENCODING_INT16: '<i2',
+    ENCODING_INT8: 'i1',
+}
+# Flag of the encoding byte: every block stores its segment metrics
+ENCODING_METRICS = 0x80
+
+FileHeader = namedtuple('FileHeader', 'slice_start, slice_size, version,'
+                        'encoding, segment_metrics')
 BeaconHeader = namedtuple('BeaconHeader', 'soa, timestamp_sec, timestamp_msec,'
                           'beacon_amplitude, beacon_noise, clock_error,'
                           'carrier_pos, carrier_amplitude, preamp_on')
 Block = namedtuple('Block', 'phase_error, data')
+# Quality of a segment in dB (snr, slice_power) and turns (phase_std)
+SegmentMetrics = namedtuple('SegmentMetrics', 'snr, slice_power, phase_std')
+
+# Version 3 (integrated products)
+IntegratedFileHeader = namedtuple('IntegratedFileHeader',
+                                  FileHeader._fields + ('device_index',))
+IntegrationHeader = namedtuple('IntegrationHeader', 'num_blocks,'
+                               'num_phase_errors, phase_error_mean,'
+                               'phase_error_rms, phase_error_max')
+CrossHeader = namedtuple('CrossHeader', 'peer_device_index, timestamp_sec,'
+                         'timestamp_msec, peer_timestamp_sec,'
+                         'peer_timestamp_msec, num_blocks')
+# power: sum of |X|^2 of all segments of the cycle
+AutoRecord = namedtuple('AutoRecord', 'header, integration, power')
+# xcorr: sum of X * conj(Y), where Y is the spectrum of the peer
+CrossRecord = namedtuple('CrossRecord', 'header, xcorr')
 
 
 def read(stream, size):
@@ -23,19 +63,51 @@ def read(stream, size):
     return data
 
 
-def cycle_block_reader(stream, block_len):
+def read_metrics(stream):
+    slice_power, snr, phase_std = unpack(stream, SEGMENT_METRICS_FMT)
+    return SegmentMetrics(snr * 0.5, slice_power * 0.01, phase_std / 512.)
+
+
+def read_bins(stream, block_len, encoding, segment_metrics=False):
+    """Read and decode the FFT bins of a single block. Returns the bins and
+    the segment metrics of the block (None if the file has none)."""
+    scale = 1.
+    if encoding in (ENCODING_INT16, ENCODING_INT8):
+        scale = struct.unpack(SCALE_FMT, read(stream, 4))[0]
+    metrics = read_metrics(stream) if segment_metrics else None
+    if encoding == ENCODING_FLOAT32:
+        return np.fromfile(stream, dtype='complex64', count=block_len,
+                           sep=''), metrics
+
+    raw = np.fromfile(stream, dtype=ENCODING_DTYPES[encoding],
+                      count=2 * block_len, sep='')
+    data = raw.astype('float32')
+    if scale != 1.:
+        data *= scale
+    return data.view('complex64'), metrics
+
+
+def cycle_block_reader(stream, block_len, encoding=ENCODING_FLOAT32,
+                       segment_metrics=False, with_metrics=False):
+    """Yields (error, data) of every block, or (error, data, metrics) if
+    with_metrics is set."""
     while True:
         header_bytes = read(stream, 1)
         error_fp = struct.unpack('b', header_bytes)[0]
         if error_fp == -128:
             break
         error_deg = error_fp / 127. / 2 * 360  # TODO: use rads instead?
-        data = np.fromfile(stream, dtype='complex64', count=block_len, sep='')
+        data, metrics = read_bins(stream, block_len, encoding,
+                                  segment_metrics)
         # data = read(stream, block_len * 8)
-        yield error_deg, data
+        if with_metrics:
+            yield error_deg, data, metrics
+        else:
+            yield error_deg, data
 
 
-def cycle_reader(stream, block_len):
+def cycle_reader(stream, block_len, encoding=ENCODING_FLOAT32,
+                 segment_metrics=False, with_metrics=False):
     while True:
         header_len = struct.calcsize(BEACON_HEADER_FMT)
         header_bytes = stream.read(header_len)
@@ -43,7 +115,8 @@ def cycle_reader(stream, block_len):
             break
         assert(len(header_bytes) == header_len)
         header = BeaconHeader._make(struct.unpack(BEACON_HEADER_FMT, header_bytes))
-        block_reader = cycle_block_reader(stream, block_len)
+        block_reader = cycle_block_reader(stream, block_len, encoding,
+                                          segment_metrics, with_metrics)
 
         yield header, block_reader
 
@@ -52,17 +125,64 @@ def cycle_reader(stream, block_len):
             pass
 
 
-def corx_reader(stream):
+def unpack(stream, fmt):
+    return struct.unpack(fmt, read(stream, struct.calcsize(fmt)))
+
+
+def record_reader(stream, slice_size):
+    """Read the records of an integrated (version 3) file."""
+    while True:
+        type_bytes = stream.read(1)
+        if len(type_bytes) == 0:  # eof
+            break
+        record_type = ord(type_bytes)
+        if record_type == RECORD_AUTO:
+            header = BeaconHeader._make(unpack(stream, BEACON_HEADER_FMT))
+            integration = IntegrationHeader._make(
+                unpack(stream, INTEGRATION_HEADER_FMT))
+            power = np.fromfile(stream, dtype='<f4', count=slice_size,
+                                sep='')
+            yield AutoRecord(header, integration, power)
+        elif record_type == RECORD_CROSS:
+            header = CrossHeader._make(unpack(stream, CROSS_HEADER_FMT))
+            xcorr = np.fromfile(stream, dtype='complex64', count=slice_size,
+                                sep='')
+            yield CrossRecord(header, xcorr)
+        else:
+            raise ValueError('Unknown record type: %d' % record_type)
+
+
+def corx_reader(stream, with_metrics=False):
+    """Returns the file header and a generator of the cycles (version 1 and
+    2) or of the records (version 3, see record_reader). The blocks of the
+    cycles include their segment metrics if with_metrics is set (see
+    cycle_block_reader)."""
     # validate signature and header
     signature = read(stream, 4)
-    assert(signature == 'CORX')
-    version = read(stream, 1)
-    assert(version == '\x01')
+    assert(signature == b'CORX')
+    version = ord(read(stream, 1))
+    assert(version in (1, 2, 3))
 
     file_header_bytes = read(stream, struct.calcsize(FILE_HEADER_FMT))
-    file_header = FileHeader._make(struct.unpack(FILE_HEADER_FMT,
-                                                 file_header_bytes))
-    return file_header, cycle_reader(stream, file_header.slice_size)
+    slice_start, slice_size = struct.unpack(FILE_HEADER_FMT,
+                                            file_header_bytes)
+    if version == 3:
+        device_index, = unpack(stream, DEVICE_INDEX_FMT)
+        file_header = IntegratedFileHeader(slice_start, slice_size, version,
+                                           ENCODING_FLOAT32, False,
+                                           device_index)
+        return file_header, record_reader(stream, slice_size)
+    encoding = ENCODING_FLOAT32
+    segment_metrics = False
+    if version >= 2:
+        encoding = ord(read(stream, 1))
+        segment_metrics = bool(encoding & ENCODING_METRICS)
+        encoding &= ~ENCODING_METRICS
+        assert(encoding in ENCODING_DTYPES)
+    file_header = FileHeader(slice_start, slice_size, version, encoding,
+                             segment_metrics)
+    return file_header, cycle_reader(stream, file_header.slice_size,
+                                     encoding, segment_metrics, with_metrics)
     
 
 
@@ -73,15 +193,29 @@ def _main():
                         type=argparse.FileType('rb'), default='-',
                         help=".corx file ('-' streams from stdin)")
     args = parser.parse_args()
-    file_header, cycles = corx_reader(args.input)
+    file_header, cycles = corx_reader(args.input, with_metrics=True)
 
     print('Slice start:', file_header.slice_start)
     print('Slice size:', file_header.slice_size)
+    print('Version:', file_header.version)
+    print('Encoding:', file_header.encoding)
+    print('Segment metrics:', file_header.segment_metrics)
+
+    if file_header.version == 3:
+        print('Device index:', file_header.device_index)
+        for record in cycles:
+            print(record.header)
+            if isinstance(record, AutoRecord):
+                print(record.integration)
+        return
 
     for beacon_header, cycle_reader in cycles:
         print(beacon_header)
-        for i, (error, block) in enumerate(cycle_reader):
+        for i, (error, block, metrics) in enumerate(cycle_reader):
             print("Error in corr block #%d: %.0f deg" % (i, error))
+            if metrics is not None:
+                print("  SNR %.1f dB, slice power %.2f dB, phase std. dev. "
+                      "%.3f turns" % metrics)
 
 
 if __name__ == '__main__':
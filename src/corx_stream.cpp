@@ -0,0 +1,188 @@
+#include "corx_stream.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace corx {
+
+namespace {
+
+const char HELLO_SIGNATURE[4] = {'C', 'X', 'S', 'T'};
+
+bool send_all(int fd, const void *data, size_t len) {
+    const char *src = static_cast<const char*>(data);
+    while (len > 0) {
+        ssize_t r = send(fd, src, len, MSG_NOSIGNAL);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return false;
+        }
+        src += r;
+        len -= r;
+    }
+    return true;
+}
+
+bool recv_all(int fd, void *data, size_t len) {
+    char *dest = static_cast<char*>(data);
+    while (len > 0) {
+        ssize_t r = recv(fd, dest, len, 0);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return false;
+        }
+        dest += r;
+        len -= r;
+    }
+    return true;
+}
+
+} // namespace
+
+
+bool is_stream_url(const std::string &output) {
+    return output.compare(0, 6, "tcp://") == 0;
+}
+
+bool parse_stream_url(const std::string &url, StreamUrl &result) {
+    if (!is_stream_url(url)) {
+        return false;
+    }
+
+    std::string rest = url.substr(6);
+    size_t slash = rest.find('/');
+    std::string address = rest.substr(0, slash);
+    result.name = (slash == std::string::npos) ? "" : rest.substr(slash + 1);
+
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos || colon == 0 ||
+            colon + 1 == address.size()) {
+        return false;
+    }
+    result.host = address.substr(0, colon);
+    result.port = address.substr(colon + 1);
+
+    if (result.name.empty()) {
+        char hostname[256] = {0};
+        gethostname(hostname, sizeof(hostname) - 1);
+        result.name = hostname;
+    }
+    return !result.name.empty() && result.name.size() <= 255;
+}
+
+int stream_connect(const StreamUrl &url) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo *res;
+    int err = getaddrinfo(url.host.c_str(), url.port.c_str(), &hints, &res);
+    if (err != 0) {
+        fprintf(stderr, "Warning: could not resolve %s: %s\n",
+                url.host.c_str(), gai_strerror(err));
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai != nullptr; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+
+    if (fd < 0) {
+        fprintf(stderr, "Warning: could not connect to %s:%s: %s\n",
+                url.host.c_str(), url.port.c_str(), strerror(errno));
+        return -1;
+    }
+
+    uint8_t name_len = url.name.size();
+    if (!send_all(fd, HELLO_SIGNATURE, sizeof(HELLO_SIGNATURE)) ||
+            !send_all(fd, &name_len, 1) ||
+            !send_all(fd, url.name.data(), name_len)) {
+        fprintf(stderr, "Warning: could not send stream hello: %s\n",
+                strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int stream_listen(const std::string &port) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET6;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    struct addrinfo *res;
+    int err = getaddrinfo(nullptr, port.c_str(), &hints, &res);
+    if (err != 0) {
+        // no IPv6 support
+        hints.ai_family = AF_INET;
+        err = getaddrinfo(nullptr, port.c_str(), &hints, &res);
+    }
+    if (err != 0) {
+        fprintf(stderr, "Warning: invalid port %s: %s\n",
+                port.c_str(), gai_strerror(err));
+        return -1;
+    }
+
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    int on = 1;
+    int off = 0;
+    if (fd >= 0) {
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (res->ai_family == AF_INET6) {
+            // accept IPv4 connections as well
+            setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+        }
+        if (bind(fd, res->ai_addr, res->ai_addrlen) != 0 ||
+                listen(fd, 16) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+
+    if (fd < 0) {
+        fprintf(stderr, "Warning: could not listen on port %s: %s\n",
+                port.c_str(), strerror(errno));
+    }
+    return fd;
+}
+
+bool stream_read_hello(int fd, std::string &name) {
+    char signature[4];
+    uint8_t name_len;
+    if (!recv_all(fd, signature, sizeof(signature)) ||
+            memcmp(signature, HELLO_SIGNATURE, sizeof(signature)) != 0 ||
+            !recv_all(fd, &name_len, 1) ||
+            name_len == 0) {
+        return false;
+    }
+    name.resize(name_len);
+    return recv_all(fd, &name[0], name_len);
+}
+
+} // namespace corx
@@ -0,0 +1,44 @@
+#ifndef CORX_STREAM_H
+#define CORX_STREAM_H
+
+#include <string>
+
+// Streaming of .corx data over TCP.
+//
+// A corx stream is a regular .corx file (signature, header, cycles) sent over
+// a TCP connection, preceded by a hello that identifies the receiver:
+//
+//     "CXST", uint8_t name_len, char name[name_len]
+//
+// The online correlator pairs the cycles of streams with different names.
+// A receiver may reconnect with the same name, e.g. for every capture.
+
+namespace corx {
+
+// Streaming destination parsed from tcp://host:port[/name]
+struct StreamUrl {
+    std::string host;
+    std::string port;
+    std::string name;   // defaults to the host name of this machine
+};
+
+// Returns true if the output is a tcp:// URL
+bool is_stream_url(const std::string &output);
+
+// Parse a tcp:// URL. Returns false if the URL is invalid.
+bool parse_stream_url(const std::string &url, StreamUrl &result);
+
+// Connect to the correlator and send the hello.
+// Returns a socket or -1 on failure (a warning is printed).
+int stream_connect(const StreamUrl &url);
+
+// Listen for incoming streams on all interfaces.
+// Returns a socket or -1 on failure (a warning is printed).
+int stream_listen(const std::string &port);
+
+// Read the hello of an accepted connection. Returns false on failure.
+bool stream_read_hello(int fd, std::string &name);
+
+} // namespace corx
+
+#endif /* CORX_STREAM_H */
@@ -0,0 +1,132 @@
+#include "cycle_integrator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+
+namespace corx {
+
+CycleIntegrator::CycleIntegrator()
+    : len_(0),
+      keep_segments_(false),
+      phase_error_threshold_(0) {
+    reset(0, false, 0, 0);
+}
+
+void CycleIntegrator::reset(size_t len, bool keep_segments,
+                            size_t num_segments,
+                            float phase_error_threshold) {
+    len_ = len;
+    keep_segments_ = keep_segments;
+    phase_error_threshold_ = phase_error_threshold;
+
+    count_ = 0;
+    num_phase_errors_ = 0;
+    phase_error_sum_ = 0;
+    phase_error_sq_sum_ = 0;
+    phase_error_max_ = 0;
+
+    power_.assign(len, 0.f);
+    segments_.clear();
+    if (keep_segments) {
+        segments_.reserve(num_segments * len);
+    }
+}
+
+void CycleIntegrator::add(const std::complex<float> *bins,
+                          float phase_error) {
+    // (operate on interleaved floats so that the loop vectorizes)
+    const float *in = reinterpret_cast<const float*>(bins);
+    float *power = power_.data();
+    for (size_t j = 0; j < len_; ++j) {
+        power[j] += in[2*j] * in[2*j] + in[2*j+1] * in[2*j+1];
+    }
+    if (keep_segments_) {
+        segments_.insert(segments_.end(), bins, bins + len_);
+    }
+
+    float abs_error = std::fabs(phase_error);
+    if (abs_error > phase_error_threshold_) {
+        num_phase_errors_++;
+    }
+    phase_error_sum_ += phase_error;
+    phase_error_sq_sum_ += phase_error * phase_error;
+    phase_error_max_ = std::max(phase_error_max_, abs_error);
+    count_++;
+}
+
+CorxIntegrationHeader CycleIntegrator::stats() const {
+    CorxIntegrationHeader header;
+    header.num_blocks = std::min(count_, (size_t)UINT16_MAX);
+    header.num_phase_errors = std::min(num_phase_errors_,
+                                       (size_t)UINT16_MAX);
+    header.phase_error_mean = 0;
+    header.phase_error_rms = 0;
+    if (count_ > 0) {
+        header.phase_error_mean = phase_error_sum_ / count_;
+        header.phase_error_rms = std::sqrt(phase_error_sq_sum_ / count_);
+    }
+    header.phase_error_max = phase_error_max_;
+    return header;
+}
+
+
+CrossSpectrumMatcher::CrossSpectrumMatcher(double interval)
+    : threshold_(interval / 4),
+      max_age_(2.5 * interval),
+      matches_(0) {
+
+    if (interval <= 0) {
+        throw std::invalid_argument("beacon interval should be positive");
+    }
+}
+
+std::vector<std::shared_ptr<const CrossSpectrumMatcher::Cycle>>
+CrossSpectrumMatcher::publish(std::shared_ptr<const Cycle> cycle) {
+    std::vector<std::shared_ptr<const Cycle>> matches;
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // drop cycles that can no longer be matched
+    // (the receivers may be a few cycles apart)
+    while (!cycles_.empty() &&
+           cycles_.front()->time < cycle->time - max_age_) {
+        cycles_.pop_front();
+    }
+
+    for (const auto &other : cycles_) {
+        if (other->device_index != cycle->device_index &&
+                other->len == cycle->len &&
+                std::fabs(other->time - cycle->time) < threshold_) {
+            matches.push_back(other);
+        }
+    }
+    matches_ += matches.size();
+
+    cycles_.push_back(std::move(cycle));
+    return matches;
+}
+
+
+size_t cross_spectrum(std::complex<float> *xcorr,
+                      const CrossSpectrumMatcher::Cycle &a,
+                      const CrossSpectrumMatcher::Cycle &b) {
+    assert(a.len == b.len);
+    size_t len = a.len;
+    size_t count = std::min(a.count, b.count);
+
+    float *out = reinterpret_cast<float*>(xcorr);
+    std::fill(out, out + 2 * len, 0.f);
+    for (size_t i = 0; i < count; ++i) {
+        const float *x = reinterpret_cast<const float*>(&a.segments[i * len]);
+        const float *y = reinterpret_cast<const float*>(&b.segments[i * len]);
+        for (size_t j = 0; j < len; ++j) {
+            // x * conj(y)
+            out[2*j] += x[2*j] * y[2*j] + x[2*j+1] * y[2*j+1];
+            out[2*j+1] += x[2*j+1] * y[2*j] - x[2*j] * y[2*j+1];
+        }
+    }
+    return count;
+}
+
+} // namespace corx
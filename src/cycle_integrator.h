@@ -0,0 +1,120 @@
+#ifndef CORX_CYCLE_INTEGRATOR_H
+#define CORX_CYCLE_INTEGRATOR_H
+
+#include <atomic>
+#include <complex>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "corx_file_format.h"
+
+namespace corx {
+
+// Accumulates the products the correlator needs from a single segment cycle
+// (i.e. the segments between two beacon pulses), so that only the sums have
+// to be written instead of every segment spectrum.
+class CycleIntegrator {
+public:
+    CycleIntegrator();
+
+    // Start a new cycle of segments with len bins each.
+    // keep_segments: keep a copy of the segment spectra (for cross-spectra)
+    // num_segments: expected number of segments (only used for reserving)
+    // phase_error_threshold: phase errors above this are counted as large
+    //                        (in fractions of a turn)
+    void reset(size_t len, bool keep_segments, size_t num_segments,
+               float phase_error_threshold);
+
+    // Add the spectrum of a segment and its phase error
+    void add(const std::complex<float> *bins, float phase_error);
+
+    size_t len() const { return len_; }
+    size_t count() const { return count_; }
+
+    // Sum of |X|^2 per bin
+    const float* power() const { return power_.data(); }
+
+    // Phase error statistics of the segments added so far
+    CorxIntegrationHeader stats() const;
+
+    // count() * len() segment spectra (only if they are kept)
+    std::vector<std::complex<float>>& segments() { return segments_; }
+
+private:
+    size_t len_;
+    bool keep_segments_;
+    float phase_error_threshold_;
+
+    size_t count_;
+    size_t num_phase_errors_;
+    double phase_error_sum_;
+    double phase_error_sq_sum_;
+    float phase_error_max_;
+
+    std::vector<float> power_;
+    std::vector<std::complex<float>> segments_;
+};
+
+
+// Pairs the segment cycles that the receivers of a host captured after the
+// same beacon pulse, so that their cross-spectra can be integrated on the
+// host.
+//
+// Every receiver publishes its cycles once they are complete. A cycle is
+// matched with the cycles of the other receivers that have been published
+// before, i.e. every pair of cycles is matched exactly once (by the
+// receiver that completed its cycle last).
+class CrossSpectrumMatcher {
+public:
+    struct Cycle {
+        int device_index;
+        // Host time of the beacon pulse
+        double time;
+        // Timestamp of the cycle in the beacon header
+        uint64_t timestamp_sec;
+        uint16_t timestamp_msec;
+        size_t len;
+        size_t count;
+        // count * len segment spectra
+        std::vector<std::complex<float>> segments;
+    };
+
+    // interval: nominal time between beacon pulses in seconds
+    explicit CrossSpectrumMatcher(double interval);
+
+    // Publish a complete cycle. Returns the cycles of the other receivers
+    // that belong to the same pulse.
+    std::vector<std::shared_ptr<const Cycle>> publish(
+            std::shared_ptr<const Cycle> cycle);
+
+    uint64_t matches() const { return matches_; }
+
+private:
+    // Maximum difference between the pulse times of matching cycles
+    // (as in correlate.py)
+    const double threshold_;
+    // Cycles older than this (relative to the last one) are dropped
+    const double max_age_;
+
+    std::mutex mutex_;
+    std::deque<std::shared_ptr<const Cycle>> cycles_;
+
+    std::atomic<uint64_t> matches_;
+};
+
+
+// Set xcorr to the sum of X * conj(Y) over the segments that both cycles
+// have captured, where X and Y are the segment spectra of a and b.
+// Returns the number of segments.
+size_t cross_spectrum(std::complex<float> *xcorr,
+                      const CrossSpectrumMatcher::Cycle &a,
+                      const CrossSpectrumMatcher::Cycle &b);
+
+} // namespace corx
+
+#endif /* CORX_CYCLE_INTEGRATOR_H */
@@ -0,0 +1,382 @@
+#include "dsp.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace corx {
+
+namespace {
+
+const float PI = 3.14159265358979323846f;
+
+} // namespace
+
+
+void freq_shift(std::complex<float> *dest,
+                const std::complex<float> *src,
+                size_t len,
+                float shift_freq,
+                DeciAngle shift_phase,
+                NCOType nco_type,
+                size_t resync_interval) {
+    float phase = 2 * PI * shift_phase;
+    float angle_rate = 2 * PI * shift_freq / (float)len;
+    if (nco_type == NCOType::PHASOR) {
+        PhasorNCO nco(phase, angle_rate, resync_interval);
+        nco.expj_multiply(dest, src, len);
+    } else {
+        SineLookupNCO nco(phase, angle_rate);
+        nco.expj_multiply(dest, src, len);
+    }
+}
+
+
+std::complex<float> freq_shift_dc(std::complex<float> *dest,
+                                  const std::complex<float> *src,
+                                  size_t len,
+                                  float shift_freq,
+                                  DeciAngle shift_phase,
+                                  NCOType nco_type,
+                                  size_t resync_interval) {
+    float phase = 2 * PI * shift_phase;
+    float angle_rate = 2 * PI * shift_freq / (float)len;
+    if (nco_type == NCOType::PHASOR) {
+        PhasorNCO nco(phase, angle_rate, resync_interval);
+        return nco.expj_multiply_accumulate(dest, src, len);
+    } else {
+        SineLookupNCO nco(phase, angle_rate);
+        return nco.expj_multiply_accumulate(dest, src, len);
+    }
+}
+
+
+void fft_shift_range(std::complex<float> *dest,
+                     const std::complex<float> *src,
+                     size_t len,
+                     float shift_freq,
+                     DeciAngle shift_phase,
+                     size_t carrier_offset,
+                     size_t begin,
+                     size_t end) {
+    SineLookupNCO nco(2 * PI * shift_phase,
+                      2 * PI * shift_freq / (float)len);
+    size_t pos_len = (len+1)/2 + carrier_offset;  // number of positive frequency components
+
+    size_t pos_end = std::min(end, pos_len);
+    if (begin < pos_end) {
+        nco.advance(begin);
+        nco.expj_multiply(dest+begin, src+begin, pos_end-begin);
+        nco.advance(pos_len - pos_end);
+    } else {
+        nco.advance(pos_len);
+    }
+
+    nco.adjust_phase(-2 * PI * shift_freq);
+    size_t neg_begin = std::max(begin, pos_len);
+    if (neg_begin < end) {
+        nco.advance(neg_begin - pos_len);
+        nco.expj_multiply(dest+neg_begin, src+neg_begin, end-neg_begin);
+    }
+}
+
+
+void fft_shift(std::complex<float> *dest,
+               const std::complex<float> *src,
+               size_t len,
+               float shift_freq,
+               DeciAngle shift_phase,
+               size_t carrier_offset) {
+    fft_shift_range(dest, src, len, shift_freq, shift_phase, carrier_offset,
+                    0, len);
+}
+
+
+namespace {
+
+// Shift the bins of FFTShifter::shift, starting at the given pointers.
+// With COUNT > 0, the number of bins is a compile-time constant (count is
+// ignored).
+template <size_t COUNT>
+void shift_bins(std::complex<float> *dest,
+                const std::complex<float> *src,
+                const float *ramp,
+                float shift_freq,
+                float phase,
+                size_t count,
+                float *power) {
+    const size_t n = (COUNT > 0) ? COUNT : count;
+    if (power == nullptr) {
+        for (size_t k = 0; k < n; ++k) {
+            float s, c;
+            sincos_poly(phase + shift_freq * ramp[k], s, c);
+            float re = src[k].real(), im = src[k].imag();
+            dest[k] = std::complex<float>(re * c - im * s, re * s + im * c);
+        }
+        return;
+    }
+
+    // (one partial sum per lane, as a single float sum would keep the
+    //  compiler from vectorizing the loop without -ffast-math)
+    const size_t LANES = 8;
+    float sums[LANES] = {0};
+    const size_t full = n - n % LANES;
+    for (size_t k = 0; k < full; k += LANES) {
+        for (size_t j = 0; j < LANES; ++j) {
+            float s, c;
+            sincos_poly(phase + shift_freq * ramp[k+j], s, c);
+            float re = src[k+j].real(), im = src[k+j].imag();
+            float out_re = re * c - im * s, out_im = re * s + im * c;
+            dest[k+j] = std::complex<float>(out_re, out_im);
+            sums[j] += out_re * out_re + out_im * out_im;
+        }
+    }
+    for (size_t k = full; k < n; ++k) {
+        float s, c;
+        sincos_poly(phase + shift_freq * ramp[k], s, c);
+        float re = src[k].real(), im = src[k].imag();
+        dest[k] = std::complex<float>(re * c - im * s, re * s + im * c);
+        sums[0] += std::norm(dest[k]);
+    }
+    float total = 0;
+    for (size_t j = 0; j < LANES; ++j) {
+        total += sums[j];
+    }
+    *power = total;
+}
+
+} // namespace
+
+
+const float* FFTShifter::ramp(size_t len, size_t carrier_offset) {
+    // number of positive frequency components (as in fft_shift_range)
+    size_t pos_len = (len+1)/2 + carrier_offset;
+    if (len != len_ || pos_len != pos_len_) {
+        ramp_.resize(len);
+        for (size_t k = 0; k < len; ++k) {
+            double bin = (k < pos_len) ? (double)k : (double)k - len;
+            ramp_[k] = (float)(2 * M_PI * bin / len);
+        }
+        len_ = len;
+        pos_len_ = pos_len;
+    }
+    return ramp_.data();
+}
+
+void FFTShifter::shift(std::complex<float> *dest,
+                       const std::complex<float> *src,
+                       size_t len,
+                       float shift_freq,
+                       DeciAngle shift_phase,
+                       size_t carrier_offset,
+                       size_t begin,
+                       size_t end,
+                       float *power) {
+    const float *w = ramp(len, carrier_offset);
+    if (end <= begin) {
+        if (power != nullptr) {
+            *power = 0;
+        }
+        return;
+    }
+    shift_bins<0>(dest + begin, src + begin, w + begin, shift_freq,
+                  2 * PI * shift_phase, end - begin, power);
+}
+
+
+// -- Kernels of fixed configurations
+
+namespace {
+
+// Same as SineLookupNCO::expj_multiply(_accumulate), but the phase of each
+// sample is computed from its index (the fixed-point phase wraps around in
+// the same way) and the product is written out, so that the iterations are
+// independent and the loop has no NaN fallback of the complex product.
+template <size_t LEN>
+std::complex<float> mix_table(std::complex<float> *dest,
+                              const std::complex<float> *src,
+                              float shift_freq,
+                              DeciAngle shift_phase,
+                              bool accumulate) {
+    const uint32_t phase = (uint32_t)SineLookupFixedPoint::float_to_fixed(
+            2 * PI * shift_phase);
+    const uint32_t step = (uint32_t)SineLookupFixedPoint::float_to_fixed(
+            2 * PI * shift_freq / (float)LEN);
+    const float *in = reinterpret_cast<const float*>(src);
+    float *out = reinterpret_cast<float*>(dest);
+    float sum_re = 0, sum_im = 0;
+    for (size_t i = 0; i < LEN; ++i) {
+        int32_t x = (int32_t)(phase + (uint32_t)i * step);
+        float c = SineLookupFixedPoint::cos(x);
+        float s = SineLookupFixedPoint::sin(x);
+        float re = in[2*i], im = in[2*i+1];
+        float out_re = c * re - s * im, out_im = c * im + s * re;
+        out[2*i] = out_re;
+        out[2*i+1] = out_im;
+        if (accumulate) {
+            sum_re += out_re;
+            sum_im += out_im;
+        }
+    }
+    return std::complex<float>(sum_re, sum_im);
+}
+
+template <size_t BLOCK_SIZE>
+void freq_shift_fixed(std::complex<float> *dest,
+                      const std::complex<float> *src,
+                      size_t len,
+                      float shift_freq,
+                      DeciAngle shift_phase,
+                      NCOType nco_type,
+                      size_t resync_interval) {
+    if (nco_type != NCOType::TABLE) {
+        // (resynced in blocks of resync_interval samples anyway)
+        freq_shift(dest, src, BLOCK_SIZE, shift_freq, shift_phase, nco_type,
+                   resync_interval);
+        return;
+    }
+    mix_table<BLOCK_SIZE>(dest, src, shift_freq, shift_phase, false);
+}
+
+template <size_t BLOCK_SIZE>
+std::complex<float> freq_shift_dc_fixed(std::complex<float> *dest,
+                                        const std::complex<float> *src,
+                                        size_t len,
+                                        float shift_freq,
+                                        DeciAngle shift_phase,
+                                        NCOType nco_type,
+                                        size_t resync_interval) {
+    if (nco_type != NCOType::TABLE) {
+        return freq_shift_dc(dest, src, BLOCK_SIZE, shift_freq, shift_phase,
+                             nco_type, resync_interval);
+    }
+    return mix_table<BLOCK_SIZE>(dest, src, shift_freq, shift_phase, true);
+}
+
+template <size_t SEGMENT_SIZE, size_t BEGIN, size_t END>
+void shift_slice_fixed(FFTShifter &shifter,
+                       std::complex<float> *dest,
+                       const std::complex<float> *src,
+                       size_t len,
+                       float shift_freq,
+                       DeciAngle shift_phase,
+                       size_t carrier_offset,
+                       size_t begin,
+                       size_t end,
+                       float *power) {
+    static_assert(BEGIN < END && END <= SEGMENT_SIZE, "invalid slice");
+    const float *w = shifter.ramp(SEGMENT_SIZE, carrier_offset);
+    shift_bins<END - BEGIN>(dest + BEGIN, src + BEGIN, w + BEGIN, shift_freq,
+                            2 * PI * shift_phase, 0, power);
+}
+
+void shift_slice_generic(FFTShifter &shifter,
+                         std::complex<float> *dest,
+                         const std::complex<float> *src,
+                         size_t len,
+                         float shift_freq,
+                         DeciAngle shift_phase,
+                         size_t carrier_offset,
+                         size_t begin,
+                         size_t end,
+                         float *power) {
+    shifter.shift(dest, src, len, shift_freq, shift_phase, carrier_offset,
+                  begin, end, power);
+}
+
+struct BlockKernels {
+    size_t block_size;
+    decltype(DspKernels::freq_shift) freq_shift;
+    decltype(DspKernels::freq_shift_dc) freq_shift_dc;
+};
+
+struct SliceKernels {
+    size_t segment_size;
+    size_t slice_start;
+    size_t slice_end;
+    decltype(DspKernels::shift_slice) shift_slice;
+};
+
+#define CORX_BLOCK_KERNELS(n) \
+    {n, &freq_shift_fixed<n>, &freq_shift_dc_fixed<n>}
+#define CORX_SLICE_KERNELS(n, begin, end) \
+    {n, begin, end, &shift_slice_fixed<n, begin, end>}
+
+// Instantiated configurations: the block sizes in use and the production
+// slice (--segment_size=1024 --slice=0-100, see experiments/flags.cfg) or
+// the whole segment (the default --slice)
+const BlockKernels BLOCK_KERNELS[] = {
+    CORX_BLOCK_KERNELS(8192),
+    CORX_BLOCK_KERNELS(16384),
+    CORX_BLOCK_KERNELS(32768),
+};
+
+const SliceKernels SLICE_KERNELS[] = {
+    CORX_SLICE_KERNELS(1024, 0, 101),
+    CORX_SLICE_KERNELS(1024, 0, 1024),
+    CORX_SLICE_KERNELS(2048, 0, 101),
+};
+
+#undef CORX_BLOCK_KERNELS
+#undef CORX_SLICE_KERNELS
+
+} // namespace
+
+
+DspKernels select_dsp_kernels(size_t block_size,
+                              size_t segment_size,
+                              size_t slice_start,
+                              size_t slice_end) {
+    DspKernels kernels = {0, 0, 0, 0, &freq_shift, &freq_shift_dc,
+                          &shift_slice_generic};
+    for (const BlockKernels &entry : BLOCK_KERNELS) {
+        if (entry.block_size == block_size) {
+            kernels.block_size = block_size;
+            kernels.freq_shift = entry.freq_shift;
+            kernels.freq_shift_dc = entry.freq_shift_dc;
+        }
+    }
+    for (const SliceKernels &entry : SLICE_KERNELS) {
+        if (entry.segment_size == segment_size &&
+                entry.slice_start == slice_start &&
+                entry.slice_end == slice_end) {
+            kernels.segment_size = segment_size;
+            kernels.slice_start = slice_start;
+            kernels.slice_end = slice_end;
+            kernels.shift_slice = entry.shift_slice;
+        }
+    }
+    return kernels;
+}
+
+
+std::complex<float> calculate_dc(const std::complex<float> *signal,
+                                 size_t len) {
+    std::complex<float> sum = std::accumulate(signal,
+                                              signal + len,
+                                              std::complex<float>(0, 0));
+    return sum;
+}
+
+
+void convert_iq_u8(std::complex<float> *dest,
+                   const uint8_t *src,
+                   size_t num_samples) {
+    float *out = reinterpret_cast<float*>(dest);
+    const float scale = 1.f / 127.5f;
+    for (size_t i = 0; i < 2 * num_samples; ++i) {
+        out[i] = ((float)src[i] - 127.5f) * scale;
+    }
+}
+
+void quantize_iq_u8(uint8_t *dest,
+                    const std::complex<float> *src,
+                    size_t num_samples) {
+    const float *in = reinterpret_cast<const float*>(src);
+    for (size_t i = 0; i < 2 * num_samples; ++i) {
+        float x = in[i] * 127.5f + 128.f;
+        dest[i] = (uint8_t)std::min(std::max(x, 0.f), 255.f);
+    }
+}
+
+} // namespace corx
@@ -0,0 +1,204 @@
+#ifndef CORX_DSP_H
+#define CORX_DSP_H
+
+#include <cmath>
+#include <complex>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sine_lookup.h"
+
+namespace corx {
+
+// Signal processing kernels of the receiver's hot path.
+
+enum class NCOType {
+    TABLE,
+    PHASOR
+};
+
+// Angles are stored as a value between -0.5 and 0.5 to simplify normalisation
+// TODO: convert to class
+using DeciAngle = float;
+
+inline DeciAngle normalize_deciangle(DeciAngle angle) {
+    return angle - int(std::round(angle));
+}
+
+// Apply a frequency and phase shift to the given signal.
+// src and dest may be the same for inline transformation.
+void freq_shift(std::complex<float> *dest,
+                const std::complex<float> *src,
+                size_t len,
+                float shift_freq,
+                DeciAngle shift_phase,
+                NCOType nco_type = NCOType::TABLE,
+                size_t resync_interval = PhasorNCO::DEFAULT_RESYNC_INTERVAL);
+
+// Like freq_shift, but also return the 0 Hz frequency component of the
+// shifted signal (see calculate_dc), computed in the same pass.
+std::complex<float> freq_shift_dc(
+        std::complex<float> *dest,
+        const std::complex<float> *src,
+        size_t len,
+        float shift_freq,
+        DeciAngle shift_phase,
+        NCOType nco_type = NCOType::TABLE,
+        size_t resync_interval = PhasorNCO::DEFAULT_RESYNC_INTERVAL);
+
+// Like freq_shift, but accounts for discontinuity at DC due to FFT
+// representation (i.e. zero-frequency at index 0).
+void fft_shift(std::complex<float> *dest,
+               const std::complex<float> *src,
+               size_t len,
+               float shift_freq,
+               DeciAngle shift_phase,
+               size_t carrier_offset);
+
+// Like fft_shift, but only shift the bins [begin, end).
+// The result is identical to the corresponding bins of fft_shift.
+void fft_shift_range(std::complex<float> *dest,
+                     const std::complex<float> *src,
+                     size_t len,
+                     float shift_freq,
+                     DeciAngle shift_phase,
+                     size_t carrier_offset,
+                     size_t begin,
+                     size_t end);
+
+// Sine and cosine of x (in radians) in single precision, without a table.
+// Branchless, so that loops over it are vectorized by the compiler. The
+// absolute error is below 1e-6 for |x| < 1e4 (and grows with |x|).
+inline void sincos_poly(float x, float &s, float &c) {
+    // x = j * pi/2 + y with |y| <= pi/4
+    // (rounding by adding and subtracting 1.5 * 2^23; requires the default
+    //  rounding mode and no -ffast-math reassociation)
+    const float round_magic = 12582912.f;
+    float j = (x * 0.636619772f + round_magic) - round_magic;
+    // (pi/2 in three parts, so that j * part is exact for |j| < 2^16)
+    float y = ((x - j * 1.5703125f) - j * 4.837512969970703125e-4f)
+              - j * 7.54978995489188216e-8f;
+    float z = y * y;
+
+    // minimax polynomials on [-pi/4, pi/4] (Cephes sinf and cosf)
+    float sy = ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z
+                - 1.6666654611e-1f) * z * y + y;
+    float cy = ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z
+                + 4.166664568298827e-2f) * z * z - 0.5f * z + 1.f;
+
+    // rotate by the quadrant
+    int q = (int)j;
+    float s1 = (q & 1) ? cy : sy;
+    float c1 = (q & 1) ? sy : cy;
+    s = (q & 2) ? -s1 : s1;
+    c = ((q + 1) & 2) ? -c1 : c1;
+}
+
+// fft_shift_range with the phase evaluated in floating point.
+//
+// The phase of bin k is shift_phase + shift_freq * w_k, where w_k is the
+// angle of signed bin k (2 pi k / len, or 2 pi (k - len) / len for the
+// negative frequencies). The ramp w_k is precomputed in double precision and
+// reused as long as the segment size and carrier offset do not change, so
+// only the phases of the fractional offset are computed per segment. More
+// accurate than the fixed-point table of SineLookupNCO, and vectorized.
+class FFTShifter {
+public:
+    FFTShifter() : len_(0), pos_len_(0) {}
+
+    // Same arguments and bins as fft_shift_range.
+    // If power is not null, it is set to the sum of |dest[k]|^2 over the
+    // shifted bins, which is computed in the same pass.
+    void shift(std::complex<float> *dest,
+               const std::complex<float> *src,
+               size_t len,
+               float shift_freq,
+               DeciAngle shift_phase,
+               size_t carrier_offset,
+               size_t begin,
+               size_t end,
+               float *power = nullptr);
+
+    // Ramp w_k of all len bins (recomputed if len or carrier_offset changed)
+    const float* ramp(size_t len, size_t carrier_offset);
+
+private:
+    size_t len_;
+    size_t pos_len_;
+    std::vector<float> ramp_;
+};
+
+// Kernels of the receiver's hot path for a configuration of block size,
+// segment size and slice.
+//
+// The common configurations (see select_dsp_kernels) are instantiated with
+// these sizes as compile-time constants, so that the compiler can fully
+// unroll and vectorize the loops; other configurations use the generic
+// kernels above. The results are the same. The kernels take the same
+// arguments as the generic ones, and the sizes passed to them have to match
+// the configuration they have been selected for.
+struct DspKernels {
+    // Sizes the kernels are specialized for (0: generic)
+    size_t block_size;
+    size_t segment_size;
+    size_t slice_start;
+    size_t slice_end;
+
+    // freq_shift and freq_shift_dc of a block
+    void (*freq_shift)(std::complex<float> *dest,
+                       const std::complex<float> *src,
+                       size_t len,
+                       float shift_freq,
+                       DeciAngle shift_phase,
+                       NCOType nco_type,
+                       size_t resync_interval);
+    std::complex<float> (*freq_shift_dc)(std::complex<float> *dest,
+                                         const std::complex<float> *src,
+                                         size_t len,
+                                         float shift_freq,
+                                         DeciAngle shift_phase,
+                                         NCOType nco_type,
+                                         size_t resync_interval);
+
+    // FFTShifter::shift of the bins [slice_start, slice_end) of a segment
+    void (*shift_slice)(FFTShifter &shifter,
+                        std::complex<float> *dest,
+                        const std::complex<float> *src,
+                        size_t len,
+                        float shift_freq,
+                        DeciAngle shift_phase,
+                        size_t carrier_offset,
+                        size_t begin,
+                        size_t end,
+                        float *power);
+};
+
+// Kernels for the given configuration (specialized where it is one of the
+// instantiated configurations, generic otherwise)
+DspKernels select_dsp_kernels(size_t block_size,
+                              size_t segment_size,
+                              size_t slice_start,
+                              size_t slice_end);
+
+// Calculate the 0 Hz frequency component from a time-domain signal
+std::complex<float> calculate_dc(const std::complex<float> *signal,
+                                 size_t len);
+
+// Convert interleaved unsigned 8-bit I/Q samples (as delivered by RTL-SDR
+// devices) to complex floats in [-1, 1].
+// (an arithmetic conversion rather than a table lookup, as the loop is then
+//  vectorized by the compiler, e.g. with NEON on the Odroids)
+void convert_iq_u8(std::complex<float> *dest,
+                   const uint8_t *src,
+                   size_t num_samples);
+
+// Inverse of convert_iq_u8 (values outside of [-1, 1] are clipped)
+void quantize_iq_u8(uint8_t *dest,
+                    const std::complex<float> *src,
+                    size_t num_samples);
+
+} // namespace corx
+
+#endif /* CORX_DSP_H */
@@ -0,0 +1,290 @@
+#include "flight_recorder.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include <time.h>
+
+#include "dsp.h"
+
+namespace corx {
+
+namespace {
+
+double to_seconds(const struct timeval &tv) {
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+double now_sec() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return to_seconds(tv);
+}
+
+size_t ring_bytes(const FlightRecorderOptions &options) {
+    // (half a second of slack for the samples that arrive while a trigger
+    //  is waiting for its last block)
+    double seconds = options.pre_seconds + options.post_seconds + 0.5;
+    if (options.sample_rate <= 0 || options.pre_seconds < 0 ||
+            options.post_seconds < 0) {
+        throw std::invalid_argument("invalid sample rate or duration");
+    }
+    return 2 * (size_t)std::ceil(seconds * options.sample_rate);
+}
+
+} // namespace
+
+
+FlightRecorder::FlightRecorder(const FlightRecorderOptions &options)
+    : options_(options),
+      pre_samples_(options.pre_seconds * options.sample_rate),
+      post_samples_(options.post_seconds * options.sample_rate),
+      ring_(ring_bytes(options)),
+      data_(reinterpret_cast<uint8_t*>(ring_.data())),
+      capacity_(ring_.size() / 2),
+      write_pos_(0),
+      num_writes_(0),
+      state_(IDLE),
+      trigger_pos_(0),
+      trigger_time_(0),
+      last_dump_time_(0),
+      quit_(false),
+      dumps_(0),
+      ignored_triggers_(0),
+      dropped_samples_(0) {
+
+    // touch every page, so that recording never page-faults
+    memset(data_, 127, ring_.size());
+    // (one entry per write; writes are at least a few hundred samples)
+    index_.resize(capacity_ / 256 + 16);
+
+    thread_ = std::thread(&FlightRecorder::runDumps, this);
+}
+
+FlightRecorder::~FlightRecorder() {
+    // (the writer has stopped: save an armed dump with what is there)
+    int armed = ARMED;
+    state_.compare_exchange_strong(armed, FROZEN);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        quit_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+}
+
+uint8_t* FlightRecorder::beginWrite(size_t len) {
+    if (state_.load(std::memory_order_acquire) == FROZEN ||
+            len > capacity_) {
+        dropped_samples_ += len;
+        return nullptr;
+    }
+    // (contiguous thanks to the mirrored mapping)
+    return data_ + 2 * (write_pos_.load(std::memory_order_relaxed)
+                        % capacity_);
+}
+
+void FlightRecorder::endWrite(size_t len, const struct timeval &time) {
+    uint64_t pos = write_pos_.load(std::memory_order_relaxed);
+    IndexEntry &entry = index_[num_writes_++ % index_.size()];
+    entry.pos = pos;
+    entry.time = to_seconds(time);
+
+    pos += len;
+    write_pos_.store(pos, std::memory_order_release);
+
+    if (state_.load(std::memory_order_acquire) == ARMED &&
+            pos >= trigger_pos_) {
+        // freeze the ring and hand it to the dump thread
+        state_ = FROZEN;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+        }
+        cv_.notify_one();
+    }
+}
+
+void FlightRecorder::record(const std::complex<float> *samples, size_t len,
+                            const struct timeval &time) {
+    uint8_t *dest = beginWrite(len);
+    if (dest != nullptr) {
+        quantize_iq_u8(dest, samples, len);
+        endWrite(len, time);
+    }
+}
+
+void FlightRecorder::recordRaw(const uint8_t *iq, size_t len,
+                               const struct timeval &time) {
+    uint8_t *dest = beginWrite(len);
+    if (dest != nullptr) {
+        memcpy(dest, iq, 2 * len);
+        endWrite(len, time);
+    }
+}
+
+bool FlightRecorder::trigger(const std::string &reason) {
+    bool command = (reason == "command");
+    if (!command && options_.triggers.count(reason) == 0) {
+        return false;
+    }
+
+    double now = now_sec();
+    if (!command && last_dump_time_ > 0 &&
+            now - last_dump_time_ < options_.min_interval) {
+        ignored_triggers_++;
+        return false;
+    }
+    int idle = IDLE;
+    if (!state_.compare_exchange_strong(idle, ARMING)) {
+        ignored_triggers_++;
+        return false;
+    }
+
+    reason_ = reason;
+    trigger_pos_ = write_pos_.load(std::memory_order_acquire) + post_samples_;
+    trigger_time_ = now;
+    last_dump_time_ = now;
+    state_.store(ARMED, std::memory_order_release);
+    return true;
+}
+
+void FlightRecorder::runDumps() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this] {
+            return quit_ || state_.load() == FROZEN;
+        });
+        if (state_.load() == FROZEN) {
+            lock.unlock();
+            dump();
+            lock.lock();
+        } else if (quit_) {
+            break;
+        }
+    }
+}
+
+double FlightRecorder::timeOf(uint64_t pos) const {
+    // latest write that started at or before pos (or the oldest one)
+    size_t count = std::min<uint64_t>(num_writes_, index_.size());
+    const IndexEntry *best = nullptr;
+    const IndexEntry *oldest = nullptr;
+    for (size_t i = 0; i < count; ++i) {
+        const IndexEntry &entry = index_[i];
+        if (entry.pos <= pos && (best == nullptr || entry.pos > best->pos)) {
+            best = &entry;
+        }
+        if (oldest == nullptr || entry.pos < oldest->pos) {
+            oldest = &entry;
+        }
+    }
+    if (best == nullptr) {
+        best = oldest;
+    }
+    if (best == nullptr) {
+        return 0;
+    }
+    return best->time + ((double)pos - best->pos) / options_.sample_rate;
+}
+
+void FlightRecorder::dump() {
+    // -- Copy the samples out of the frozen ring
+    uint64_t end = write_pos_.load(std::memory_order_acquire);
+    uint64_t len = std::min(std::min(end, capacity_),
+                            pre_samples_ + post_samples_);
+    uint64_t start = end - len;
+    std::vector<uint8_t> samples(data_ + 2 * (start % capacity_),
+                                 data_ + 2 * (start % capacity_) + 2 * len);
+    double start_time = timeOf(start);
+    std::string reason = reason_;
+    double trigger_time = trigger_time_;
+
+    // -- Resume recording
+    state_ = WRITING;
+
+    // -- Save
+    char time_str[32];
+    time_t trigger_sec = (time_t)trigger_time;
+    struct tm tm;
+    localtime_r(&trigger_sec, &tm);
+    strftime(time_str, sizeof(time_str), "%Y%m%d-%H%M%S", &tm);
+    std::string name = (options_.dir + "/corx_dump_rx" +
+                        std::to_string(options_.device_index) + "_" +
+                        time_str + "_" + reason);
+
+    bool success = false;
+    FILE *out = fopen((name + ".cu8").c_str(), "wb");
+    if (out != nullptr) {
+        success = (fwrite(samples.data(), 1, samples.size(), out)
+                   == samples.size());
+        success = (fclose(out) == 0) && success;
+    }
+    FILE *meta = success ? fopen((name + ".json").c_str(), "w") : nullptr;
+    if (meta != nullptr) {
+        fprintf(meta,
+                "{\"reason\": \"%s\", \"device_index\": %d, "
+                "\"sample_rate\": %.1f, \"frequency\": %u, "
+                "\"format\": \"cu8\", \"samples\": %llu, "
+                "\"start_time\": %.6f, \"trigger_time\": %.6f}\n",
+                reason.c_str(), options_.device_index, options_.sample_rate,
+                options_.frequency, (unsigned long long)len, start_time,
+                trigger_time);
+        success = (fclose(meta) == 0);
+    } else {
+        success = false;
+    }
+
+    if (success) {
+        dumps_++;
+        printf("Flight recorder: saved %.1f s of samples to %s.cu8 "
+               "(trigger: %s)\n",
+               len / options_.sample_rate, name.c_str(), reason.c_str());
+    } else {
+        fprintf(stderr, "Warning: flight recorder could not write %s: %s\n",
+                name.c_str(), strerror(errno));
+    }
+    fflush(stdout);
+
+    state_ = IDLE;
+}
+
+void FlightRecorder::printStats(FILE* out) const {
+    fprintf(out,
+            "Flight recorder: %llu dumps; %llu triggers ignored; "
+            "%llu samples dropped while saving\n",
+            (unsigned long long)dumps_.load(),
+            (unsigned long long)ignored_triggers_.load(),
+            (unsigned long long)dropped_samples_.load());
+}
+
+
+bool parse_flight_recorder_triggers(const std::string &str,
+                                    std::set<std::string> &triggers) {
+    static const char *valid[] = {
+        "lost_lock", "time_step", "phase_errors", "command"
+    };
+    triggers.clear();
+    size_t offset = 0;
+    while (offset <= str.size()) {
+        size_t pos = str.find(',', offset);
+        if (pos == std::string::npos) {
+            pos = str.size();
+        }
+        std::string trigger = str.substr(offset, pos - offset);
+        offset = pos + 1;
+        if (trigger.empty()) {
+            continue;
+        }
+        if (std::find(std::begin(valid), std::end(valid), trigger)
+                == std::end(valid)) {
+            return false;
+        }
+        triggers.insert(trigger);
+    }
+    return true;
+}
+
+} // namespace corx
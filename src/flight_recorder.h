@@ -0,0 +1,146 @@
+#ifndef CORX_FLIGHT_RECORDER_H
+#define CORX_FLIGHT_RECORDER_H
+
+#include <atomic>
+#include <complex>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#include "mirrored_buffer.h"
+
+namespace corx {
+
+// Settings of FlightRecorder
+struct FlightRecorderOptions {
+    double sample_rate;
+    uint32_t frequency;
+    int device_index;
+    // Seconds of samples to save before and after a trigger
+    double pre_seconds;
+    double post_seconds;
+    // Directory of the dumps
+    std::string dir;
+    // Triggers that cause a dump (the "command" trigger is always enabled)
+    std::set<std::string> triggers;
+    // Minimum time between two dumps of the same recorder in seconds,
+    // except for the "command" trigger
+    double min_interval;
+
+    FlightRecorderOptions()
+        : sample_rate(0), frequency(0), device_index(-1), pre_seconds(4),
+          post_seconds(1), dir("."), min_interval(60) {}
+};
+
+// Always-on recorder of the raw input samples, saved when something goes
+// wrong (e.g. the carrier is lost or a beacon pulse is missed).
+//
+// The samples are kept as interleaved uint8 I/Q (as delivered by RTL-SDR
+// devices) in a fixed-size, pre-faulted, memory-mapped ring. A single writer
+// (the thread that reads the samples) appends to the ring without locks.
+// Once a trigger has fired and the samples after it have been recorded, the
+// writer freezes the ring and wakes up the dump thread, which copies the
+// samples around the trigger out of the ring, unfreezes it and writes them
+// to a .cu8 file (with a .json file describing the dump). The writer drops
+// samples while the ring is frozen, i.e. during a copy of a few MB.
+class FlightRecorder {
+public:
+    // Throws std::runtime_error if the ring can not be allocated
+    explicit FlightRecorder(const FlightRecorderOptions &options);
+    ~FlightRecorder();
+
+    FlightRecorder(const FlightRecorder&) = delete;
+    FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+    // -- Writer (a single thread)
+    // Append samples in [-1, 1] (quantized to uint8) or raw uint8 I/Q
+    // samples, the first of which has been sampled at the given host time.
+    void record(const std::complex<float> *samples, size_t len,
+                const struct timeval &time);
+    void recordRaw(const uint8_t *iq, size_t len,
+                   const struct timeval &time);
+
+    // -- Triggers (a single thread, which may differ from the writer)
+    // Request a dump of the samples around now. Returns false if the
+    // trigger is disabled, a dump is in progress or the last dump happened
+    // less than min_interval ago (except for the "command" trigger).
+    bool trigger(const std::string &reason);
+
+    uint64_t dumps() const { return dumps_; }
+    uint64_t ignoredTriggers() const { return ignored_triggers_; }
+    uint64_t droppedSamples() const { return dropped_samples_; }
+
+    void printStats(FILE* out) const;
+
+private:
+    enum State {
+        IDLE,     // recording
+        ARMING,   // trigger is setting up a dump
+        ARMED,    // recording the samples after the trigger
+        FROZEN,   // dump thread is copying the samples
+        WRITING   // recording; dump thread is writing the file
+    };
+
+    // Reserve space for len samples; returns nullptr if frozen
+    uint8_t* beginWrite(size_t len);
+    void endWrite(size_t len, const struct timeval &time);
+    void runDumps();
+    void dump();
+    // Host time of the sample at the given ring position
+    double timeOf(uint64_t pos) const;
+
+    const FlightRecorderOptions options_;
+    const uint64_t pre_samples_;
+    const uint64_t post_samples_;
+
+    MirroredBuffer ring_;
+    uint8_t *data_;
+    // Capacity of the ring in samples
+    uint64_t capacity_;
+
+    // Number of samples written (writer only; read by the dump thread
+    // while the ring is frozen)
+    std::atomic<uint64_t> write_pos_;
+
+    // Host time of the first sample of recent writes (by write count)
+    struct IndexEntry {
+        uint64_t pos;
+        double time;
+    };
+    std::vector<IndexEntry> index_;
+    uint64_t num_writes_;
+
+    std::atomic<int> state_;
+    // Set by the trigger before arming
+    std::string reason_;
+    uint64_t trigger_pos_;
+    double trigger_time_;
+    double last_dump_time_;
+
+    // Dump thread
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool quit_;
+    std::thread thread_;
+
+    std::atomic<uint64_t> dumps_;
+    std::atomic<uint64_t> ignored_triggers_;
+    std::atomic<uint64_t> dropped_samples_;
+};
+
+// Parse a comma-separated list of flight recorder triggers
+// (lost_lock, time_step, phase_errors or command)
+bool parse_flight_recorder_triggers(const std::string &str,
+                                    std::set<std::string> &triggers);
+
+} // namespace corx
+
+#endif /* CORX_FLIGHT_RECORDER_H */
@@ -0,0 +1,60 @@
+#include "goertzel.h"
+
+#include <cmath>
+
+namespace corx {
+
+namespace {
+
+// Number of bins computed in a single pass over the input
+const size_t BINS_PER_PASS = 4;
+
+} // namespace
+
+
+void goertzel_bins(std::complex<float> *dest,
+                   const std::complex<float> *src,
+                   size_t len,
+                   size_t begin,
+                   size_t end) {
+    const float *x = reinterpret_cast<const float*>(src);
+
+    for (size_t k0 = begin; k0 < end; k0 += BINS_PER_PASS) {
+        size_t num_bins = std::min(BINS_PER_PASS, end - k0);
+
+        double coeff[BINS_PER_PASS];
+        double s1_re[BINS_PER_PASS] = {0}, s1_im[BINS_PER_PASS] = {0};
+        double s2_re[BINS_PER_PASS] = {0}, s2_im[BINS_PER_PASS] = {0};
+        for (size_t b = 0; b < num_bins; ++b) {
+            coeff[b] = 2 * std::cos(2 * M_PI * (k0 + b) / len);
+        }
+
+        // s[n] = x[n] + coeff * s[n-1] - s[n-2]
+        for (size_t n = 0; n < len; ++n) {
+            double re = x[2*n], im = x[2*n+1];
+            for (size_t b = 0; b < num_bins; ++b) {
+                double s_re = re + coeff[b] * s1_re[b] - s2_re[b];
+                double s_im = im + coeff[b] * s1_im[b] - s2_im[b];
+                s2_re[b] = s1_re[b];
+                s2_im[b] = s1_im[b];
+                s1_re[b] = s_re;
+                s1_im[b] = s_im;
+            }
+        }
+
+        // X[k] = exp(j w) s[N-1] - s[N-2]
+        for (size_t b = 0; b < num_bins; ++b) {
+            double w = 2 * M_PI * (k0 + b) / len;
+            double c = std::cos(w), s = std::sin(w);
+            dest[k0 + b] = std::complex<float>(
+                    c * s1_re[b] - s * s1_im[b] - s2_re[b],
+                    s * s1_re[b] + c * s1_im[b] - s2_im[b]);
+        }
+    }
+}
+
+bool goertzel_is_cheaper(size_t len, size_t num_bins) {
+    return 4. * num_bins < 2.5 * std::log2((double)len);
+}
+
+} // namespace corx
@@ -0,0 +1,30 @@
+#ifndef CORX_GOERTZEL_H
+#define CORX_GOERTZEL_H
+
+#include <complex>
+
+#include <stddef.h>
+
+namespace corx {
+
+// Calculate the bins [begin, end) of the len-point DFT of src with the
+// Goertzel algorithm. Bin k is written to dest[k]; other bins are not
+// touched. The recursion is evaluated in double precision, since its
+// rounding error grows with len for bins close to DC.
+void goertzel_bins(std::complex<float> *dest,
+                   const std::complex<float> *src,
+                   size_t len,
+                   size_t begin,
+                   size_t end);
+
+// Whether computing num_bins bins with goertzel_bins is expected to be cheaper
+// than a full FFT of len points.
+//
+// Cost model: the Goertzel recursion takes about 4 flops per sample and bin
+// (real coefficient, complex input), and a (SIMD) FFT about 2.5 len log2(len)
+// flops.
+bool goertzel_is_cheaper(size_t len, size_t num_bins);
+
+} // namespace corx
+
+#endif /* CORX_GOERTZEL_H */
@@ -0,0 +1,255 @@
+#include "hot_memory.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace corx {
+
+namespace {
+
+const size_t SMALL_PAGE = 4096;
+const size_t HUGE_PAGE = HotArena::CHUNK_SIZE;
+
+// (MAP_HUGETLB and MADV_HUGEPAGE are Linux specific)
+void* map_chunk(size_t size, bool huge_pages, const char *&backing) {
+    void *data = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (huge_pages) {
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        backing = "hugetlb";
+    }
+#endif
+    if (data == MAP_FAILED) {
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        backing = "4k";
+#ifdef MADV_HUGEPAGE
+        if (data != MAP_FAILED && huge_pages &&
+                madvise(data, size, MADV_HUGEPAGE) == 0) {
+            backing = "thp";
+        }
+#endif
+    }
+    return data == MAP_FAILED ? nullptr : data;
+}
+
+// Page-aligned range of the pages of a buffer
+std::pair<uintptr_t, uintptr_t> page_range(const void *data,
+                                           size_t bytes,
+                                           size_t page) {
+    uintptr_t begin = reinterpret_cast<uintptr_t>(data);
+    uintptr_t end = begin + bytes;
+    begin -= begin % page;
+    end = (end + page - 1) / page * page;
+    return std::make_pair(begin, end);
+}
+
+// Number of pages covered by the union of the ranges
+size_t count_pages(std::vector<std::pair<uintptr_t, uintptr_t>> ranges,
+                   size_t page) {
+    std::sort(ranges.begin(), ranges.end());
+    size_t pages = 0;
+    uintptr_t covered = 0;
+    for (const std::pair<uintptr_t, uintptr_t> &range : ranges) {
+        uintptr_t begin = std::max(range.first, covered);
+        if (range.second > begin) {
+            pages += (range.second - begin) / page;
+            covered = range.second;
+        }
+    }
+    return pages;
+}
+
+} // namespace
+
+
+HotArena::~HotArena() {
+    for (const Chunk &chunk : chunks_) {
+        munmap(chunk.data, chunk.size);
+    }
+}
+
+void HotArena::setOptions(const HotMemoryOptions &options) {
+    for (Chunk &chunk : chunks_) {
+        if (options.lock && !chunk.locked) {
+            if (mlock(chunk.data, chunk.size) == 0) {
+                chunk.locked = true;
+            } else {
+                fprintf(stderr, "Warning: could not lock %zu KiB of hot "
+                                "buffers: %s\n",
+                        chunk.size / 1024, strerror(errno));
+            }
+        } else if (!options.lock && chunk.locked) {
+            munlock(chunk.data, chunk.size);
+            chunk.locked = false;
+        }
+    }
+    options_ = options;
+}
+
+void* HotArena::allocate(size_t bytes) {
+    bytes = std::max<size_t>(bytes, 1);
+    if (chunks_.empty() ||
+            chunks_.back().size - chunks_.back().used < bytes) {
+        Chunk chunk;
+        chunk.size = (bytes + CHUNK_SIZE - 1) / CHUNK_SIZE * CHUNK_SIZE;
+        chunk.used = 0;
+        chunk.data = static_cast<char*>(map_chunk(chunk.size,
+                                                  options_.huge_pages,
+                                                  chunk.backing));
+        if (chunk.data == nullptr) {
+            throw std::bad_alloc();
+        }
+        chunk.locked = false;
+        if (options_.lock) {
+            if (mlock(chunk.data, chunk.size) == 0) {
+                chunk.locked = true;
+            } else {
+                fprintf(stderr, "Warning: could not lock %zu KiB of hot "
+                                "buffers: %s\n",
+                        chunk.size / 1024, strerror(errno));
+            }
+        }
+        chunks_.push_back(chunk);
+    }
+
+    Chunk &chunk = chunks_.back();
+    void *data = chunk.data + chunk.used;
+    size_t aligned = (bytes + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    chunk.used = std::min(chunk.size, chunk.used + aligned);
+    used_ += bytes;
+    return data;
+}
+
+size_t HotArena::mapped() const {
+    size_t size = 0;
+    for (const Chunk &chunk : chunks_) {
+        size += chunk.size;
+    }
+    return size;
+}
+
+std::string HotArena::backing() const {
+    std::string result;
+    for (const Chunk &chunk : chunks_) {
+        if (result.find(chunk.backing) == std::string::npos) {
+            result += (result.empty() ? "" : "+");
+            result += chunk.backing;
+        }
+    }
+    return result.empty() ? "none" : result;
+}
+
+bool HotArena::locked() const {
+    for (const Chunk &chunk : chunks_) {
+        if (!chunk.locked) {
+            return false;
+        }
+    }
+    return !chunks_.empty();
+}
+
+
+void HotSet::add(const std::string &name,
+                 const void *data,
+                 size_t bytes,
+                 bool in_arena) {
+    if (data == nullptr || bytes == 0) {
+        return;
+    }
+    Buffer buffer;
+    buffer.name = name;
+    buffer.data = data;
+    buffer.bytes = bytes;
+    buffer.in_arena = in_arena;
+    buffers_.push_back(buffer);
+}
+
+bool HotSet::apply(const HotMemoryOptions &options) {
+    // (buffers of the previous configuration may have been released)
+    unlock();
+    bool success = true;
+    for (const Buffer &buffer : buffers_) {
+        if (buffer.in_arena) {
+            continue;
+        }
+        std::pair<uintptr_t, uintptr_t> range = page_range(
+                buffer.data, buffer.bytes, SMALL_PAGE);
+        void *begin = reinterpret_cast<void*>(range.first);
+        size_t size = range.second - range.first;
+#ifdef MADV_HUGEPAGE
+        // (only affects the 2 MiB regions that are completely inside)
+        if (options.huge_pages) {
+            madvise(begin, size, MADV_HUGEPAGE);
+        }
+#endif
+        if (!options.lock) {
+            continue;
+        }
+        if (mlock(begin, size) == 0) {
+            locked_.push_back(std::make_pair(begin, size));
+        } else {
+            fprintf(stderr, "Warning: could not lock %s (%zu KiB): %s\n",
+                    buffer.name.c_str(), size / 1024, strerror(errno));
+            success = false;
+        }
+    }
+    return success;
+}
+
+void HotSet::unlock() {
+    for (const std::pair<void*, size_t> &range : locked_) {
+        munlock(range.first, range.second);
+    }
+    locked_.clear();
+}
+
+size_t HotSet::bytes() const {
+    size_t total = 0;
+    for (const Buffer &buffer : buffers_) {
+        total += buffer.bytes;
+    }
+    return total;
+}
+
+void HotSet::print(FILE *out,
+                   const std::string &prefix,
+                   const HotArena *arena) const {
+    std::vector<std::pair<uintptr_t, uintptr_t>> small, huge;
+    size_t arena_bytes = 0;
+    for (const Buffer &buffer : buffers_) {
+        small.push_back(page_range(buffer.data, buffer.bytes, SMALL_PAGE));
+        huge.push_back(page_range(buffer.data, buffer.bytes, HUGE_PAGE));
+        if (buffer.in_arena) {
+            arena_bytes += buffer.bytes;
+        }
+    }
+
+    fprintf(out, "%sHot set: %.1f KiB in %zu buffers (%.1f KiB in the "
+                 "arena); %zu pages of 4 KiB, %zu regions of 2 MiB\n",
+            prefix.c_str(), bytes() / 1024., buffers_.size(),
+            arena_bytes / 1024., count_pages(small, SMALL_PAGE),
+            count_pages(huge, HUGE_PAGE));
+    if (arena != nullptr) {
+        fprintf(out, "%s  arena: %.1f of %.1f KiB in %zu chunks (%s%s)\n",
+                prefix.c_str(), arena->used() / 1024.,
+                arena->mapped() / 1024., arena->numChunks(),
+                arena->backing().c_str(),
+                arena->locked() ? ", locked" : "");
+    }
+    for (const Buffer &buffer : buffers_) {
+        fprintf(out, "%s  %s: %.1f KiB%s\n", prefix.c_str(),
+                buffer.name.c_str(), buffer.bytes / 1024.,
+                buffer.in_arena ? " (arena)" : "");
+    }
+}
+
+} // namespace corx
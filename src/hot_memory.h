@@ -0,0 +1,153 @@
+#ifndef CORX_HOT_MEMORY_H
+#define CORX_HOT_MEMORY_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+#include <stdio.h>
+
+namespace corx {
+
+struct HotMemoryOptions {
+    // Back the memory with huge pages: MAP_HUGETLB if huge pages have been
+    // reserved (vm.nr_hugepages), otherwise transparent huge pages
+    bool huge_pages;
+    // Lock the memory (mlock), so that page faults and swapping cannot stall
+    // the capture (limited by RLIMIT_MEMLOCK unless privileged)
+    bool lock;
+
+    HotMemoryOptions() : huge_pages(false), lock(false) {}
+};
+
+// Arena of the hot buffers of a receiver, i.e. the buffers that are
+// accessed for every block.
+//
+// Buffers are allocated contiguously (cache line aligned) from chunks of
+// anonymous memory that are a multiple of the huge page size. A new chunk is
+// mapped whenever a buffer does not fit into the last one. Memory is only
+// released when the arena is destroyed, so that buffers allocated for one
+// configuration remain valid when the configuration changes (cf.
+// ObjectCache). Failures to use huge pages or to lock a chunk are warnings;
+// allocations throw std::bad_alloc if no memory can be mapped.
+class HotArena {
+public:
+    static const size_t CACHE_LINE = 64;
+    static const size_t CHUNK_SIZE = 2 << 20;
+
+    HotArena() : used_(0) {}
+    ~HotArena();
+
+    HotArena(const HotArena&) = delete;
+    HotArena& operator=(const HotArena&) = delete;
+
+    // Options of the chunks mapped after this call. The chunks mapped so far
+    // are locked or unlocked according to options.lock.
+    void setOptions(const HotMemoryOptions &options);
+
+    void* allocate(size_t bytes);
+
+    template <typename T>
+    T* allocate(size_t count) {
+        return static_cast<T*>(allocate(count * sizeof(T)));
+    }
+
+    // Bytes allocated from and mapped by the arena
+    size_t used() const { return used_; }
+    size_t mapped() const;
+    size_t numChunks() const { return chunks_.size(); }
+    // How the chunks are backed, e.g. "hugetlb", "thp" or "4k" (joined by
+    // "+" if they differ)
+    std::string backing() const;
+    bool locked() const;
+
+private:
+    struct Chunk {
+        char *data;
+        size_t size;
+        size_t used;
+        const char *backing;
+        bool locked;
+    };
+
+    HotMemoryOptions options_;
+    std::vector<Chunk> chunks_;
+    size_t used_;
+};
+
+// Buffers allocated from a HotArena for every key used so far, so that
+// switching back to a configuration does not allocate again (cf.
+// ObjectCache). The buffers belong to the arena.
+template <typename Key, typename T>
+class ArenaBufferCache {
+public:
+    // Returns the buffer for the given key, allocated with count elements
+    // if it is not in the cache yet.
+    T* get(HotArena &arena, const Key &key, size_t count) {
+        auto it = buffers_.find(key);
+        if (it == buffers_.end()) {
+            it = buffers_.insert(std::make_pair(
+                    key, arena.allocate<T>(count))).first;
+        }
+        return it->second;
+    }
+
+    size_t size() const { return buffers_.size(); }
+
+private:
+    std::map<Key, T*> buffers_;
+};
+
+// The hot buffers of a receiver, for the hot-set report. Buffers that have
+// not been allocated from a HotArena (e.g. the FFT buffers of fastdet)
+// cannot be moved, but their pages can be advised to use transparent huge
+// pages and locked.
+class HotSet {
+public:
+    HotSet() {}
+    ~HotSet() { unlock(); }
+
+    HotSet(const HotSet&) = delete;
+    HotSet& operator=(const HotSet&) = delete;
+
+    // (the pages stay locked until the next apply)
+    void clear() { buffers_.clear(); }
+
+    void add(const std::string &name,
+             const void *data,
+             size_t bytes,
+             bool in_arena = false);
+
+    // Apply the options to the pages of the buffers that are not in an
+    // arena, after unlocking the pages locked by the previous call. Returns
+    // false (with a warning) if locking failed.
+    bool apply(const HotMemoryOptions &options);
+
+    size_t bytes() const;
+
+    // Print the total size, the number of 4 KiB pages and 2 MiB regions the
+    // buffers span (an estimate of the TLB entries needed) and every buffer
+    void print(FILE *out,
+               const std::string &prefix,
+               const HotArena *arena) const;
+
+private:
+    struct Buffer {
+        std::string name;
+        const void *data;
+        size_t bytes;
+        bool in_arena;
+    };
+
+    // Unlock the pages locked by apply
+    void unlock();
+
+    std::vector<Buffer> buffers_;
+    // Page ranges locked by apply
+    std::vector<std::pair<void*, size_t>> locked_;
+};
+
+} // namespace corx
+
+#endif /* CORX_HOT_MEMORY_H */
@@ -0,0 +1,69 @@
+#include "mirrored_buffer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace corx {
+
+namespace {
+
+std::string error_str(const char *what) {
+    return std::string(what) + ": " + strerror(errno);
+}
+
+} // namespace
+
+MirroredBuffer::MirroredBuffer(size_t min_size)
+    : size_(0), data_(nullptr) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = (std::max(min_size, (size_t)1) + page - 1) / page * page;
+
+    // (syscall instead of memfd_create, which requires glibc 2.27)
+    int fd = syscall(SYS_memfd_create, "corx_ring", 0);
+    if (fd < 0) {
+        throw std::runtime_error(error_str("memfd_create failed"));
+    }
+    if (ftruncate(fd, size) != 0) {
+        std::string error = error_str("ftruncate failed");
+        close(fd);
+        throw std::runtime_error(error);
+    }
+
+    // reserve twice the address space, and map the file to both halves
+    void *base = mmap(nullptr, 2 * size, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        std::string error = error_str("mmap failed");
+        close(fd);
+        throw std::runtime_error(error);
+    }
+    char *data = static_cast<char*>(base);
+    for (int i = 0; i < 2; ++i) {
+        void *half = mmap(data + i * size, size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_FIXED, fd, 0);
+        if (half == MAP_FAILED) {
+            std::string error = error_str("mmap failed");
+            munmap(base, 2 * size);
+            close(fd);
+            throw std::runtime_error(error);
+        }
+    }
+    // (the mappings keep the memory alive)
+    close(fd);
+
+    size_ = size;
+    data_ = data;
+}
+
+MirroredBuffer::~MirroredBuffer() {
+    munmap(data_, 2 * size_);
+}
+
+} // namespace corx
@@ -0,0 +1,37 @@
+#ifndef CORX_MIRRORED_BUFFER_H
+#define CORX_MIRRORED_BUFFER_H
+
+#include <stddef.h>
+
+namespace corx {
+
+// A ring buffer whose memory is mapped twice in a row, so that every window
+// of up to size() bytes starting within the buffer is contiguous, i.e.
+// reads and writes that wrap around the end of the ring need no copies.
+//
+// Linux only (uses memfd_create).
+class MirroredBuffer {
+public:
+    // The size is rounded up to a multiple of the page size.
+    // Throws std::runtime_error if the memory cannot be mapped.
+    explicit MirroredBuffer(size_t min_size);
+    ~MirroredBuffer();
+
+    MirroredBuffer(const MirroredBuffer&) = delete;
+    MirroredBuffer& operator=(const MirroredBuffer&) = delete;
+
+    size_t size() const { return size_; }
+
+    // Start of the buffer; data()[i] and data()[i + size()] are the same
+    // byte for i < size().
+    char* data() { return data_; }
+    const char* data() const { return data_; }
+
+private:
+    size_t size_;
+    char *data_;
+};
+
+} // namespace corx
+
+#endif /* CORX_MIRRORED_BUFFER_H */
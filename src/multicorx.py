@@ -12,6 +12,7 @@ import sys
 import re
 import signal
 import socket
+import struct
 
 
 # We only support Python 3
@@ -29,11 +30,34 @@ STATE_REGEX_PATTERN = r'\[#\d+\] STATE changed from [A-Z_]+ to ([A-Z_]+)'
 STATE_REGEX = re.compile(STATE_REGEX_PATTERN)
 MODE_REGEX_PATTERN = r'\[#\d+\] MODE changed from [A-Z_]+ to ([A-Z_]+)'
 MODE_REGEX = re.compile(MODE_REGEX_PATTERN)
+STATS_REGEX_PATTERN = r'STATS rx=(\d+) (\S+)(.*)'
+STATS_REGEX = re.compile(STATS_REGEX_PATTERN)
+
+# Binary control channel (see src/control_channel.h)
+FRAME_HEADER = struct.Struct('<IHh')  # length, type, rx
+FRAME_COMMAND = 1
+FRAME_STATE = 2
+FRAME_TRACK_STATE = 3
+FRAME_MODE = 4
+FRAME_BEACON = 5
+FRAME_CYCLE = 6
+FRAME_STATUS = 7
+FRAME_STATS = 8
+TRANSITION_PAYLOAD = struct.Struct('<BBI')  # old, new, block
+BEACON_PAYLOAD = struct.Struct('<iIdf')  # beacon, block, soa, peak power
+CYCLE_PAYLOAD = struct.Struct('<iIB')  # beacon, block, preamp on
+STATUS_ENTRY = struct.Struct('<hBBBBIi')
+# (in the order of the enums of receiver.h)
+STATES = ['STOPPED', 'STANDBY', 'TRACK', 'NOISE_WAIT', 'NOISE_CAPTURE']
+MODES = ['STOP', 'STANDBY', 'LOCK', 'CAPTURE']
+TRACK_STATES = ['INACTIVE', 'FIND_CARRIER', 'LOCKED', 'FIND_BEACON',
+                'CAPTURE']
 
 # Globals
 poller = select.epoll()
 subprocs = {}
 stderrs = {}
+controls = {}  # control channel FD -> Subproc (binary mode only)
 
 exec_procs = {}
 exec_when_idle = []
@@ -45,12 +69,15 @@ server = None  # Socket server
 clients = {}  # Socket clients
 notify_later = []  # list of FDs to notify when receivers are inactive
 
+stats_pending = set()  # RX IDs of receivers that have not reported stats
+
 # Args
 CORX_CMD = '../build/corx_rx'
 SUBPROC_LOG = sys.stdout
 INACTIVE_LOG_PATH = None
 ALLOW_EXEC = False
 HOST_ID = 'A'
+BINARY = False
 
 
 class Subproc(object):
@@ -60,22 +87,43 @@ class Subproc(object):
         self.state = 'STOPPED'
         self.dirty_state = False
         self.mode = 'STOP'
+        self.stats = {}  # (rx, name) -> {key: value}
+        self.control = None  # control channel socket (binary mode only)
+        self.control_buf = b''
+
+
+def name_of(names, value):
+    return names[value] if value < len(names) else 'UNKNOWN'
 
 
 def create_corx(rxid):
     args = [arg.format(rxid=rxid, hostid=HOST_ID) for arg in CORX_ARGS]
     cmd = [CORX_CMD] + args
+    pass_fds = ()
+    if BINARY:
+        # commands and events go through a socketpair instead of
+        # stdin/stdout
+        control, child = socket.socketpair()
+        cmd.append('--control_fd={}'.format(child.fileno()))
+        pass_fds = (child.fileno(),)
     print("Run", cmd)
     proc = subprocess.Popen(cmd,
                             stdout=subprocess.PIPE,
                             stdin=subprocess.PIPE,
-                            stderr=subprocess.PIPE)
+                            stderr=subprocess.PIPE,
+                            pass_fds=pass_fds)
     poller.register(proc.stdout, select.EPOLLHUP | select.EPOLLIN)
     poller.register(proc.stderr, select.EPOLLIN)
     fd = proc.stdout.fileno()
     subprocs[fd] = Subproc(rxid=rxid, proc=proc)
     errfd = proc.stderr.fileno()
     stderrs[errfd] = subprocs[fd]
+    if BINARY:
+        child.close()
+        control.setblocking(False)
+        poller.register(control.fileno(), select.EPOLLIN)
+        subprocs[fd].control = control
+        controls[control.fileno()] = subprocs[fd]
 
     # Do not block read
     # This doesn't work properly with Python 2.x
@@ -143,6 +191,13 @@ def process_command(line, from_=None):
 
     else:
         # Command is for subprocs
+        if cmd == 'STATS':
+            stats_pending.clear()
+            for subproc in subprocs.values():
+                subproc.stats.clear()
+                if subproc.state != 'DEAD':
+                    stats_pending.add(subproc.rxid)
+
         if cmd in ['STOP', 'STANDBY', 'LOCK', 'CAPTURE']:
             for subproc in subprocs.values():
                 if subproc.mode != cmd:
@@ -152,8 +207,24 @@ def process_command(line, from_=None):
             # inject RXID
             proc_cmd = line.format(rxid=subproc.rxid, hostid=HOST_ID)
             # send command
-            subproc.proc.stdin.write(proc_cmd.encode())
-            subproc.proc.stdin.flush()
+            if subproc.control is not None:
+                send_frame(subproc.control, FRAME_COMMAND,
+                           proc_cmd.rstrip('\n').encode())
+            else:
+                subproc.proc.stdin.write(proc_cmd.encode())
+                subproc.proc.stdin.flush()
+
+
+def send_frame(conn, frame_type, payload):
+    header = FRAME_HEADER.pack(4 + len(payload), frame_type, -1)
+    conn.setblocking(True)
+    try:
+        conn.sendall(header + payload)
+    except (BrokenPipeError, ConnectionResetError):
+        # (corx_rx has exited; read_corx_control sees EOF)
+        pass
+    finally:
+        conn.setblocking(False)
 
 
 def read_stdin():
@@ -201,6 +272,94 @@ def notify_if_exec_done():
         notify_exec_done.clear()
 
 
+def print_stats_summary():
+    """Print the stats of all receivers and the headroom of the host."""
+    print("*** Stats of host {}:".format(HOST_ID))
+    headrooms = []
+    totals = {'late': 0, 'dropped': 0, 'tracking_failures': 0}
+    for subproc in sorted(subprocs.values(), key=lambda x: x.rxid):
+        for (rx, name), values in sorted(subproc.stats.items()):
+            if name != 'counters':
+                continue
+            block = subproc.stats.get((rx, 'stage=block'), {})
+            print("RX #{}: headroom={} block_p99_us={} late={} dropped={} "
+                  "tracking_failures={} phase_errors={} beacons={}"
+                  .format(rx, values.get('headroom'), block.get('p99_us'),
+                          values.get('late'), values.get('dropped'),
+                          values.get('tracking_failures'),
+                          values.get('phase_errors'), values.get('beacons')))
+            headrooms.append(float(values.get('headroom', 0)))
+            for key in totals:
+                totals[key] += int(values.get(key, 0))
+    if headrooms:
+        print("Host {}: min headroom={:.3f} late={} dropped={} "
+              "tracking_failures={}"
+              .format(HOST_ID, min(headrooms), totals['late'],
+                      totals['dropped'], totals['tracking_failures']))
+
+
+def update_state(subproc, new_state):
+    """Record a state change. Returns True if all receivers became
+    inactive."""
+    inactive_before = check_all_inactive()
+    subproc.state = new_state
+    subproc.dirty_state = False
+    print("RX #{} changed state to {}"
+          .format(subproc.rxid, new_state))
+    sorted_subprocs = sorted(subprocs.values(),
+                             key=lambda x: x.rxid)
+    state_strs = ["{}={}".format(p.rxid, p.state)
+                  for p in sorted_subprocs]
+    print("States:", ' '.join(state_strs))
+    return not inactive_before and check_all_inactive()
+
+
+def update_mode(subproc, new_mode):
+    subproc.mode = new_mode
+    print("RX #{} changed mode to {}"
+          .format(subproc.rxid, new_mode))
+    sorted_subprocs = sorted(subprocs.values(),
+                             key=lambda x: x.rxid)
+    mode_strs = ["{}={}".format(p.rxid, p.mode)
+                 for p in sorted_subprocs]
+    print("Modes:", ' '.join(mode_strs))
+
+
+def update_stats(subproc, line_str):
+    m = STATS_REGEX.match(line_str)
+    if m:
+        rx, name, rest = m.groups()
+        values = dict(kv.split('=', 1) for kv in rest.split()
+                      if '=' in kv)
+        subproc.stats[(int(rx), name)] = values
+        if name == 'counters' and subproc.rxid in stats_pending:
+            stats_pending.discard(subproc.rxid)
+            if len(stats_pending) == 0:
+                print_stats_summary()
+
+
+def handle_all_inactive():
+    print("*** All the receivers are now inactive")
+    if INACTIVE_LOG_PATH is not None:
+        print("(write to inactive -- may block until read)", end='')
+        inactive = open(INACTIVE_LOG_PATH, 'w')
+        inactive.write("INACTIVE\n")
+        inactive.flush()
+        inactive.close()  # send EOF
+        print(" ..done")
+    for client_fd in notify_later:
+        if client_fd in clients:
+            notify_client_inactive(client_fd)
+    notify_later.clear()
+
+    if len(exec_when_idle) > 0:
+        print("Executing pending exec_when_idle jobs...")
+        for cmd in exec_when_idle:
+            shell_exec(cmd)
+        exec_when_idle.clear()
+        # TODO: notify_exec
+
+
 def read_corx_stdout(fd):
     subproc = subprocs[fd]
 
@@ -209,35 +368,21 @@ def read_corx_stdout(fd):
     for line in subproc.proc.stdout:
         line_str = line.decode()
 
-        # parse state
-        m = STATE_REGEX.match(line_str)
-        if m:
-            new_state = m.groups()[0]
-            inactive_before = check_all_inactive()
-            subproc.state = new_state
-            subproc.dirty_state = False
-            print("RX #{} changed state to {}"
-                  .format(subproc.rxid, new_state))
-            sorted_subprocs = sorted(subprocs.values(),
-                                     key=lambda x: x.rxid)
-            state_strs = ["{}={}".format(p.rxid, p.state)
-                          for p in sorted_subprocs]
-            print("States:", ' '.join(state_strs))
-            if not inactive_before and check_all_inactive():
-                active_to_inactive = True
+        # (in binary mode, states, modes and stats arrive as frames)
+        if subproc.control is None:
+            # parse state
+            m = STATE_REGEX.match(line_str)
+            if m:
+                if update_state(subproc, m.groups()[0]):
+                    active_to_inactive = True
+
+            # parse stats
+            update_stats(subproc, line_str)
 
-        # parse mode
-        m = MODE_REGEX.match(line_str)
-        if m:
-            new_mode = m.groups()[0]
-            subproc.mode = new_mode
-            print("RX #{} changed mode to {}"
-                  .format(subproc.rxid, new_mode))
-            sorted_subprocs = sorted(subprocs.values(),
-                                     key=lambda x: x.rxid)
-            mode_strs = ["{}={}".format(p.rxid, p.mode)
-                         for p in sorted_subprocs]
-            print("Modes:", ' '.join(mode_strs))
+            # parse mode
+            m = MODE_REGEX.match(line_str)
+            if m:
+                update_mode(subproc, m.groups()[0])
 
         # forward output
         SUBPROC_LOG.write("{}|".format(subproc.rxid))
@@ -247,25 +392,75 @@ def read_corx_stdout(fd):
     SUBPROC_LOG.flush()
 
     if active_to_inactive:
-        print("*** All the receivers are now inactive")
-        if INACTIVE_LOG_PATH is not None:
-            print("(write to inactive -- may block until read)", end='')
-            inactive = open(INACTIVE_LOG_PATH, 'w')
-            inactive.write("INACTIVE\n")
-            inactive.flush()
-            inactive.close()  # send EOF
-            print(" ..done")
-        for client_fd in notify_later:
-            if client_fd in clients:
-                notify_client_inactive(client_fd)
-        notify_later.clear()
+        handle_all_inactive()
+
+
+def read_corx_control(fd):
+    """Handle the frames of a binary control channel."""
+    subproc = controls[fd]
+    try:
+        data = subproc.control.recv(65536)
+    except BlockingIOError:
+        return
+    except ConnectionResetError:
+        # (corx_rx died with unread commands; handled like EOF)
+        data = b''
+    if not data:
+        poller.unregister(fd)
+        controls.pop(fd)
+        return
+    buf = subproc.control_buf + data
+
+    active_to_inactive = False
+    while len(buf) >= FRAME_HEADER.size:
+        length, frame_type, rx = FRAME_HEADER.unpack_from(buf)
+        end = 4 + length
+        if len(buf) < end:
+            break
+        payload = buf[FRAME_HEADER.size:end]
+        buf = buf[end:]
 
-        if len(exec_when_idle) > 0:
-            print("Executing pending exec_when_idle jobs...")
-            for cmd in exec_when_idle:
-                shell_exec(cmd)
-            exec_when_idle.clear()
-            # TODO: notify_exec
+        if frame_type == FRAME_STATE:
+            _, new, _ = TRANSITION_PAYLOAD.unpack_from(payload)
+            if update_state(subproc, name_of(STATES, new)):
+                active_to_inactive = True
+        elif frame_type == FRAME_MODE:
+            _, new, _ = TRANSITION_PAYLOAD.unpack_from(payload)
+            update_mode(subproc, name_of(MODES, new))
+        elif frame_type == FRAME_TRACK_STATE:
+            _, new, block = TRANSITION_PAYLOAD.unpack_from(payload)
+            SUBPROC_LOG.write("{}B|[#{}] TRACK {}\n"
+                              .format(subproc.rxid, block,
+                                      name_of(TRACK_STATES, new)))
+        elif frame_type == FRAME_BEACON:
+            beacon, block, soa, power = BEACON_PAYLOAD.unpack_from(payload)
+            SUBPROC_LOG.write("{}B|[#{}] beacon {} soa={:.3f} ampl={:.0f}\n"
+                              .format(subproc.rxid, block, beacon, soa,
+                                      power))
+        elif frame_type == FRAME_CYCLE:
+            beacon, block, preamp_on = CYCLE_PAYLOAD.unpack_from(payload)
+            SUBPROC_LOG.write("{}B|[#{}] cycle {} done (preamp {})\n"
+                              .format(subproc.rxid, block, beacon,
+                                      'on' if preamp_on else 'off'))
+        elif frame_type == FRAME_STATUS:
+            for offset in range(0, len(payload) - STATUS_ENTRY.size + 1,
+                                STATUS_ENTRY.size):
+                (entry_rx, state, mode, track, failed, block,
+                 beacon) = STATUS_ENTRY.unpack_from(payload, offset)
+                print("RX #{}: state={} mode={} track={} block={} "
+                      "beacon={} failed={}"
+                      .format(entry_rx, name_of(STATES, state),
+                              name_of(MODES, mode),
+                              name_of(TRACK_STATES, track), block, beacon,
+                              failed))
+        elif frame_type == FRAME_STATS:
+            for line_str in payload.decode().splitlines():
+                update_stats(subproc, line_str)
+    subproc.control_buf = buf
+    SUBPROC_LOG.flush()
+
+    if active_to_inactive:
+        handle_all_inactive()
 
 
 def read_corx_stderr(fd):
@@ -355,6 +550,7 @@ def signal_handler(signum, frame):
 
 def _main():
     global CORX_CMD, SUBPROC_LOG, INACTIVE_LOG_PATH, ALLOW_EXEC, HOST_ID
+    global BINARY
     import argparse
     parser = argparse.ArgumentParser()
     parser.add_argument('--log', type=argparse.FileType('w'),
@@ -381,12 +577,17 @@ def _main():
                              'via the EXEC command. WARNING: This will provide'
                              'full shell access over an insecure channel.'
                              'Only enable this on a trusted network!')
+    parser.add_argument('--binary', action='store_true',
+                        help='Control the receivers and receive their '
+                             'events over a binary channel (corx_rx '
+                             '--control_fd) instead of stdin/stdout.')
     args = parser.parse_args()
     SUBPROC_LOG = args.log
     CORX_CMD = args.corx
     INACTIVE_LOG_PATH = args.inactive
     ALLOW_EXEC = args.allow_exec
     HOST_ID = args.hostid
+    BINARY = args.binary
 
     if args.socket:
         global server
@@ -437,6 +638,8 @@ def _main():
                     read_corx_stdout(fd)
                 if event & select.EPOLLHUP:
                     handle_corx_sighup(fd)
+            elif fd in controls:
+                read_corx_control(fd)
             elif fd in stderrs:
                 if event & select.EPOLLIN:
                     read_corx_stderr(fd)
@@ -0,0 +1,176 @@
+/**
+ * Numpy .npz writer
+ *
+ * References:
+ *  - https://numpy.org/doc/stable/reference/generated/numpy.lib.format.html
+ *  - https://pkware.cachefly.net/webdocs/casestudies/APPNOTE.TXT
+ *
+ * Assumes a little-endian host.
+ */
+
+#include "npz_writer.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+namespace corx {
+
+namespace {
+
+struct CrcTable {
+    uint32_t entries[256];
+
+    CrcTable() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            }
+            entries[i] = c;
+        }
+    }
+};
+
+uint32_t crc32(const char *data, size_t len) {
+    // (thread-safe initialization, baselines are written concurrently)
+    static const CrcTable table;
+
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < len; ++i) {
+        crc = table.entries[(crc ^ (uint8_t)data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc ^ 0xffffffff;
+}
+
+void put16(std::vector<char> &out, uint16_t value) {
+    out.push_back(value & 0xff);
+    out.push_back(value >> 8);
+}
+
+void put32(std::vector<char> &out, uint32_t value) {
+    put16(out, value & 0xffff);
+    put16(out, value >> 16);
+}
+
+void put(std::vector<char> &out, const void *data, size_t len) {
+    const char *p = static_cast<const char*>(data);
+    out.insert(out.end(), p, p + len);
+}
+
+} // namespace
+
+
+void NpzWriter::add(const std::string &name,
+                    const std::complex<float> *data,
+                    size_t len) {
+    addArray(name, "<c8", "(" + std::to_string(len) + ",)",
+             data, len * sizeof(std::complex<float>));
+}
+
+void NpzWriter::add(const std::string &name, const std::vector<float> &data) {
+    addArray(name, "<f4", "(" + std::to_string(data.size()) + ",)",
+             data.data(), data.size() * sizeof(float));
+}
+
+void NpzWriter::add(const std::string &name, int64_t value) {
+    addArray(name, "<i8", "()", &value, sizeof(value));
+}
+
+void NpzWriter::addArray(const std::string &name,
+                         const char *descr,
+                         const std::string &shape,
+                         const void *data,
+                         size_t size) {
+    // .npy version 1.0 header, padded so that the data is 64-byte aligned
+    std::string header = (std::string("{'descr': '") + descr +
+                          "', 'fortran_order': False, 'shape': " + shape +
+                          ", }");
+    size_t preamble = 10;  // magic (6) + version (2) + header length (2)
+    size_t total = preamble + header.size() + 1;
+    header.append((64 - total % 64) % 64, ' ');
+    header.push_back('\n');
+
+    Entry entry;
+    entry.filename = name + ".npy";
+    put(entry.data, "\x93NUMPY\x01\x00", 8);
+    put16(entry.data, header.size());
+    put(entry.data, header.data(), header.size());
+    put(entry.data, data, size);
+    entries_.push_back(std::move(entry));
+}
+
+std::vector<char> NpzWriter::serialize() const {
+    std::vector<char> out;
+    std::vector<char> directory;
+    const uint16_t dos_time = 0, dos_date = (1 << 5) | 1;  // 1980-01-01
+
+    for (const Entry &entry : entries_) {
+        uint32_t offset = out.size();
+        uint32_t crc = crc32(entry.data.data(), entry.data.size());
+        uint32_t size = entry.data.size();
+        uint16_t name_len = entry.filename.size();
+
+        // local file header
+        put32(out, 0x04034b50);
+        put16(out, 20);          // version needed to extract
+        put16(out, 0);           // flags
+        put16(out, 0);           // compression: stored
+        put16(out, dos_time);
+        put16(out, dos_date);
+        put32(out, crc);
+        put32(out, size);        // compressed size
+        put32(out, size);        // uncompressed size
+        put16(out, name_len);
+        put16(out, 0);           // extra field length
+        put(out, entry.filename.data(), name_len);
+        put(out, entry.data.data(), size);
+
+        // central directory file header
+        put32(directory, 0x02014b50);
+        put16(directory, 20);    // version made by
+        put16(directory, 20);    // version needed to extract
+        put16(directory, 0);     // flags
+        put16(directory, 0);     // compression: stored
+        put16(directory, dos_time);
+        put16(directory, dos_date);
+        put32(directory, crc);
+        put32(directory, size);
+        put32(directory, size);
+        put16(directory, name_len);
+        put16(directory, 0);     // extra field length
+        put16(directory, 0);     // comment length
+        put16(directory, 0);     // disk number
+        put16(directory, 0);     // internal attributes
+        put32(directory, 0);     // external attributes
+        put32(directory, offset);
+        put(directory, entry.filename.data(), name_len);
+    }
+
+    uint32_t directory_offset = out.size();
+    put(out, directory.data(), directory.size());
+
+    // end of central directory record
+    put32(out, 0x06054b50);
+    put16(out, 0);               // disk number
+    put16(out, 0);               // disk with central directory
+    put16(out, entries_.size());
+    put16(out, entries_.size());
+    put32(out, directory.size());
+    put32(out, directory_offset);
+    put16(out, 0);               // comment length
+
+    return out;
+}
+
+bool NpzWriter::save(const std::string &path) const {
+    std::vector<char> data = serialize();
+    std::unique_ptr<FILE, decltype(&fclose)> file(fopen(path.c_str(), "wb"),
+                                                  &fclose);
+    if (!file) {
+        return false;
+    }
+    return fwrite(data.data(), 1, data.size(), file.get()) == data.size();
+}
+
+} // namespace corx
@@ -0,0 +1,55 @@
+#ifndef CORX_NPZ_WRITER_H
+#define CORX_NPZ_WRITER_H
+
+#include <complex>
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace corx {
+
+// Writes numpy .npz archives (an uncompressed zip file of .npy arrays) that
+// can be read with numpy.load().
+class NpzWriter {
+public:
+    // Add a one-dimensional complex64 array
+    void add(const std::string &name,
+             const std::complex<float> *data,
+             size_t len);
+    void add(const std::string &name,
+             const std::vector<std::complex<float>> &data) {
+        add(name, data.data(), data.size());
+    }
+
+    // Add a one-dimensional float32 array
+    void add(const std::string &name, const std::vector<float> &data);
+
+    // Add an int64 scalar (zero-dimensional array)
+    void add(const std::string &name, int64_t value);
+
+    // Write the archive. Returns false on failure.
+    bool save(const std::string &path) const;
+
+    // Serialize the archive
+    std::vector<char> serialize() const;
+
+private:
+    struct Entry {
+        std::string filename;
+        std::vector<char> data;
+    };
+
+    void addArray(const std::string &name,
+                  const char *descr,
+                  const std::string &shape,
+                  const void *data,
+                  size_t size);
+
+    std::vector<Entry> entries_;
+};
+
+} // namespace corx
+
+#endif /* CORX_NPZ_WRITER_H */
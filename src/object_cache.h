@@ -0,0 +1,37 @@
+#ifndef CORX_OBJECT_CACHE_H
+#define CORX_OBJECT_CACHE_H
+
+#include <map>
+#include <memory>
+#include <utility>
+
+namespace corx {
+
+// Owns objects that are expensive to create (e.g. FFT plans), keyed by their
+// configuration, so that switching back to an earlier configuration does not
+// create them again. Objects are kept until the cache is destroyed.
+template <typename Key, typename T>
+class ObjectCache {
+public:
+    // Returns the object for the given key, created with create() (which
+    // should return a new T*) if it is not in the cache yet.
+    template <typename Factory>
+    T* get(const Key &key, Factory create) {
+        auto it = objects_.find(key);
+        if (it == objects_.end()) {
+            std::unique_ptr<T> object(create());
+            it = objects_.insert(std::make_pair(key,
+                                                std::move(object))).first;
+        }
+        return it->second.get();
+    }
+
+    size_t size() const { return objects_.size(); }
+
+private:
+    std::map<Key, std::unique_ptr<T>> objects_;
+};
+
+} // namespace corx
+
+#endif /* CORX_OBJECT_CACHE_H */
@@ -0,0 +1,203 @@
+#include "online_correlator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+#include "corx_stream.h"
+
+namespace corx {
+
+namespace {
+
+double timestamp(const CorxBeaconHeader &header) {
+    return header.timestamp_sec + header.timestamp_msec / 1000.;
+}
+
+} // namespace
+
+
+OnlineCorrelator::OnlineCorrelator(double period, double window,
+                                   const SegmentFilter &filter)
+    : period_(period), window_(window), filter_(filter),
+      have_slice_(false) {}
+
+void OnlineCorrelator::processStream(int fd) {
+    std::string name;
+    if (!stream_read_hello(fd, name)) {
+        fprintf(stderr, "Warning: invalid stream hello\n");
+        return;
+    }
+
+    CorxStreamReader reader(fd, name);
+    try {
+        reader.readHeader();
+    } catch (const std::exception &e) {
+        fprintf(stderr, "Warning: %s\n", e.what());
+        return;
+    }
+
+    int idx = registerStream(name, reader.header());
+    if (idx < 0) {
+        fprintf(stderr, "Warning: slice of stream %s does not match the "
+                        "other streams\n", name.c_str());
+        return;
+    }
+    printf("Stream %s connected\n", name.c_str());
+
+    while (true) {
+        std::shared_ptr<CorxCycle> cycle(new CorxCycle());
+        if (!reader.next(*cycle)) {
+            break;
+        }
+        addCycle(idx, cycle);
+    }
+    printf("Stream %s disconnected\n", name.c_str());
+}
+
+int OnlineCorrelator::registerStream(const std::string &name,
+                                     const CorxFileHeader &header) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!have_slice_) {
+        slice_ = header;
+        have_slice_ = true;
+    } else if (header.slice_start_idx != slice_.slice_start_idx ||
+               header.slice_size != slice_.slice_size) {
+        return -1;
+    }
+
+    // a receiver reconnects for every capture
+    for (size_t i = 0; i < streams_.size(); ++i) {
+        if (streams_[i]->name == name) {
+            return i;
+        }
+    }
+
+    std::unique_ptr<Stream> stream(new Stream());
+    stream->name = name;
+    stream->off_sum.assign(slice_.slice_size, 0);
+    stream->off_cnt = 0;
+    streams_.push_back(std::move(stream));
+    return streams_.size() - 1;
+}
+
+OnlineCorrelator::OnlineBaseline& OnlineCorrelator::baseline(size_t idx1,
+                                                             size_t idx2) {
+    std::unique_ptr<OnlineBaseline> &baseline = baselines_[
+            std::make_pair(idx1, idx2)];
+    if (!baseline) {
+        baseline.reset(new OnlineBaseline());
+        baseline->data.reset(slice_.slice_size);
+        baseline->data.file1 = idx1;
+        baseline->data.file2 = idx2;
+        baseline->updated = false;
+    }
+    return *baseline;
+}
+
+void OnlineCorrelator::addCycle(size_t idx,
+                                const std::shared_ptr<const CorxCycle> &cycle) {
+    const size_t len = slice_.slice_size;
+    const double timediff_thresh = period_ / 4.;
+    const double t = timestamp(cycle->header);
+
+    struct Match {
+        OnlineBaseline *baseline;
+        std::shared_ptr<const CorxCycle> other;
+    };
+    std::vector<Match> matches;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Stream &stream = *streams_[idx];
+
+        if (!cycle->header.preamp_on) {
+            for (size_t k = 0; k < cycle->num_blocks(); ++k) {
+                accumulate_power(stream.off_sum.data(),
+                                 cycle->data.data() + k * len, len);
+                stream.off_cnt++;
+            }
+            for (auto &entry : baselines_) {
+                if (entry.first.first == idx || entry.first.second == idx) {
+                    entry.second->updated = true;
+                }
+            }
+            return;
+        }
+
+        for (size_t i = 0; i < streams_.size(); ++i) {
+            if (i == idx) {
+                continue;
+            }
+            for (const auto &other : streams_[i]->recent) {
+                if (std::abs(timestamp(other->header) - t) < timediff_thresh) {
+                    Match match;
+                    match.baseline = &baseline(std::min(i, idx),
+                                               std::max(i, idx));
+                    match.other = other;
+                    matches.push_back(match);
+                    break;
+                }
+            }
+        }
+
+        // keep recent cycles for streams that are lagging behind
+        stream.recent.push_back(cycle);
+        auto expired = std::remove_if(
+                stream.recent.begin(), stream.recent.end(),
+                [&](const std::shared_ptr<const CorxCycle> &c) {
+                    return timestamp(c->header) < t - window_;
+                });
+        stream.recent.erase(expired, stream.recent.end());
+    }
+
+    // accumulate outside of the global lock so that baselines are
+    // correlated in parallel by the stream threads
+    for (const Match &match : matches) {
+        std::lock_guard<std::mutex> lock(match.baseline->mutex);
+        Baseline &data = match.baseline->data;
+        if (data.file1 == idx) {
+            accumulate_cycles(*cycle, *match.other, len, false, data,
+                              filter_);
+        } else {
+            accumulate_cycles(*match.other, *cycle, len, false, data,
+                              filter_);
+        }
+        match.baseline->updated = true;
+    }
+}
+
+std::vector<Baseline> OnlineCorrelator::takeUpdated() {
+    std::vector<Baseline> result;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &entry : baselines_) {
+        OnlineBaseline &baseline = *entry.second;
+        std::lock_guard<std::mutex> baseline_lock(baseline.mutex);
+        if (!baseline.updated) {
+            continue;
+        }
+        baseline.updated = false;
+        result.push_back(baseline.data);
+
+        Baseline &data = result.back();
+        const Stream &stream1 = *streams_[data.file1];
+        const Stream &stream2 = *streams_[data.file2];
+        data.autocorr1_off_sum = stream1.off_sum;
+        data.autocorr1_off_cnt = stream1.off_cnt;
+        data.autocorr2_off_sum = stream2.off_sum;
+        data.autocorr2_off_cnt = stream2.off_cnt;
+    }
+    return result;
+}
+
+std::vector<std::string> OnlineCorrelator::streamNames() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> names;
+    for (const auto &stream : streams_) {
+        names.push_back(stream->name);
+    }
+    return names;
+}
+
+} // namespace corx
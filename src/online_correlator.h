@@ -0,0 +1,76 @@
+#ifndef CORX_ONLINE_CORRELATOR_H
+#define CORX_ONLINE_CORRELATOR_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "correlator.h"
+#include "corx_file_reader.h"
+
+namespace corx {
+
+// Correlates .corx streams (see corx_stream.h) in real time.
+//
+// Every stream is read by its own thread with processStream(). A complete
+// cycle is matched against the recent cycles of all other streams as soon as
+// it arrives, and the xcorr and autocorr of each matching pair are added to
+// the corresponding baseline. As in correlate(), cycles are matched if their
+// timestamps differ by less than period / 4.
+class OnlineCorrelator {
+public:
+    // Cycles are kept for matching for window seconds after the newest
+    // cycle of the same stream. Blocks are rejected by their segment
+    // metrics (if any) with the given filter.
+    OnlineCorrelator(double period, double window,
+                     const SegmentFilter &filter = SegmentFilter());
+
+    // Read a stream until it ends. Does not close the socket.
+    void processStream(int fd);
+
+    // Copy all baselines that changed since the last call. The preamp-off
+    // autocorrelation of each baseline contains all preamp-off data of its
+    // streams.
+    std::vector<Baseline> takeUpdated();
+
+    // Name of each stream, indexed by Baseline::file1 and Baseline::file2
+    std::vector<std::string> streamNames() const;
+
+private:
+    struct Stream {
+        std::string name;
+        std::vector<std::shared_ptr<const CorxCycle>> recent;
+        std::vector<float> off_sum;
+        int64_t off_cnt;
+    };
+
+    struct OnlineBaseline {
+        std::mutex mutex;
+        Baseline data;
+        bool updated;
+    };
+
+    // Returns the index of the stream, or -1 if its slice does not match the
+    // slice of the other streams.
+    int registerStream(const std::string &name, const CorxFileHeader &header);
+    void addCycle(size_t idx, const std::shared_ptr<const CorxCycle> &cycle);
+    OnlineBaseline& baseline(size_t idx1, size_t idx2);
+
+    const double period_;
+    const double window_;
+    const SegmentFilter filter_;
+
+    mutable std::mutex mutex_;
+    bool have_slice_;
+    CorxFileHeader slice_;
+    std::vector<std::unique_ptr<Stream>> streams_;
+    std::map<std::pair<size_t, size_t>,
+             std::unique_ptr<OnlineBaseline>> baselines_;
+};
+
+} // namespace corx
+
+#endif /* CORX_ONLINE_CORRELATOR_H */
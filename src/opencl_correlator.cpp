@@ -0,0 +1,495 @@
+#include "opencl_correlator.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#ifdef CORX_HAVE_OPENCL
+#define CL_TARGET_OPENCL_VERSION 120
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+#endif
+
+namespace corx {
+
+namespace {
+
+float error_to_degrees(int8_t error_fp) {
+    return error_fp / 127.f / 2 * 360;
+}
+
+#ifdef CORX_HAVE_OPENCL
+
+// One work-item per bin (dimension 0) and baseline (dimension 1): the
+// work-items of a work-group read adjacent bins of the same blocks.
+const char *KERNEL_SOURCE = R"CLC(
+__kernel void correlate(__global const float2 *blocks,
+                        const uint len,
+                        __global const uint2 *pairs,
+                        __global const uint *pair_ranges,
+                        __global const uint *off_blocks,
+                        __global const uint *off_ranges,
+                        __global float2 *xcorr,
+                        __global float *autocorr1,
+                        __global float *autocorr2,
+                        __global float *autocorr1_off,
+                        __global float *autocorr2_off) {
+    const uint bin = get_global_id(0);
+    const uint b = get_global_id(1);
+    if (bin >= len) {
+        return;
+    }
+
+    float2 x = (float2)(0, 0);
+    float a1 = 0, a2 = 0;
+    for (uint p = pair_ranges[b]; p < pair_ranges[b + 1]; ++p) {
+        const uint2 idx = pairs[p];
+        const float2 u = blocks[(size_t)idx.x * len + bin];
+        const float2 v = blocks[(size_t)idx.y * len + bin];
+        // u * conj(v)
+        x += (float2)(u.x * v.x + u.y * v.y, u.y * v.x - u.x * v.y);
+        a1 += dot(u, u);
+        a2 += dot(v, v);
+    }
+
+    float o1 = 0, o2 = 0;
+    for (uint p = off_ranges[2 * b]; p < off_ranges[2 * b + 1]; ++p) {
+        const float2 u = blocks[(size_t)off_blocks[p] * len + bin];
+        o1 += dot(u, u);
+    }
+    for (uint p = off_ranges[2 * b + 1]; p < off_ranges[2 * b + 2]; ++p) {
+        const float2 v = blocks[(size_t)off_blocks[p] * len + bin];
+        o2 += dot(v, v);
+    }
+
+    const size_t out = (size_t)b * len + bin;
+    xcorr[out] = x;
+    autocorr1[out] = a1;
+    autocorr2[out] = a2;
+    autocorr1_off[out] = o1;
+    autocorr2_off[out] = o2;
+}
+)CLC";
+
+void check(cl_int err, const char *what) {
+    if (err != CL_SUCCESS) {
+        throw std::runtime_error(std::string("OpenCL: ") + what +
+                                 " failed (error " + std::to_string(err) +
+                                 ")");
+    }
+}
+
+#endif
+
+} // namespace
+
+
+#ifdef CORX_HAVE_OPENCL
+
+struct OpenCLState {
+    cl_device_id device;
+    cl_context context;
+    cl_command_queue queue;
+    cl_program program;
+    cl_kernel kernel;
+    cl_ulong max_alloc;
+
+    // Blocks of each file, kept until their (non-blocking) writes are done
+    std::vector<std::vector<std::complex<float>>> staging;
+    // Blocks of all files
+    cl_mem blocks;
+    size_t blocks_capacity;
+    std::vector<cl_mem> buffers;
+
+    OpenCLState()
+        : device(nullptr), context(nullptr), queue(nullptr),
+          program(nullptr), kernel(nullptr), max_alloc(0), blocks(nullptr),
+          blocks_capacity(0) {}
+
+    ~OpenCLState() {
+        if (queue != nullptr) {
+            clFinish(queue);
+        }
+        if (blocks != nullptr) {
+            clReleaseMemObject(blocks);
+        }
+        releaseBuffers(buffers);
+        if (kernel != nullptr) {
+            clReleaseKernel(kernel);
+        }
+        if (program != nullptr) {
+            clReleaseProgram(program);
+        }
+        if (queue != nullptr) {
+            clReleaseCommandQueue(queue);
+        }
+        if (context != nullptr) {
+            clReleaseContext(context);
+        }
+    }
+
+    static void releaseBuffers(std::vector<cl_mem> &mems) {
+        for (cl_mem mem : mems) {
+            clReleaseMemObject(mem);
+        }
+        mems.clear();
+    }
+
+    // Make room for needed bytes of blocks, of which the first used bytes
+    // have been written. The buffer is only grown (with a copy on the
+    // device) if capacity, the expected size of all blocks, was too small.
+    void reserveBlocks(size_t used, size_t needed, size_t capacity) {
+        if (needed <= blocks_capacity) {
+            return;
+        }
+        if (needed > max_alloc) {
+            throw std::runtime_error("OpenCL: the blocks of all files do "
+                                     "not fit into a buffer of the device");
+        }
+        capacity = std::min<size_t>(std::max(capacity, needed), max_alloc);
+        cl_int err;
+        cl_mem mem = clCreateBuffer(context, CL_MEM_READ_ONLY, capacity,
+                                    nullptr, &err);
+        check(err, "clCreateBuffer");
+        if (blocks != nullptr) {
+            if (used > 0) {
+                err = clEnqueueCopyBuffer(queue, blocks, mem, 0, 0, used, 0,
+                                          nullptr, nullptr);
+                if (err != CL_SUCCESS) {
+                    clReleaseMemObject(mem);
+                    check(err, "clEnqueueCopyBuffer");
+                }
+            }
+            // (released once the queued commands are done)
+            clReleaseMemObject(blocks);
+        }
+        blocks = mem;
+        blocks_capacity = capacity;
+    }
+
+    // Device buffer of the given number of bytes (at least one, as empty
+    // buffers are invalid), released with the state
+    cl_mem createBuffer(cl_mem_flags flags, size_t size,
+                        const void *data = nullptr) {
+        if (size > max_alloc) {
+            throw std::runtime_error("OpenCL: buffer of " +
+                                     std::to_string(size) + " bytes exceeds "
+                                     "the maximum allocation of the device");
+        }
+        cl_int err;
+        cl_mem mem = clCreateBuffer(
+                context, flags | (data != nullptr ? CL_MEM_COPY_HOST_PTR : 0),
+                std::max(size, (size_t)1), const_cast<void*>(data), &err);
+        check(err, "clCreateBuffer");
+        buffers.push_back(mem);
+        return mem;
+    }
+
+    template <typename T>
+    cl_mem upload(const std::vector<T> &data) {
+        static const T zero = T();
+        return createBuffer(CL_MEM_READ_ONLY, data.size() * sizeof(T),
+                            data.empty() ? &zero : data.data());
+    }
+
+    template <typename T>
+    void download(cl_mem mem, size_t offset, std::vector<T> &dest) {
+        check(clEnqueueReadBuffer(queue, mem, CL_TRUE, offset * sizeof(T),
+                                  dest.size() * sizeof(T), dest.data(),
+                                  0, nullptr, nullptr),
+              "clEnqueueReadBuffer");
+    }
+};
+
+#else
+
+struct OpenCLState {};
+
+#endif
+
+
+OpenCLCorrelator::OpenCLCorrelator(double period,
+                                   const SegmentFilter &filter,
+                                   unsigned device_index,
+                                   AlignMethod align)
+    : filter_(filter), table_(period, align), num_blocks_(0),
+      expected_files_(0) {
+
+#ifdef CORX_HAVE_OPENCL
+    std::unique_ptr<OpenCLState> cl(new OpenCLState());
+
+    // -- Device
+    cl_uint num_platforms = 0;
+    check(clGetPlatformIDs(0, nullptr, &num_platforms), "clGetPlatformIDs");
+    std::vector<cl_platform_id> platforms(num_platforms);
+    if (num_platforms > 0) {
+        check(clGetPlatformIDs(num_platforms, platforms.data(), nullptr),
+              "clGetPlatformIDs");
+    }
+    std::vector<cl_device_id> devices;
+    for (cl_platform_id platform : platforms) {
+        cl_uint num_devices = 0;
+        if (clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 0, nullptr,
+                           &num_devices) != CL_SUCCESS) {
+            continue;
+        }
+        std::vector<cl_device_id> ids(num_devices);
+        check(clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, num_devices,
+                             ids.data(), nullptr),
+              "clGetDeviceIDs");
+        devices.insert(devices.end(), ids.begin(), ids.end());
+    }
+    if (device_index >= devices.size()) {
+        throw std::runtime_error("OpenCL device " +
+                                 std::to_string(device_index) +
+                                 " not found (" +
+                                 std::to_string(devices.size()) +
+                                 " devices)");
+    }
+    cl->device = devices[device_index];
+
+    char name[256] = {0};
+    check(clGetDeviceInfo(cl->device, CL_DEVICE_NAME, sizeof(name) - 1, name,
+                          nullptr),
+          "clGetDeviceInfo");
+    device_name_ = name;
+    check(clGetDeviceInfo(cl->device, CL_DEVICE_MAX_MEM_ALLOC_SIZE,
+                          sizeof(cl->max_alloc), &cl->max_alloc, nullptr),
+          "clGetDeviceInfo");
+
+    // -- Context, queue and kernel
+    cl_int err;
+    cl->context = clCreateContext(nullptr, 1, &cl->device, nullptr, nullptr,
+                                  &err);
+    check(err, "clCreateContext");
+    cl->queue = clCreateCommandQueue(cl->context, cl->device, 0, &err);
+    check(err, "clCreateCommandQueue");
+
+    cl->program = clCreateProgramWithSource(cl->context, 1, &KERNEL_SOURCE,
+                                            nullptr, &err);
+    check(err, "clCreateProgramWithSource");
+    err = clBuildProgram(cl->program, 1, &cl->device, "", nullptr, nullptr);
+    if (err != CL_SUCCESS) {
+        size_t log_size = 0;
+        clGetProgramBuildInfo(cl->program, cl->device, CL_PROGRAM_BUILD_LOG,
+                              0, nullptr, &log_size);
+        std::string log(log_size, '\0');
+        clGetProgramBuildInfo(cl->program, cl->device, CL_PROGRAM_BUILD_LOG,
+                              log_size, &log[0], nullptr);
+        throw std::runtime_error("OpenCL: could not build the kernel: " +
+                                 log);
+    }
+    cl->kernel = clCreateKernel(cl->program, "correlate", &err);
+    check(err, "clCreateKernel");
+
+    cl_ = std::move(cl);
+#else
+    throw std::runtime_error("corx has been built without OpenCL");
+#endif
+}
+
+OpenCLCorrelator::~OpenCLCorrelator() {
+}
+
+void OpenCLCorrelator::addFile(const CorxFileReader *file) {
+    if (!files_.empty() &&
+            (file->header().slice_start_idx !=
+                 files_[0]->header().slice_start_idx ||
+             file->slice_size() != files_[0]->slice_size())) {
+        throw std::runtime_error("Slice of " + file->path() +
+                                 " differs from " + files_[0]->path());
+    }
+
+    const std::vector<CorxCycle> &cycles = file->cycles();
+    std::vector<size_t> offsets;
+    size_t num_blocks = 0;
+    for (const CorxCycle &cycle : cycles) {
+        offsets.push_back(num_blocks_ + num_blocks);
+        num_blocks += cycle.num_blocks();
+    }
+    if (num_blocks_ + num_blocks > std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("too many blocks for the OpenCL backend");
+    }
+
+#ifdef CORX_HAVE_OPENCL
+    // (one contiguous write per file, at the offset of its first block)
+    size_t len = file->slice_size();
+    std::vector<std::complex<float>> staging;
+    staging.reserve(num_blocks * len);
+    for (const CorxCycle &cycle : cycles) {
+        staging.insert(staging.end(), cycle.data.begin(),
+                       cycle.data.begin() + cycle.num_blocks() * len);
+    }
+
+    size_t offset = num_blocks_ * len * sizeof(std::complex<float>);
+    size_t size = staging.size() * sizeof(std::complex<float>);
+    if (size > 0) {
+        size_t remaining = std::max<size_t>(
+                expected_files_ > files_.size()
+                ? expected_files_ - files_.size() : 0, 1);
+        cl_->reserveBlocks(offset, offset + size, offset + size * remaining);
+        check(clEnqueueWriteBuffer(cl_->queue, cl_->blocks, CL_FALSE,
+                                   offset, size, staging.data(), 0, nullptr,
+                                   nullptr),
+              "clEnqueueWriteBuffer");
+        // (start the transfer while the next file is parsed)
+        check(clFlush(cl_->queue), "clFlush");
+    }
+    cl_->staging.push_back(std::move(staging));
+#endif
+
+    files_.push_back(file);
+    table_.addFile(file->cycles());
+    file_offsets_.push_back(num_blocks_);
+    cycle_offsets_.push_back(std::move(offsets));
+    num_blocks_ += num_blocks;
+}
+
+void OpenCLCorrelator::planBaseline(Baseline &baseline, Plan &plan) const {
+    const CorxFileReader &corx1 = *files_[baseline.file1];
+    const CorxFileReader &corx2 = *files_[baseline.file2];
+    const std::vector<CorxCycle> &cycles1 = corx1.cycles();
+    const std::vector<CorxCycle> &cycles2 = corx2.cycles();
+    const std::vector<size_t> &offsets1 = cycle_offsets_[baseline.file1];
+    const std::vector<size_t> &offsets2 = cycle_offsets_[baseline.file2];
+
+    CycleAlignment alignment;
+    table_.alignPair(baseline.file1, baseline.file2, alignment);
+    baseline.skipped = alignment.skipped;
+
+    // same selection of blocks as accumulate_cycles
+    for (const std::pair<size_t, size_t> &match : alignment.matches) {
+        const CorxCycle &cycle1 = cycles1[match.first];
+        const CorxCycle &cycle2 = cycles2[match.second];
+        size_t num_blocks = std::min(cycle1.num_blocks(),
+                                     cycle2.num_blocks());
+        bool has_metrics1 = !cycle1.metrics.empty();
+        bool has_metrics2 = !cycle2.metrics.empty();
+        for (size_t k = 0; k < num_blocks; ++k) {
+            if ((has_metrics1 && !filter_.accept(cycle1.metrics[k])) ||
+                    (has_metrics2 && !filter_.accept(cycle2.metrics[k]))) {
+                baseline.rejected++;
+                continue;
+            }
+            plan.pairs.push_back(offsets1[match.first] + k);
+            plan.pairs.push_back(offsets2[match.second] + k);
+            baseline.cnt++;
+            baseline.errors1.push_back(
+                    error_to_degrees(cycle1.phase_errors[k]));
+            baseline.errors2.push_back(
+                    error_to_degrees(cycle2.phase_errors[k]));
+        }
+    }
+
+    for (size_t idx1 : alignment.off1) {
+        for (size_t k = 0; k < cycles1[idx1].num_blocks(); ++k) {
+            plan.off1.push_back(offsets1[idx1] + k);
+        }
+    }
+    for (size_t idx2 : alignment.off2) {
+        for (size_t k = 0; k < cycles2[idx2].num_blocks(); ++k) {
+            plan.off2.push_back(offsets2[idx2] + k);
+        }
+    }
+    baseline.autocorr1_off_cnt = plan.off1.size();
+    baseline.autocorr2_off_cnt = plan.off2.size();
+}
+
+void OpenCLCorrelator::run() {
+    baselines_.clear();
+    if (files_.size() < 2) {
+        return;
+    }
+    size_t len = files_[0]->slice_size();
+
+    // -- Block indices of all baselines (on the host, while the blocks are
+    //    still being transferred)
+    std::vector<uint32_t> pairs;
+    std::vector<uint32_t> pair_ranges(1, 0);
+    std::vector<uint32_t> off_blocks;
+    std::vector<uint32_t> off_ranges(1, 0);
+    for (size_t i = 0; i < files_.size(); ++i) {
+        for (size_t j = i + 1; j < files_.size(); ++j) {
+            Baseline baseline;
+            baseline.file1 = i;
+            baseline.file2 = j;
+            baseline.reset(len);
+
+            Plan plan;
+            planBaseline(baseline, plan);
+            pairs.insert(pairs.end(), plan.pairs.begin(), plan.pairs.end());
+            pair_ranges.push_back(pairs.size() / 2);
+            off_blocks.insert(off_blocks.end(), plan.off1.begin(),
+                              plan.off1.end());
+            off_ranges.push_back(off_blocks.size());
+            off_blocks.insert(off_blocks.end(), plan.off2.begin(),
+                              plan.off2.end());
+            off_ranges.push_back(off_blocks.size());
+
+            baselines_.push_back(std::move(baseline));
+        }
+    }
+    if (pairs.size() / 2 > std::numeric_limits<uint32_t>::max() ||
+            off_blocks.size() > std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("too many blocks for the OpenCL backend");
+    }
+
+#ifdef CORX_HAVE_OPENCL
+    OpenCLState &cl = *cl_;
+    size_t num_baselines = baselines_.size();
+
+    // (the blocks of all files have been written by addFile)
+    cl_mem blocks = cl.blocks;
+    if (blocks == nullptr) {
+        blocks = cl.createBuffer(CL_MEM_READ_ONLY, 0);
+    }
+
+    cl_mem pairs_mem = cl.upload(pairs);
+    cl_mem pair_ranges_mem = cl.upload(pair_ranges);
+    cl_mem off_blocks_mem = cl.upload(off_blocks);
+    cl_mem off_ranges_mem = cl.upload(off_ranges);
+
+    size_t out_len = num_baselines * len;
+    cl_mem xcorr = cl.createBuffer(CL_MEM_WRITE_ONLY,
+                                   out_len * sizeof(std::complex<float>));
+    cl_mem autocorr[4];
+    for (cl_mem &mem : autocorr) {
+        mem = cl.createBuffer(CL_MEM_WRITE_ONLY, out_len * sizeof(float));
+    }
+
+    // -- All baselines in a single launch
+    cl_uint len_arg = len;
+    cl_uint arg = 0;
+    auto set_arg = [&](size_t size, const void *value) {
+        check(clSetKernelArg(cl.kernel, arg++, size, value),
+              "clSetKernelArg");
+    };
+    set_arg(sizeof(cl_mem), &blocks);
+    set_arg(sizeof(len_arg), &len_arg);
+    for (cl_mem *mem : {&pairs_mem, &pair_ranges_mem, &off_blocks_mem,
+                        &off_ranges_mem, &xcorr, &autocorr[0], &autocorr[1],
+                        &autocorr[2], &autocorr[3]}) {
+        set_arg(sizeof(cl_mem), mem);
+    }
+    size_t global_size[2] = {len, num_baselines};
+    check(clEnqueueNDRangeKernel(cl.queue, cl.kernel, 2, nullptr,
+                                 global_size, nullptr, 0, nullptr, nullptr),
+          "clEnqueueNDRangeKernel");
+
+    for (size_t b = 0; b < num_baselines; ++b) {
+        Baseline &baseline = baselines_[b];
+        cl.download(xcorr, b * len, baseline.xcorr_sum);
+        cl.download(autocorr[0], b * len, baseline.autocorr1_sum);
+        cl.download(autocorr[1], b * len, baseline.autocorr2_sum);
+        cl.download(autocorr[2], b * len, baseline.autocorr1_off_sum);
+        cl.download(autocorr[3], b * len, baseline.autocorr2_off_sum);
+    }
+
+    OpenCLState::releaseBuffers(cl.buffers);
+#endif
+}
+
+} // namespace corx
@@ -0,0 +1,87 @@
+#ifndef CORX_OPENCL_CORRELATOR_H
+#define CORX_OPENCL_CORRELATOR_H
+
+#include <complex>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "correlator.h"
+#include "corx_file_reader.h"
+#include "segment_metrics.h"
+
+namespace corx {
+
+struct OpenCLState;
+
+// OpenCL backend of Correlator (same results, up to float rounding).
+//
+// The blocks of every file are written into a single device buffer (at the
+// offset of the file) as soon as the file has been parsed (addFile), so
+// that the transfers overlap with parsing the next file. run() then aligns
+// the cycles of all pairs on the host (see CycleTable), which only produces
+// lists of block indices, and computes the cross-spectra and
+// autocorrelations of all N(N-1)/2 baselines in a single kernel launch with
+// one work-item per bin and baseline.
+class OpenCLCorrelator {
+public:
+    // Use the device with the given index among the devices of all OpenCL
+    // platforms. Throws std::runtime_error on failure (or if corx has been
+    // built without OpenCL).
+    OpenCLCorrelator(double period,
+                     const SegmentFilter &filter = SegmentFilter(),
+                     unsigned device_index = 0,
+                     AlignMethod align = AlignMethod::BEACON);
+    ~OpenCLCorrelator();
+
+    OpenCLCorrelator(const OpenCLCorrelator&) = delete;
+    OpenCLCorrelator& operator=(const OpenCLCorrelator&) = delete;
+
+    const std::string& deviceName() const { return device_name_; }
+
+    // Number of files that will be added, so that the device buffer of the
+    // blocks is allocated once (for files of about the same size as the
+    // first one) instead of being grown.
+    void reserveFiles(size_t count) { expected_files_ = count; }
+
+    // Start copying the blocks of a file to the device. The file has to
+    // outlive run(), and its slice has to match the first file's.
+    void addFile(const CorxFileReader *file);
+
+    // Correlate all baselines of the files added so far. Throws
+    // std::runtime_error if the blocks do not fit into device memory.
+    void run();
+
+    const std::vector<Baseline>& baselines() const { return baselines_; }
+
+private:
+    // Block indices of a baseline (into the blocks of all files)
+    struct Plan {
+        std::vector<uint32_t> pairs;   // interleaved block of file 1 and 2
+        std::vector<uint32_t> off1;
+        std::vector<uint32_t> off2;
+    };
+
+    void planBaseline(Baseline &baseline, Plan &plan) const;
+
+    SegmentFilter filter_;
+    std::string device_name_;
+
+    std::vector<const CorxFileReader*> files_;
+    CycleTable table_;
+    // Index of the first block of each file and of each of its cycles
+    std::vector<size_t> file_offsets_;
+    std::vector<std::vector<size_t>> cycle_offsets_;
+    size_t num_blocks_;
+    size_t expected_files_;
+
+    std::unique_ptr<OpenCLState> cl_;
+    std::vector<Baseline> baselines_;
+};
+
+} // namespace corx
+
+#endif /* CORX_OPENCL_CORRELATOR_H */
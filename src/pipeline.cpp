@@ -0,0 +1,141 @@
+#include "pipeline.h"
+
+#include <cassert>
+#include <cstring>
+
+#include <fastdet/corr_detector.h>
+
+namespace corx {
+
+ReaderStage::ReaderStage(CarrierDetector *carrier_det,
+                         size_t block_size,
+                         size_t depth,
+                         const ThreadPlacement &placement,
+                         std::complex<float> *buffer)
+    : carrier_det_(carrier_det),
+      block_size_(block_size),
+      placement_(placement),
+      ring_(depth > 0 ? depth : 1),
+      carrier_search_(false),
+      finished_(false) {
+
+    if (buffer == nullptr) {
+        own_buffer_.reset(new AlignedArray<std::complex<float>>(
+                block_size_ * ring_.capacity()));
+        buffer = own_buffer_->data();
+    }
+    for (size_t i = 0; i < ring_.capacity(); ++i) {
+        ring_.slot(i).samples = buffer + i * block_size_;
+    }
+}
+
+ReaderStage::~ReaderStage() {
+    if (running()) {
+        carrier_det_->cancel();
+        // drain ring to unblock the reader thread until it has published
+        // the eof block (which may already have been consumed)
+        while (!finished_.load(std::memory_order_acquire)) {
+            if (ring_.front()) {
+                ring_.pop();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        join();
+    }
+}
+
+void ReaderStage::start() {
+    assert(!running());
+    finished_ = false;
+    thread_ = std::thread(&ReaderStage::run, this);
+}
+
+void ReaderStage::setPlacement(const ThreadPlacement &placement) {
+    assert(!running());
+    placement_ = placement;
+}
+
+void ReaderStage::join() {
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+const PipelineBlock& ReaderStage::front() {
+    unsigned attempt = 0;
+    PipelineBlock *block = ring_.front();
+    if (block == nullptr) {
+        counters_.dsp_starved++;
+        while ((block = ring_.front()) == nullptr) {
+            spsc_backoff(attempt);
+        }
+    }
+    return *block;
+}
+
+void ReaderStage::pop() {
+    ring_.pop();
+}
+
+void ReaderStage::run() {
+    // (always applied, since the thread inherits the placement of its
+    //  creator; only reported if it is not the default placement)
+    apply_thread_placement(placement_, "",
+                           placement_.isDefault() ? nullptr : stdout);
+    bool eof = false;
+    while (!eof) {
+        PipelineBlock *block = ring_.acquire();
+        if (block == nullptr) {
+            // DSP stage is back-pressuring the reader
+            counters_.reader_stalls++;
+            unsigned attempt = 0;
+            while ((block = ring_.acquire()) == nullptr) {
+                spsc_backoff(attempt);
+            }
+        }
+
+        eof = !carrier_det_->next();
+        block->eof = eof;
+        block->carrier_processed = false;
+
+        if (!eof) {
+            const fastcard_data_t& data = carrier_det_->data();
+
+            if (carrier_search_.load(std::memory_order_relaxed)) {
+                carrier_det_->process();
+                block->carrier_processed = true;
+                block->carrier.detected = data.detected;
+                if (data.detected) {
+                    block->carrier.pos = (
+                        data.detection.argmax +
+                        CorrDetector::interpolate_parabolic(
+                            &data.fft_power[data.detection.argmax]));
+                    block->carrier.max = data.detection.max;
+                    block->carrier.noise = data.detection.noise;
+                }
+            }
+
+            memcpy(static_cast<void*>(block->samples),
+                   data.samples,
+                   block_size_ * sizeof(std::complex<float>));
+            block->timestamp = data.block->timestamp;
+            counters_.blocks++;
+        }
+
+        ring_.publish();
+    }
+    finished_.store(true, std::memory_order_release);
+}
+
+void ReaderStage::printStats(FILE* out) const {
+    fprintf(out,
+            "Pipeline reader: %llu blocks read; "
+            "%llu reader stalls (DSP back-pressure); "
+            "%llu DSP waits for input\n",
+            (unsigned long long)counters_.blocks.load(),
+            (unsigned long long)counters_.reader_stalls.load(),
+            (unsigned long long)counters_.dsp_starved.load());
+}
+
+} // namespace corx
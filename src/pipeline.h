@@ -0,0 +1,121 @@
+#ifndef CORX_PIPELINE_H
+#define CORX_PIPELINE_H
+
+#include <atomic>
+#include <complex>
+#include <memory>
+#include <thread>
+
+#include <sys/time.h>
+
+#include <fastdet/fastcard_wrappers.h>
+
+#include "spsc_ring.h"
+#include "thread_placement.h"
+
+namespace corx {
+
+// Result of a fastcard carrier detection on a block of data
+struct CarrierInfo {
+    bool detected;
+    float pos;      // position of carrier in FFT bins (unsigned)
+    float max;      // SNR: peak
+    float noise;    // SNR: noise
+};
+
+// A block of samples handed from the reader stage to the DSP stage
+struct PipelineBlock {
+    std::complex<float> *samples;   // block_size samples
+    struct timeval timestamp;
+    bool eof;               // no more blocks will follow
+    bool carrier_processed; // carrier detection was performed on this block
+    CarrierInfo carrier;
+};
+
+// Back-pressure counters of the pipeline stages.
+// Each counter is only written by the stage that owns it.
+struct PipelineCounters {
+    // Number of times the reader found the block ring full, i.e. the DSP
+    // stage failed to keep up and samples may be dropped by the SDR.
+    std::atomic<uint64_t> reader_stalls;
+    // Number of times the DSP stage had to wait for a block from the reader.
+    std::atomic<uint64_t> dsp_starved;
+    // Number of blocks read.
+    std::atomic<uint64_t> blocks;
+
+    PipelineCounters() : reader_stalls(0), dsp_starved(0), blocks(0) {}
+};
+
+// Reader stage of the pipelined receiver.
+//
+// Runs CarrierDetector::next() on a separate thread and copies the blocks
+// into a lock-free ring of pre-allocated blocks that is consumed by the DSP
+// stage. Carrier detection (CarrierDetector::process) is performed by the
+// reader while it has been requested by the DSP stage, since it operates on
+// the detector's internal buffers.
+class ReaderStage {
+public:
+    // buffer: depth * block_size samples for the blocks of the ring, which
+    // must outlive the stage (e.g. from a HotArena). If it is nullptr, the
+    // stage allocates the blocks itself.
+    ReaderStage(CarrierDetector *carrier_det,
+                size_t block_size,
+                size_t depth,
+                const ThreadPlacement &placement = ThreadPlacement(),
+                std::complex<float> *buffer = nullptr);
+    ~ReaderStage();
+
+    // Start the reader thread. The carrier detector should be started.
+    void start();
+
+    // Wait for the reader thread to finish. The reader thread stops once
+    // CarrierDetector::next() fails, e.g. after CarrierDetector::cancel().
+    void join();
+
+    bool running() const { return thread_.joinable(); }
+
+    // Placement of the reader thread, applied when it is started. Only
+    // while the reader thread is not running.
+    void setPlacement(const ThreadPlacement &placement);
+
+    // -- DSP stage
+    // Get the next block. Blocks until a block is available.
+    const PipelineBlock& front();
+
+    // Release the block returned by front().
+    void pop();
+
+    // Request carrier detection on subsequent blocks.
+    void setCarrierSearch(bool on) {
+        carrier_search_.store(on, std::memory_order_relaxed);
+    }
+
+    // Pre-allocated sample buffers of the blocks of the ring (e.g. for the
+    // hot set of the receiver)
+    size_t depth() const { return ring_.capacity(); }
+    std::complex<float>* blockSamples(size_t idx) {
+        return ring_.slot(idx).samples;
+    }
+
+    const PipelineCounters& counters() const { return counters_; }
+    void printStats(FILE* out) const;
+
+private:
+    void run();
+
+    CarrierDetector *carrier_det_;
+    size_t block_size_;
+    ThreadPlacement placement_;
+    // Blocks of the ring unless a buffer was given
+    std::unique_ptr<AlignedArray<std::complex<float>>> own_buffer_;
+    SpscRing<PipelineBlock> ring_;
+    std::thread thread_;
+    std::atomic<bool> carrier_search_;
+    // Set by the reader thread once it has published the eof block
+    std::atomic<bool> finished_;
+    PipelineCounters counters_;
+};
+
+} // namespace corx
+
+#endif /* CORX_PIPELINE_H */
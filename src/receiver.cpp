@@ -12,6 +12,13 @@
 #include <deque>
 #include <stdexcept>
 #include <memory>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
 
 #include <cmath>
 
@@ -21,6 +28,7 @@
 #include <stdio.h>
 
 #include <sys/poll.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <gflags/gflags.h>
@@ -31,16 +39,36 @@
 #include <fastcard/parse.h>
 #include <fastcard/rtlsdr_reader.h>
 
+#include "beacon_coordinator.h"
+#include "beacon_prefilter.h"
+#include "batch_fft.h"
+#include "carrier_search.h"
+#include "control_channel.h"
+#include "bin_encoding.h"
 #include "corx_file_writer.h"
+#include "cycle_integrator.h"
+#include "flight_recorder.h"
+#include "goertzel.h"
+#include "hot_memory.h"
+#include "corx_stream.h"
+#include "object_cache.h"
+#include "dsp.h"
+#include "pipeline.h"
+#include "receiver_stats.h"
+#include "rtlsdr_async_reader.h"
+#include "segment_metrics.h"
 #include "sine_lookup.h"
+#include "spsc_ring.h"
+#include "thread_placement.h"
 #include "receiver.h"
 
 using namespace std;
 
 #define PI 3.14159265358979323846
 
-// printf with block ID prepended
-#define BPRINTF(fmt, ...) printf("[#%u] " fmt, block_idx_, ##__VA_ARGS__)
+// printf with block ID (and receiver ID, if any) prepended
+#define BPRINTF(fmt, ...) printf("%s[#%u] " fmt, log_prefix_.c_str(), \
+                                 block_idx_, ##__VA_ARGS__)
 
 namespace corx {
 // TODO: Writer should also be in corx namespace
@@ -69,6 +97,16 @@ DEFINE_string(frequency, "1.42G",
 DEFINE_string(sample_rate, "2.4M", "Sample rate");
 DEFINE_uint64(gain, 0, "Tuner gain");
 DEFINE_uint64(device_index, 0, "RTL-SDR device index");
+DEFINE_string(device_indices, "",
+              "Comma-separated list of RTL-SDR device indices to drive from "
+              "a single process, e.g. 0,1,2,3 (overrides --device_index). "
+              "Each device gets its own receiver thread; --output should "
+              "contain {rx}, which is replaced by the device index.");
+DEFINE_int32(control_fd, -1,
+             "File descriptor of a connected socket (e.g. a socketpair "
+             "inherited from multicorx.py --binary) for the binary control "
+             "and telemetry channel, see control_channel.h (-1: disabled; "
+             "requires --interactive).");
 
 // Carrier detection
 DEFINE_string(carrier_window, "0--1",
@@ -82,10 +120,26 @@ DEFINE_string(beacon_threshold, "15s",
               "Beacon correlation detection theshold");
 DEFINE_string(template, "template.tpl",
               "Template to correlate with for beacon detection");
+DEFINE_double(beacon_prefilter, 0,
+              "Only perform the full beacon detection if the normalized "
+              "correlation (squared, between 0 and 1) of the decimated "
+              "signal and template is at least this value. Should be well "
+              "below the coefficient of a detectable beacon (0 to disable).");
+DEFINE_uint64(beacon_prefilter_decimation, 8,
+              "Decimation factor of the beacon prefilter");
+DEFINE_double(beacon_share_window, 0,
+              "When driving several devices (--device_indices), a beacon "
+              "detected by one receiver limits the beacon search of the "
+              "others to blocks within this many seconds of the expected "
+              "time of the next pulses (0: disabled). Block times are host "
+              "timestamps, so the window should exceed their jitter.");
 
 //// Corx settings
 DEFINE_string(output, "",
-              ".corx file to write output to");
+              ".corx file to write output to, or tcp://host:port[/name] to "
+              "stream the output to an online correlator "
+              "(corx_correlate --listen). {rx} is replaced by the device "
+              "index.");
 
 DEFINE_double(carrier_ref, -277800,
               "The expected nominal frequency offset of the reference "
@@ -117,12 +171,31 @@ DEFINE_double(beacon_carrier_trigger_factor, 1.1,
               "magnitude is less than the average carrier magnitude times "
               "this factor.");
 
+DEFINE_bool(throughput_report, false,
+            "Print the number of samples processed per second and the "
+            "real-time factor (as JSON) when the receiver stops, e.g. to "
+            "benchmark the replay of a recording with --input");
+
 DEFINE_double(timeout, 0,
               "Maximum amount of time the receiver is allowed to spend in "
               "the active state regardless of detection state (0 to disable).");
 DEFINE_double(carrier_search_timeout, 5,
               "Maximum time, in seconds, to search for a carrier before "
               "giving up");
+DEFINE_int32(reacquire_blocks, 8,
+             "Number of blocks to search a narrow window around the last "
+             "position of a carrier that has been lost (tracking failure) "
+             "before searching the whole carrier window (0: always search "
+             "the whole window).");
+DEFINE_int32(reacquire_window, 8,
+             "Half width, in bins, of the narrow window of "
+             "--reacquire_blocks (at least 2).");
+DEFINE_bool(huge_pages, false,
+            "Back the hot DSP buffers with huge pages (MAP_HUGETLB if huge "
+            "pages are reserved, otherwise transparent huge pages).");
+DEFINE_bool(mlock_buffers, false,
+            "Lock the hot DSP buffers into memory (mlock; limited by "
+            "RLIMIT_MEMLOCK, see ulimit -l).");
 DEFINE_double(capture_time, 10.5,
               "time in seconds to capture correlation data after the first "
               "beacon detection");
@@ -136,6 +209,116 @@ DEFINE_double(preamp_off_transition_time, 0.2,
 DEFINE_string(slice, "0--1",
               "Only store the specified slice of the correlation segment FFTs");
 
+DEFINE_string(corx_encoding, "float32",
+              "Encoding of the FFT bins in the .corx output file: "
+              "float32 (version 1 format), float16, int16 or int8 "
+              "(version 2 format with a scale factor per segment)");
+
+DEFINE_bool(integrate, false,
+            "Only write the integrated products of every segment cycle "
+            "(auto-power spectrum, phase error statistics and the "
+            "cross-spectra with the other receivers of the host) in the "
+            "version 3 format instead of every segment spectrum");
+
+DEFINE_bool(segment_metrics, false,
+            "Store the quality metrics of every segment (SNR of the carrier "
+            "bin, mean power of the slice and rolling phase error standard "
+            "deviation) with its spectrum (version 2 format), so that the "
+            "correlator can reject bad segments");
+
+DEFINE_bool(rtlsdr_async, false,
+            "Read from the RTL-SDR device with librtlsdr's asynchronous API "
+            "instead of through fastcard (one USB transfer per block, "
+            "blocks are read in place and timestamped with a minimum "
+            "latency estimate; carrier detection is performed by corx). "
+            "Only used with --input=rtlsdr");
+DEFINE_uint64(rtlsdr_buffers, 16,
+              "Number of USB transfers in flight with --rtlsdr_async");
+DEFINE_uint64(rtlsdr_ring_blocks, 32,
+              "Number of blocks the receiver may fall behind with "
+              "--rtlsdr_async before samples are dropped");
+
+DEFINE_double(flight_recorder_seconds, 0,
+              "Keep the last seconds of raw input samples in memory and "
+              "save them (with --flight_recorder_post_seconds of samples "
+              "after the trigger) to a .cu8 file when a trigger of "
+              "--flight_recorder_triggers fires or on the 'dump' command "
+              "(0: disabled; e.g. 4)");
+DEFINE_double(flight_recorder_post_seconds, 1,
+              "Seconds of samples to save after a flight recorder trigger");
+DEFINE_string(flight_recorder_dir, ".",
+              "Directory of the flight recorder dumps");
+DEFINE_string(flight_recorder_triggers, "lost_lock,time_step,phase_errors",
+              "Comma-separated events that cause a flight recorder dump: "
+              "lost_lock (tracking loop failed), time_step (missed beacon "
+              "pulse) and phase_errors (more than "
+              "--flight_recorder_phase_error_fraction of the segment cycles "
+              "of a beacon have a large phase error)");
+DEFINE_double(flight_recorder_min_interval, 60,
+              "Minimum time in seconds between two flight recorder dumps "
+              "(except for the 'dump' command)");
+DEFINE_double(flight_recorder_phase_error_fraction, 0.25,
+              "Fraction of segment cycles with a large phase error above "
+              "which the phase_errors trigger fires");
+
+DEFINE_bool(pipeline, false,
+            "Decouple reading from the SDR, DSP and writing to the output "
+            "file by running them on separate threads");
+DEFINE_uint64(pipeline_depth, 32,
+              "Number of blocks that may be queued between the reader and "
+              "the DSP thread in pipelined mode");
+DEFINE_bool(async_writer, false,
+            "Write the output file from a background thread using large "
+            "page-aligned buffers (implied by --pipeline)");
+DEFINE_uint64(writer_queue_depth, 4,
+              "Number of output buffers that may be queued between the DSP "
+              "and the writer thread (at least two)");
+DEFINE_uint64(writer_buffer_size, 1 << 20,
+              "Size in bytes of each output buffer of the background writer");
+DEFINE_bool(writer_direct_io, false,
+            "Bypass the page cache (O_DIRECT) when writing the output file "
+            "from the background writer");
+
+DEFINE_string(dsp_cpus, "",
+              "CPUs the DSP thread of each receiver is pinned to, e.g. 2 or "
+              "2-3 (empty: not pinned). Groups separated by / are assigned "
+              "by device index, e.g. 1/2/3/4 for receivers 0-3.");
+DEFINE_string(reader_cpus, "",
+              "CPUs of the thread that reads from the SDR (--pipeline or "
+              "--rtlsdr_async), as --dsp_cpus.");
+DEFINE_string(writer_cpus, "",
+              "CPUs of the background writer thread (--async_writer), as "
+              "--dsp_cpus.");
+DEFINE_bool(isolate_reader, false,
+            "Keep the DSP and writer threads of the receivers off the "
+            "--reader_cpus.");
+DEFINE_string(sched_policy, "other",
+              "Scheduling policy of the DSP, reader and writer threads: "
+              "other, fifo (SCHED_FIFO) or rr (SCHED_RR). Real-time policies "
+              "require CAP_SYS_NICE or an rtprio limit (ulimit -r).");
+DEFINE_int32(dsp_priority, 50,
+             "Real-time priority (1-99) of the DSP threads with "
+             "--sched_policy=fifo or rr.");
+DEFINE_int32(reader_priority, 60,
+             "Real-time priority (1-99) of the reader threads, as "
+             "--dsp_priority.");
+DEFINE_int32(writer_priority, 40,
+             "Real-time priority (1-99) of the writer threads, as "
+             "--dsp_priority.");
+
+DEFINE_string(nco, "table",
+              "Oscillator used for carrier recovery: 'table' (fixed-point "
+              "sine table lookup; reference implementation) or 'phasor' "
+              "(vectorized phasor recurrence; faster)");
+DEFINE_string(slice_transform, "auto",
+              "Transform used for the sliced segment bins: 'fft' (full FFT), "
+              "'goertzel' (only compute the bins of the slice) or 'auto' "
+              "(cheapest for the slice size)");
+DEFINE_uint64(nco_resync_interval, PhasorNCO::DEFAULT_RESYNC_INTERVAL,
+              "Number of samples after which the phasor NCO is resynced "
+              "with the exact phase. Smaller values are more accurate; "
+              "larger values are faster.");
+
 
 bool parse_slice_str(const std::string &slice, int segment_size,
                      int& start, int& len) {
@@ -163,50 +346,159 @@ bool parse_slice_str(const std::string &slice, int segment_size,
 }
 
 
-// Angles are stored as a value between -0.5 and 0.5 to simplify normalisation
-// TODO: convert to class
-using DeciAngle = float;
-DeciAngle normalize_deciangle(DeciAngle angle) {
-    return angle - int(round(angle));
+// Parse a comma-separated list of device indices
+bool parse_device_indices_str(const std::string &str,
+                              std::vector<int> &indices) {
+    indices.clear();
+    std::string::size_type offset = 0;
+    while (offset <= str.size()) {
+        std::string::size_type pos = str.find(',', offset);
+        if (pos == std::string::npos) {
+            pos = str.size();
+        }
+        int index;
+        char c;
+        std::string item = str.substr(offset, pos - offset);
+        if (sscanf(item.c_str(), "%d%c", &index, &c) != 1 || index < 0 ||
+                std::find(indices.begin(), indices.end(), index) !=
+                indices.end()) {
+            return false;
+        }
+        indices.push_back(index);
+        offset = pos + 1;
+    }
+    return !indices.empty();
+}
+
+
+// Replace {rx} in an output file name (or stream URL) by the device index
+std::string expand_output_pattern(const std::string &pattern,
+                                  int device_index) {
+    std::string result = pattern;
+    const std::string key = "{rx}";
+    std::string value = std::to_string(device_index);
+    std::string::size_type pos = 0;
+    while ((pos = result.find(key, pos)) != std::string::npos) {
+        result.replace(pos, key.size(), value);
+        pos += value.size();
+    }
+    return result;
 }
 
 
-// Apply a frequency and phase shift to the given signal.
-// src and dest may be the same for inline transformation.
-void freq_shift(complex<float> *dest,
-                const complex<float> *src,
-                size_t len,
-                float shift_freq,
-                DeciAngle shift_phase) {
-    SineLookupNCO nco(2 * (float)PI * shift_phase,
-                      2 * (float)PI * shift_freq / (float)len);
-    nco.expj_multiply(dest, src, len);
+// Modification time of a file as a string (empty if it does not exist)
+std::string file_mtime_str(const std::string &path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return std::string();
+    }
+    return (std::to_string(st.st_mtim.tv_sec) + "." +
+            std::to_string(st.st_mtim.tv_nsec));
 }
 
 
-// Like freq_shift, but accounts for discontinuity at DC due to FFT
-// representation (i.e. zero-frequency at index 0).
-void fft_shift(complex<float> *dest,
-                const complex<float> *src,
-                size_t len,
-                float shift_freq,
-                DeciAngle shift_phase,
-                size_t carrier_offset) {
-    SineLookupNCO nco(2 * (float)PI * shift_phase,
-                      2 * (float)PI * shift_freq / (float)len);
-    size_t pos_len = (len+1)/2 + carrier_offset;  // number of positive frequency components
-    nco.expj_multiply(dest, src, pos_len);
-    nco.adjust_phase(-2 * (float)PI * shift_freq);
-    nco.expj_multiply(dest+pos_len, src+pos_len, len-pos_len);
+// Join the values of the flags that configure a submodule, to detect
+// whether they have changed
+std::string join_config(std::initializer_list<std::string> values) {
+    std::string config;
+    for (const std::string &value : values) {
+        config += value;
+        config += '\n';
+    }
+    return config;
+}
+
+// Placement of the thread of a receiver that has the given role, from the
+// --<role>_cpus and --<role>_priority flags. Invalid values leave the
+// thread unpinned or at the default policy.
+ThreadPlacement make_thread_placement(const std::string &role,
+                                      const std::string &cpus,
+                                      int priority,
+                                      int policy,
+                                      int device_index) {
+    ThreadPlacement placement;
+    placement.name = "rx" + std::to_string(device_index) + "-" + role;
+    if (!cpus.empty() &&
+            !select_cpu_group(cpus, device_index, placement.cpus)) {
+        fprintf(stderr, "Invalid value for --%s_cpus: %s\n", role.c_str(),
+                cpus.c_str());
+        // exit(1);
+    }
+    if (policy != SCHED_OTHER) {
+        if (priority < sched_get_priority_min(policy) ||
+                priority > sched_get_priority_max(policy)) {
+            fprintf(stderr, "Invalid value for --%s_priority: %d\n",
+                    role.c_str(), priority);
+            // exit(1);
+        } else {
+            placement.policy = policy;
+            placement.priority = priority;
+        }
+    }
+    return placement;
 }
 
 
-// Calculate the 0 Hz frequency component from a time-domain signal
-complex<float> calculate_dc(complex<float> *signal, size_t len) {
-    std::complex<float> sum = std::accumulate(signal,
-                                              signal + len,
-                                              std::complex<float>(0, 0));
-    return sum;
+// Load a beacon template, sharing the samples between all receivers of the
+// process. Templates are reloaded when the file has been modified; receivers
+// keep the samples they were built from alive.
+std::shared_ptr<const vector<float>> load_shared_template(
+        const std::string &path) {
+    struct CachedTemplate {
+        struct timespec mtime;
+        std::shared_ptr<const vector<float>> samples;
+    };
+    static std::mutex mutex;
+    static std::map<std::string, CachedTemplate> cache;
+
+    struct stat st;
+    memset(&st, 0, sizeof(st));
+    stat(path.c_str(), &st);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = cache.find(path);
+    if (it == cache.end() ||
+            it->second.mtime.tv_sec != st.st_mtim.tv_sec ||
+            it->second.mtime.tv_nsec != st.st_mtim.tv_nsec) {
+        CachedTemplate entry;
+        entry.mtime = st.st_mtim;
+        entry.samples = std::make_shared<const vector<float>>(
+                load_template(path));
+        it = cache.insert(std::make_pair(path, CachedTemplate())).first;
+        it->second = std::move(entry);
+    }
+    return it->second.samples;
+}
+
+
+enum class SliceTransform {
+    AUTO,
+    FFT,
+    GOERTZEL
+};
+
+bool parse_slice_transform_str(const std::string &str, SliceTransform &type) {
+    if (str == "auto") {
+        type = SliceTransform::AUTO;
+    } else if (str == "fft") {
+        type = SliceTransform::FFT;
+    } else if (str == "goertzel") {
+        type = SliceTransform::GOERTZEL;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_nco_str(const std::string &nco, NCOType &type) {
+    if (nco == "table") {
+        type = NCOType::TABLE;
+    } else if (nco == "phasor") {
+        type = NCOType::PHASOR;
+    } else {
+        return false;
+    }
+    return true;
 }
 
 
@@ -218,13 +510,20 @@ inline complex<float>* to_complex_star(fcomplex* array) {
 // TODO: move to header (and user PIMPL?)
 class Receiver {
 public:
-    Receiver() {
+    // device_index overrides --device_index if non-negative.
+    explicit Receiver(int device_index = -1) {
+        device_index_ = device_index;
+        if (device_index_ >= 0) {
+            log_prefix_ = "rx" + std::to_string(device_index_) + " ";
+        }
         state_ = ReceiverState::STOPPED;
         mode_ = ReceiverMode::STOP;
         last_inactive_mode_ = ReceiverMode::STOP;
 
         block_idx_ = 0;
         cycle_ = -1;
+        beacon_time_ = 0;
+        reacquire_blocks_left_ = 0;
         fargs_.reset(fargs_new());
 
         reloadFlags();
@@ -256,7 +555,20 @@ public:
         return state_;
     }
 
-    const char* stateToString(ReceiverState state) {
+    TrackState getTrackState() {
+        return track_state_;
+    }
+
+    // Number of blocks read and index of the last beacon pulse
+    // (-1 before the first pulse of a capture)
+    unsigned getBlockIndex() {
+        return block_idx_;
+    }
+    int getBeacon() {
+        return beacon_;
+    }
+
+    static const char* stateToString(ReceiverState state) {
         switch (state) {
             case ReceiverState::STOPPED:
                 return "STOPPED";
@@ -272,7 +584,7 @@ public:
         return "UNKNOWN";
     }
 
-    const char* modeToString(ReceiverMode state) {
+    static const char* modeToString(ReceiverMode state) {
         switch (state) {
             case ReceiverMode::STOP:
                 return "STOP";
@@ -286,7 +598,7 @@ public:
         return "UNKNOWN";
     }
 
-    const char* trackStateToString(TrackState state) {
+    static const char* trackStateToString(TrackState state) {
         switch (state) {
             case TrackState::INACTIVE:
                 return "INACTIVE";
@@ -308,7 +620,48 @@ public:
 
     void setOutput(std::string filename) {
         assert(isInactiveState(state_));
-        FLAGS_output = filename;
+        output_ = expand_output_pattern(filename, getDeviceIndex());
+    }
+
+    // Share beacon detections with the other receivers of the host
+    // (nullptr to disable). May only be changed in the STOPPED state.
+    void setBeaconCoordinator(BeaconCoordinator *coordinator) {
+        assert(state_ == ReceiverState::STOPPED);
+        beacon_coordinator_ = coordinator;
+    }
+
+    // Integrate cross-spectra with the other receivers of the host
+    // (nullptr to disable). May only be changed in the STOPPED state.
+    void setCrossSpectrumMatcher(CrossSpectrumMatcher *matcher) {
+        assert(state_ == ReceiverState::STOPPED);
+        cross_matcher_ = matcher;
+    }
+
+    // Push state changes, beacons and cycles to the controller
+    // (nullptr to disable)
+    void setControlChannel(ControlChannel *control) {
+        control_ = control;
+    }
+
+    // Save the recent input samples (if the flight recorder is enabled)
+    void triggerFlightRecorder(const std::string &reason) {
+        if (flight_recorder_ && flight_recorder_->trigger(reason)) {
+            BPRINTF("Flight recorder triggered (%s)\n", reason.c_str());
+        }
+    }
+
+    // Per-stage timings and counters.
+    // May be called from any thread (e.g. the control thread).
+    const ReceiverStats& getStats() const {
+        return stats_;
+    }
+    void printStats(FILE* out) const {
+        stats_.print(out, getDeviceIndex(), block_budget_ns_.load());
+    }
+
+    // RTL-SDR device index of this receiver
+    int getDeviceIndex() const {
+        return device_index_ >= 0 ? device_index_ : (int)FLAGS_device_index;
     }
 
     void setFrequency() {
@@ -337,6 +690,12 @@ public:
                 state == ReceiverState::STANDBY);
     }
 
+    // Modes that keep the receiver in an inactive state
+    static bool isInactiveMode(ReceiverMode mode) {
+        return (mode == ReceiverMode::STOP ||
+                mode == ReceiverMode::STANDBY);
+    }
+
 protected:
     // State transitions should only happend from within the next() function
     void setState(ReceiverState new_state);
@@ -356,10 +715,28 @@ protected:
     void recoverCarrier();
     void findBeacon();
 
+    // Read the next block of input samples.
+    // Sets input_samples_ and input_timestamp_.
+    bool readBlock();
+    bool readInputBlock();
+
+    // Print the throughput since the receiver has been started
+    void printThroughput();
+
+    // Perform carrier detection on the current block of input samples.
+    void detectCarrier(CarrierInfo &carrier);
+
     // Capture segment FFTs for cross-correlation.
     // Returns false when the last segment cycle has been reached.
     bool captureCorrSegments();
 
+    // Start and stop a segment cycle (sets cycle_).
+    // In integrated mode, the cycle is written when it is stopped.
+    void startCycle(const CorxBeaconHeader &header);
+    void stopCycle();
+    // Write the integrated products of the current cycle
+    void writeIntegratedCycle();
+
     // Estimate the receiver's clock offset from the position of the carrier
     // frequency. It is assumed that the downconverter and ADC have the same
     // local oscillator (i.e. that they are coherent).
@@ -373,6 +750,14 @@ protected:
         if (strcmp(fargs_->input_file, "rtlsdr") != 0) {
             return false;
         }
+        if (rtlsdr_reader_) {
+            bool success = rtlsdr_reader_->setBiasTee(on);
+            if (success) {
+                BPRINTF("%s",
+                        on ? "Enabled bias tee\n" : "Disabled bias tee\n");
+            }
+            return success;
+        }
 
 #ifdef LIBRTLSDR_BIAS_TEE_SUPPORT
         rtlsdr_reader_set_bias_tee(carrier_det_->get()->reader, on);
@@ -386,7 +771,11 @@ protected:
     }
 
     void setStandby(bool on) {
-        if (strcmp(fargs_->input_file, "rtlsdr") == 0) {
+        if (rtlsdr_reader_) {
+            rtlsdr_reader_->setStandby(on);
+            BPRINTF("%s",
+                    on ? "Input discard enabled\n" : "Input discard disabled\n");
+        } else if (strcmp(fargs_->input_file, "rtlsdr") == 0) {
             rtlsdr_reader_set_standby(carrier_det_->get()->reader, on);
             BPRINTF("%s",
                     on ? "Input discard enabled\n" : "Input discard disabled\n");
@@ -422,22 +811,117 @@ private:
     unique_ptr<fargs_t, decltype(free)*> fargs_ = {NULL, free};
     // Read input and perform carrier detection using fastcard.
     std::unique_ptr<CarrierDetector> carrier_det_;
-
+    // Raw input samples for trigger-time dumps (optional; declared before
+    // rtlsdr_reader_, which records into it from the librtlsdr thread).
+    std::unique_ptr<FlightRecorder> flight_recorder_;
+    // Or read from librtlsdr directly and detect the carrier locally
+    // (--rtlsdr_async; carrier_det_ is not created then).
+    std::unique_ptr<RtlsdrAsyncReader> rtlsdr_reader_;
+    std::unique_ptr<CarrierSearch> carrier_search_;
+    // Re-acquisition of a lost carrier near its last position
+    // (--reacquire_blocks; created regardless of the input)
+    std::unique_ptr<NarrowCarrierSearch> narrow_search_;
+
+    // Reader thread (pipelined mode only).
+    std::unique_ptr<ReaderStage> reader_stage_;
+
+    // Current block of input samples and the time it has been read.
+    const complex<float>* input_samples_;
+    struct timeval input_timestamp_;
+    // Current block from the reader thread (pipelined mode only).
+    const PipelineBlock* input_block_;
+
+    // Beacon template shared with the other receivers of the process
+    // (declared before the detectors that are built from it)
+    std::shared_ptr<const vector<float>> template_samples_;
     // Perform correlation detection using fastdet.
     std::unique_ptr<CorrDetector> corr_det_;
+    // Coarse beacon search gating corr_det_ (optional).
+    std::unique_ptr<BeaconPrefilter> beacon_prefilter_;
+    // Beacon detections of the other receivers of the host (optional).
+    BeaconCoordinator *beacon_coordinator_ = nullptr;
+    // Cycles of the other receivers of the host (integrated mode only).
+    CrossSpectrumMatcher *cross_matcher_ = nullptr;
+    // Binary control channel of the process (optional).
+    ControlChannel *control_ = nullptr;
+    // Placement of the DSP thread (applied when leaving the STOPPED state)
+    // and of the writer thread.
+    ThreadPlacement dsp_placement_;
+    bool dsp_placement_pending_ = false;
+    ThreadPlacement writer_placement_;
 
     // Synced signal, i.e. signal after carrier recovery.
-    std::unique_ptr<FFT> synced_fft_calc_;
+    // (FFTs and buffers are owned by the caches below)
+    FFT *synced_fft_calc_ = nullptr;
     complex<float>* synced_signal_;
     complex<float>* synced_fft_;
 
     // Correlation block buffers.
-    std::unique_ptr<FFT> corr_fft_calc_;
-    complex<float>* corr_signal_;
-    complex<float>* corr_fft_;
-    std::unique_ptr<AlignedArray<complex<float>>> corrected_corr_fft_;
+    // Segment FFTs of a block are calculated in batches, directly from the
+    // synced signal.
+    BatchFFT *corr_fft_calc_ = nullptr;
+    complex<float> *corrected_corr_fft_ = nullptr;
+
+    // Arena of the segment spectra, the corrected segment, the segment
+    // starts and the pipeline ring (declared before the caches, which hold
+    // pointers into it)
+    HotArena hot_arena_;
+    // Hot buffers of the current configuration, for the startup report
+    HotSet hot_set_;
+    std::string hot_config_;
+
+    // FFT plans and buffers of every block and segment size used so far,
+    // so that reloadFlags does not have to plan again when switching back.
+    ObjectCache<size_t, FFT> synced_fft_cache_;
+    ObjectCache<std::pair<size_t, size_t>, BatchFFT> corr_fft_cache_;
+    ArenaBufferCache<size_t, complex<float>> corr_buffer_cache_;
+    ArenaBufferCache<size_t, double> segment_starts_cache_;
+    ArenaBufferCache<size_t, size_t> segment_start_idxs_cache_;
+    // Blocks of the pipeline ring, by block size and depth
+    ArenaBufferCache<std::pair<size_t, size_t>, complex<float>>
+            pipeline_buffer_cache_;
+
+    // Configuration of the submodules created by the last reloadFlags call;
+    // only submodules whose configuration has changed are created again.
+    std::string carrier_config_;
+    std::string narrow_search_config_;
+    std::string reader_config_;
+    std::string reader_placement_config_;
+    std::string flight_recorder_config_;
+    std::string corr_det_config_;
+    std::string prefilter_config_;
+    std::string debug_config_;
+    // Phase and time offset correction of the segment spectra
+    FFTShifter corr_shifter_;
+    // Kernels specialized for the block size, segment size and slice
+    // (selected in reloadFlags)
+    DspKernels dsp_kernels_;
+    // Start of each segment of the current block (fractional and rounded;
+    // max_count() of corr_fft_calc_ entries)
+    double *segment_starts_ = nullptr;
+    size_t *segment_start_idxs_ = nullptr;
 
     // -- Variables that may not change after construction (or reload)
+    // Device index given on construction (-1: use --device_index)
+    int device_index_;
+    // Prepended to log messages
+    std::string log_prefix_;
+    // Output file or stream URL
+    std::string output_;
+
+    // Instrumentation (always on)
+    ReceiverStats stats_;
+    // Real-time budget of a block, i.e. the duration of its new samples
+    std::atomic<double> block_budget_ns_{0};
+    // Time and number of blocks when the receiver has been started
+    uint64_t throughput_start_ns_ = 0;
+    uint64_t throughput_start_blocks_ = 0;
+
+    // Host time at which the next block is expected to start, according to
+    // the number of samples read (used to detect dropped samples)
+    double stream_time_;
+    bool stream_time_valid_;
+
     size_t block_size_;
     size_t history_size_;
     size_t nonhistory_size_;
@@ -449,6 +933,23 @@ private:
     int slice_start_;
     int slice_len_;
 
+    // Compute only the bins of the slice (and bin 0) with the Goertzel
+    // algorithm instead of the full segment FFT.
+    bool use_goertzel_;
+
+    // Oscillator used for carrier recovery
+    NCOType nco_type_;
+
+    // Encoding of FFT bins in output file
+    uint8_t encoding_;
+
+    // Only write the integrated products of each cycle (version 3 format)
+    bool integrate_ = false;
+
+    // Store the quality metrics of every segment
+    bool segment_metrics_ = false;
+    SegmentQuality segment_quality_;
+
     // -- Variables used by all states
 
     // Number of blocks read.
@@ -487,6 +988,14 @@ private:
     int32_t cycle_;
     // TODO: assert cycle_ == -1 on destruction
 
+    // Beacon header of the current cycle and the host time of its pulse
+    CorxBeaconHeader cycle_header_;
+    double beacon_time_;
+    // Integrated products of the current cycle (integrated mode only)
+    CycleIntegrator integrator_;
+    // Cross-spectrum with another receiver
+    vector<complex<float>> xcorr_;
+
     // Output stream.
     // Opened when entering non-inactive state.
     // Closed when exiting non-inactive state.
@@ -514,6 +1023,10 @@ private:
     // Number of correlation blocks with large phase offsets.
     int num_phase_errors_;
 
+    // Blocks left to search for a lost carrier with narrow_search_ before
+    // searching the whole carrier window
+    int reacquire_blocks_left_;
+
     // -- Timeouts
     size_t track_timeout_;
     size_t lock_timeout_;
@@ -547,6 +1060,27 @@ void Receiver::reloadFlags() {
         // exit(1);
     }
 
+    NCOType nco_type = NCOType::TABLE;
+    if (!parse_nco_str(FLAGS_nco, nco_type)) {
+        fprintf(stderr, "Invalid value for --nco: %s\n",
+                FLAGS_nco.c_str());
+        // exit(1);
+    }
+
+    SliceTransform slice_transform = SliceTransform::AUTO;
+    if (!parse_slice_transform_str(FLAGS_slice_transform, slice_transform)) {
+        fprintf(stderr, "Invalid value for --slice_transform: %s\n",
+                FLAGS_slice_transform.c_str());
+        // exit(1);
+    }
+
+    uint8_t encoding = CORX_ENCODING_FLOAT32;
+    if (!parse_bin_encoding(FLAGS_corx_encoding, encoding)) {
+        fprintf(stderr, "Invalid value for --corx_encoding: %s\n",
+                FLAGS_corx_encoding.c_str());
+        // exit(1);
+    }
+
     // Parse fargs (fastcard settings)
     fargs_->input_file = FLAGS_input.c_str();
     fargs_->wisdom_file = FLAGS_wisdom.c_str();
@@ -573,40 +1107,371 @@ void Receiver::reloadFlags() {
     fargs_->sdr_freq = (uint32_t)parse_si_float(&FLAGS_frequency[0]);
     fargs_->sdr_gain = (int)FLAGS_gain * 10; // unit: tenths of a dB
     fargs_->sdr_sample_rate = (uint32_t)parse_si_float(&FLAGS_sample_rate[0]);
-    fargs_->sdr_dev_index = FLAGS_device_index;
+    fargs_->sdr_dev_index = getDeviceIndex();
 
     // Init variables
     block_size_ = fargs_->block_len;
     history_size_ = fargs_->history_len;
     nonhistory_size_ = fargs_->block_len - fargs_->history_len;
     corr_size_ = FLAGS_segment_size;
+    block_budget_ns_ = nonhistory_size_ * 1e9 / fargs_->sdr_sample_rate;
+    stream_time_valid_ = false;
+
+    // Only create the submodules whose configuration has changed, e.g. a
+    // "set" of timing flags does not plan any FFTs or open the SDR again.
+    uint64_t reload_start = stats_now_ns();
+    std::string rebuilt;
+
+    HotMemoryOptions hot_options;
+    hot_options.huge_pages = FLAGS_huge_pages;
+    hot_options.lock = FLAGS_mlock_buffers;
+    hot_arena_.setOptions(hot_options);
+
+    size_t block_size = block_size_;
+    synced_fft_calc_ = synced_fft_cache_.get(block_size_, [block_size] {
+        return new FFT(block_size, true);
+    });
+    size_t segment_size = FLAGS_segment_size;
+    corr_fft_calc_ = corr_fft_cache_.get(
+            std::make_pair(block_size_, segment_size),
+            [this, block_size, segment_size] {
+        size_t max_count = block_size / segment_size + 1;
+        return new BatchFFT(segment_size, max_count,
+                            hot_arena_.allocate<complex<float>>(
+                                    segment_size * max_count));
+    });
+    size_t max_count = corr_fft_calc_->max_count();
+    segment_starts_ = segment_starts_cache_.get(hot_arena_, max_count,
+                                                max_count);
+    segment_start_idxs_ = segment_start_idxs_cache_.get(hot_arena_,
+                                                        max_count,
+                                                        max_count);
+    corrected_corr_fft_ = corr_buffer_cache_.get(hot_arena_, segment_size,
+                                                 segment_size);
+
+    bool rtlsdr_async = FLAGS_rtlsdr_async && FLAGS_input == "rtlsdr";
+    if (FLAGS_rtlsdr_async && !rtlsdr_async) {
+        fprintf(stderr, "Warning: --rtlsdr_async is ignored unless "
+                        "--input=rtlsdr\n");
+    }
+
+    // CPUs and scheduling policies of the threads of the receiver
+    int sched_policy = SCHED_OTHER;
+    if (!parse_sched_policy(FLAGS_sched_policy, sched_policy)) {
+        fprintf(stderr, "Invalid value for --sched_policy: %s\n",
+                FLAGS_sched_policy.c_str());
+        // exit(1);
+    }
+    ThreadPlacement dsp_placement = make_thread_placement(
+            "dsp", FLAGS_dsp_cpus, FLAGS_dsp_priority, sched_policy,
+            getDeviceIndex());
+    ThreadPlacement reader_placement = make_thread_placement(
+            "reader", FLAGS_reader_cpus, FLAGS_reader_priority, sched_policy,
+            getDeviceIndex());
+    ThreadPlacement writer_placement = make_thread_placement(
+            "writer", FLAGS_writer_cpus, FLAGS_writer_priority, sched_policy,
+            getDeviceIndex());
+    if (FLAGS_isolate_reader && reader_placement.cpus.empty()) {
+        fprintf(stderr, "Warning: --isolate_reader is ignored without "
+                        "--reader_cpus\n");
+    } else if (FLAGS_isolate_reader) {
+        for (ThreadPlacement *placement : {&dsp_placement,
+                                           &writer_placement}) {
+            std::vector<int> &cpus = placement->cpus;
+            if (cpus.empty()) {
+                cpus = cpus_excluding(reader_placement.cpus);
+                if (cpus.empty()) {
+                    fprintf(stderr, "Warning: no cpus left for %s with "
+                                    "--isolate_reader\n",
+                            placement->name.c_str());
+                }
+            } else if (std::find_first_of(
+                               cpus.begin(), cpus.end(),
+                               reader_placement.cpus.begin(),
+                               reader_placement.cpus.end()) != cpus.end()) {
+                // (explicit CPUs take precedence)
+                fprintf(stderr, "Warning: %s shares cpus with the reader "
+                                "despite --isolate_reader\n",
+                        placement->name.c_str());
+            }
+        }
+    }
+    if (!(dsp_placement == dsp_placement_) &&
+            !(dsp_placement.isDefault() && dsp_placement_.isDefault())) {
+        // (applied by the DSP thread when the receiver starts)
+        dsp_placement_ = dsp_placement;
+        dsp_placement_pending_ = true;
+    }
+    writer_placement_ = writer_placement;
+    std::string reader_placement_config = join_config({
+            reader_placement.name, format_cpu_list(reader_placement.cpus),
+            std::to_string(reader_placement.policy),
+            std::to_string(reader_placement.priority)});
+
+    std::string carrier_config = join_config({
+            FLAGS_input, FLAGS_wisdom, FLAGS_carrier_window,
+            FLAGS_carrier_threshold, FLAGS_frequency, FLAGS_sample_rate,
+            std::to_string(FLAGS_gain), std::to_string(block_size_),
+            std::to_string(history_size_),
+            std::to_string(getDeviceIndex()),
+            std::to_string(rtlsdr_async), std::to_string(FLAGS_rtlsdr_buffers),
+            std::to_string(FLAGS_rtlsdr_ring_blocks)});
+    std::string reader_config = join_config({
+            carrier_config, std::to_string(FLAGS_pipeline),
+            std::to_string(FLAGS_pipeline_depth)});
+    if (carrier_config != carrier_config_) {
+        reader_stage_.reset();
+        carrier_det_.reset();
+        rtlsdr_reader_.reset();
+        carrier_search_.reset();
+        if (rtlsdr_async) {
+            RtlsdrReaderOptions options;
+            options.device_index = fargs_->sdr_dev_index;
+            options.frequency = fargs_->sdr_freq;
+            options.sample_rate = fargs_->sdr_sample_rate;
+            options.gain = fargs_->sdr_gain;
+            options.block_size = block_size_;
+            options.history_size = history_size_;
+            options.num_buffers = FLAGS_rtlsdr_buffers;
+            options.ring_blocks = FLAGS_rtlsdr_ring_blocks;
+            options.placement = reader_placement;
+            try {
+                rtlsdr_reader_.reset(new RtlsdrAsyncReader(options));
+                carrier_search_.reset(new CarrierSearch(
+                        block_size_,
+                        fargs_->carrier_freq_min,
+                        fargs_->carrier_freq_max,
+                        fargs_->threshold_const,
+                        fargs_->threshold_snr));
+                rebuilt += " rtlsdr_reader";
+            } catch (const std::exception &e) {
+                fprintf(stderr, "Warning: could not use --rtlsdr_async (%s); "
+                                "reading through fastcard\n", e.what());
+                rtlsdr_reader_.reset();
+                carrier_search_.reset();
+            }
+        }
+        if (!rtlsdr_reader_) {
+            carrier_det_.reset(new CarrierDetector(fargs_.get()));
+            rebuilt += " carrier_detector";
+        }
+        carrier_config_ = carrier_config;
+        reader_config_.clear();
+    }
+    if (reader_config != reader_config_) {
+        reader_stage_.reset();
+        if (FLAGS_pipeline && rtlsdr_reader_) {
+            // (the librtlsdr thread already decouples reading from DSP)
+            fprintf(stderr, "Warning: --pipeline is ignored with "
+                            "--rtlsdr_async\n");
+        } else if (FLAGS_pipeline) {
+            size_t depth = std::max<size_t>(1, FLAGS_pipeline_depth);
+            complex<float> *buffer = pipeline_buffer_cache_.get(
+                    hot_arena_, std::make_pair(block_size_, depth),
+                    block_size_ * depth);
+            reader_stage_.reset(new ReaderStage(carrier_det_.get(),
+                                                block_size_,
+                                                depth,
+                                                reader_placement,
+                                                buffer));
+        }
+        reader_config_ = reader_config;
+        rebuilt += " reader";
+    }
+    if (reader_placement_config != reader_placement_config_) {
+        // (the reader threads are placed when they are started, so they
+        //  are re-pinned without opening the device again)
+        if (rtlsdr_reader_) {
+            rtlsdr_reader_->setPlacement(reader_placement);
+        }
+        if (reader_stage_) {
+            reader_stage_->setPlacement(reader_placement);
+        }
+        reader_placement_config_ = reader_placement_config;
+    }
+    input_samples_ = nullptr;
+    input_block_ = nullptr;
+
+    if (FLAGS_reacquire_blocks < 0) {
+        fprintf(stderr, "Invalid value for --reacquire_blocks\n");
+        // exit(1);
+    }
+    std::string narrow_search_config = join_config({
+            std::to_string(FLAGS_reacquire_blocks > 0),
+            std::to_string(FLAGS_reacquire_window),
+            FLAGS_carrier_threshold, std::to_string(block_size_)});
+    if (narrow_search_config != narrow_search_config_) {
+        narrow_search_.reset();
+        if (FLAGS_reacquire_blocks > 0) {
+            try {
+                narrow_search_.reset(new NarrowCarrierSearch(
+                        block_size_,
+                        std::max(0, FLAGS_reacquire_window),
+                        fargs_->threshold_const,
+                        fargs_->threshold_snr));
+                rebuilt += " narrow_carrier_search";
+            } catch (const std::invalid_argument &e) {
+                fprintf(stderr, "Invalid value for --reacquire_window: %s\n",
+                        e.what());
+                // exit(1);
+            }
+        }
+        narrow_search_config_ = narrow_search_config;
+    }
 
-    synced_fft_calc_.reset(new FFT(block_size_, true));
-    corr_fft_calc_.reset(new FFT(FLAGS_segment_size, true));
-    corrected_corr_fft_.reset(
-            new AlignedArray<complex<float>>(FLAGS_segment_size));
-
-    carrier_det_.reset();
-    carrier_det_.reset(new CarrierDetector(fargs_.get()));
-    vector<float> template_samples = load_template(FLAGS_template);
-    corr_det_.reset(new CorrDetector(template_samples,
-                                     block_size_,
-                                     history_size_,
-                                     corr_thresh_const,
-                                     corr_thresh_snr));
+    std::string flight_recorder_config = join_config({
+            carrier_config, std::to_string(FLAGS_flight_recorder_seconds),
+            std::to_string(FLAGS_flight_recorder_post_seconds),
+            FLAGS_flight_recorder_dir, FLAGS_flight_recorder_triggers,
+            std::to_string(FLAGS_flight_recorder_min_interval)});
+    if (flight_recorder_config != flight_recorder_config_) {
+        if (rtlsdr_reader_) {
+            rtlsdr_reader_->setFlightRecorder(nullptr);
+        }
+        flight_recorder_.reset();
+        FlightRecorderOptions options;
+        options.sample_rate = fargs_->sdr_sample_rate;
+        options.frequency = fargs_->sdr_freq;
+        options.device_index = getDeviceIndex();
+        options.pre_seconds = FLAGS_flight_recorder_seconds;
+        options.post_seconds = FLAGS_flight_recorder_post_seconds;
+        options.dir = FLAGS_flight_recorder_dir;
+        options.min_interval = FLAGS_flight_recorder_min_interval;
+        if (!parse_flight_recorder_triggers(FLAGS_flight_recorder_triggers,
+                                            options.triggers)) {
+            fprintf(stderr, "Invalid value for --flight_recorder_triggers: "
+                            "%s\n", FLAGS_flight_recorder_triggers.c_str());
+            // exit(1);
+        }
+        if (FLAGS_flight_recorder_seconds > 0) {
+            try {
+                flight_recorder_.reset(new FlightRecorder(options));
+                rebuilt += " flight_recorder";
+            } catch (const std::exception &e) {
+                fprintf(stderr, "Warning: flight recorder disabled (%s)\n",
+                        e.what());
+            }
+        }
+        if (rtlsdr_reader_) {
+            rtlsdr_reader_->setFlightRecorder(flight_recorder_.get());
+        }
+        flight_recorder_config_ = flight_recorder_config;
+    }
+
+    // (the template is reloaded if the file has been modified)
+    std::string template_config = join_config({
+            FLAGS_template, file_mtime_str(FLAGS_template),
+            std::to_string(block_size_), std::to_string(history_size_)});
+    std::string corr_det_config = join_config({
+            template_config, FLAGS_beacon_threshold});
+    std::string prefilter_config = join_config({
+            template_config, std::to_string(FLAGS_beacon_prefilter),
+            std::to_string(FLAGS_beacon_prefilter_decimation)});
+    if (!corr_det_ || corr_det_config != corr_det_config_ ||
+            prefilter_config != prefilter_config_) {
+        template_samples_ = load_shared_template(FLAGS_template);
+        const vector<float> &template_samples = *template_samples_;
+        if (!corr_det_ || corr_det_config != corr_det_config_) {
+            corr_det_.reset();
+            corr_det_.reset(new CorrDetector(template_samples,
+                                             block_size_,
+                                             history_size_,
+                                             corr_thresh_const,
+                                             corr_thresh_snr));
+            corr_det_config_ = corr_det_config;
+            rebuilt += " beacon_detector";
+        }
+        if (prefilter_config != prefilter_config_) {
+            beacon_prefilter_.reset();
+            if (FLAGS_beacon_prefilter > 0) {
+                try {
+                    beacon_prefilter_.reset(new BeaconPrefilter(
+                            template_samples,
+                            block_size_,
+                            history_size_,
+                            FLAGS_beacon_prefilter_decimation,
+                            FLAGS_beacon_prefilter));
+                } catch (const std::invalid_argument &e) {
+                    fprintf(stderr, "Invalid value for "
+                                    "--beacon_prefilter_decimation: %s\n",
+                            e.what());
+                }
+            }
+            prefilter_config_ = prefilter_config;
+            rebuilt += " beacon_prefilter";
+        }
+    }
     
     synced_signal_ = to_complex_star(synced_fft_calc_->input());
     synced_fft_ = to_complex_star(synced_fft_calc_->output());
     
-    corr_signal_ = to_complex_star(corr_fft_calc_->input());
-    corr_fft_ = to_complex_star(corr_fft_calc_->output());
     
     slice_start_ = max(0, slice_start);
     slice_len_ = (slice_len <= 0) ? corr_size_-slice_start_
                  : min(corr_size_-slice_start_, (size_t)slice_len);
+
+    dsp_kernels_ = select_dsp_kernels(block_size_, corr_size_, slice_start_,
+                                      slice_start_ + slice_len_);
+
+    // bin 0 is always needed for the phase error
+    size_t num_bins = slice_len_ + (slice_start_ > 0 ? 1 : 0);
+    use_goertzel_ = (slice_transform == SliceTransform::GOERTZEL ||
+                     (slice_transform == SliceTransform::AUTO &&
+                      goertzel_is_cheaper(corr_size_, num_bins)));
     
-    // setOutput(FLAGS_output);
-    debug_ = CFile(FLAGS_debug);
+    nco_type_ = nco_type;
+    encoding_ = encoding;
+    integrate_ = FLAGS_integrate;
+    if (integrate_ && encoding_ != CORX_ENCODING_FLOAT32) {
+        fprintf(stderr, "Warning: --corx_encoding is ignored with "
+                        "--integrate\n");
+    }
+    segment_metrics_ = FLAGS_segment_metrics && !integrate_;
+    if (FLAGS_segment_metrics && integrate_) {
+        fprintf(stderr, "Warning: --segment_metrics is ignored with "
+                        "--integrate\n");
+    }
+
+    setOutput(FLAGS_output);
+    if (FLAGS_debug != debug_config_) {
+        debug_ = CFile(FLAGS_debug);
+        debug_config_ = FLAGS_debug;
+    }
+
+    // Report the hot set whenever it may have changed
+    hot_set_.clear();
+    hot_set_.add("synced signal", synced_signal_,
+                 block_size_ * sizeof(complex<float>));
+    hot_set_.add("synced spectrum", synced_fft_,
+                 block_size_ * sizeof(complex<float>));
+    hot_set_.add("segment spectra", corr_fft_calc_->output(0),
+                 corr_fft_calc_->output_size() * sizeof(complex<float>),
+                 true);
+    hot_set_.add("corrected segment", corrected_corr_fft_,
+                 segment_size * sizeof(complex<float>), true);
+    hot_set_.add("segment starts", segment_starts_,
+                 max_count * sizeof(double), true);
+    hot_set_.add("segment start indices", segment_start_idxs_,
+                 max_count * sizeof(size_t), true);
+    if (reader_stage_) {
+        for (size_t i = 0; i < reader_stage_->depth(); i++) {
+            hot_set_.add("pipeline block " + std::to_string(i),
+                         reader_stage_->blockSamples(i),
+                         block_size_ * sizeof(complex<float>), true);
+        }
+    }
+    hot_set_.apply(hot_options);
+    std::string hot_config = join_config({
+            std::to_string(FLAGS_huge_pages),
+            std::to_string(FLAGS_mlock_buffers)});
+    if (!rebuilt.empty() || hot_config != hot_config_) {
+        hot_set_.print(stdout, log_prefix_, &hot_arena_);
+        hot_config_ = hot_config;
+    }
+
+    printf("%sReloaded flags in %.3f ms (created:%s)\n", log_prefix_.c_str(),
+           (stats_now_ns() - reload_start) * 1e-6,
+           rebuilt.empty() ? " nothing" : rebuilt.c_str());
 }
 
 
@@ -625,11 +1490,19 @@ void Receiver::setMode(ReceiverMode new_mode) {
     BPRINTF("MODE changed from %s to %s\n",
             modeToString(old_mode),
             modeToString(new_mode));
+    if (control_) {
+        control_->sendTransition(ControlFrame::MODE, getDeviceIndex(),
+                                 (uint8_t)old_mode, (uint8_t)new_mode,
+                                 block_idx_);
+    }
 
     if (new_mode == ReceiverMode::STOP) {
         if (carrier_det_) {
             carrier_det_->cancel();
         }
+        if (rtlsdr_reader_) {
+            rtlsdr_reader_->cancel();
+        }
         // the next next() call will transition to the STOP state
     }
 }
@@ -654,10 +1527,10 @@ void Receiver::setState(ReceiverState new_state) {
             // This action should be taken before the file is closed
             // (also performed for NOISE_CAPTURE state)
             if (cycle_ >= 0) {
-                cycle_ = -1;
-                writer_->write_cycle_stop();
+                stopCycle();
             }
-            // TODO: flush output
+            // Hand captured data to the writer
+            writer_->flush();
 
             setTrackState(TrackState::INACTIVE);
 
@@ -674,10 +1547,10 @@ void Receiver::setState(ReceiverState new_state) {
             // This action should be taken before the file is closed
             // (also performed for NOISE_CAPTURE state)
             if (cycle_ >= 0) {
-                cycle_ = -1;
-                writer_->write_cycle_stop();
+                stopCycle();
             }
-            // TODO: flush output
+            // Hand captured data to the writer
+            writer_->flush();
 
             // May only reach INACTIVE state from NOISE_CAPTURE
             assert(isInactiveState(new_state));
@@ -691,12 +1564,60 @@ void Receiver::setState(ReceiverState new_state) {
     BPRINTF("STATE changed from %s to %s\n",
             stateToString(old_state),
             stateToString(new_state));
+    if (control_) {
+        control_->sendTransition(ControlFrame::STATE, getDeviceIndex(),
+                                 (uint8_t)old_state, (uint8_t)new_state,
+                                 block_idx_);
+    }
 
     // -- Actions for changing to new state
     switch (new_state) {
         case ReceiverState::STOPPED:
             // Output stats
-            carrier_det_->print_stats(stdout);
+            stream_time_valid_ = false;
+            if (carrier_det_) {
+                carrier_det_->print_stats(stdout);
+            }
+            if (rtlsdr_reader_) {
+                rtlsdr_reader_->printStats(stdout);
+                printf("Carrier search: carrier detected in %llu of %llu "
+                       "blocks\n",
+                       (unsigned long long)carrier_search_->detections(),
+                       (unsigned long long)carrier_search_->searches());
+            }
+            if (narrow_search_) {
+                printf("Narrow carrier search: carrier reacquired in %llu of "
+                       "%llu blocks\n",
+                       (unsigned long long)narrow_search_->detections(),
+                       (unsigned long long)narrow_search_->searches());
+            }
+            if (flight_recorder_) {
+                flight_recorder_->printStats(stdout);
+            }
+            if (reader_stage_) {
+                reader_stage_->join();
+                reader_stage_->printStats(stdout);
+            }
+            if (beacon_prefilter_) {
+                printf("Beacon prefilter: %llu of %llu checks passed to "
+                       "beacon detection\n",
+                       (unsigned long long)beacon_prefilter_->passes(),
+                       (unsigned long long)beacon_prefilter_->checks());
+            }
+            if (FLAGS_throughput_report) {
+                printThroughput();
+            }
+            if (beacon_coordinator_) {
+                printf("Beacon sharing: %llu blocks searched; %llu blocks "
+                       "skipped (all receivers)\n",
+                       (unsigned long long)beacon_coordinator_->searches(),
+                       (unsigned long long)beacon_coordinator_->skips());
+            }
+            if (cross_matcher_) {
+                printf("Cross-spectra: %llu cycle pairs integrated "
+                       "(all receivers)\n",
+                       (unsigned long long)cross_matcher_->matches());
+            }
             break;
 
         case ReceiverState::STANDBY:
@@ -723,6 +1644,7 @@ void Receiver::setState(ReceiverState new_state) {
             avg_dc_ampl_ = 0;
             beacon_ = -1;
             num_phase_errors_ = 0;
+            reacquire_blocks_left_ = 0;
 
             // set timers
             setTimeout(track_timeout_, FLAGS_timeout);
@@ -757,25 +1679,83 @@ void Receiver::setState(ReceiverState new_state) {
     // Transition from inactive state
     if (isInactiveState(old_state) && !isInactiveState(new_state)) {
         // Open output file
-        writer_.reset(new CorxFileWriter(CFile(FLAGS_output)));
+        CorxWriterOptions writer_options;
+        writer_options.async = FLAGS_pipeline || FLAGS_async_writer;
+        writer_options.queue_depth = FLAGS_writer_queue_depth;
+        writer_options.buffer_size = FLAGS_writer_buffer_size;
+        writer_options.direct_io = FLAGS_writer_direct_io;
+        writer_options.encoding = encoding_;
+        writer_options.integrated = integrate_;
+        writer_options.segment_metrics = segment_metrics_;
+        writer_options.device_index = getDeviceIndex();
+        writer_options.placement = writer_placement_;
+        if (is_stream_url(output_)) {
+            StreamUrl url;
+            int fd = -1;
+            if (!parse_stream_url(output_, url)) {
+                fprintf(stderr, "Invalid value for --output\n");
+            } else {
+                fd = stream_connect(url);
+            }
+            if (fd >= 0) {
+                writer_.reset(new CorxFileWriter(fd, writer_options));
+            } else {
+                fprintf(stderr, "Warning: streaming disabled; "
+                                "output is discarded\n");
+                writer_.reset(new CorxFileWriter(CFile(""),
+                                                 writer_options));
+            }
+        } else {
+            writer_.reset(new CorxFileWriter(CFile(output_),
+                                             writer_options));
+        }
 
         // Write header
         writer_->write_file_header({(uint16_t)slice_start_,
                 (uint16_t)slice_len_});
 
-        printf("Opened output file \"%s\"\n", FLAGS_output.data());
+        printf("%sOpened output file \"%s\"\n", log_prefix_.c_str(),
+               output_.data());
     }
 
     // Transition to inactive state
     if (!isInactiveState(old_state) && isInactiveState(new_state)) {
+        writer_->print_stats(stdout);
         writer_.reset();
         printf("Closed output file\n");
     }
 
     // Transition from STOPPED
     if (old_state == ReceiverState::STOPPED) {
+        // (setState runs on the DSP thread. Threads inherit the placement
+        //  of the thread that creates them, so the reader threads, e.g.
+        //  fastcard's USB thread, are started from the default placement
+        //  and the DSP thread is placed afterwards.)
+        bool place_dsp = (dsp_placement_pending_ ||
+                          !dsp_placement_.isDefault());
+        if (place_dsp) {
+            apply_thread_placement(ThreadPlacement(), "", nullptr);
+        }
+
         // RTL should be on in all states other that STOPPED
-        carrier_det_->start();
+        if (rtlsdr_reader_) {
+            rtlsdr_reader_->start();
+        } else {
+            carrier_det_->start();
+        }
+        throughput_start_ns_ = stats_now_ns();
+        throughput_start_blocks_ = stats_.blocks.load();
+        if (reader_stage_) {
+            reader_stage_->start();
+        }
+
+        if (place_dsp) {
+            // (only reported when it has changed)
+            apply_thread_placement(dsp_placement_, log_prefix_,
+                                   dsp_placement_pending_ ? stdout
+                                                          : nullptr);
+            dsp_placement_pending_ = false;
+        }
     }
 }
 
@@ -810,7 +1790,10 @@ bool Receiver::next() {
     }
 
     // read next block without performing carrier detection
-    bool success = carrier_det_->next();
+    uint64_t read_start = stats_now_ns();
+    bool success = readBlock();
+    uint64_t block_start = stats_now_ns();
+    stats_.stages[ReceiverStats::READ].record(block_start - read_start);
     if (!success) {
         // Transition to STOPPED state
         setState(ReceiverState::STOPPED);
@@ -870,16 +1853,25 @@ bool Receiver::next() {
             break;
     }
 
+    uint64_t block_ns = stats_now_ns() - block_start;
+    stats_.stages[ReceiverStats::BLOCK].record(block_ns);
+    ReceiverStats::increment(stats_.blocks);
+    if (block_ns > block_budget_ns_.load(std::memory_order_relaxed)) {
+        ReceiverStats::increment(stats_.late_blocks);
+    }
+
     return true;
 }
 
 void Receiver::nextNoiseCapture() {
     // continue with last carrier frequency from active state
-    freq_shift(synced_signal_,
-               to_complex_star(carrier_det_->data().samples),
-               block_size_,
-               -carrier_pos_,
-               sample_phase_);
+    dsp_kernels_.freq_shift(synced_signal_,
+                            input_samples_,
+                            block_size_,
+                            -carrier_pos_,
+                            sample_phase_,
+                            nco_type_,
+                            FLAGS_nco_resync_interval);
 
     if (cycle_ == -1) {
         // FIXME: copy-pasta
@@ -887,10 +1879,10 @@ void Receiver::nextNoiseCapture() {
 
         soa_ = (nonhistory_size_ * block_idx_);  // FIXME: no padding
 
-        cycle_ = 0;
         num_phase_errors_ = 0;
 
-        const struct timeval ts = carrier_det_->data().block->timestamp;
+        const struct timeval ts = input_timestamp_;
+        beacon_time_ = ts.tv_sec + ts.tv_usec * 1e-6;
         CorxBeaconHeader header;
         header.soa = soa_;
         header.timestamp_sec = ts.tv_sec;
@@ -901,20 +1893,22 @@ void Receiver::nextNoiseCapture() {
         header.carrier_pos = carrier_pos_;
         header.carrier_amplitude = 0;
         header.preamp_on = false;
-        writer_->write_cycle_start(header);
+        startCycle(header);
     }
 
     bool has_more_segments = captureCorrSegments();
     if (!has_more_segments) {
-        cycle_ = -1;
-        writer_->write_cycle_stop();
+        stopCycle();
     }
 }
 
 void Receiver::nextActive() {
     // Track carrier
     // Transition to FIND_CARRIER if lost; transition to LOCKED if found
-    recoverCarrier();
+    {
+        ScopedTimer timer(stats_.stages[ReceiverStats::CARRIER]);
+        recoverCarrier();
+    }
 
     sample_phase_ -= (carrier_pos_ *
                       (1.f - (float)history_size_ / block_size_));
@@ -942,6 +1936,7 @@ void Receiver::nextActive() {
 
     if (track_state_ == TrackState::FIND_BEACON) {
         // Look for beacon signal and transition to CAPTURE if found
+        ScopedTimer timer(stats_.stages[ReceiverStats::BEACON]);
         findBeacon();
     }
 
@@ -968,6 +1963,9 @@ void Receiver::setTrackState(TrackState new_state) {
 
         case TrackState::FIND_CARRIER:
             deactiveTimeout(lock_timeout_);
+            if (reader_stage_) {
+                reader_stage_->setCarrierSearch(false);
+            }
             break;
 
         case TrackState::LOCKED:
@@ -978,19 +1976,27 @@ void Receiver::setTrackState(TrackState new_state) {
 
         case TrackState::CAPTURE:
             if (cycle_ >= 0) {
-                cycle_ = -1;
-                writer_->write_cycle_stop();
+                stopCycle();
             }
             if (num_phase_errors_ > 0) {
                 printf("beacon %d: %d / %d corr blocks have large phase error\n",
                        beacon_, num_phase_errors_, num_cycles_);
             }
+            if (num_phase_errors_ > (FLAGS_flight_recorder_phase_error_fraction
+                                     * num_cycles_)) {
+                triggerFlightRecorder("phase_errors");
+            }
             break;
     }
 
     BPRINTF("TRACK state changed from %s to %s\n",
             trackStateToString(old_state),
             trackStateToString(new_state));
+    if (control_) {
+        control_->sendTransition(ControlFrame::TRACK_STATE, getDeviceIndex(),
+                                 (uint8_t)old_state, (uint8_t)new_state,
+                                 block_idx_);
+    }
 
     switch (new_state) {
         case TrackState::INACTIVE:
@@ -998,6 +2004,10 @@ void Receiver::setTrackState(TrackState new_state) {
 
         case TrackState::FIND_CARRIER:
             setTimeout(lock_timeout_, FLAGS_carrier_search_timeout);
+            // (the reader thread only searches the whole carrier window)
+            if (reader_stage_ && reacquire_blocks_left_ == 0) {
+                reader_stage_->setCarrierSearch(true);
+            }
             break;
 
         case TrackState::LOCKED:
@@ -1007,7 +2017,6 @@ void Receiver::setTrackState(TrackState new_state) {
             break;
 
         case TrackState::CAPTURE:
-            cycle_ = 0;
             num_phase_errors_ = 0;
 
             if (beacon_ == 0) {
@@ -1018,7 +2027,7 @@ void Receiver::setTrackState(TrackState new_state) {
                 setTimeout(capture_timeout_, FLAGS_capture_time);
             }
 
-            const struct timeval ts = carrier_det_->data().block->timestamp;
+            const struct timeval ts = input_timestamp_;
 
             CorxBeaconHeader header;
             header.soa = soa_;
@@ -1030,7 +2039,7 @@ void Receiver::setTrackState(TrackState new_state) {
             header.carrier_pos = carrier_pos_;
             header.carrier_amplitude = dc_ampl_;
             header.preamp_on = true;
-            writer_->write_cycle_start(header);
+            startCycle(header);
             break;
     }
 }
@@ -1040,15 +2049,17 @@ void Receiver::recoverCarrier() {
 
     //// Carrier tracking and synchronization
     if (track_state_ != TrackState::FIND_CARRIER) {
-        freq_shift(synced_signal_,
-                   to_complex_star(carrier_det_->data().samples),
-                   block_size_,
-                   -carrier_pos_,
-                   sample_phase_);
+        complex<float> dc = dsp_kernels_.freq_shift_dc(
+                synced_signal_,
+                input_samples_,
+                block_size_,
+                -carrier_pos_,
+                sample_phase_,
+                nco_type_,
+                FLAGS_nco_resync_interval);
 
         prev_dc_angle_ = dc_angle_;
 
-        complex<float> dc = calculate_dc(synced_signal_, block_size_);
         dc_ampl_ = abs(dc);
         dc_angle_ = normalize_deciangle(arg(dc) / (float)PI / 2);
 
@@ -1059,6 +2070,11 @@ void Receiver::recoverCarrier() {
         if (angle_diff * 360 > FLAGS_max_tracking_phase_diff) {
             // tracking loop failed
             BPRINTF("Tracking loop failed\n");
+            ReceiverStats::increment(stats_.tracking_failures);
+            triggerFlightRecorder("lost_lock");
+            // (search near the last carrier position first)
+            reacquire_blocks_left_ = (narrow_search_ ? FLAGS_reacquire_blocks
+                                                     : 0);
             setTrackState(TrackState::FIND_CARRIER);
         } else {
             // track
@@ -1074,13 +2090,11 @@ void Receiver::recoverCarrier() {
     //// Carrier detection and synchronization
     if (track_state_ == TrackState::FIND_CARRIER) {
         //// Tracking loop failed
-        carrier_det_->process();
-        const fastcard_data_t& carrier = carrier_det_->data();
+        CarrierInfo carrier;
+        detectCarrier(carrier);
 
         if (carrier.detected) {
-            float carrier_offset = CorrDetector::interpolate_parabolic(
-                    &carrier.fft_power[carrier.detection.argmax]);
-            carrier_pos_ = carrier.detection.argmax + carrier_offset;
+            carrier_pos_ = carrier.pos;
 
             // calculate signed index
             if (carrier_pos_ > block_size_ / 2) {
@@ -1088,13 +2102,14 @@ void Receiver::recoverCarrier() {
             }
 
             // perform freq shift
-            freq_shift(synced_signal_,
-                       to_complex_star(carrier_det_->data().samples),
-                       block_size_,
-                       -carrier_pos_,
-                       sample_phase_);
-
-            complex<float> dc = calculate_dc(synced_signal_, block_size_);
+            complex<float> dc = dsp_kernels_.freq_shift_dc(
+                    synced_signal_,
+                    input_samples_,
+                    block_size_,
+                    -carrier_pos_,
+                    sample_phase_,
+                    nco_type_,
+                    FLAGS_nco_resync_interval);
             dc_ampl_ = abs(dc);
             dc_angle_ = normalize_deciangle(arg(dc) / (float)PI / 2);
 
@@ -1103,8 +2118,8 @@ void Receiver::recoverCarrier() {
 
             BPRINTF("Detected carrier @ %.3f; SNR: %.1f / %.1f; (DC: %.1f)\n",
                     carrier_pos_,
-                    carrier.detection.max,
-                    carrier.detection.noise,
+                    carrier.max,
+                    carrier.noise,
                     dc_ampl_);
 
             setTrackState(TrackState::LOCKED);
@@ -1115,6 +2130,138 @@ void Receiver::recoverCarrier() {
     }
 }
 
+void Receiver::printThroughput() {
+    double seconds = (stats_now_ns() - throughput_start_ns_) * 1e-9;
+    uint64_t samples = ((stats_.blocks.load() - throughput_start_blocks_)
+                        * nonhistory_size_);
+    double samples_per_sec = seconds > 0 ? samples / seconds : 0;
+    printf("%sTHROUGHPUT {\"samples\": %llu, \"seconds\": %.3f, "
+           "\"samples_per_sec\": %.1f, \"realtime_factor\": %.2f}\n",
+           log_prefix_.c_str(), (unsigned long long)samples, seconds,
+           samples_per_sec, samples_per_sec / fargs_->sdr_sample_rate);
+}
+
+bool Receiver::readBlock() {
+    bool success = readInputBlock();
+    if (success) {
+        // Blocks may be timestamped early (e.g. when buffered), but never
+        // much later than the samples read so far imply, unless samples
+        // have been lost.
+        const double max_lag = 0.05;
+        double time = (input_timestamp_.tv_sec +
+                       input_timestamp_.tv_usec * 1e-6);
+        double block_time = (double)nonhistory_size_ /
+                            fargs_->sdr_sample_rate;
+        if (stream_time_valid_ && time > stream_time_ + max_lag) {
+            ReceiverStats::increment(stats_.dropped_blocks,
+                ((uint64_t)((time - stream_time_) / block_time)));
+            stream_time_ = time;
+        } else if (!stream_time_valid_) {
+            stream_time_ = time;
+            stream_time_valid_ = true;
+        }
+        stream_time_ += block_time;
+
+        // (the librtlsdr thread records the raw samples itself)
+        if (flight_recorder_ && !rtlsdr_reader_) {
+            double new_time = time + (double)history_size_ /
+                                     fargs_->sdr_sample_rate;
+            struct timeval ts;
+            ts.tv_sec = (time_t)new_time;
+            ts.tv_usec = (suseconds_t)((new_time - ts.tv_sec) * 1e6);
+            flight_recorder_->record(input_samples_ + history_size_,
+                                     nonhistory_size_, ts);
+        }
+    }
+    return success;
+}
+
+bool Receiver::readInputBlock() {
+    if (rtlsdr_reader_) {
+        if (!rtlsdr_reader_->next()) {
+            return false;
+        }
+        input_samples_ = rtlsdr_reader_->samples();
+        input_timestamp_ = rtlsdr_reader_->timestamp();
+        return true;
+    }
+    if (!reader_stage_) {
+        if (!carrier_det_->next()) {
+            return false;
+        }
+        input_samples_ = to_complex_star(carrier_det_->data().samples);
+        input_timestamp_ = carrier_det_->data().block->timestamp;
+        return true;
+    }
+
+    // Release the previous block to the reader thread
+    if (input_block_ != nullptr) {
+        reader_stage_->pop();
+        input_block_ = nullptr;
+    }
+
+    const PipelineBlock& block = reader_stage_->front();
+    if (block.eof) {
+        reader_stage_->pop();
+        return false;
+    }
+    input_block_ = &block;
+    input_samples_ = block.samples;
+    input_timestamp_ = block.timestamp;
+    return true;
+}
+
+void Receiver::detectCarrier(CarrierInfo &carrier) {
+    if (reacquire_blocks_left_ > 0) {
+        // (carrier_pos_ is the last position of the lost carrier; the
+        //  narrow search may have been disabled by reloadFlags since)
+        if (narrow_search_) {
+            narrow_search_->detect(input_samples_, carrier_pos_, carrier);
+            if (carrier.detected) {
+                ReceiverStats::increment(stats_.carrier_reacquisitions);
+                reacquire_blocks_left_ = 0;
+                return;
+            }
+            if (--reacquire_blocks_left_ > 0) {
+                return;
+            }
+        }
+        reacquire_blocks_left_ = 0;
+        BPRINTF("Carrier not found near %.3f; searching the whole carrier "
+                "window\n", carrier_pos_);
+        if (reader_stage_) {
+            reader_stage_->setCarrierSearch(true);
+        }
+        // (the reader thread has not searched this block)
+    }
+
+    if (reader_stage_) {
+        // Carrier detection has been performed by the reader thread if it
+        // has already seen the request to search for the carrier
+        if (input_block_->carrier_processed) {
+            carrier = input_block_->carrier;
+        } else {
+            carrier.detected = false;
+        }
+        return;
+    }
+    if (carrier_search_) {
+        carrier_search_->detect(input_samples_, carrier);
+        return;
+    }
+
+    carrier_det_->process();
+    const fastcard_data_t& data = carrier_det_->data();
+    carrier.detected = data.detected;
+    if (data.detected) {
+        float carrier_offset = CorrDetector::interpolate_parabolic(
+                &data.fft_power[data.detection.argmax]);
+        carrier.pos = data.detection.argmax + carrier_offset;
+        carrier.max = data.detection.max;
+        carrier.noise = data.detection.noise;
+    }
+}
+
 void Receiver::findBeacon() {
     assert(cycle_ == -1);
     assert(track_state_ == TrackState::FIND_BEACON);
@@ -1138,11 +2285,30 @@ void Receiver::findBeacon() {
             dc_ampl_,
             avg_dc_ampl_ * FLAGS_beacon_carrier_trigger_factor);
 
+    // host time of the first sample of the block
+    double block_time = (input_timestamp_.tv_sec +
+                         input_timestamp_.tv_usec * 1e-6);
+    double block_duration = (double)block_size_ / fargs_->sdr_sample_rate;
+    if (beacon_coordinator_ &&
+            !beacon_coordinator_->shouldSearch(block_time,
+                                               block_time + block_duration)) {
+        // another receiver has seen the last pulse, and the next one is not
+        // expected in this block
+        return;
+    }
+
+    if (beacon_prefilter_ &&
+            !beacon_prefilter_->check(synced_signal_, block_idx_)) {
+        // no beacon-like signal: skip the FFT of the whole block
+        return;
+    }
+
     synced_fft_calc_->execute();
     float signal_energy = 0; // TODO: calculate signal_energy
     CorrDetection corr = corr_det_->detect(synced_fft_, signal_energy);
     if (corr.detected) {
         BPRINTF("detected beacon (ampl: %.0f)\n", corr.peak_power);
+        ReceiverStats::increment(stats_.beacons);
         
         prev_soa_ = soa_;
         soa_ = (nonhistory_size_ * block_idx_
@@ -1152,17 +2318,30 @@ void Receiver::findBeacon() {
         if ((beacon_ > 0) && (time_step > 1.5 * FLAGS_beacon_interval)) {
             // We missed a pulse. Estimate beacon index from sample index.
             printf("Large time step!\n");
+            ReceiverStats::increment(stats_.large_time_steps);
+            triggerFlightRecorder("time_step");
             beacon_ += (int)round(time_step);
         } else {
             beacon_++;
         }
 
         clock_error_ = estimateClockError();
+        // (the receiver's sample clock is off by clock_error_)
+        double offset = corr.peak_idx + corr.peak_offset;
+        beacon_time_ = (block_time + offset / fargs_->sdr_sample_rate
+                                     / (1 - clock_error_));
+        if (beacon_coordinator_) {
+            beacon_coordinator_->report(beacon_time_);
+        }
         printf("beacon #%d: soa = %.3f; timestep = %.1f; ppm=%.3f\n",
                beacon_,
                soa_,
                time_step,
                clock_error_ * 1e6);
+        if (control_) {
+            control_->sendBeacon(getDeviceIndex(), beacon_, block_idx_, soa_,
+                                 corr.peak_power);
+        }
 
         beacon_corr_ = corr;
         setTrackState(TrackState::CAPTURE);
@@ -1177,55 +2356,187 @@ bool Receiver::captureCorrSegments() {
 
     assert(cycle_ >= 0);
 
-    for (; cycle_ < num_cycles_; ++cycle_) {
-        // calculate index of first sample in correlation block
+    uint64_t start_ns = stats_now_ns();
+    uint64_t write_ns = 0;
+    uint64_t bytes_before = writer_->bytes_submitted();
+
+    // calculate index of first sample of each segment in this block
+    double *starts = segment_starts_;
+    size_t *start_idxs = segment_start_idxs_;
+    size_t count = 0;
+    for (int32_t cycle = cycle_; cycle < num_cycles_; ++cycle) {
         double start = (soa_
-                        + (FLAGS_beacon_padding + cycle_ * corr_size_)
+                        + (FLAGS_beacon_padding + cycle * corr_size_)
                          * (1 - clock_error_)
                        - block_idx_ * nonhistory_size_);
         size_t start_idx = int(round(start));
 
-        if (start_idx + corr_size_ > block_size_) {
+        if (start_idx + corr_size_ > block_size_ ||
+                count == corr_fft_calc_->max_count()) {
             break;
         }
+        starts[count] = start;
+        start_idxs[count] = start_idx;
+        count++;
+    }
 
-        memcpy(corr_signal_,
-               synced_signal_+start_idx,
-               corr_size_ * sizeof(complex<float>));
-
-        // calculate FFT
-        corr_fft_calc_->execute();
+    // calculate FFTs, one batch per run of adjacent segments
+    for (size_t first = 0; first < count && !use_goertzel_; ) {
+        size_t last = first + 1;
+        while (last < count &&
+               start_idxs[last] == start_idxs[last-1] + corr_size_) {
+            last++;
+        }
+        corr_fft_calc_->execute(synced_signal_ + start_idxs[first],
+                                last - first,
+                                first);
+        first = last;
+    }
+
+    for (size_t i = 0; i < count; ++i, ++cycle_) {
+        complex<float> *corr_fft = corr_fft_calc_->output(i);
+        if (use_goertzel_) {
+            goertzel_bins(corr_fft, synced_signal_ + start_idxs[i],
+                          corr_size_, slice_start_, slice_start_ + slice_len_);
+            if (slice_start_ > 0) {
+                goertzel_bins(corr_fft, synced_signal_ + start_idxs[i],
+                              corr_size_, 0, 1);
+            }
+        }
 
         // correct for complex phase offset and time offset
-        fft_shift(corrected_corr_fft_->data(),
-                  corr_fft_,
-                  corr_size_,
-                  start - start_idx,
-                  -avg_dc_angle_,
-                  -carrier_pos_ * corr_size_ / block_size_);
-
-        DeciAngle error = arg(corrected_corr_fft_->data()[0]) / 2 / PI;
+        // (only for the bins that are used; the power of the slice is
+        //  summed in the same pass for the segment metrics)
+        float slice_power = 0;
+        dsp_kernels_.shift_slice(corr_shifter_,
+                                 corrected_corr_fft_,
+                                 corr_fft,
+                                 corr_size_,
+                                 starts[i] - start_idxs[i],
+                                 -avg_dc_angle_,
+                                 -carrier_pos_ * corr_size_ / block_size_,
+                                 slice_start_,
+                                 slice_start_ + slice_len_,
+                                 segment_metrics_ ? &slice_power : nullptr);
+        if (slice_start_ > 0) {
+            corr_shifter_.shift(corrected_corr_fft_,
+                                corr_fft,
+                                corr_size_,
+                                starts[i] - start_idxs[i],
+                                -avg_dc_angle_,
+                                -carrier_pos_ * corr_size_ / block_size_,
+                                0, 1);
+        }
+
+        DeciAngle error = arg(corrected_corr_fft_[0]) / 2 / PI;
         if (abs(error) > 0.2) {
             num_phase_errors_++;
+            ReceiverStats::increment(stats_.phase_errors);
         }
 
         // printf("block #%d, beacon #%d, cycle #%d, start %lu: error %.1f deg\n",
         //        block_idx_,
         //        beacon_,
         //        cycle_,
-        //        start_idx,
+        //        start_idxs[i],
         //        error / 2 / PI * 360);
 
-        // Dump to output file
-        int8_t error_fp = error / 0.5 * 127;
-        writer_->write_cycle_block(error_fp,
-                                  corrected_corr_fft_->data()+slice_start_,
-                                  slice_len_);
+        // Dump to output file (or accumulate)
+        uint64_t write_start = stats_now_ns();
+        if (integrate_) {
+            integrator_.add(corrected_corr_fft_+slice_start_, error);
+        } else if (segment_metrics_) {
+            int8_t error_fp = error / 0.5 * 127;
+            CorxSegmentMetrics metrics = encode_segment_metrics(
+                    segment_quality_.update(corrected_corr_fft_[0],
+                                            slice_power, slice_len_));
+            writer_->write_cycle_block(error_fp,
+                                      corrected_corr_fft_+slice_start_,
+                                      slice_len_,
+                                      &metrics);
+        } else {
+            int8_t error_fp = error / 0.5 * 127;
+            writer_->write_cycle_block(error_fp,
+                                      corrected_corr_fft_+slice_start_,
+                                      slice_len_);
+        }
+        write_ns += stats_now_ns() - write_start;
     }
 
+    stats_.stages[ReceiverStats::WRITER].record(write_ns);
+    stats_.stages[ReceiverStats::SEGMENTS].record(
+            stats_now_ns() - start_ns - write_ns);
+    ReceiverStats::increment(stats_.bytes_written,
+                             writer_->bytes_submitted() - bytes_before);
+
     return (cycle_ < num_cycles_);
 }
 
+void Receiver::startCycle(const CorxBeaconHeader &header) {
+    assert(cycle_ == -1);
+    cycle_ = 0;
+    cycle_header_ = header;
+    if (integrate_) {
+        // (cross-spectra are only integrated while the preamp is on)
+        integrator_.reset(slice_len_,
+                          cross_matcher_ != nullptr && header.preamp_on,
+                          num_cycles_,
+                          0.2);
+    } else {
+        segment_quality_.reset();
+        writer_->write_cycle_start(header);
+    }
+}
+
+void Receiver::stopCycle() {
+    assert(cycle_ >= 0);
+    cycle_ = -1;
+    if (integrate_) {
+        writeIntegratedCycle();
+    } else {
+        writer_->write_cycle_stop();
+    }
+    if (control_) {
+        control_->sendCycle(getDeviceIndex(), beacon_, block_idx_,
+                            cycle_header_.preamp_on);
+    }
+}
+
+void Receiver::writeIntegratedCycle() {
+    if (integrator_.count() == 0) {
+        return;
+    }
+    uint64_t bytes_before = writer_->bytes_submitted();
+    writer_->write_auto_record(cycle_header_, integrator_.stats(),
+                               integrator_.power(), slice_len_);
+
+    if (!integrator_.segments().empty()) {
+        std::shared_ptr<CrossSpectrumMatcher::Cycle> cycle(
+                new CrossSpectrumMatcher::Cycle());
+        cycle->device_index = getDeviceIndex();
+        cycle->time = beacon_time_;
+        cycle->timestamp_sec = cycle_header_.timestamp_sec;
+        cycle->timestamp_msec = cycle_header_.timestamp_msec;
+        cycle->len = integrator_.len();
+        cycle->count = integrator_.count();
+        cycle->segments.swap(integrator_.segments());
+
+        xcorr_.resize(slice_len_);
+        for (const auto &peer : cross_matcher_->publish(cycle)) {
+            CorxCrossHeader header;
+            header.peer_device_index = peer->device_index;
+            header.timestamp_sec = cycle->timestamp_sec;
+            header.timestamp_msec = cycle->timestamp_msec;
+            header.peer_timestamp_sec = peer->timestamp_sec;
+            header.peer_timestamp_msec = peer->timestamp_msec;
+            header.num_blocks = cross_spectrum(xcorr_.data(), *cycle, *peer);
+            writer_->write_cross_record(header, xcorr_.data(), slice_len_);
+        }
+    }
+    ReceiverStats::increment(stats_.bytes_written,
+                             writer_->bytes_submitted() - bytes_before);
+}
+
 
 
 // TODO: move LineReader and InteractiveReceiver to interactive_receiver.cpp
@@ -1239,15 +2550,33 @@ bool Receiver::captureCorrSegments() {
 class LineReader {
 public:
     LineReader() {
-        fds.fd = STDIN_FILENO;
-        fds.events = POLLIN;
+        fds[0].fd = STDIN_FILENO;
+        fds[0].events = POLLIN;
+        nfds_ = 1;
+        control_ = nullptr;
         linebuf_len_ = 0;
         eof_ = false;
     }
 
-    bool readInput(bool block) {
-        int ret = poll(&fds, 1, block ? -1 : 0);
-        if (ret > 0) {
+    // Also read the command frames of a control channel
+    void setControl(ControlChannel *control) {
+        control_ = control;
+        fds[1].fd = control->fd();
+        fds[1].events = POLLIN;
+        nfds_ = 2;
+    }
+
+    // Wait for input for at most timeout_ms (indefinitely if block is set)
+    bool readInput(bool block, int timeout_ms = 0) {
+        int ret = poll(fds, nfds_, block ? -1 : timeout_ms);
+        if (ret > 0 && nfds_ > 1 && fds[1].revents != 0) {
+            if (!control_->receive(lines_)) {
+                // (the controller has gone away)
+                eof_ = true;
+                return false;
+            }
+        }
+        if (ret > 0 && fds[0].revents != 0) {
             // clear buffer on overflow
             if (linebuf_len_ == LINEREADER_BUFLEN - 1) {
                 fprintf(stderr, "Warning: Read buffer overflow\n");
@@ -1312,14 +2641,415 @@ private:
     std::deque<std::string> lines_;
     char linebuf_[LINEREADER_BUFLEN];
     size_t linebuf_len_;
-    struct pollfd fds;
+    struct pollfd fds[2];
+    nfds_t nfds_;
+    ControlChannel *control_;
     bool eof_;
 };
 
 
+// Snapshot of the status of a receiver, published by the receiver thread
+// after every block and command
+struct ReceiverStatus {
+    ReceiverState state;
+    ReceiverMode mode;
+    TrackState track_state;
+    unsigned block_idx;
+    int beacon;
+};
+
+// Runs a receiver on its own thread.
+// Commands are executed on the receiver thread in between two blocks, so
+// they never race with the signal processing of the receiver. They are
+// passed through a lock-free queue that the receiver thread polls after
+// every block, so the sample loop never waits for the control thread.
+// The status of the receiver can be read from any thread without going
+// through the receiver thread.
+class ReceiverWorker {
+public:
+    typedef std::function<void(Receiver&)> Command;
+
+    // (commands are synchronous, so there is at most one queued command)
+    static const size_t COMMAND_QUEUE_DEPTH = 4;
+
+    explicit ReceiverWorker(int device_index)
+        : receiver_(device_index),
+          commands_(COMMAND_QUEUE_DEPTH) {
+        posted_ = 0;
+        done_ = 0;
+        quit_ = false;
+        failed_ = false;
+        snapshot();
+        thread_ = std::thread(&ReceiverWorker::run, this);
+    }
+
+    ~ReceiverWorker() {
+        quit_ = true;
+        wake();
+        thread_.join();
+    }
+
+    // Execute a command on the receiver thread and wait for it to finish.
+    // May only be called from a single (control) thread.
+    void call(Command command) {
+        unsigned attempt = 0;
+        Command *slot;
+        while ((slot = commands_.acquire()) == nullptr) {
+            if (failed_) {
+                return;
+            }
+            spsc_backoff(attempt);
+        }
+        if (failed_) {
+            return;
+        }
+        *slot = std::move(command);
+        uint64_t ticket = ++posted_;
+        commands_.publish();
+        wake();
+
+        attempt = 0;
+        while (done_.load(std::memory_order_acquire) < ticket && !failed_) {
+            spsc_backoff(attempt);
+        }
+    }
+
+    // State of the receiver after the last block or command
+    ReceiverState getState() const { return state_.load(); }
+    ReceiverMode getMode() const { return mode_.load(); }
+
+    ReceiverStatus getStatus() const {
+        ReceiverStatus status;
+        status.state = state_.load();
+        status.mode = mode_.load();
+        status.track_state = track_state_.load();
+        status.block_idx = block_idx_.load();
+        status.beacon = beacon_.load();
+        return status;
+    }
+
+    int getDeviceIndex() const { return receiver_.getDeviceIndex(); }
+
+    bool isStopped() const {
+        return failed_ || (getState() == ReceiverState::STOPPED &&
+                           getMode() == ReceiverMode::STOP);
+    }
+
+    // True if the receiver has executed all posted commands and stays in
+    // an inactive state, i.e. a mode change (e.g. capture) has taken effect
+    // and ended again. May only be called from the control thread.
+    bool isInactive() const {
+        if (failed_) {
+            return true;
+        }
+        if (done_.load(std::memory_order_acquire) != posted_) {
+            return false;
+        }
+        // (the mode is changed by commands before the state follows on the
+        //  next block, so both have to be inactive)
+        return (Receiver::isInactiveState(getState()) &&
+                Receiver::isInactiveMode(getMode()));
+    }
+
+    // True if the receiver thread has been terminated by an exception
+    bool hasFailed() const { return failed_; }
+
+    // Stats may be read without going through the receiver thread
+    void printStats(FILE* out) const { receiver_.printStats(out); }
+
+private:
+    void run();
+
+    void snapshot() {
+        state_ = receiver_.getState();
+        mode_ = receiver_.getMode();
+        track_state_ = receiver_.getTrackState();
+        block_idx_ = receiver_.getBlockIndex();
+        beacon_ = receiver_.getBeacon();
+    }
+
+    // Wake up the receiver thread if it is idle
+    void wake() {
+        // (the receiver thread only holds the mutex while it is idle)
+        { std::lock_guard<std::mutex> lock(idle_mutex_); }
+        idle_cv_.notify_one();
+    }
+
+    Receiver receiver_;
+
+    // Pending commands (control thread -> receiver thread)
+    SpscRing<Command> commands_;
+    // Number of posted (control thread only) and executed commands
+    uint64_t posted_;
+    std::atomic<uint64_t> done_;
+    std::atomic<bool> quit_;
+
+    // Used to wait for commands while the receiver is stopped
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cv_;
+
+    // Status snapshot
+    std::atomic<ReceiverState> state_;
+    std::atomic<ReceiverMode> mode_;
+    std::atomic<TrackState> track_state_;
+    std::atomic<unsigned> block_idx_;
+    std::atomic<int> beacon_;
+    std::atomic<bool> failed_;
+
+    std::thread thread_;
+};
+
+
+void ReceiverWorker::run() {
+    try {
+        while (true) {
+            Command *command;
+            while ((command = commands_.front()) != nullptr) {
+                (*command)(receiver_);
+                // (release the captured state on this thread)
+                *command = nullptr;
+                commands_.pop();
+                snapshot();
+                fflush(stdout);
+                done_.fetch_add(1, std::memory_order_release);
+            }
+
+            if (isStopped()) {
+                if (quit_) {
+                    break;
+                }
+                std::unique_lock<std::mutex> lock(idle_mutex_);
+                idle_cv_.wait(lock, [this] {
+                    return quit_ || !commands_.empty();
+                });
+                continue;
+            }
+
+            receiver_.next();
+            snapshot();
+            fflush(stdout);
+        }
+    } catch (FastcardException& e) {
+        fprintf(stderr, "Receiver #%d failed: %s\n",
+                receiver_.getDeviceIndex(), e.what());
+    } catch (std::exception& e) {
+        fprintf(stderr, "Receiver #%d failed: %s\n",
+                receiver_.getDeviceIndex(), e.what());
+    }
+
+    if (!quit_) {
+        failed_ = true;
+    }
+}
+
+
+// A group of receivers driven from a single process, e.g. one receiver per
+// RTL-SDR device connected to the host.
+// Every receiver runs on its own thread. The receivers are constructed one
+// after another, as FFTW planning is not thread-safe; FFTW wisdom is shared
+// by the whole process, so only the first receiver has to plan from scratch.
+class ReceiverHost {
+public:
+    explicit ReceiverHost(const std::vector<int> &device_indices) {
+        for (int device_index : device_indices) {
+            workers_.emplace_back(new ReceiverWorker(device_index));
+        }
+        configureBeaconSharing();
+        configureCrossSpectra();
+    }
+
+    ~ReceiverHost() {
+        // receivers should be stopped before their threads are terminated
+        broadcast([](Receiver &receiver) { receiver.stop(); });
+        while (!allStopped()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+
+    size_t size() const { return workers_.size(); }
+
+    // Execute a command on every receiver (in order of construction)
+    void broadcast(std::function<void(Receiver&)> command) {
+        for (auto &worker : workers_) {
+            worker->call(command);
+        }
+    }
+
+    bool allStopped() const {
+        for (auto &worker : workers_) {
+            if (!worker->isStopped()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool allInactive() const {
+        for (auto &worker : workers_) {
+            if (!worker->isInactive()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool anyFailed() const {
+        for (auto &worker : workers_) {
+            if (worker->hasFailed()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void printStats(FILE* out) const {
+        for (auto &worker : workers_) {
+            worker->printStats(out);
+        }
+    }
+
+    // Print the status snapshot of every receiver (as STATUS lines)
+    void printStatus(FILE* out) const;
+
+    // Send the status snapshots (as one STATUS frame) and the stats of the
+    // receivers to a control channel
+    void sendStatus(ControlChannel &control) const;
+    void sendStats(ControlChannel &control) const;
+
+    // (Re)create the beacon coordinator from the current flags.
+    // May only be called when all receivers are stopped.
+    void configureBeaconSharing();
+    // (Re)create the matcher of cross-spectra (integrated mode only).
+    // May only be called when all receivers are stopped.
+    void configureCrossSpectra();
+
+    // Capture until all receivers have stopped (non-interactive mode)
+    void run();
+    void sigint() { sigint_ = true; }
+
+private:
+    std::vector<std::unique_ptr<ReceiverWorker>> workers_;
+    std::unique_ptr<BeaconCoordinator> beacon_coordinator_;
+    std::unique_ptr<CrossSpectrumMatcher> cross_matcher_;
+    std::atomic<bool> sigint_{false};
+};
+
+
+void ReceiverHost::printStatus(FILE* out) const {
+    for (auto &worker : workers_) {
+        ReceiverStatus status = worker->getStatus();
+        fprintf(out, "STATUS rx=%d state=%s mode=%s track=%s block=%u "
+                     "beacon=%d failed=%d\n",
+                worker->getDeviceIndex(),
+                Receiver::stateToString(status.state),
+                Receiver::modeToString(status.mode),
+                Receiver::trackStateToString(status.track_state),
+                status.block_idx,
+                status.beacon,
+                worker->hasFailed() ? 1 : 0);
+    }
+}
+
+void ReceiverHost::sendStatus(ControlChannel &control) const {
+    std::vector<ControlStatus> entries;
+    for (auto &worker : workers_) {
+        ReceiverStatus status = worker->getStatus();
+        ControlStatus entry;
+        entry.rx = worker->getDeviceIndex();
+        entry.state = (uint8_t)status.state;
+        entry.mode = (uint8_t)status.mode;
+        entry.track_state = (uint8_t)status.track_state;
+        entry.failed = worker->hasFailed();
+        entry.block = status.block_idx;
+        entry.beacon = status.beacon;
+        entries.push_back(entry);
+    }
+    control.sendStatus(entries);
+}
+
+void ReceiverHost::sendStats(ControlChannel &control) const {
+    for (auto &worker : workers_) {
+        char *text = nullptr;
+        size_t len = 0;
+        FILE *out = open_memstream(&text, &len);
+        if (out == nullptr) {
+            return;
+        }
+        worker->printStats(out);
+        fclose(out);
+        control.send(ControlFrame::STATS, worker->getDeviceIndex(),
+                     std::string(text, len));
+        free(text);
+    }
+}
+
+void ReceiverHost::configureBeaconSharing() {
+    std::unique_ptr<BeaconCoordinator> coordinator;
+    if (workers_.size() > 1 && FLAGS_beacon_share_window > 0) {
+        try {
+            coordinator.reset(new BeaconCoordinator(
+                    FLAGS_beacon_interval, FLAGS_beacon_share_window));
+        } catch (const std::invalid_argument &e) {
+            fprintf(stderr, "Invalid value for --beacon_share_window: %s\n",
+                    e.what());
+        }
+    }
+    BeaconCoordinator *ptr = coordinator.get();
+    broadcast([ptr](Receiver &receiver) {
+        receiver.setBeaconCoordinator(ptr);
+    });
+    beacon_coordinator_ = std::move(coordinator);
+}
+
+void ReceiverHost::configureCrossSpectra() {
+    std::unique_ptr<CrossSpectrumMatcher> matcher;
+    if (workers_.size() > 1 && FLAGS_integrate) {
+        try {
+            matcher.reset(new CrossSpectrumMatcher(FLAGS_beacon_interval));
+        } catch (const std::invalid_argument &e) {
+            fprintf(stderr, "Invalid value for --beacon_interval: %s\n",
+                    e.what());
+        }
+    }
+    CrossSpectrumMatcher *ptr = matcher.get();
+    broadcast([ptr](Receiver &receiver) {
+        receiver.setCrossSpectrumMatcher(ptr);
+    });
+    cross_matcher_ = std::move(matcher);
+}
+
+
+void ReceiverHost::run() {
+    broadcast([](Receiver &receiver) { receiver.capture(); });
+    while (!allStopped()) {
+        if (sigint_) {
+            sigint_ = false;
+            broadcast([](Receiver &receiver) { receiver.stop(); });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+
+// Check that the output of several receivers does not end up in the same file
+bool validate_output_pattern(const std::string &pattern, size_t count) {
+    return (count <= 1 || pattern.empty() ||
+            pattern.find("{rx}") != std::string::npos);
+}
+
+
 class InteractiveReceiver {
 public:
-    InteractiveReceiver() {};
+    explicit InteractiveReceiver(const std::vector<int> &device_indices)
+        : host_(device_indices) {
+        if (FLAGS_control_fd >= 0) {
+            control_.reset(new ControlChannel(FLAGS_control_fd));
+            ControlChannel *control = control_.get();
+            host_.broadcast([control](Receiver &receiver) {
+                receiver.setControlChannel(control);
+            });
+        }
+    };
     void run();
     void sigint() { sigint_ = true; }
     void exit() { sigint_ = true; eof_ = true; waiting_ = false; }
@@ -1328,24 +3058,26 @@ private:
     void executeCommand(std::string line);
     bool eof_;
     bool waiting_;
-    bool sigint_ = false;
-    Receiver receiver_;
+    std::atomic<bool> sigint_{false};
+    // (declared before host_, so that it outlives the receivers)
+    std::unique_ptr<ControlChannel> control_;
+    ReceiverHost host_;
 };
 
 
 void InteractiveReceiver::run() {
     LineReader reader;
+    if (control_) {
+        reader.setControl(control_.get());
+    }
     eof_ = false;
     waiting_ = false;
 
     while (true) {
-        ReceiverMode mode = receiver_.getMode();
-        ReceiverState state = receiver_.getState();
-        bool stopped = (state == ReceiverState::STOPPED &&
-                        mode == ReceiverMode::STOP);
+        bool stopped = host_.allStopped();
 
         if (sigint_) {
-            //  (first Ctrl-C will stop wait or stop the receiver;
+            //  (first Ctrl-C will stop wait or stop the receivers;
             //   second one will exit)
             if (waiting_) {
                 waiting_ = false;
@@ -1359,7 +3091,9 @@ void InteractiveReceiver::run() {
                 if (stopped) {
                     eof_ = true;
                 } else {
-                    receiver_.setMode(ReceiverMode::STOP);
+                    host_.broadcast([](Receiver &receiver) {
+                        receiver.setMode(ReceiverMode::STOP);
+                    });
                     printf("Receiver stopped. Press Ctrl-C again to exit.\n");
                 }
             }
@@ -1367,7 +3101,7 @@ void InteractiveReceiver::run() {
             sigint_ = false;
         }
 
-        if (waiting_ && Receiver::isInactiveState(state)) {
+        if (waiting_ && host_.allInactive()) {
             printf("Done waiting\n");
             waiting_ = false;
         } 
@@ -1378,13 +3112,17 @@ void InteractiveReceiver::run() {
                     printf("corx> ");
                     fflush(stdout);
                 }
-                eof_ = !reader.readInput(stopped);
+                // (the receivers run on their own threads, so only poll for
+                //  input periodically while they are active)
+                eof_ = !reader.readInput(stopped, 10);
             }
             if (eof_) {
                 if (stopped) {
                     break;
                 } else if (!reader.hasLines()) {
-                    receiver_.setMode(ReceiverMode::STOP);
+                    host_.broadcast([](Receiver &receiver) {
+                        receiver.setMode(ReceiverMode::STOP);
+                    });
                 }
             }
 
@@ -1393,12 +3131,10 @@ void InteractiveReceiver::run() {
                 string line = reader.popLine();
                 executeCommand(line);
             }
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
         }
 
-        if (!stopped) {
-            receiver_.next();
-            // TODO: check return value?
-        }
         // flush output
         fflush(stdout);
     }
@@ -1418,36 +3154,57 @@ void InteractiveReceiver::executeCommand(std::string line) {
 
     // Handle command
     transform(command.begin(), command.end(), command.begin(), ::tolower);
-    ReceiverState state = receiver_.getState();
     if (command == "stop") {
-        receiver_.stop();
+        host_.broadcast([](Receiver &receiver) { receiver.stop(); });
     } else if (command == "standby") {
-        receiver_.standby();
+        host_.broadcast([](Receiver &receiver) { receiver.standby(); });
     } else if (command == "lock") {
-        receiver_.lock();
+        host_.broadcast([](Receiver &receiver) { receiver.lock(); });
     } else if (command == "capture") {
-        receiver_.capture();
+        host_.broadcast([](Receiver &receiver) { receiver.capture(); });
     } else if (command == "wait") {
         printf("Waiting until an inactive state is reached "
                 "(i.e. STOPPED or STANDBY)\n");
         printf("Press Ctrl-C to cancel wait\n");
         waiting_ = true;
+    } else if (command == "stats") {
+        host_.printStats(stdout);
+        if (control_) {
+            host_.sendStats(*control_);
+        }
+    } else if (command == "status") {
+        host_.printStatus(stdout);
+        if (control_) {
+            host_.sendStatus(*control_);
+        }
+    } else if (command == "dump") {
+        if (FLAGS_flight_recorder_seconds <= 0) {
+            fprintf(stderr, "Warning: the flight recorder is disabled "
+                            "(see --flight_recorder_seconds)\n");
+        }
+        host_.broadcast([](Receiver &receiver) {
+            receiver.triggerFlightRecorder("command");
+        });
     } else if (command == "exit") {
-        receiver_.stop();
+        host_.broadcast([](Receiver &receiver) { receiver.stop(); });
         eof_ = true;
     } else if (command == "output") {
-        if (state != ReceiverState::STOPPED &&
-                state != ReceiverState::STANDBY) {
+        if (!host_.allInactive()) {
             printf("Output file may be changed only when the receiver is "
                    "in the STOPPED or STANDBY state.\n");
+        } else if (!validate_output_pattern(argument, host_.size())) {
+            printf("Output file should contain {rx} when using multiple "
+                   "devices.\n");
         } else {
             FLAGS_output = argument;
-            receiver_.setOutput(argument);
+            host_.broadcast([&](Receiver &receiver) {
+                receiver.setOutput(argument);
+            });
         }
     } else if (command == "set") {
         // Use command with extreme care.
         // The program will exit if an invalid flag is passed.
-        if (state != ReceiverState::STOPPED) {
+        if (!host_.allStopped()) {
             printf("Flags may only be changed in STOPPED state.\n");
         } else {
             // Split argument by space
@@ -1461,33 +3218,32 @@ void InteractiveReceiver::executeCommand(std::string line) {
                 args.push_back(argument.substr(offset));
             }
 
-            // Parse flags (not the most elegant method)
-            char** argv = new char*[args.size() + 1];
-            argv[0] = new char[1];
-            argv[0][0] = '\0';
-            for (size_t i = 0; i < args.size(); i++) {
-                argv[i + 1] = new char[args[i].size() + 1];
-                memcpy(argv[i + 1], args[i].c_str(), args[i].size());
-                argv[i + 1][args[i].size()] = '\0';
-                // argv[i + 1] = (char*) args[i].c_str();
+            // Parse flags on the control thread
+            // (all receiver threads are idle in the STOPPED state)
+            std::string program_name;
+            std::vector<char*> argv_storage;
+            argv_storage.push_back(&program_name[0]);
+            for (std::string &arg : args) {
+                argv_storage.push_back(&arg[0]);
             }
+            argv_storage.push_back(nullptr);
             int argc = args.size() + 1;
+            char **argv = argv_storage.data();
             gflags::ParseCommandLineFlags(&argc, &argv, false);
 
-            for (size_t i = 0; i < args.size() + 1; i++) {
-                delete[] argv[i];
-            }
-            delete[] argv;
-
-            // reload
-            receiver_.reloadFlags();
+            // reload (one receiver at a time)
+            host_.broadcast([](Receiver &receiver) {
+                receiver.reloadFlags();
+            });
+            host_.configureBeaconSharing();
+            host_.configureCrossSpectra();
         }
     } else {
         if (command != "help") {
             printf("Invalid command: %s\n", command.data());
         }
         printf("Valid commands: stop standby lock capture wait output set "
-                "exit help\n");
+                "stats status dump exit help\n");
     }
     // freq <new_freq>
     //   may be changed in STOPPED or STANDBY state only
@@ -1503,12 +3259,16 @@ using namespace corx;
 // TODO: move everything below this line to cli.cpp
 
 std::unique_ptr<Receiver> receiver;
+std::unique_ptr<ReceiverHost> receiver_host;
 std::unique_ptr<InteractiveReceiver> interactive_receiver;
 
 void signal_handler(int signo) {
     if (receiver) {
         receiver->stop();
     }
+    if (receiver_host) {
+        receiver_host->sigint();
+    }
     if (interactive_receiver) {
         if (signo == SIGINT) {
             interactive_receiver->sigint();
@@ -1532,19 +3292,44 @@ int main(int argc, char **argv) {
     }
     // TODO: validate format of flags
 
+    // -1: single receiver using --device_index
+    std::vector<int> device_indices(1, -1);
+    if (!FLAGS_device_indices.empty() &&
+            !parse_device_indices_str(FLAGS_device_indices, device_indices)) {
+        fprintf(stderr, "Invalid value for --device_indices: %s\n",
+                FLAGS_device_indices.c_str());
+        exit(1);
+    }
+    if (!validate_output_pattern(FLAGS_output, device_indices.size())) {
+        fprintf(stderr, "Invalid value for --output: should contain {rx} "
+                        "when using multiple devices\n");
+        exit(1);
+    }
+    if (FLAGS_control_fd >= 0 && !FLAGS_interactive) {
+        fprintf(stderr, "Warning: --control_fd is ignored without "
+                        "--interactive\n");
+    }
+
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
     signal(SIGQUIT, signal_handler);
     signal(SIGPIPE, signal_handler);
 
     try {
-        if (!FLAGS_interactive) {
-            receiver.reset(new Receiver());
+        if (FLAGS_interactive) {
+            interactive_receiver.reset(
+                    new InteractiveReceiver(device_indices));
+            interactive_receiver->run();
+        } else if (device_indices.size() == 1) {
+            receiver.reset(new Receiver(device_indices[0]));
             receiver->capture();
             while (receiver->next()) {}
         } else {
-            interactive_receiver.reset(new InteractiveReceiver());
-            interactive_receiver->run();
+            receiver_host.reset(new ReceiverHost(device_indices));
+            receiver_host->run();
+            if (receiver_host->anyFailed()) {
+                return -1;
+            }
         }
     } catch (FastcardException& e) {
         cerr << e.what() << endl;
@@ -0,0 +1,106 @@
+#include "receiver_stats.h"
+
+#include <algorithm>
+
+namespace corx {
+
+LatencyHistogram::LatencyHistogram()
+    : count_(0), sum_(0), max_(0) {
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        buckets_[i] = 0;
+    }
+}
+
+uint64_t LatencyHistogram::quantile(double q) const {
+    // (the buckets may be updated while reading; use their own total)
+    uint64_t counts[NUM_BUCKETS];
+    uint64_t total = 0;
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        counts[i] = buckets_[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(q * (total - 1)) + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < NUM_BUCKETS - 1; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return std::min((uint64_t)2 << i, max());
+        }
+    }
+    return max();
+}
+
+
+ReceiverStats::ReceiverStats()
+    : blocks(0),
+      late_blocks(0),
+      dropped_blocks(0),
+      tracking_failures(0),
+      carrier_reacquisitions(0),
+      phase_errors(0),
+      beacons(0),
+      large_time_steps(0),
+      bytes_written(0) {}
+
+const char* ReceiverStats::stageToString(Stage stage) {
+    switch (stage) {
+        case READ:
+            return "read";
+        case CARRIER:
+            return "carrier";
+        case BEACON:
+            return "beacon";
+        case SEGMENTS:
+            return "segments";
+        case WRITER:
+            return "writer";
+        case BLOCK:
+            return "block";
+        case NUM_STAGES:
+            break;
+    }
+    return "unknown";
+}
+
+void ReceiverStats::print(FILE* out, int rx, double block_budget_ns) const {
+    for (int i = 0; i < NUM_STAGES; ++i) {
+        const LatencyHistogram &h = stages[i];
+        uint64_t count = h.count();
+        fprintf(out, "STATS rx=%d stage=%s count=%llu mean_us=%.1f "
+                     "p50_us=%.1f p99_us=%.1f max_us=%.1f\n",
+                rx, stageToString((Stage)i),
+                (unsigned long long)count,
+                count > 0 ? h.sum() / 1e3 / count : 0.,
+                h.quantile(0.5) / 1e3,
+                h.quantile(0.99) / 1e3,
+                h.max() / 1e3);
+    }
+
+    // fraction of the real-time budget that is not used by the DSP
+    const LatencyHistogram &block = stages[BLOCK];
+    double headroom = 0;
+    if (block.count() > 0 && block_budget_ns > 0) {
+        headroom = 1 - block.sum() / (block.count() * block_budget_ns);
+    }
+    fprintf(out, "STATS rx=%d counters blocks=%llu late=%llu dropped=%llu "
+                 "tracking_failures=%llu reacquisitions=%llu "
+                 "phase_errors=%llu beacons=%llu large_time_steps=%llu "
+                 "bytes_written=%llu headroom=%.3f\n",
+            rx,
+            (unsigned long long)blocks.load(),
+            (unsigned long long)late_blocks.load(),
+            (unsigned long long)dropped_blocks.load(),
+            (unsigned long long)tracking_failures.load(),
+            (unsigned long long)carrier_reacquisitions.load(),
+            (unsigned long long)phase_errors.load(),
+            (unsigned long long)beacons.load(),
+            (unsigned long long)large_time_steps.load(),
+            (unsigned long long)bytes_written.load(),
+            headroom);
+}
+
+} // namespace corx
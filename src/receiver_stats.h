@@ -0,0 +1,128 @@
+#ifndef CORX_RECEIVER_STATS_H
+#define CORX_RECEIVER_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include <stdint.h>
+#include <stdio.h>
+
+namespace corx {
+
+// Histogram of durations with power-of-two buckets (in nanoseconds).
+//
+// Lock-free and always on: there is a single recording thread (the receiver
+// thread), so recording only needs relaxed loads and stores, while any other
+// thread may read the histogram at any time.
+class LatencyHistogram {
+public:
+    // bucket i counts durations in [2^i, 2^(i+1)) ns; the last bucket also
+    // counts all longer durations (>= 2 s)
+    static const int NUM_BUCKETS = 32;
+
+    LatencyHistogram();
+
+    // Record a duration (recording thread only)
+    void record(uint64_t ns) {
+        int bucket = ns > 0 ? 63 - __builtin_clzll(ns) : 0;
+        if (bucket >= NUM_BUCKETS) {
+            bucket = NUM_BUCKETS - 1;
+        }
+        increment(buckets_[bucket], 1);
+        increment(count_, 1);
+        increment(sum_, ns);
+        if (ns > max_.load(std::memory_order_relaxed)) {
+            max_.store(ns, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+    // Upper bound of the bucket that contains the given quantile (0..1)
+    uint64_t quantile(double q) const;
+
+private:
+    static void increment(std::atomic<uint64_t> &value, uint64_t delta) {
+        value.store(value.load(std::memory_order_relaxed) + delta,
+                    std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> buckets_[NUM_BUCKETS];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
+
+
+// Monotonic time in nanoseconds
+inline uint64_t stats_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// Records the lifetime of the timer in a histogram
+class ScopedTimer {
+public:
+    explicit ScopedTimer(LatencyHistogram &histogram)
+        : histogram_(histogram), start_(stats_now_ns()) {}
+    ~ScopedTimer() { histogram_.record(stats_now_ns() - start_); }
+
+private:
+    LatencyHistogram &histogram_;
+    const uint64_t start_;
+};
+
+
+// Per-stage timings and event counters of a receiver.
+// Cumulative since the receiver has been constructed.
+struct ReceiverStats {
+    enum Stage {
+        READ,           // readBlock (waiting for input included)
+        CARRIER,        // recoverCarrier
+        BEACON,         // findBeacon
+        SEGMENTS,       // captureCorrSegments (writer excluded)
+        WRITER,         // writing the segments of a block
+        BLOCK,          // processing of a block, i.e. all but READ
+        NUM_STAGES
+    };
+
+    static const char* stageToString(Stage stage);
+
+    ReceiverStats();
+
+    // Increment a counter (recording thread only)
+    static void increment(std::atomic<uint64_t> &counter,
+                          uint64_t delta = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + delta,
+                      std::memory_order_relaxed);
+    }
+
+    // Print the stats as "STATS rx=<id> <name> key=value ..." lines.
+    // The real-time budget of a block is used to estimate the headroom,
+    // i.e. the fraction of time the receiver thread is not busy.
+    void print(FILE* out, int rx, double block_budget_ns) const;
+
+    LatencyHistogram stages[NUM_STAGES];
+
+    std::atomic<uint64_t> blocks;
+    // Blocks that took longer to process than their real-time budget
+    std::atomic<uint64_t> late_blocks;
+    // Discontinuities in the sample stream, i.e. block timestamps that are
+    // later than expected from the number of samples read
+    std::atomic<uint64_t> dropped_blocks;
+    std::atomic<uint64_t> tracking_failures;
+    // Lost carriers found again by the narrow search (--reacquire_blocks)
+    std::atomic<uint64_t> carrier_reacquisitions;
+    std::atomic<uint64_t> phase_errors;
+    std::atomic<uint64_t> beacons;
+    std::atomic<uint64_t> large_time_steps;
+    std::atomic<uint64_t> bytes_written;
+};
+
+} // namespace corx
+
+#endif /* CORX_RECEIVER_STATS_H */
@@ -0,0 +1,284 @@
+#include "rtlsdr_async_reader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#ifdef CORX_HAVE_RTLSDR
+#include <rtl-sdr.h>
+#endif
+
+#include "dsp.h"
+#include "flight_recorder.h"
+#include "spsc_ring.h"
+
+namespace corx {
+
+namespace {
+
+// librtlsdr requires transfers of a multiple of 512 bytes
+const size_t TRANSFER_ALIGN = 512;
+
+size_t transfer_bytes(const RtlsdrReaderOptions &options) {
+    size_t len = 2 * (options.block_size - options.history_size);
+    return (len + TRANSFER_ALIGN - 1) / TRANSFER_ALIGN * TRANSFER_ALIGN;
+}
+
+size_t ring_bytes(const RtlsdrReaderOptions &options) {
+    // (room for a whole transfer in addition to the blocks)
+    size_t samples = (std::max(options.ring_blocks, (size_t)2)
+                      * options.block_size + transfer_bytes(options) / 2);
+    return samples * sizeof(std::complex<float>);
+}
+
+double now_sec() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+void check(int ret, const char *what) {
+    if (ret < 0) {
+        throw std::runtime_error(std::string("librtlsdr: ") + what +
+                                 " failed");
+    }
+}
+
+} // namespace
+
+
+RtlsdrAsyncReader::RtlsdrAsyncReader(const RtlsdrReaderOptions &options)
+    : options_(options),
+      placement_(options.placement),
+      nonhistory_size_(options.block_size - options.history_size),
+      transfer_len_(transfer_bytes(options)),
+      dev_(nullptr),
+      ring_(ring_bytes(options)),
+      ring_samples_(reinterpret_cast<std::complex<float>*>(ring_.data())),
+      capacity_(ring_.size() / sizeof(std::complex<float>)),
+      running_(false),
+      cancelled_(false),
+      standby_(false),
+      written_(0),
+      transfers_(0),
+      time_offset_(0),
+      flight_recorder_(nullptr),
+      consumed_(0),
+      first_block_(true),
+      samples_(nullptr),
+      received_samples_(0),
+      dropped_transfers_(0),
+      max_latency_(0) {
+
+    timestamp_.tv_sec = 0;
+    timestamp_.tv_usec = 0;
+    if (options.history_size >= options.block_size ||
+            options.sample_rate == 0) {
+        throw std::invalid_argument("invalid block size or sample rate");
+    }
+
+#ifdef CORX_HAVE_RTLSDR
+    check(rtlsdr_open(&dev_, options.device_index), "open");
+    try {
+        check(rtlsdr_set_sample_rate(dev_, options.sample_rate),
+              "set_sample_rate");
+        check(rtlsdr_set_center_freq(dev_, options.frequency),
+              "set_center_freq");
+        if (options.gain > 0) {
+            check(rtlsdr_set_tuner_gain_mode(dev_, 1), "set_tuner_gain_mode");
+            check(rtlsdr_set_tuner_gain(dev_, options.gain), "set_tuner_gain");
+        } else {
+            check(rtlsdr_set_tuner_gain_mode(dev_, 0), "set_tuner_gain_mode");
+        }
+    } catch (...) {
+        rtlsdr_close(dev_);
+        throw;
+    }
+#else
+    (void)check;
+    throw std::runtime_error("corx has been built without librtlsdr");
+#endif
+}
+
+RtlsdrAsyncReader::~RtlsdrAsyncReader() {
+    cancel();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+#ifdef CORX_HAVE_RTLSDR
+    rtlsdr_close(dev_);
+#endif
+}
+
+void RtlsdrAsyncReader::start() {
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    written_ = 0;
+    consumed_ = 0;
+    transfers_ = 0;
+    offsets_.clear();
+    first_block_ = true;
+    cancelled_ = false;
+    running_ = true;
+    thread_ = std::thread(&RtlsdrAsyncReader::run, this);
+}
+
+void RtlsdrAsyncReader::cancel() {
+    cancelled_ = true;
+#ifdef CORX_HAVE_RTLSDR
+    // (no effect if the thread has not started reading yet; the callback
+    //  cancels the transfers then)
+    if (running_) {
+        rtlsdr_cancel_async(dev_);
+    }
+#endif
+}
+
+void RtlsdrAsyncReader::setFlightRecorder(FlightRecorder *recorder) {
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    flight_recorder_ = recorder;
+}
+
+void RtlsdrAsyncReader::setPlacement(const ThreadPlacement &placement) {
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    placement_ = placement;
+}
+
+void RtlsdrAsyncReader::run() {
+    // (always applied, since the thread inherits the placement of its
+    //  creator; only reported if it is not the default placement)
+    apply_thread_placement(placement_, "",
+                           placement_.isDefault() ? nullptr : stdout);
+#ifdef CORX_HAVE_RTLSDR
+    rtlsdr_reset_buffer(dev_);
+    if (!cancelled_) {
+        rtlsdr_read_async(dev_, &RtlsdrAsyncReader::callback, this,
+                          options_.num_buffers, transfer_len_);
+    }
+#endif
+    running_ = false;
+}
+
+void RtlsdrAsyncReader::callback(unsigned char *buf, uint32_t len,
+                                 void *ctx) {
+    RtlsdrAsyncReader *reader = static_cast<RtlsdrAsyncReader*>(ctx);
+    if (reader->cancelled_) {
+#ifdef CORX_HAVE_RTLSDR
+        rtlsdr_cancel_async(reader->dev_);
+#endif
+        return;
+    }
+    reader->receive(buf, len);
+}
+
+void RtlsdrAsyncReader::receive(const uint8_t *buf, size_t len) {
+    double now = now_sec();
+    size_t num_samples = len / 2;
+    received_samples_ += num_samples;
+    uint64_t written = written_.load(std::memory_order_relaxed);
+
+    if (flight_recorder_ != nullptr) {
+        // (timestamped with the current estimate, as if the transfer was
+        //  appended to the ring)
+        double time = (time_offset_.load(std::memory_order_relaxed)
+                       + (double)written / options_.sample_rate);
+        if (transfers_ == 0) {
+            time = now - (double)num_samples / options_.sample_rate;
+        }
+        struct timeval tv;
+        double sec = std::floor(time);
+        tv.tv_sec = (time_t)sec;
+        tv.tv_usec = (suseconds_t)((time - sec) * 1e6);
+        flight_recorder_->recordRaw(buf, num_samples, tv);
+    }
+
+    if (written + num_samples >
+            consumed_.load(std::memory_order_acquire) + capacity_) {
+        // the receiver is falling behind: drop the transfer
+        dropped_transfers_++;
+        // (later samples arrive later than their position in the ring
+        //  implies, so start a new estimate of the time offset)
+        offsets_.clear();
+        return;
+    }
+
+    if (!standby_.load(std::memory_order_relaxed)) {
+        // (contiguous thanks to the mirrored mapping)
+        convert_iq_u8(ring_samples_ + written % capacity_, buf, num_samples);
+    }
+
+    // sliding minimum of the time offset of ring sample 0
+    uint64_t end = written + num_samples;
+    double offset = now - (double)end / options_.sample_rate;
+    uint64_t idx = transfers_++;
+    while (!offsets_.empty() && offsets_.back().second >= offset) {
+        offsets_.pop_back();
+    }
+    offsets_.push_back(std::make_pair(idx, offset));
+    while (offsets_.front().first + TIME_OFFSET_WINDOW <= idx) {
+        offsets_.pop_front();
+    }
+    double min_offset = offsets_.front().second;
+    time_offset_.store(min_offset, std::memory_order_relaxed);
+    if (offset - min_offset > max_latency_.load(std::memory_order_relaxed)) {
+        max_latency_.store(offset - min_offset, std::memory_order_relaxed);
+    }
+
+    written_.store(end, std::memory_order_release);
+}
+
+bool RtlsdrAsyncReader::next() {
+    uint64_t start = 0;
+    if (!first_block_) {
+        start = consumed_.load(std::memory_order_relaxed) + nonhistory_size_;
+    }
+    // release the new samples of the previous block
+    consumed_.store(start, std::memory_order_release);
+
+    unsigned attempt = 0;
+    while (written_.load(std::memory_order_acquire) <
+           start + options_.block_size) {
+        if (cancelled_ || !running_) {
+            return false;
+        }
+        spsc_backoff(attempt);
+    }
+    if (cancelled_) {
+        return false;
+    }
+    first_block_ = false;
+
+    samples_ = ring_samples_ + start % capacity_;
+    double time = (time_offset_.load(std::memory_order_relaxed)
+                   + (double)start / options_.sample_rate);
+    double sec = std::floor(time);
+    timestamp_.tv_sec = (time_t)sec;
+    timestamp_.tv_usec = (suseconds_t)((time - sec) * 1e6);
+    return true;
+}
+
+bool RtlsdrAsyncReader::setBiasTee(bool on) {
+#if defined(CORX_HAVE_RTLSDR) && defined(LIBRTLSDR_BIAS_TEE_SUPPORT)
+    return rtlsdr_set_bias_tee(dev_, on ? 1 : 0) == 0;
+#else
+    return false;
+#endif
+}
+
+void RtlsdrAsyncReader::printStats(FILE* out) const {
+    fprintf(out,
+            "RTL-SDR async reader: %llu samples received; %llu transfers "
+            "dropped (DSP back-pressure); max. latency above timestamp "
+            "estimate %.3f ms\n",
+            (unsigned long long)received_samples_.load(),
+            (unsigned long long)dropped_transfers_.load(),
+            max_latency_.load() * 1e3);
+}
+
+} // namespace corx
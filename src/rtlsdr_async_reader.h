@@ -0,0 +1,155 @@
+#ifndef CORX_RTLSDR_ASYNC_READER_H
+#define CORX_RTLSDR_ASYNC_READER_H
+
+#include <atomic>
+#include <complex>
+#include <deque>
+#include <thread>
+#include <utility>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#include "mirrored_buffer.h"
+#include "thread_placement.h"
+
+struct rtlsdr_dev;
+
+namespace corx {
+
+class FlightRecorder;
+
+// Settings of RtlsdrAsyncReader
+struct RtlsdrReaderOptions {
+    int device_index;
+    uint32_t frequency;
+    uint32_t sample_rate;
+    // Tuner gain in tenths of a dB (0: automatic gain control)
+    int gain;
+    // Blocks overlap by history_size samples
+    size_t block_size;
+    size_t history_size;
+    // Number of USB transfers in flight
+    size_t num_buffers;
+    // Capacity of the sample ring in blocks, i.e. how far the receiver may
+    // fall behind before samples are dropped
+    size_t ring_blocks;
+    // CPUs and scheduling policy of the librtlsdr thread
+    ThreadPlacement placement;
+
+    RtlsdrReaderOptions()
+        : device_index(0), frequency(0), sample_rate(0), gain(0),
+          block_size(0), history_size(0), num_buffers(16),
+          ring_blocks(32) {}
+};
+
+// Reads samples from an RTL-SDR device with librtlsdr's asynchronous API.
+//
+// Each USB transfer holds the new samples of one block (rounded up to the
+// 512 bytes librtlsdr requires). The librtlsdr thread converts every
+// transfer from uint8 to complex floats directly into a mirrored ring of
+// samples, from which the receiver reads its overlapping blocks in place,
+// i.e. no copies are needed for the history of a block or at the end of the
+// ring. If the receiver falls behind by more than the ring capacity,
+// transfers are dropped.
+//
+// Blocks are timestamped with the host time of their first sample. As the
+// arrival of a transfer is delayed by a variable USB and scheduling latency,
+// but never early, the offset between host time and sample time is
+// estimated as the minimum of (arrival time - sample time) over the recent
+// transfers, instead of using the arrival time of each transfer.
+class RtlsdrAsyncReader {
+public:
+    // Opens and configures the device.
+    // Throws std::runtime_error on failure (or if corx has been built
+    // without librtlsdr).
+    explicit RtlsdrAsyncReader(const RtlsdrReaderOptions &options);
+    ~RtlsdrAsyncReader();
+
+    RtlsdrAsyncReader(const RtlsdrAsyncReader&) = delete;
+    RtlsdrAsyncReader& operator=(const RtlsdrAsyncReader&) = delete;
+
+    // Start streaming (again, after cancel())
+    void start();
+    // Stop streaming; next() returns false afterwards.
+    // May be called from any thread.
+    void cancel();
+
+    // Wait for the next block. Returns false when streaming has stopped.
+    bool next();
+
+    // Samples of the current block (block_size samples, valid until the
+    // next call of next())
+    const std::complex<float>* samples() const { return samples_; }
+    // Host time of the first sample of the current block
+    struct timeval timestamp() const { return timestamp_; }
+
+    // Skip the conversion of the samples (blocks are still delivered, but
+    // their contents are undefined)
+    void setStandby(bool on) { standby_ = on; }
+    // Returns false if librtlsdr does not support the bias tee
+    bool setBiasTee(bool on);
+    // Record the raw samples of every transfer (also of dropped ones) for
+    // trigger-time dumps; nullptr disables. Only while not streaming.
+    void setFlightRecorder(FlightRecorder *recorder);
+    // Placement of the librtlsdr thread, applied when streaming starts.
+    // Only while not streaming.
+    void setPlacement(const ThreadPlacement &placement);
+
+    void printStats(FILE* out) const;
+
+private:
+    static void callback(unsigned char *buf, uint32_t len, void *ctx);
+    void receive(const uint8_t *buf, size_t len);
+    void run();
+
+    // Number of transfers over which the minimum time offset is taken
+    static const uint64_t TIME_OFFSET_WINDOW = 64;
+
+    const RtlsdrReaderOptions options_;
+    // Placement of the librtlsdr thread (options_.placement unless changed)
+    ThreadPlacement placement_;
+    const size_t nonhistory_size_;
+    // Bytes per USB transfer
+    size_t transfer_len_;
+    rtlsdr_dev *dev_;
+
+    MirroredBuffer ring_;
+    std::complex<float> *ring_samples_;
+    // Capacity of the ring in samples
+    size_t capacity_;
+
+    std::thread thread_;
+    std::atomic<bool> running_;
+    std::atomic<bool> cancelled_;
+    std::atomic<bool> standby_;
+
+    // -- librtlsdr thread
+    // Number of samples written to the ring
+    std::atomic<uint64_t> written_;
+    uint64_t transfers_;
+    // Recent (transfer index, time offset) with increasing offsets
+    std::deque<std::pair<uint64_t, double>> offsets_;
+    // Estimated host time of ring sample 0
+    std::atomic<double> time_offset_;
+    FlightRecorder *flight_recorder_;
+
+    // -- Receiver thread
+    // First sample of the current block, which may not be overwritten
+    std::atomic<uint64_t> consumed_;
+    bool first_block_;
+    const std::complex<float> *samples_;
+    struct timeval timestamp_;
+
+    // -- Stats
+    std::atomic<uint64_t> received_samples_;
+    std::atomic<uint64_t> dropped_transfers_;
+    // Largest latency of a transfer above the estimated offset (seconds)
+    std::atomic<double> max_latency_;
+};
+
+} // namespace corx
+
+#endif /* CORX_RTLSDR_ASYNC_READER_H */
@@ -0,0 +1,99 @@
+#include "segment_metrics.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace corx {
+
+namespace {
+
+// (tiny floor, so that empty slices give a finite, saturated value)
+float to_db(float power) {
+    return 10 * std::log10(std::max(power, 1e-30f));
+}
+
+int quantize(float x, float step, int min, int max) {
+    float q = std::round(x / step);
+    return (int)std::min(std::max(q, (float)min), (float)max);
+}
+
+const float SNR_STEP = 0.5f;
+const float POWER_STEP = 0.01f;
+const float PHASE_STD_STEP = 1.f / 512;
+
+} // namespace
+
+
+SegmentQuality::SegmentQuality(float weight)
+    : weight_(weight) {
+    reset();
+}
+
+void SegmentQuality::reset() {
+    first_ = true;
+    mean_ = 0;
+    var_ = 0;
+}
+
+SegmentMetrics SegmentQuality::update(std::complex<float> carrier,
+                                      float slice_power_sum,
+                                      size_t slice_len) {
+    SegmentMetrics metrics;
+    metrics.phase_error = std::arg(carrier) / (2 * (float)M_PI);
+
+    float mean_power = slice_power_sum / std::max(slice_len, (size_t)1);
+    metrics.slice_power = to_db(mean_power);
+    metrics.snr = to_db(std::norm(carrier)) - metrics.slice_power;
+
+    // exponentially weighted moving mean and variance
+    if (first_) {
+        mean_ = metrics.phase_error;
+        var_ = 0;
+        first_ = false;
+    } else {
+        // (phase errors wrap around at half a turn)
+        float diff = metrics.phase_error - mean_;
+        diff -= std::round(diff);
+        float incr = weight_ * diff;
+        mean_ += incr;
+        mean_ -= std::round(mean_);
+        var_ = (1 - weight_) * (var_ + diff * incr);
+    }
+    metrics.phase_std = std::sqrt(var_);
+    return metrics;
+}
+
+
+CorxSegmentMetrics encode_segment_metrics(const SegmentMetrics &metrics) {
+    CorxSegmentMetrics out;
+    out.slice_power = quantize(metrics.slice_power, POWER_STEP,
+                               INT16_MIN, INT16_MAX);
+    out.snr = quantize(metrics.snr, SNR_STEP, INT8_MIN, INT8_MAX);
+    out.phase_std = quantize(metrics.phase_std, PHASE_STD_STEP, 0,
+                             UINT8_MAX);
+    return out;
+}
+
+SegmentMetrics decode_segment_metrics(int8_t phase_error,
+                                      const CorxSegmentMetrics &metrics) {
+    SegmentMetrics out;
+    out.phase_error = phase_error / 127.f / 2;
+    out.snr = metrics.snr * SNR_STEP;
+    out.slice_power = metrics.slice_power * POWER_STEP;
+    out.phase_std = metrics.phase_std * PHASE_STD_STEP;
+    return out;
+}
+
+
+bool SegmentFilter::accept(const CorxSegmentMetrics &metrics) const {
+    if (metrics.snr * SNR_STEP < min_snr) {
+        return false;
+    }
+    if (max_phase_std > 0 &&
+            metrics.phase_std * PHASE_STD_STEP > max_phase_std) {
+        return false;
+    }
+    return true;
+}
+
+} // namespace corx
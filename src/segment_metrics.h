@@ -0,0 +1,73 @@
+#ifndef CORX_SEGMENT_METRICS_H
+#define CORX_SEGMENT_METRICS_H
+
+#include <complex>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "corx_file_format.h"
+
+namespace corx {
+
+// Quality of a corrected segment spectrum
+struct SegmentMetrics {
+    // Phase of the carrier bin (in fractions of a turn)
+    float phase_error;
+    // Power of the carrier bin over the mean power of the slice (dB)
+    float snr;
+    // Mean |X|^2 of the slice bins (dB)
+    float slice_power;
+    // Rolling standard deviation of the phase error of the segments of the
+    // cycle so far (in fractions of a turn)
+    float phase_std;
+};
+
+// Computes the metrics of the segments of a cycle, one segment at a time.
+// The phase error variance is an exponentially weighted moving variance, so
+// that a burst of bad segments stands out even in a long cycle.
+class SegmentQuality {
+public:
+    // weight: weight of the newest segment in the moving variance
+    explicit SegmentQuality(float weight = 0.125f);
+
+    // Start a new cycle
+    void reset();
+
+    // carrier: corrected carrier bin
+    // slice_power_sum: sum of |X|^2 of the slice_len bins of the slice
+    //                  (e.g. from FFTShifter::shift)
+    SegmentMetrics update(std::complex<float> carrier,
+                          float slice_power_sum,
+                          size_t slice_len);
+
+private:
+    float weight_;
+    bool first_;
+    float mean_;
+    float var_;
+};
+
+// Quantization of the metrics for .corx files (saturated at the limits of
+// CorxSegmentMetrics); the phase error is stored in the phase error byte.
+CorxSegmentMetrics encode_segment_metrics(const SegmentMetrics &metrics);
+SegmentMetrics decode_segment_metrics(int8_t phase_error,
+                                      const CorxSegmentMetrics &metrics);
+
+// Thresholds for rejecting segments by their stored metrics before they are
+// correlated. The default accepts every segment.
+struct SegmentFilter {
+    // Minimum SNR of the carrier bin (dB)
+    float min_snr;
+    // Maximum rolling phase error standard deviation (fraction of a turn;
+    // 0: no limit)
+    float max_phase_std;
+
+    SegmentFilter() : min_snr(-100), max_phase_std(0) {}
+
+    bool accept(const CorxSegmentMetrics &metrics) const;
+};
+
+} // namespace corx
+
+#endif /* CORX_SEGMENT_METRICS_H */
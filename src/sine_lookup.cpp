@@ -1,8 +1,128 @@
 #include "sine_lookup.h"
 
+#include <algorithm>
+#include <cmath>
+
+#ifdef CORX_USE_VOLK_NCO
+#include <volk/volk.h>
+#endif
+
 const float SineLookupFixedPoint::s_sine_table[1 << NBITS][2] = {
   #include "sine_table.h"
 };
 
 const float SineLookupFixedPoint::PI = 3.14159265358979323846;
 const float SineLookupFixedPoint::TWO_TO_THE_31 = 2147483648.0;
+
+const size_t PhasorNCO::DEFAULT_RESYNC_INTERVAL;
+
+
+namespace {
+
+#ifndef CORX_USE_VOLK_NCO
+// Rotate src by phasor * increment^i. Four independent phasors are stepped by
+// increment^4 so that the loop body has no serial dependency on the previous
+// sample and can be vectorized.
+void rotate(std::complex<float> *dest,
+            const std::complex<float> *src,
+            std::complex<float> increment,
+            std::complex<float> phasor,
+            size_t len) {
+    const size_t LANES = 4;
+    float p_re[LANES], p_im[LANES];
+    std::complex<float> p = phasor;
+    for (size_t k = 0; k < LANES; ++k) {
+        p_re[k] = p.real();
+        p_im[k] = p.imag();
+        p *= increment;
+    }
+    std::complex<float> inc4 = increment * increment;
+    inc4 *= inc4;
+    const float i_re = inc4.real(), i_im = inc4.imag();
+
+    const float *in = reinterpret_cast<const float*>(src);
+    float *out = reinterpret_cast<float*>(dest);
+    size_t i = 0;
+    for (; i + LANES <= len; i += LANES) {
+        for (size_t k = 0; k < LANES; ++k) {
+            float s_re = in[2*(i+k)], s_im = in[2*(i+k)+1];
+            out[2*(i+k)] = s_re * p_re[k] - s_im * p_im[k];
+            out[2*(i+k)+1] = s_re * p_im[k] + s_im * p_re[k];
+            float re = p_re[k] * i_re - p_im[k] * i_im;
+            p_im[k] = p_re[k] * i_im + p_im[k] * i_re;
+            p_re[k] = re;
+        }
+    }
+    for (size_t k = 0; i < len; ++i, ++k) {
+        dest[i] = src[i] * std::complex<float>(p_re[k], p_im[k]);
+    }
+}
+#endif
+
+// Sum a block of complex samples using independent partial sums so that the
+// loop can be vectorized.
+std::complex<float> sum(const std::complex<float> *src, size_t len) {
+    const size_t LANES = 8;  // (re, im) x 4
+    float acc[LANES] = {0};
+    const float *in = reinterpret_cast<const float*>(src);
+    size_t i = 0;
+    for (; i + LANES <= 2 * len; i += LANES) {
+        for (size_t k = 0; k < LANES; ++k) {
+            acc[k] += in[i + k];
+        }
+    }
+    for (size_t k = 0; i < 2 * len; ++i, ++k) {
+        acc[k] += in[i];
+    }
+    return std::complex<float>(acc[0] + acc[2] + acc[4] + acc[6],
+                               acc[1] + acc[3] + acc[5] + acc[7]);
+}
+
+} // namespace
+
+
+void PhasorNCO::expj_multiply(std::complex<float> *dest,
+                              const std::complex<float> *src,
+                              size_t len) {
+    mix(dest, src, len, nullptr);
+}
+
+
+std::complex<float> PhasorNCO::expj_multiply_accumulate(
+        std::complex<float> *dest,
+        const std::complex<float> *src,
+        size_t len) {
+    std::complex<float> total(0, 0);
+    mix(dest, src, len, &total);
+    return total;
+}
+
+
+void PhasorNCO::mix(std::complex<float> *dest,
+                    const std::complex<float> *src,
+                    size_t len,
+                    std::complex<float> *total) {
+    const std::complex<float> increment = std::polar(1.f, (float)phase_step_);
+
+    for (size_t i = 0; i < len; ) {
+        size_t n = std::min(resync_interval_, len - i);
+
+        // resync the recurrence with the exact phase
+        phase_ = std::remainder(phase_, 2 * M_PI);
+        std::complex<float> phasor = std::polar(1.f, (float)phase_);
+
+#ifdef CORX_USE_VOLK_NCO
+        volk_32fc_s32fc_x2_rotator_32fc(dest + i, src + i, increment,
+                                        &phasor, n);
+#else
+        rotate(dest + i, src + i, increment, phasor, n);
+#endif
+
+        if (total != nullptr) {
+            *total += sum(dest + i, n);
+        }
+
+        phase_ += phase_step_ * n;
+        i += n;
+    }
+}
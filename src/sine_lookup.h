@@ -105,6 +105,12 @@ public:
         phase_ += phase_step_;
     }
 
+    // Equivalent to calling step() n times
+    void advance(size_t n) {
+        phase_ = (int32_t)((uint32_t)phase_
+                           + (uint32_t)n * (uint32_t)phase_step_);
+    }
+
     // compute cos or sin or the complex exponential for current phase angle
     float cos() const { return SineLookupFixedPoint::cos(phase_); }
     float sin() const { return SineLookupFixedPoint::sin(phase_); }
@@ -126,9 +132,91 @@ public:
         }
     }
 
+    // Like expj_multiply, but also return the sum of the output samples,
+    // i.e. mix and accumulate in a single pass over the signal.
+    std::complex<float> expj_multiply_accumulate(
+            std::complex<float> *dest,
+            const std::complex<float> *src,
+            size_t len) {
+
+        std::complex<float> sum(0, 0);
+        for (size_t i = 0; i < len; ++i) {
+            dest[i] = expj() * src[i];
+            sum += dest[i];
+            step();
+        }
+        return sum;
+    }
+
 private:
     uint32_t phase_;
     int32_t phase_step_;
 };
 
+// Generate a complex exponential series using a phasor recurrence, i.e. by
+// repeatedly rotating a unit phasor by exp(j*angle_rate).
+//
+// This is considerably faster than SineLookupNCO since it maps directly onto
+// SIMD complex multiplies (VOLK's rotator kernel if CORX_USE_VOLK_NCO is
+// defined, otherwise a portable four-lane recurrence that the compiler can
+// vectorize). The phase is accumulated in double precision and the phasor is
+// recomputed from it every resync_interval samples to prevent the magnitude
+// and phase of the recurrence from drifting. Smaller intervals are more
+// accurate, larger intervals are faster.
+class PhasorNCO {
+public:
+    static const size_t DEFAULT_RESYNC_INTERVAL = 512;
+
+    PhasorNCO() : phase_(0), phase_step_(0),
+                  resync_interval_(DEFAULT_RESYNC_INTERVAL) {}
+
+    PhasorNCO(float phase,
+              float angle_rate,
+              size_t resync_interval = DEFAULT_RESYNC_INTERVAL)
+        : resync_interval_(resync_interval > 0 ? resync_interval : 1) {
+        set_phase(phase);
+        set_freq(angle_rate);
+    }
+
+    // angle is in rads
+    void set_phase(float angle) { phase_ = angle; }
+
+    // angle_rate is in radians / step
+    void set_freq(float angle_rate) { phase_step_ = angle_rate; }
+
+    void adjust_phase(float delta_angle) { phase_ += delta_angle; }
+
+    void step() { phase_ += phase_step_; }
+
+    std::complex<float> expj() const {
+        return std::polar(1.f, (float)phase_);
+    }
+
+    // compute the complex exponential function for a block of phase angles
+    // and multiply it with an input signal.
+    // src and dest may be the same for inline transformation.
+    void expj_multiply(std::complex<float> *dest,
+                       const std::complex<float> *src,
+                       size_t len);
+
+    // Like expj_multiply, but also return the sum of the output samples.
+    // Every resync interval is summed while it is still in the L1 cache,
+    // so the signal only passes through memory once.
+    std::complex<float> expj_multiply_accumulate(
+            std::complex<float> *dest,
+            const std::complex<float> *src,
+            size_t len);
+
+private:
+    // Mix (and optionally accumulate) a block of samples.
+    void mix(std::complex<float> *dest,
+             const std::complex<float> *src,
+             size_t len,
+             std::complex<float> *total);
+
+    double phase_;
+    double phase_step_;
+    size_t resync_interval_;
+};
+
 #endif /* SINE_LOOKUP_H */
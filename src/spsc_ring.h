@@ -0,0 +1,107 @@
+#ifndef CORX_SPSC_RING_H
+#define CORX_SPSC_RING_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include <stddef.h>
+
+namespace corx {
+
+// A bounded, lock-free single-producer single-consumer ring of pre-allocated
+// slots.
+//
+// The producer fills the slot returned by acquire() and hands it to the
+// consumer with publish(). The consumer reads the slot returned by front()
+// and hands it back to the producer with pop(). Slots are never allocated or
+// freed after construction; use slot() to pre-allocate their contents.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity)
+        : capacity_(capacity), slots_(new T[capacity]), head_(0), tail_(0) {}
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    size_t capacity() const { return capacity_; }
+
+    // Access a slot directly, e.g. to pre-allocate its buffers.
+    // Should only be used while neither producer nor consumer is active.
+    T& slot(size_t idx) { return slots_[idx]; }
+
+    // -- Producer
+    // Returns the next free slot, or nullptr if the ring is full.
+    T* acquire() {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == capacity_) {
+            return nullptr;
+        }
+        return &slots_[tail % capacity_];
+    }
+
+    // Make the slot returned by acquire() available to the consumer.
+    void publish() {
+        tail_.fetch_add(1, std::memory_order_release);
+    }
+
+    // -- Consumer
+    // Returns the oldest published slot, or nullptr if the ring is empty.
+    T* front() {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &slots_[head % capacity_];
+    }
+
+    // Return the slot returned by front() to the producer.
+    void pop() {
+        head_.fetch_add(1, std::memory_order_release);
+    }
+
+    // Number of published slots that have not been popped yet.
+    size_t size() const {
+        return (tail_.load(std::memory_order_acquire) -
+                head_.load(std::memory_order_acquire));
+    }
+
+    bool empty() const { return size() == 0; }
+
+private:
+    const size_t capacity_;
+    std::unique_ptr<T[]> slots_;
+
+    // head_ is only written by the consumer and tail_ only by the producer.
+    // Keep them on separate cache lines to avoid false sharing.
+    char pad0_[64];
+    std::atomic<size_t> head_;
+    char pad1_[64];
+    std::atomic<size_t> tail_;
+    char pad2_[64];
+};
+
+
+// Back off while waiting for a ring to become (non-)full.
+// Spins briefly before yielding the CPU to the other stages, and sleeps for
+// progressively longer when a stage stays idle.
+inline void spsc_backoff(unsigned &attempt) {
+    if (attempt < 64) {
+        // spin
+    } else if (attempt < 128) {
+        std::this_thread::yield();
+    } else if (attempt < 1024) {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    } else {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (attempt < 1024) {
+        ++attempt;
+    }
+}
+
+} // namespace corx
+
+#endif /* CORX_SPSC_RING_H */
@@ -0,0 +1,220 @@
+#include "thread_placement.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace corx {
+
+namespace {
+
+// CPUs the process may run on, captured before any thread is pinned
+std::vector<int> get_affinity() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+const std::vector<int> process_cpus = get_affinity();
+
+bool parse_int(const std::string &str, int &value) {
+    if (str.empty()) {
+        return false;
+    }
+    char *end;
+    long result = strtol(str.c_str(), &end, 10);
+    if (*end != '\0' || result < 0 || result >= CPU_SETSIZE) {
+        return false;
+    }
+    value = (int)result;
+    return true;
+}
+
+} // namespace
+
+
+bool parse_cpu_list(const std::string &str, std::vector<int> &cpus) {
+    std::vector<int> result;
+    std::string::size_type offset = 0;
+    while (offset <= str.size()) {
+        std::string::size_type pos = str.find(',', offset);
+        if (pos == std::string::npos) {
+            pos = str.size();
+        }
+        std::string item = str.substr(offset, pos - offset);
+        std::string::size_type dash = item.find('-');
+        int first, last;
+        if (dash == std::string::npos) {
+            if (!parse_int(item, first)) {
+                return false;
+            }
+            last = first;
+        } else if (!parse_int(item.substr(0, dash), first) ||
+                   !parse_int(item.substr(dash + 1), last) ||
+                   last < first) {
+            return false;
+        }
+        for (int cpu = first; cpu <= last; cpu++) {
+            result.push_back(cpu);
+        }
+        offset = pos + 1;
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    cpus.swap(result);
+    return true;
+}
+
+bool select_cpu_group(const std::string &str,
+                      size_t index,
+                      std::vector<int> &cpus) {
+    std::vector<std::string> groups;
+    std::string::size_type offset = 0, pos;
+    while ((pos = str.find('/', offset)) != std::string::npos) {
+        groups.push_back(str.substr(offset, pos - offset));
+        offset = pos + 1;
+    }
+    groups.push_back(str.substr(offset));
+
+    if (groups.size() == 1) {
+        index = 0;
+    } else if (index >= groups.size()) {
+        return false;
+    }
+    return parse_cpu_list(groups[index], cpus);
+}
+
+std::string format_cpu_list(const std::vector<int> &cpus) {
+    if (cpus.empty()) {
+        return "all";
+    }
+    std::string result;
+    for (size_t i = 0; i < cpus.size(); ) {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) {
+            j++;
+        }
+        result += (result.empty() ? "" : ",") + std::to_string(cpus[i]);
+        if (j > i) {
+            result += "-" + std::to_string(cpus[j]);
+        }
+        i = j + 1;
+    }
+    return result;
+}
+
+bool parse_sched_policy(const std::string &str, int &policy) {
+    if (str == "other") {
+        policy = SCHED_OTHER;
+    } else if (str == "fifo") {
+        policy = SCHED_FIFO;
+    } else if (str == "rr") {
+        policy = SCHED_RR;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* sched_policy_name(int policy) {
+    switch (policy) {
+        case SCHED_OTHER:
+            return "SCHED_OTHER";
+        case SCHED_FIFO:
+            return "SCHED_FIFO";
+        case SCHED_RR:
+            return "SCHED_RR";
+    }
+    return "UNKNOWN";
+}
+
+std::vector<int> cpus_excluding(const std::vector<int> &excluded) {
+    std::vector<int> cpus;
+    for (int cpu : process_cpus) {
+        if (std::find(excluded.begin(), excluded.end(), cpu) ==
+                excluded.end()) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+bool apply_thread_placement(const ThreadPlacement &placement,
+                            const std::string &prefix,
+                            FILE *out) {
+    bool success = true;
+    pthread_t self = pthread_self();
+    long tid = syscall(SYS_gettid);
+    // (the main thread keeps the name of the process)
+    if (!placement.name.empty() && tid != getpid()) {
+        pthread_setname_np(self, placement.name.substr(0, 15).c_str());
+    }
+
+    // (an empty list restores the CPUs of the process)
+    const std::vector<int> &cpus = (placement.cpus.empty() ? process_cpus
+                                                           : placement.cpus);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    int ret = pthread_setaffinity_np(self, sizeof(set), &set);
+    if (ret != 0) {
+        fprintf(stderr, "Warning: could not pin %s to cpus %s: %s\n",
+                placement.name.c_str(), format_cpu_list(cpus).c_str(),
+                strerror(ret));
+        success = false;
+    }
+
+    struct sched_param param;
+    param.sched_priority = (placement.policy == SCHED_OTHER
+                            ? 0 : placement.priority);
+    ret = pthread_setschedparam(self, placement.policy, &param);
+    if (ret != 0) {
+        fprintf(stderr, "Warning: could not set %s %d for %s: %s%s\n",
+                sched_policy_name(placement.policy), param.sched_priority,
+                placement.name.c_str(), strerror(ret),
+                ret == EPERM ? " (requires CAP_SYS_NICE or an rtprio limit, "
+                               "see ulimit -r)" : "");
+        success = false;
+    }
+
+    if (out != nullptr) {
+        fprintf(out, "%sThread %s (tid %ld): %s\n", prefix.c_str(),
+                placement.name.c_str(), tid,
+                describe_thread_placement().c_str());
+    }
+    return success;
+}
+
+std::string describe_thread_placement() {
+    std::vector<int> cpus = get_affinity();
+    std::string result = "cpus " + (cpus == process_cpus
+                                    ? std::string("all")
+                                    : format_cpu_list(cpus));
+    int policy;
+    struct sched_param param;
+    if (pthread_getschedparam(pthread_self(), &policy, &param) == 0) {
+        result += ", ";
+        result += sched_policy_name(policy);
+        if (policy != SCHED_OTHER) {
+            result += " " + std::to_string(param.sched_priority);
+        }
+    }
+    return result;
+}
+
+} // namespace corx
@@ -0,0 +1,71 @@
+#ifndef CORX_THREAD_PLACEMENT_H
+#define CORX_THREAD_PLACEMENT_H
+
+#include <string>
+#include <vector>
+
+#include <sched.h>
+#include <stdio.h>
+
+namespace corx {
+
+// CPUs and scheduling policy of a thread
+struct ThreadPlacement {
+    // Thread name (ps -L, top -H; truncated to 15 characters)
+    std::string name;
+    // CPUs the thread may run on (empty: all CPUs of the process)
+    std::vector<int> cpus;
+    // SCHED_OTHER, SCHED_FIFO or SCHED_RR
+    int policy;
+    // Real-time priority (1-99; not used for SCHED_OTHER)
+    int priority;
+
+    ThreadPlacement() : policy(SCHED_OTHER), priority(0) {}
+
+    // True if the thread is neither pinned nor real-time
+    bool isDefault() const {
+        return cpus.empty() && policy == SCHED_OTHER;
+    }
+
+    bool operator==(const ThreadPlacement &other) const {
+        return (name == other.name && cpus == other.cpus &&
+                policy == other.policy && priority == other.priority);
+    }
+};
+
+// Parse a list of CPUs, e.g. "0-3,6". Returns false if it is invalid.
+bool parse_cpu_list(const std::string &str, std::vector<int> &cpus);
+
+// CPUs of group index of a list of groups separated by "/", e.g. group 1
+// of "0/1-2/3" is 1-2. A single group applies to every index. Returns false
+// if the list is invalid or has no group index.
+bool select_cpu_group(const std::string &str,
+                      size_t index,
+                      std::vector<int> &cpus);
+
+// Format a list of CPUs as parsed by parse_cpu_list ("all" if empty)
+std::string format_cpu_list(const std::vector<int> &cpus);
+
+// Parse a scheduling policy (other, fifo or rr)
+bool parse_sched_policy(const std::string &str, int &policy);
+const char* sched_policy_name(int policy);
+
+// CPUs of the process at startup, except the excluded ones
+std::vector<int> cpus_excluding(const std::vector<int> &excluded);
+
+// Apply a placement to the calling thread and report the resulting
+// placement (read back from the kernel) to out, unless it is nullptr. The
+// default placement resets the thread to the CPUs of the process and
+// SCHED_OTHER. Failures, e.g. real-time policies without CAP_SYS_NICE or an
+// rtprio limit, are warnings; returns false if the placement could not be
+// applied completely.
+bool apply_thread_placement(const ThreadPlacement &placement,
+                            const std::string &prefix,
+                            FILE *out = stdout);
+
+// Placement of the calling thread, e.g. "cpus 2-3, SCHED_FIFO 50"
+std::string describe_thread_placement();
+
+} // namespace corx
+
+#endif /* CORX_THREAD_PLACEMENT_H */
@@ -0,0 +1,137 @@
+#include "work_stealing_pool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+
+namespace corx {
+
+namespace {
+
+// Index of the worker of the current thread in its pool (-1: not a worker)
+thread_local const WorkStealingPool *current_pool = nullptr;
+thread_local int current_worker = -1;
+
+} // namespace
+
+
+WorkStealingPool::WorkStealingPool(unsigned num_threads)
+    : queued_(0), quit_(false), pending_(0), next_(0), tasks_run_(0),
+      steals_(0) {
+
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < num_threads; ++i) {
+        workers_.push_back(std::unique_ptr<Worker>(new Worker()));
+    }
+    for (unsigned i = 0; i < num_threads; ++i) {
+        threads_.push_back(std::thread(&WorkStealingPool::run, this, i));
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        quit_ = true;
+    }
+    cv_.notify_all();
+    for (std::thread &thread : threads_) {
+        thread.join();
+    }
+}
+
+void WorkStealingPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        pending_++;
+    }
+
+    unsigned index;
+    if (current_pool == this) {
+        index = current_worker;
+    } else {
+        index = next_++ % workers_.size();
+    }
+    // (counted before it can be popped, so that queued_ cannot underflow)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued_++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+        workers_[index]->tasks.push_back(std::move(task));
+    }
+    cv_.notify_one();
+}
+
+void WorkStealingPool::wait() {
+    std::unique_lock<std::mutex> lock(idle_mutex_);
+    idle_cv_.wait(lock, [this] { return pending_ == 0; });
+}
+
+bool WorkStealingPool::pop(unsigned index, std::function<void()> &task) {
+    // newest task of the own queue
+    {
+        Worker &worker = *workers_[index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (!worker.tasks.empty()) {
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+            return true;
+        }
+    }
+    // oldest task of another queue
+    for (size_t i = 1; i < workers_.size(); ++i) {
+        Worker &victim = *workers_[(index + i) % workers_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            steals_++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::run(unsigned index) {
+    current_pool = this;
+    current_worker = index;
+
+    while (true) {
+        std::function<void()> task;
+        if (pop(index, task)) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                queued_--;
+            }
+            try {
+                task();
+            } catch (const std::exception &e) {
+                fprintf(stderr, "Error: %s\n", e.what());
+            } catch (...) {
+                fprintf(stderr, "Error: unknown exception in a task\n");
+            }
+            task = nullptr;
+            tasks_run_++;
+
+            std::lock_guard<std::mutex> lock(idle_mutex_);
+            if (--pending_ == 0) {
+                idle_cv_.notify_all();
+            }
+            continue;
+        }
+
+        // (queued_ may still count a task that another worker has just
+        //  taken; the loop then tries again)
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return quit_ || queued_ > 0; });
+        if (quit_ && queued_ == 0) {
+            break;
+        }
+    }
+}
+
+} // namespace corx
@@ -0,0 +1,76 @@
+#ifndef CORX_WORK_STEALING_POOL_H
+#define CORX_WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace corx {
+
+// Thread pool with a task queue per worker.
+//
+// Tasks submitted by a worker (e.g. the tasks a task spawns) go to the back
+// of its own queue, which the worker processes in LIFO order while the data
+// of its last task is still in the cache. Tasks submitted by other threads
+// are distributed round-robin. A worker whose queue is empty steals the
+// oldest task of another worker, so that a long task only delays the tasks
+// queued behind it until another worker is idle.
+class WorkStealingPool {
+public:
+    // num_threads: 0 for the number of CPUs
+    explicit WorkStealingPool(unsigned num_threads = 0);
+    // Finishes all queued tasks
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // Exceptions of tasks are printed and ignored
+    void submit(std::function<void()> task);
+
+    // Wait until all tasks (including the tasks they submit) are done
+    void wait();
+
+    unsigned numThreads() const { return workers_.size(); }
+    uint64_t tasksRun() const { return tasks_run_; }
+    uint64_t steals() const { return steals_; }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void run(unsigned index);
+    bool pop(unsigned index, std::function<void()> &task);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+
+    // Number of queued tasks (wakes up idle workers)
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    size_t queued_;
+    bool quit_;
+
+    // Number of queued and running tasks (for wait)
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cv_;
+    size_t pending_;
+
+    std::atomic<unsigned> next_;
+    std::atomic<uint64_t> tasks_run_;
+    std::atomic<uint64_t> steals_;
+};
+
+} // namespace corx
+
+#endif /* CORX_WORK_STEALING_POOL_H */